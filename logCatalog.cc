@@ -0,0 +1,1360 @@
+/*
+ * logCatalog.cc
+ *
+ *  Keeps a catalog of the AutoQuad logs found in directories, with a summary of each log
+ *  and each of its flights, and lists the flights which match a query.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+The directories given are searched (with their subdirectories) for logs, by file name
+extension (--ext); files given by name are taken whatever their name. A log already in the
+catalog with the same size and modification time is not read again. Otherwise the file is
+hashed and, if its contents are those of a log in the catalog (eg. it was only touched,
+copied or moved), that summary is used. The remaining logs are read by the threads, each
+log twice: once to find its flights (logFlightsScan(), as for logDump --flights) and once
+for the summaries.
+
+The catalog is a text file: a header line, then for each log a line starting with "L"
+(size, modification time, hash, format, records, duration, GPS area, maximum altitude,
+minimum voltage, checksum errors, flights and the file name) followed by a line starting
+with "F" for each of its flights (number, records, start and duration in seconds, GPS
+area, maximum altitude above the start, minimum voltage, checksum errors and the increase
+of RADIO_ERRORS), then its GPS track as lines starting with "T" (a new piece of track) or
+"t" (more of it) of record numbers and positions. Logs which no longer exist are removed
+from it. The track is the positions of the GPS area, simplified to within
+CATALOG_TRACK_TOL meters (see logSimplify()), and broken where there is no position for a
+while or the position jumps.
+
+With the catalog an area index is written (the catalog file name with CATALOG_GEO_EXT
+added, see catalogGeoSave()): the track segments of all the logs, and for each cell of a
+grid of CATALOG_GEO_CELL degrees the segments which cross it. --radius and --polygon read
+only the index, test the segments of the cells which the area covers, and print the record
+ranges of each log whose segments pass through it, split at the flights (flight 0 for the
+records outside a flight), without opening any log.
+
+The time of a log is its modification time (the logs have no date), shown in UTC.
+*/
+
+#include "logger.h"
+#include "logDump_flights.h"
+#include "logDump_simplify.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define CATALOG_VERSION			2
+#define CATALOG_DEF_FILE		"logs.catalog"
+#define CATALOG_DEF_EXT			"LOG"
+#define CATALOG_GPS_MAX_HACC	10.0			// meters; less accurate positions are not in the GPS area
+#define CATALOG_MAX_STEP		1.0				// seconds; a bigger LASTUPDATE step between records is taken as a reset
+#define CATALOG_HASH_BUF		(1<<20)
+#define CATALOG_TRACK_TOL		5.0				// meters; tracks are simplified to within this
+#define CATALOG_TRACK_GAP		(5 * FLIGHT_REC_RATE)	// records without a position which break a track
+#define CATALOG_TRACK_JUMP		10.0			// meters per record; a faster move (a bad position) breaks a track
+#define CATALOG_TRACK_LINE		16				// track points per catalog line
+#define CATALOG_GEO_EXT			".geo"
+#define CATALOG_GEO_VERSION		1
+#define CATALOG_GEO_CELL		0.01			// degrees of latitude and longitude of a cell of the area index
+#define CATALOG_EARTH_RADIUS	6378137.0		// meters
+
+// what a log or a flight covers
+typedef struct {
+	bool hasGps;
+	double latMin, latMax, lonMin, lonMax;
+	double maxAlt;
+	double minVolt;								// 0 if not logged
+	int errors;									// packets with checksum errors
+} catalogArea_t;
+
+typedef struct {
+	uint32_t startRec, endRec;
+	double start, duration;						// seconds from the start of the log
+	catalogArea_t a;							// maxAlt is above the start altitude
+	int radioErrors;							// RADIO_ERRORS increase
+} catalogFlight_t;
+
+enum catalogStates {
+	CATALOG_KEPT = 0,							// in the catalog, not seen this run
+	CATALOG_SAME,
+	CATALOG_NEW,
+	CATALOG_CHANGED,
+	CATALOG_REMOVED
+};
+
+// a point of a track; a new track starts at those marked
+typedef struct {
+	double lat, lon;
+	uint32_t rec;
+	bool start;
+} catalogPt_t;
+
+typedef struct {
+	char *fname;
+	long long size, mtime;
+	uint64_t hash;
+	int format;									// 'M' or 'L', 0 if no records
+	long records;
+	double duration;
+	catalogArea_t a;
+	int numFlights;
+	catalogFlight_t *flights;
+	int numPts;
+	catalogPt_t *pts;
+	int state;
+	bool scanned;								// read this run (not from the catalog)
+} catalogLog_t;
+
+typedef struct {
+	catalogLog_t *logs;
+	int numLogs, alloc;
+} catalogList_t;
+
+typedef struct {
+	catalogLog_t **todo;
+	int numTodo;
+	const catalogList_t *old;
+	int next;
+} catalogJob_t;
+
+static const char *catalogFile = CATALOG_DEF_FILE;
+static const char *catalogExt = CATALOG_DEF_EXT;
+static int numThreads;
+static bool catalogForce;
+static bool catalogList;
+static double catalogMinAlt = -1e9;
+static double catalogMinDuration;
+static long long catalogAfter = -1, catalogBefore = -1;
+static const char *catalogRadius;
+static const char *catalogPolygon;
+
+static void catalogUsage(void) {
+	fprintf(stderr, "usage: logCatalog [--help] [--catalog file] [--ext ext] [--threads num] [--rescan]\n\
+	[--list [--min-alt m] [--min-duration secs] [--after date] [--before date]]\n\
+	[--radius lat,lon,meters | --polygon lat,lon,lat,lon,...] [<dir|log_file> ...]\n\
+\n\
+ --catalog (-C) file\n\
+	Catalog file to update (default %s).\n\
+\n\
+ --ext (-x) extension\n\
+	Extension of the log files in directories (default %s, any case).\n\
+\n\
+ --threads (-j) number\n\
+	Threads to use (default the number of CPUs).\n\
+\n\
+ --rescan (-r)\n\
+	Read every log again, even if it has not changed.\n\
+\n\
+ --list (-l)\n\
+	Print the flights of the catalog (as CSV) which match these:\n\
+\n\
+ --min-alt (-a) meters\n\
+	Highest altitude above the start of the flight at least this.\n\
+\n\
+ --min-duration (-d) seconds\n\
+	Flights at least this long.\n\
+\n\
+ --after (-A) YYYY-MM-DD\n\
+ --before (-B) YYYY-MM-DD\n\
+	Logs from this day on, or from before this day (UTC).\n\
+\n\
+ --radius (-R) lat,lon,meters\n\
+ --polygon (-P) lat,lon,lat,lon,lat,lon,...\n\
+	Print the records of the logs (as CSV) whose tracks pass within this\n\
+	distance of a point, or through this polygon, from the area index of\n\
+	the catalog (the catalog file with %s added): a range of records\n\
+	for each flight, and flight 0 for those outside a flight.\n\
+\n", CATALOG_DEF_FILE, CATALOG_DEF_EXT, CATALOG_GEO_EXT);
+}
+
+// seconds since 1970 of the start of a day (UTC), -1 if not a date
+static long long catalogDate(const char *s) {
+	int y, m, d;
+	long long days;
+
+	if (sscanf(s, "%d-%d-%d", &y, &m, &d) != 3 || m < 1 || m > 12 || d < 1 || d > 31)
+		return -1;
+
+	// days from 1970-01-01 of the proleptic Gregorian calendar
+	y -= (m <= 2);
+	days = (long long)365 * y + y / 4 - y / 100 + y / 400 + (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1 - 719468;
+
+	return days * 86400;
+}
+
+static void catalogOpts(int argc, char **argv) {
+	int ch;
+
+	static struct option longopts[] = {
+		{"help",			no_argument,		NULL,		'h'},
+		{"catalog",			required_argument,	NULL,		'C'},
+		{"ext",				required_argument,	NULL,		'x'},
+		{"threads",			required_argument,	NULL,		'j'},
+		{"rescan",			no_argument,		NULL,		'r'},
+		{"list",			no_argument,		NULL,		'l'},
+		{"min-alt",			required_argument,	NULL,		'a'},
+		{"min-duration",	required_argument,	NULL,		'd'},
+		{"after",			required_argument,	NULL,		'A'},
+		{"before",			required_argument,	NULL,		'B'},
+		{"radius",			required_argument,	NULL,		'R'},
+		{"polygon",			required_argument,	NULL,		'P'},
+		{NULL,				0,					NULL,		0}
+	};
+
+	while ((ch = getopt_long(argc, argv, "hC:x:j:rla:d:A:B:R:P:", longopts, NULL)) != -1) {
+		switch (ch) {
+			case 'h':
+				catalogUsage();
+				exit(0);
+			case 'C':
+				catalogFile = optarg;
+				break;
+			case 'x':
+				catalogExt = optarg;
+				break;
+			case 'j':
+				numThreads = atoi(optarg);
+				break;
+			case 'r':
+				catalogForce = true;
+				break;
+			case 'l':
+				catalogList = true;
+				break;
+			case 'a':
+				catalogMinAlt = atof(optarg);
+				break;
+			case 'd':
+				catalogMinDuration = atof(optarg);
+				break;
+			case 'A':
+			case 'B':
+				if (catalogDate(optarg) < 0) {
+					fprintf(stderr, "logCatalog: bad date '%s', use YYYY-MM-DD\n", optarg);
+					exit(1);
+				}
+				*(ch == 'A' ? &catalogAfter : &catalogBefore) = catalogDate(optarg);
+				break;
+			case 'R':
+				catalogRadius = optarg;
+				break;
+			case 'P':
+				catalogPolygon = optarg;
+				break;
+			default:
+				catalogUsage();
+				exit(1);
+		}
+	}
+}
+
+static catalogLog_t *catalogAdd(catalogList_t *l) {
+	if (l->numLogs == l->alloc) {
+		l->alloc = l->alloc ? l->alloc * 2 : 256;
+		l->logs = (catalogLog_t *)realloc(l->logs, l->alloc * sizeof(catalogLog_t));
+	}
+	memset(&l->logs[l->numLogs], 0, sizeof(catalogLog_t));
+
+	return &l->logs[l->numLogs++];
+}
+
+static int catalogCompare(const void *a, const void *b) {
+	return strcmp(((const catalogLog_t *)a)->fname, ((const catalogLog_t *)b)->fname);
+}
+
+static catalogLog_t *catalogFind(const catalogList_t *l, const char *fname) {
+	catalogLog_t key;
+
+	key.fname = (char *)fname;
+
+	return (catalogLog_t *)bsearch(&key, l->logs, l->numLogs, sizeof(catalogLog_t), catalogCompare);
+}
+
+static int catalogReadArea(const char *line, catalogArea_t *a, int *n) {
+	int gps;
+
+	if (sscanf(line, "%d %lf %lf %lf %lf %lf %lf %d%n", &gps, &a->latMin, &a->latMax, &a->lonMin, &a->lonMax,
+			&a->maxAlt, &a->minVolt, &a->errors, n) != 8)
+		return 0;
+	a->hasGps = gps;
+
+	return 1;
+}
+
+static void catalogWriteArea(FILE *fp, const catalogArea_t *a) {
+	fprintf(fp, "%d %.7f %.7f %.7f %.7f %.2f %.2f %d", a->hasGps, a->latMin, a->latMax, a->lonMin, a->lonMax, a->maxAlt, a->minVolt, a->errors);
+}
+
+// Reads the catalog file, sorted by file name. A missing file is an empty catalog; returns
+// false if it cannot be read.
+static bool catalogLoad(const char *fname, catalogList_t *l) {
+	catalogLog_t *c = NULL;
+	catalogFlight_t *f;
+	char line[4096];
+	catalogPt_t pt;
+	unsigned long long hash;
+	int version, format, n, m, k, len, maxFlights = 0, maxPts = 0;
+	bool ok = true;
+	FILE *fp;
+
+	memset(l, 0, sizeof(catalogList_t));
+
+	if (!(fp = fopen(fname, "r")))
+		return true;
+
+	if (!fgets(line, sizeof(line), fp) || sscanf(line, "# logCatalog %d", &version) != 1 || version < 1 || version > CATALOG_VERSION) {
+		fprintf(stderr, "logCatalog: '%s' is not a catalog of this version\n", fname);
+		fclose(fp);
+		return false;
+	}
+
+	while (ok && fgets(line, sizeof(line), fp)) {
+		if ((len = strlen(line)) && line[len-1] == '\n')
+			line[--len] = 0;
+
+		if (line[0] == 'L') {
+			c = catalogAdd(l);
+			ok = (sscanf(line, "L %lld %lld %llx %d %ld %lf %n", &c->size, &c->mtime, &hash, &format, &c->records, &c->duration, &n) == 6 &&
+				catalogReadArea(line + n, &c->a, &m) && sscanf(line + n + m, " %d %n", &c->numFlights, &k) == 1 && c->numFlights >= 0);
+			if (ok) {
+				c->hash = hash;
+				c->format = format;
+				c->fname = strdup(line + n + m + k);
+				c->flights = (catalogFlight_t *)calloc(c->numFlights + 1, sizeof(catalogFlight_t));
+				maxFlights = c->numFlights;
+				c->numFlights = 0;
+				maxPts = 0;
+			}
+		}
+		else if (line[0] == 'F' && c && c->numFlights < maxFlights) {
+			f = &c->flights[c->numFlights++];
+			ok = (sscanf(line, "F %d %u %u %lf %lf %n", &k, &f->startRec, &f->endRec, &f->start, &f->duration, &n) == 5 &&
+				catalogReadArea(line + n, &f->a, &m) && sscanf(line + n + m, "%d", &f->radioErrors) == 1);
+		}
+		else if ((line[0] == 'T' || line[0] == 't') && c) {
+			pt.start = (line[0] == 'T');
+			for (n = 1; sscanf(line + n, " %u %lf %lf%n", &pt.rec, &pt.lat, &pt.lon, &m) == 3; n += m) {
+				if (c->numPts == maxPts) {
+					maxPts = maxPts ? maxPts * 2 : 64;
+					c->pts = (catalogPt_t *)realloc(c->pts, maxPts * sizeof(catalogPt_t));
+				}
+				c->pts[c->numPts++] = pt;
+				pt.start = false;
+			}
+		}
+		else if (line[0] != '#') {
+			ok = false;
+		}
+	}
+	fclose(fp);
+
+	if (!ok) {
+		fprintf(stderr, "logCatalog: bad line in '%s': %s\n", fname, line);
+		return false;
+	}
+
+	// catalogs from before tracks were kept are read again
+	for (k = 0; version < 2 && k < l->numLogs; k++) {
+		l->logs[k].mtime = -1;
+		l->logs[k].hash = 0;
+	}
+
+	qsort(l->logs, l->numLogs, sizeof(catalogLog_t), catalogCompare);
+
+	return true;
+}
+
+// writes the catalog to a new file, then replaces the old one with it
+static bool catalogSave(const char *fname, const catalogList_t *l) {
+	const catalogLog_t *c;
+	const catalogFlight_t *f;
+	char *tmp = (char *)malloc(strlen(fname) + 5);
+	bool ok;
+	FILE *fp;
+	int i, j, k;
+
+	sprintf(tmp, "%s.new", fname);
+	if (!(fp = fopen(tmp, "w"))) {
+		free(tmp);
+		return false;
+	}
+
+	fprintf(fp, "# logCatalog %d\n", CATALOG_VERSION);
+	fprintf(fp, "# L SIZE MTIME HASH FORMAT RECORDS DURATION_S GPS LAT_MIN LAT_MAX LON_MIN LON_MAX MAX_ALT_M MIN_VOLT_V CHECKSUM_ERRORS FLIGHTS FILE\n");
+	fprintf(fp, "# F FLIGHT START_REC END_REC START_S DURATION_S GPS LAT_MIN LAT_MAX LON_MIN LON_MAX MAX_ALT_M MIN_VOLT_V CHECKSUM_ERRORS RADIO_ERRORS\n");
+	fprintf(fp, "# T (new track) or t (more of it): RECORD LAT LON ...\n");
+	for (i = 0; i < l->numLogs; i++) {
+		c = &l->logs[i];
+		if (c->state == CATALOG_REMOVED)
+			continue;
+		fprintf(fp, "L %lld %lld %016llx %d %ld %.3f ", c->size, c->mtime, (unsigned long long)c->hash, c->format, c->records, c->duration);
+		catalogWriteArea(fp, &c->a);
+		fprintf(fp, " %d %s\n", c->numFlights, c->fname);
+		for (j = 0; j < c->numFlights; j++) {
+			f = &c->flights[j];
+			fprintf(fp, "F %d %u %u %.3f %.3f ", j+1, f->startRec, f->endRec, f->start, f->duration);
+			catalogWriteArea(fp, &f->a);
+			fprintf(fp, " %d\n", f->radioErrors);
+		}
+		for (j = 0, k = 0; j < c->numPts; j++, k++) {
+			if (c->pts[j].start || k == CATALOG_TRACK_LINE) {
+				fprintf(fp, "%s%c", (j ? "\n" : ""), (c->pts[j].start ? 'T' : 't'));
+				k = 0;
+			}
+			fprintf(fp, " %u %.7f %.7f", c->pts[j].rec, c->pts[j].lat, c->pts[j].lon);
+		}
+		if (c->numPts)
+			fprintf(fp, "\n");
+	}
+
+	ok = !(ferror(fp) | fclose(fp)) && !rename(tmp, fname);
+	free(tmp);
+
+	return ok;
+}
+
+static bool catalogIsLog(const char *name) {
+	const char *dot = strrchr(name, '.');
+
+	return (dot && !strcasecmp(dot + 1, catalogExt));
+}
+
+// adds the logs of a directory and its subdirectories to the list
+static void catalogWalk(const char *dir, catalogList_t *l) {
+	struct dirent *e;
+	struct stat st;
+	catalogLog_t *c;
+	char *path;
+	DIR *d;
+
+	if (!(d = opendir(dir))) {
+		fprintf(stderr, "logCatalog: cannot read directory '%s'\n", dir);
+		return;
+	}
+
+	while ((e = readdir(d))) {
+		if (e->d_name[0] == '.')
+			continue;
+
+		path = (char *)malloc(strlen(dir) + strlen(e->d_name) + 2);
+		sprintf(path, "%s%s%s", dir, (dir[strlen(dir)-1] == '/' ? "" : "/"), e->d_name);
+
+		if (stat(path, &st)) {
+			free(path);
+		}
+		else if (S_ISDIR(st.st_mode)) {
+			catalogWalk(path, l);
+			free(path);
+		}
+		else if (S_ISREG(st.st_mode) && catalogIsLog(e->d_name)) {
+			c = catalogAdd(l);
+			c->fname = path;
+			c->size = st.st_size;
+			c->mtime = st.st_mtime;
+		}
+		else {
+			free(path);
+		}
+	}
+
+	closedir(d);
+}
+
+// 64 bit FNV-1a of the file (8 bytes at a time) and its size
+static bool catalogHash(const char *fname, long long size, uint64_t *hash) {
+	unsigned char *buf = (unsigned char *)malloc(CATALOG_HASH_BUF + 8);
+	uint64_t h = 0xcbf29ce484222325ULL ^ size, w;
+	size_t n, i;
+	FILE *fp;
+
+	if (!(fp = fopen(fname, "rb"))) {
+		free(buf);
+		return false;
+	}
+
+	while ((n = fread(buf, 1, CATALOG_HASH_BUF, fp)) > 0) {
+		memset(buf + n, 0, 8);
+		for (i = 0; i < n; i += 8) {
+			memcpy(&w, buf + i, 8);
+			h = (h ^ w) * 0x100000001b3ULL;
+		}
+	}
+	fclose(fp);
+	free(buf);
+
+	*hash = h;
+
+	return true;
+}
+
+// adds a record to a summary; returns true if it has a good position
+static bool catalogAreaAdd(catalogArea_t *a, const loggerRecord_t *r, bool hasHacc, int altField, int voltField) {
+	double lat = r->data[LOG_GPS_LAT], lon = r->data[LOG_GPS_LON], v;
+	bool pos = false;
+
+	if ((lat != 0.0 || lon != 0.0) && (!hasHacc || r->data[LOG_GPS_HACC] <= CATALOG_GPS_MAX_HACC)) {
+		pos = true;
+		if (!a->hasGps) {
+			a->latMin = a->latMax = lat;
+			a->lonMin = a->lonMax = lon;
+			a->hasGps = true;
+		}
+		if (lat < a->latMin)
+			a->latMin = lat;
+		if (lat > a->latMax)
+			a->latMax = lat;
+		if (lon < a->lonMin)
+			a->lonMin = lon;
+		if (lon > a->lonMax)
+			a->lonMax = lon;
+	}
+
+	if (altField >= 0 && r->data[altField] > a->maxAlt)
+		a->maxAlt = r->data[altField];
+
+	if (voltField >= 0 && (v = r->data[voltField]) > 0.0 && (a->minVolt == 0.0 || v < a->minVolt))
+		a->minVolt = v;
+
+	return pos;
+}
+
+// simplifies each track of a log (see logSimplify()), in place
+static void catalogSimplify(catalogLog_t *c) {
+	logSimplifyPt_t *sp = (logSimplifyPt_t *)calloc(c->numPts + 1, sizeof(logSimplifyPt_t));
+	bool *keep = (bool *)calloc(c->numPts + 1, sizeof(bool));
+	int i, j, k, n = 0;
+
+	for (i = 0; i < c->numPts; i = j) {
+		for (j = i; j < c->numPts && (j == i || !c->pts[j].start); j++) {
+			sp[j-i].lat = c->pts[j].lat;
+			sp[j-i].lon = c->pts[j].lon;
+		}
+		logSimplify(sp, j - i, CATALOG_TRACK_TOL, keep);
+		for (k = i; k < j; k++)
+			if (keep[k-i])
+				c->pts[n++] = c->pts[k];
+	}
+	c->numPts = n;
+
+	free(sp);
+	free(keep);
+}
+
+// reads a log for its summary and flights
+static bool catalogScan(catalogLog_t *c) {
+	static const int ids[] = {LOG_LASTUPDATE, LOG_GPS_LAT, LOG_GPS_LON, LOG_GPS_HACC, LOG_UKF_ALT, LOG_GPS_HEIGHT, LOG_ADC_VIN, LOG_VIN_PDB, LOG_RADIO_ERRORS};
+	loggerStream_t *s;
+	loggerRecord_t r;
+	logFlight_t *flights;
+	catalogFlight_t *f = NULL;
+	int altField = -1, voltField = -1, k = 0, type, fErrors = 0, i, n, maxPts = 0;
+	bool hasHacc = true, started = false, jump;
+	catalogPt_t *pt;
+	long lastPosRec = -1;
+	double t = 0.0, dt, fRadio = 0.0;
+	uint32_t lu, lastLu = 0;
+	long count = 0;
+	FILE *fp;
+
+	if (!(fp = fopen(c->fname, "rb"))) {
+		fprintf(stderr, "logCatalog: cannot open log file '%s'\n", c->fname);
+		return false;
+	}
+	s = (loggerStream_t *)malloc(sizeof(loggerStream_t));
+
+	loggerStreamInit(s, fp);
+	n = logFlightsScan(s, &flights);
+	c->numFlights = n;
+	c->flights = (catalogFlight_t *)calloc(n + 1, sizeof(catalogFlight_t));
+	for (i = 0; i < n; i++) {
+		c->flights[i].startRec = flights[i].startRec;
+		c->flights[i].endRec = flights[i].endRec;
+		c->flights[i].duration = flights[i].duration;
+	}
+
+	rewind(fp);
+	loggerStreamInit(s, fp);
+	memset(&r, 0, sizeof(r));
+	memset(&c->a, 0, sizeof(c->a));
+	c->format = 0;
+
+	for (; (type = loggerReadPacket(s, &r)) != EOF; count++) {
+		if (!c->format) {
+			c->format = type;
+			if (type == 'L' || s->schema.fieldIndex[LOG_UKF_ALT] >= 0)
+				altField = LOG_UKF_ALT;
+			else if (s->schema.fieldIndex[LOG_GPS_HEIGHT] >= 0)
+				altField = LOG_GPS_HEIGHT;
+			if (type == 'L' || s->schema.fieldIndex[LOG_ADC_VIN] >= 0)
+				voltField = LOG_ADC_VIN;
+			else if (s->schema.fieldIndex[LOG_VIN_PDB] >= 0)
+				voltField = LOG_VIN_PDB;
+			hasHacc = (type == 'L' || s->schema.fieldIndex[LOG_GPS_HACC] >= 0);
+			c->a.maxAlt = -1e9;
+		}
+		if (type == 'M')
+			loggerDecodeFieldIds(&s->schema, s->buf, &r, ids, sizeof(ids) / sizeof(int));
+
+		// seconds from the start, by LASTUPDATE (in micros, which wraps)
+		lu = (uint32_t)r.data[LOG_LASTUPDATE];
+		if (started) {
+			dt = (uint32_t)(lu - lastLu) / 1e6;
+			t += (dt > CATALOG_MAX_STEP) ? 1.0 / FLIGHT_REC_RATE : dt;
+		}
+		started = true;
+		lastLu = lu;
+
+		// the track, where the position changes
+		if (catalogAreaAdd(&c->a, &r, hasHacc, altField, voltField)) {
+			pt = c->numPts ? &c->pts[c->numPts-1] : NULL;
+			if (!pt || pt->lat != r.data[LOG_GPS_LAT] || pt->lon != r.data[LOG_GPS_LON]) {
+				jump = pt && hypot(r.data[LOG_GPS_LAT] - pt->lat, (r.data[LOG_GPS_LON] - pt->lon) * cos(pt->lat * M_PI / 180.0)) *
+					CATALOG_EARTH_RADIUS * M_PI / 180.0 > CATALOG_TRACK_JUMP * (count - pt->rec);
+				if (c->numPts == maxPts) {
+					maxPts = maxPts ? maxPts * 2 : 1024;
+					c->pts = (catalogPt_t *)realloc(c->pts, maxPts * sizeof(catalogPt_t));
+				}
+				pt = &c->pts[c->numPts++];
+				pt->start = (jump || lastPosRec < 0 || count - lastPosRec > CATALOG_TRACK_GAP);
+				pt->lat = r.data[LOG_GPS_LAT];
+				pt->lon = r.data[LOG_GPS_LON];
+				pt->rec = count;
+			}
+			lastPosRec = count;
+		}
+
+		if (k < n && count == c->flights[k].startRec) {
+			f = &c->flights[k];
+			f->start = t;
+			f->a.maxAlt = flights[k].maxAlt;
+			fErrors = s->errors;
+			fRadio = r.data[LOG_RADIO_ERRORS];
+		}
+		if (f) {
+			catalogAreaAdd(&f->a, &r, hasHacc, -1, voltField);
+			if (r.data[LOG_RADIO_ERRORS] > fRadio)
+				f->radioErrors += r.data[LOG_RADIO_ERRORS] - fRadio;
+			fRadio = r.data[LOG_RADIO_ERRORS];
+			if (count == f->endRec) {
+				f->a.errors = s->errors - fErrors;
+				f = NULL;
+				k++;
+			}
+		}
+	}
+
+	catalogSimplify(c);
+	c->records = count;
+	c->duration = t;
+	c->a.errors = s->errors;
+	if (altField < 0 || !count)
+		c->a.maxAlt = 0.0;
+
+	free(flights);
+	free(s);
+	fclose(fp);
+
+	return true;
+}
+
+// copies the summary of a log of the catalog with the same contents
+static void catalogCopy(catalogLog_t *c, const catalogLog_t *o) {
+	c->format = o->format;
+	c->records = o->records;
+	c->duration = o->duration;
+	c->a = o->a;
+	c->numFlights = o->numFlights;
+	c->flights = (catalogFlight_t *)malloc((o->numFlights + 1) * sizeof(catalogFlight_t));
+	memcpy(c->flights, o->flights, o->numFlights * sizeof(catalogFlight_t));
+	c->numPts = o->numPts;
+	c->pts = (catalogPt_t *)malloc((o->numPts + 1) * sizeof(catalogPt_t));
+	memcpy(c->pts, o->pts, o->numPts * sizeof(catalogPt_t));
+}
+
+static void *catalogThread(void *arg) {
+	catalogJob_t *job = (catalogJob_t *)arg;
+	const catalogLog_t *o;
+	catalogLog_t *c;
+	int i;
+
+	while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->numTodo) {
+		c = job->todo[i];
+
+		// the same contents as a log of the catalog (by the hash and size)
+		if (catalogHash(c->fname, c->size, &c->hash) && !catalogForce) {
+			for (o = job->old->logs; o < job->old->logs + job->old->numLogs; o++) {
+				if (o->hash == c->hash && o->size == c->size) {
+					catalogCopy(c, o);
+					if (c->state == CATALOG_CHANGED)
+						c->state = CATALOG_SAME;
+					break;
+				}
+			}
+			if (o < job->old->logs + job->old->numLogs)
+				continue;
+		}
+
+		c->scanned = catalogScan(c);
+	}
+
+	return NULL;
+}
+
+// The area index (<catalog>.geo) has the tracks of the catalog as segments, and for each cell
+// of CATALOG_GEO_CELL degrees which a segment crosses, the segments which cross it. After the
+// header come the logs, their flights (first and last record), the segments, the cells
+// (sorted, and one more to end the last) and the segments of each cell, then the file names.
+typedef struct {
+	char magic[4];								// "AqGI"
+	uint32_t version;
+	double cell;
+	uint32_t numLogs, numFlights, numSegs, numCells, numRefs, namesLen;
+} catalogGeoHeader_t;
+
+typedef struct {
+	uint32_t name;								// offset in the names
+	uint32_t firstFlight, numFlights;
+} catalogGeoLog_t;
+
+typedef struct {
+	int32_t lat[2], lon[2];						// 1e-7 degrees
+	uint32_t log;
+	uint32_t rec[2];
+} catalogGeoSeg_t;
+
+typedef struct {
+	uint32_t key;								// latitude cell << 16 | longitude cell
+	uint32_t first;								// first of its segments
+} catalogGeoCell_t;
+
+// an area to look for tracks in: a circle, or a polygon (of n points)
+typedef struct {
+	bool circle;
+	double lat, lon, radius;
+	int n;
+	double *plat, *plon;
+	double latMin, latMax, lonMin, lonMax;
+} catalogQuery_t;
+
+static int catalogGeoCell(double deg, double offset) {
+	int i = (int)floor((deg + offset) / CATALOG_GEO_CELL);
+	int max = (int)(2.0 * offset / CATALOG_GEO_CELL) - 1;
+
+	return (i < 0) ? 0 : (i > max ? max : i);
+}
+
+static int catalogCompareU64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+// adds the cells a segment crosses, in steps of half a cell, to the (cell, segment) pairs
+static void catalogGeoAddSeg(const catalogGeoSeg_t *g, uint32_t seg, uint64_t **pairs, long *n, long *alloc) {
+	double lat0 = g->lat[0] / 1e7, lon0 = g->lon[0] / 1e7;
+	double dLat = g->lat[1] / 1e7 - lat0, dLon = g->lon[1] / 1e7 - lon0;
+	int steps = (int)ceil(fmax(fabs(dLat), fabs(dLon)) / (CATALOG_GEO_CELL / 2.0));
+	int k, x, y, x0, x1, y0, y1;
+
+	if (steps < 1)
+		steps = 1;
+
+	for (k = 0; k < steps; k++) {
+		y0 = catalogGeoCell(lat0 + dLat * k / steps, 90.0);
+		y1 = catalogGeoCell(lat0 + dLat * (k + 1) / steps, 90.0);
+		x0 = catalogGeoCell(lon0 + dLon * k / steps, 180.0);
+		x1 = catalogGeoCell(lon0 + dLon * (k + 1) / steps, 180.0);
+		for (y = (y0 < y1 ? y0 : y1); y <= (y0 < y1 ? y1 : y0); y++) {
+			for (x = (x0 < x1 ? x0 : x1); x <= (x0 < x1 ? x1 : x0); x++) {
+				if (*n == *alloc) {
+					*alloc = *alloc ? *alloc * 2 : 4096;
+					*pairs = (uint64_t *)realloc(*pairs, *alloc * sizeof(uint64_t));
+				}
+				(*pairs)[(*n)++] = (uint64_t)((uint32_t)y << 16 | x) << 32 | seg;
+			}
+		}
+	}
+}
+
+// writes the area index of the catalog
+static bool catalogGeoSave(const char *fname, const catalogList_t *l) {
+	catalogGeoHeader_t h;
+	catalogGeoLog_t *logs;
+	uint32_t *flights;
+	catalogGeoSeg_t *segs, *g;
+	catalogGeoCell_t *cells;
+	uint32_t *refs;
+	uint64_t *pairs = NULL;
+	long numPairs = 0, allocPairs = 0, i;
+	const catalogLog_t *c;
+	const catalogPt_t *p, *q;
+	char *names, *tmp;
+	int j, k;
+	bool ok;
+	FILE *fp;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "AqGI", 4);
+	h.version = CATALOG_GEO_VERSION;
+	h.cell = CATALOG_GEO_CELL;
+
+	for (i = 0; i < l->numLogs; i++) {
+		c = &l->logs[i];
+		if (c->state == CATALOG_REMOVED)
+			continue;
+		h.numLogs++;
+		h.numFlights += c->numFlights;
+		h.namesLen += strlen(c->fname) + 1;
+		for (j = 0; j < c->numPts; j++)
+			if ((j + 1 < c->numPts && !c->pts[j+1].start) || c->pts[j].start)
+				h.numSegs++;
+	}
+
+	logs = (catalogGeoLog_t *)calloc(h.numLogs + 1, sizeof(catalogGeoLog_t));
+	flights = (uint32_t *)calloc(h.numFlights * 2 + 1, sizeof(uint32_t));
+	segs = (catalogGeoSeg_t *)calloc(h.numSegs + 1, sizeof(catalogGeoSeg_t));
+	names = (char *)calloc(h.namesLen + 1, 1);
+
+	// each point to the next of its track; a track of one point is a segment of no length
+	h.numLogs = h.numFlights = h.numSegs = h.namesLen = 0;
+	for (i = 0; i < l->numLogs; i++) {
+		c = &l->logs[i];
+		if (c->state == CATALOG_REMOVED)
+			continue;
+		logs[h.numLogs].name = h.namesLen;
+		logs[h.numLogs].firstFlight = h.numFlights;
+		logs[h.numLogs].numFlights = c->numFlights;
+		strcpy(names + h.namesLen, c->fname);
+		h.namesLen += strlen(c->fname) + 1;
+		for (j = 0; j < c->numFlights; j++) {
+			flights[h.numFlights * 2] = c->flights[j].startRec;
+			flights[h.numFlights * 2 + 1] = c->flights[j].endRec;
+			h.numFlights++;
+		}
+		for (j = 0; j < c->numPts; j++) {
+			p = &c->pts[j];
+			q = (j + 1 < c->numPts && !c->pts[j+1].start) ? &c->pts[j+1] : p;
+			if (q == p && !p->start)
+				continue;
+			g = &segs[h.numSegs];
+			g->lat[0] = (int32_t)lround(p->lat * 1e7);
+			g->lon[0] = (int32_t)lround(p->lon * 1e7);
+			g->lat[1] = (int32_t)lround(q->lat * 1e7);
+			g->lon[1] = (int32_t)lround(q->lon * 1e7);
+			g->rec[0] = p->rec;
+			g->rec[1] = q->rec;
+			g->log = h.numLogs;
+			catalogGeoAddSeg(g, h.numSegs++, &pairs, &numPairs, &allocPairs);
+		}
+		h.numLogs++;
+	}
+
+	// the segments of each cell
+	qsort(pairs, numPairs, sizeof(uint64_t), catalogCompareU64);
+	cells = (catalogGeoCell_t *)calloc(numPairs + 1, sizeof(catalogGeoCell_t));
+	refs = (uint32_t *)calloc(numPairs + 1, sizeof(uint32_t));
+	for (i = 0; i < numPairs; i++) {
+		if (i && pairs[i] == pairs[i-1])
+			continue;
+		if (!h.numRefs || (uint32_t)(pairs[i] >> 32) != cells[h.numCells-1].key) {
+			cells[h.numCells].key = pairs[i] >> 32;
+			cells[h.numCells++].first = h.numRefs;
+		}
+		refs[h.numRefs++] = (uint32_t)pairs[i];
+	}
+	cells[h.numCells].key = UINT32_MAX;
+	cells[h.numCells].first = h.numRefs;
+
+	tmp = (char *)malloc(strlen(fname) + 5);
+	sprintf(tmp, "%s.new", fname);
+	if ((fp = fopen(tmp, "wb"))) {
+		k = fwrite(&h, sizeof(h), 1, fp) + fwrite(logs, sizeof(catalogGeoLog_t), h.numLogs, fp) +
+			fwrite(flights, 2 * sizeof(uint32_t), h.numFlights, fp) + fwrite(segs, sizeof(catalogGeoSeg_t), h.numSegs, fp) +
+			fwrite(cells, sizeof(catalogGeoCell_t), h.numCells + 1, fp) + fwrite(refs, sizeof(uint32_t), h.numRefs, fp) +
+			fwrite(names, 1, h.namesLen, fp);
+		ok = (k == (int)(1 + h.numLogs + h.numFlights + h.numSegs + h.numCells + 1 + h.numRefs + h.namesLen));
+		ok = !(ferror(fp) | fclose(fp)) && ok && !rename(tmp, fname);
+	}
+	else {
+		ok = false;
+	}
+
+	free(tmp);
+	free(pairs);
+	free(refs);
+	free(cells);
+	free(names);
+	free(segs);
+	free(flights);
+	free(logs);
+
+	return ok;
+}
+
+// Reads an area given as "lat,lon,meters" (a circle) or "lat,lon,lat,lon,lat,lon,..." (a
+// polygon). Returns false if it is neither.
+static bool catalogQueryParse(const char *s, bool circle, catalogQuery_t *q) {
+	double v[2 * 1024];
+	int n = 0, k;
+
+	memset(q, 0, sizeof(catalogQuery_t));
+	while (n < 2 * 1024 && sscanf(s, " %lf%n", &v[n], &k) == 1) {
+		n++;
+		s += k;
+		if (*s == ',' || *s == ';')
+			s++;
+	}
+
+	q->circle = circle;
+	if (circle) {
+		if (n != 3 || v[2] <= 0.0)
+			return false;
+		q->lat = v[0];
+		q->lon = v[1];
+		q->radius = v[2];
+		q->latMin = q->lat - v[2] / CATALOG_EARTH_RADIUS * 180.0 / M_PI;
+		q->latMax = q->lat + v[2] / CATALOG_EARTH_RADIUS * 180.0 / M_PI;
+		q->lonMin = q->lon - v[2] / (CATALOG_EARTH_RADIUS * cos(q->lat * M_PI / 180.0)) * 180.0 / M_PI;
+		q->lonMax = q->lon + v[2] / (CATALOG_EARTH_RADIUS * cos(q->lat * M_PI / 180.0)) * 180.0 / M_PI;
+		return true;
+	}
+
+	if (n < 6 || n % 2)
+		return false;
+	q->n = n / 2;
+	q->plat = (double *)malloc(q->n * sizeof(double));
+	q->plon = (double *)malloc(q->n * sizeof(double));
+	for (k = 0; k < q->n; k++) {
+		q->plat[k] = v[2*k];
+		q->plon[k] = v[2*k+1];
+		if (!k || q->plat[k] < q->latMin)
+			q->latMin = q->plat[k];
+		if (!k || q->plat[k] > q->latMax)
+			q->latMax = q->plat[k];
+		if (!k || q->plon[k] < q->lonMin)
+			q->lonMin = q->plon[k];
+		if (!k || q->plon[k] > q->lonMax)
+			q->lonMax = q->plon[k];
+	}
+
+	return true;
+}
+
+// whether the point is in the polygon (by the crossings of a ray from it)
+static bool catalogInPolygon(const catalogQuery_t *q, double lat, double lon) {
+	bool in = false;
+	int i, j;
+
+	for (i = 0, j = q->n - 1; i < q->n; j = i++)
+		if ((q->plat[i] > lat) != (q->plat[j] > lat) &&
+				lon < (q->plon[j] - q->plon[i]) * (lat - q->plat[i]) / (q->plat[j] - q->plat[i]) + q->plon[i])
+			in = !in;
+
+	return in;
+}
+
+static bool catalogSegsCross(double ay, double ax, double by, double bx, double cy, double cx, double dy, double dx) {
+	double d1 = (dx - cx) * (ay - cy) - (dy - cy) * (ax - cx);
+	double d2 = (dx - cx) * (by - cy) - (dy - cy) * (bx - cx);
+	double d3 = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+	double d4 = (bx - ax) * (dy - ay) - (by - ay) * (dx - ax);
+
+	return ((d1 > 0) != (d2 > 0) && (d3 > 0) != (d4 > 0));
+}
+
+// whether a segment passes through the area
+static bool catalogQueryMatch(const catalogQuery_t *q, const catalogGeoSeg_t *g) {
+	double lat0 = g->lat[0] / 1e7, lon0 = g->lon[0] / 1e7, lat1 = g->lat[1] / 1e7, lon1 = g->lon[1] / 1e7;
+	double scale, ax, ay, bx, by, dx, dy, len2, t;
+	int i, j;
+
+	if (q->circle) {
+		// the nearest point of the segment to the center, in meters on a plane at the center
+		scale = CATALOG_EARTH_RADIUS * M_PI / 180.0;
+		ax = (lon0 - q->lon) * cos(q->lat * M_PI / 180.0) * scale;
+		ay = (lat0 - q->lat) * scale;
+		bx = (lon1 - q->lon) * cos(q->lat * M_PI / 180.0) * scale;
+		by = (lat1 - q->lat) * scale;
+		dx = bx - ax;
+		dy = by - ay;
+		len2 = dx*dx + dy*dy;
+		t = (len2 > 0.0) ? -(ax*dx + ay*dy) / len2 : 0.0;
+		t = (t < 0.0) ? 0.0 : (t > 1.0 ? 1.0 : t);
+		ax += t * dx;
+		ay += t * dy;
+		return (ax*ax + ay*ay <= q->radius * q->radius);
+	}
+
+	if (catalogInPolygon(q, lat0, lon0) || catalogInPolygon(q, lat1, lon1))
+		return true;
+	for (i = 0, j = q->n - 1; i < q->n; j = i++)
+		if (catalogSegsCross(lat0, lon0, lat1, lon1, q->plat[j], q->plon[j], q->plat[i], q->plon[i]))
+			return true;
+
+	return false;
+}
+
+static int catalogCompareCell(const void *a, const void *b) {
+	uint32_t x = ((const catalogGeoCell_t *)a)->key, y = ((const catalogGeoCell_t *)b)->key;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+// Prints the records rec0 to rec1 of a log as a range for each flight (first and last record
+// of each of the n flights) which they overlap, and one with flight 0 for each part between
+// flights. Returns the number of ranges printed.
+static int catalogGeoPrintRange(const char *name, const uint32_t *flights, int n, uint32_t rec0, uint32_t rec1) {
+	uint32_t cur = rec0, end;
+	int ranges = 0, j;
+
+	for (j = 0; j < n && cur <= rec1; j++) {
+		if (flights[j*2+1] < cur || flights[j*2] > rec1)
+			continue;
+		if (flights[j*2] > cur) {
+			printf("%s,0,%u,%u\n", name, cur, flights[j*2] - 1);
+			ranges++;
+			cur = flights[j*2];
+		}
+		end = (flights[j*2+1] < rec1) ? flights[j*2+1] : rec1;
+		printf("%s,%d,%u,%u\n", name, j + 1, cur, end);
+		ranges++;
+		if (end == UINT32_MAX)
+			return ranges;
+		cur = end + 1;
+	}
+	if (cur <= rec1) {
+		printf("%s,0,%u,%u\n", name, cur, rec1);
+		ranges++;
+	}
+
+	return ranges;
+}
+
+// Prints the record ranges of the logs of the area index whose tracks pass through the area.
+// Returns false if the index cannot be read.
+static bool catalogGeoQuery(const char *fname, const catalogQuery_t *q) {
+	catalogGeoHeader_t *h;
+	catalogGeoLog_t *logs;
+	uint32_t *flights, *refs, r;
+	catalogGeoSeg_t *segs, *g;
+	catalogGeoCell_t *cells, key, *cell;
+	unsigned char *cand;
+	char *buf, *names;
+	struct stat st;
+	struct timeval tv0, tv1;
+	long len, x, y, x0, x1, y0, y1;
+	int ranges = 0, logsFound = 0, tested = 0, last = -1;
+	uint32_t log = 0, rec0 = 0, rec1 = 0;
+	bool open = false;
+	FILE *fp;
+
+	gettimeofday(&tv0, NULL);
+
+	if (!(fp = fopen(fname, "rb")) || fstat(fileno(fp), &st)) {
+		fprintf(stderr, "logCatalog: cannot read area index '%s' (update the catalog first)\n", fname);
+		if (fp)
+			fclose(fp);
+		return false;
+	}
+	len = st.st_size;
+	buf = (char *)malloc(len + 1);
+	len = fread(buf, 1, len, fp);
+	fclose(fp);
+
+	h = (catalogGeoHeader_t *)buf;
+	if (len < (long)sizeof(catalogGeoHeader_t) || memcmp(h->magic, "AqGI", 4) || h->version != CATALOG_GEO_VERSION || h->cell != CATALOG_GEO_CELL ||
+			len != (long)(sizeof(catalogGeoHeader_t) + h->numLogs * sizeof(catalogGeoLog_t) + h->numFlights * 2 * sizeof(uint32_t) +
+			h->numSegs * sizeof(catalogGeoSeg_t) + (h->numCells + 1) * sizeof(catalogGeoCell_t) + h->numRefs * sizeof(uint32_t) + h->namesLen)) {
+		fprintf(stderr, "logCatalog: bad area index '%s'\n", fname);
+		free(buf);
+		return false;
+	}
+	logs = (catalogGeoLog_t *)(h + 1);
+	flights = (uint32_t *)(logs + h->numLogs);
+	segs = (catalogGeoSeg_t *)(flights + h->numFlights * 2);
+	cells = (catalogGeoCell_t *)(segs + h->numSegs);
+	refs = (uint32_t *)(cells + h->numCells + 1);
+	names = (char *)(refs + h->numRefs);
+
+	// the segments of the cells the area covers
+	cand = (unsigned char *)calloc(h->numSegs + 1, 1);
+	y0 = catalogGeoCell(q->latMin, 90.0);
+	y1 = catalogGeoCell(q->latMax, 90.0);
+	x0 = catalogGeoCell(q->lonMin, 180.0);
+	x1 = catalogGeoCell(q->lonMax, 180.0);
+	if ((y1 - y0 + 1) * (x1 - x0 + 1) < (long)h->numCells) {
+		for (y = y0; y <= y1; y++) {
+			for (x = x0; x <= x1; x++) {
+				key.key = (uint32_t)y << 16 | x;
+				if ((cell = (catalogGeoCell_t *)bsearch(&key, cells, h->numCells, sizeof(catalogGeoCell_t), catalogCompareCell)))
+					for (r = cell->first; r < cell[1].first; r++)
+						cand[refs[r]] = 1;
+			}
+		}
+	}
+	else {
+		for (cell = cells; cell < cells + h->numCells; cell++) {
+			y = cell->key >> 16;
+			x = cell->key & 0xffff;
+			if (y >= y0 && y <= y1 && x >= x0 && x <= x1)
+				for (r = cell->first; r < cell[1].first; r++)
+					cand[refs[r]] = 1;
+		}
+	}
+
+	// the matching segments, joined in to record ranges (segments are in log and record order)
+	printf("FILE,FLIGHT,START_REC,END_REC\n");
+	for (r = 0; r <= h->numSegs; r++) {
+		g = &segs[r];
+		if (r < h->numSegs) {
+			if (!cand[r])
+				continue;
+			tested++;
+			if (!catalogQueryMatch(q, g))
+				continue;
+			if (open && g->log == log && g->rec[0] <= rec1) {
+				if (g->rec[1] > rec1)
+					rec1 = g->rec[1];
+				continue;
+			}
+		}
+		if (open) {
+			ranges += catalogGeoPrintRange(names + logs[log].name, flights + logs[log].firstFlight * 2, logs[log].numFlights, rec0, rec1);
+			if ((int)log != last)
+				logsFound++;
+			last = log;
+		}
+		if (r < h->numSegs) {
+			open = true;
+			log = g->log;
+			rec0 = g->rec[0];
+			rec1 = g->rec[1];
+		}
+	}
+
+	gettimeofday(&tv1, NULL);
+	fprintf(stderr, "logCatalog: %d record ranges in %d logs, %d of %u segments tested (%.2f ms)\n", ranges, logsFound, tested, h->numSegs,
+		(tv1.tv_sec - tv0.tv_sec) * 1e3 + (tv1.tv_usec - tv0.tv_usec) / 1e3);
+
+	free(cand);
+	free(buf);
+
+	return true;
+}
+
+static void catalogPrintFlights(const catalogList_t *l) {
+	const catalogLog_t *c;
+	const catalogFlight_t *f;
+	char date[32];
+	time_t mtime;
+	int i, j;
+
+	printf("FILE,LOG_TIME,FLIGHT,START_S,DURATION_S,LAT_MIN,LAT_MAX,LON_MIN,LON_MAX,MAX_ALT_M,MIN_VOLT_V,CHECKSUM_ERRORS,RADIO_ERRORS\n");
+
+	for (i = 0; i < l->numLogs; i++) {
+		c = &l->logs[i];
+		if (c->state == CATALOG_REMOVED || (catalogAfter >= 0 && c->mtime < catalogAfter) || (catalogBefore >= 0 && c->mtime >= catalogBefore))
+			continue;
+
+		mtime = c->mtime;
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", gmtime(&mtime));
+
+		for (j = 0; j < c->numFlights; j++) {
+			f = &c->flights[j];
+			if (f->a.maxAlt < catalogMinAlt || f->duration < catalogMinDuration)
+				continue;
+			printf("%s,%s,%d,%.1f,%.1f,", c->fname, date, j+1, f->start, f->duration);
+			if (f->a.hasGps)
+				printf("%.7f,%.7f,%.7f,%.7f,", f->a.latMin, f->a.latMax, f->a.lonMin, f->a.lonMax);
+			else
+				printf(",,,,");
+			printf("%.2f,", f->a.maxAlt);
+			if (f->a.minVolt > 0.0)
+				printf("%.2f", f->a.minVolt);
+			printf(",%d,%d\n", f->a.errors, f->radioErrors);
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	catalogList_t old, found;
+	catalogJob_t job;
+	catalogLog_t *c, *o;
+	pthread_t *threads;
+	catalogQuery_t q;
+	struct stat st;
+	char *path, *geoFile;
+	int counts[CATALOG_REMOVED + 1];
+	int i, logs = 0, flights = 0;
+
+	catalogOpts(argc, argv);
+	argc -= optind;
+	argv += optind;
+
+	if (!argc && !catalogList && !catalogRadius && !catalogPolygon) {
+		catalogUsage();
+		return 1;
+	}
+	if (catalogRadius && catalogPolygon) {
+		fprintf(stderr, "logCatalog: use only one of --radius and --polygon\n");
+		return 1;
+	}
+	if (catalogRadius && !catalogQueryParse(catalogRadius, true, &q)) {
+		fprintf(stderr, "logCatalog: bad radius '%s', use lat,lon,meters\n", catalogRadius);
+		return 1;
+	}
+	if (catalogPolygon && !catalogQueryParse(catalogPolygon, false, &q)) {
+		fprintf(stderr, "logCatalog: bad polygon '%s', use lat,lon of at least 3 points\n", catalogPolygon);
+		return 1;
+	}
+	geoFile = (char *)malloc(strlen(catalogFile) + strlen(CATALOG_GEO_EXT) + 1);
+	sprintf(geoFile, "%s%s", catalogFile, CATALOG_GEO_EXT);
+
+	// only the area index is needed for an area
+	if (!argc && !catalogList)
+		return !catalogGeoQuery(geoFile, &q);
+
+	if (!numThreads)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads < 1)
+		numThreads = 1;
+
+	if (!catalogLoad(catalogFile, &old))
+		return 1;
+
+	// the logs to catalog, by their full names so each is only in the catalog once
+	memset(&found, 0, sizeof(found));
+	for (i = 0; i < argc; i++) {
+#if defined (__WIN32__)
+		path = _fullpath(NULL, argv[i], 0);
+#else
+		path = realpath(argv[i], NULL);
+#endif
+		if (!path || stat(path, &st)) {
+			fprintf(stderr, "logCatalog: cannot find '%s'\n", argv[i]);
+			free(path);
+		}
+		else if (S_ISDIR(st.st_mode)) {
+			catalogWalk(path, &found);
+			free(path);
+		}
+		else {
+			c = catalogAdd(&found);
+			c->fname = path;
+			c->size = st.st_size;
+			c->mtime = st.st_mtime;
+		}
+	}
+	qsort(found.logs, found.numLogs, sizeof(catalogLog_t), catalogCompare);
+
+	// those not in the catalog as they are now
+	memset(&job, 0, sizeof(job));
+	job.old = &old;
+	job.todo = (catalogLog_t **)calloc(found.numLogs + 1, sizeof(catalogLog_t *));
+	for (i = 0; i < found.numLogs; i++) {
+		c = &found.logs[i];
+		if (i && !strcmp(c->fname, found.logs[i-1].fname)) {
+			c->state = CATALOG_REMOVED;		// given twice
+			continue;
+		}
+		if ((o = catalogFind(&old, c->fname))) {
+			o->state = CATALOG_SAME;
+			if (o->size == c->size && o->mtime == c->mtime && !catalogForce) {
+				c->hash = o->hash;
+				catalogCopy(c, o);
+				c->state = CATALOG_SAME;
+				continue;
+			}
+			c->state = CATALOG_CHANGED;
+		}
+		else {
+			c->state = CATALOG_NEW;
+		}
+		job.todo[job.numTodo++] = c;
+	}
+
+	if (numThreads > job.numTodo)
+		numThreads = job.numTodo;
+	threads = (pthread_t *)calloc(numThreads + 1, sizeof(pthread_t));
+	for (i = 0; i < numThreads; i++) {
+		if (pthread_create(&threads[i], NULL, catalogThread, &job)) {
+			fprintf(stderr, "logCatalog: cannot create thread\n");
+			return 1;
+		}
+	}
+	for (i = 0; i < numThreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	// keep the logs of the catalog which were not looked for, if they are still there
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < old.numLogs; i++) {
+		o = &old.logs[i];
+		if (o->state == CATALOG_SAME)
+			continue;
+		if (stat(o->fname, &st)) {
+			counts[CATALOG_REMOVED]++;
+			continue;
+		}
+		c = catalogAdd(&found);
+		*c = *o;
+		c->state = CATALOG_KEPT;
+	}
+	qsort(found.logs, found.numLogs, sizeof(catalogLog_t), catalogCompare);
+
+	for (i = 0; i < found.numLogs; i++) {
+		c = &found.logs[i];
+		if (c->state == CATALOG_REMOVED)
+			continue;
+		if (c->state != CATALOG_KEPT && c->state != CATALOG_SAME && !c->scanned && !c->flights) {
+			c->state = CATALOG_REMOVED;		// could not be read
+			counts[CATALOG_REMOVED]++;
+			continue;
+		}
+		counts[c->state]++;
+		logs++;
+		flights += c->numFlights;
+	}
+
+	if (argc) {
+		if (!catalogSave(catalogFile, &found)) {
+			fprintf(stderr, "logCatalog: cannot write catalog '%s'\n", catalogFile);
+			return 1;
+		}
+		if (!catalogGeoSave(geoFile, &found)) {
+			fprintf(stderr, "logCatalog: cannot write area index '%s'\n", geoFile);
+			return 1;
+		}
+		fprintf(stderr, "logCatalog: %s: %d logs (%d new, %d changed, %d unchanged, %d not searched, %d removed), %d flights\n", catalogFile,
+			logs, counts[CATALOG_NEW], counts[CATALOG_CHANGED], counts[CATALOG_SAME], counts[CATALOG_KEPT],
+			counts[CATALOG_REMOVED], flights);
+	}
+
+	if (catalogList)
+		catalogPrintFlights(&found);
+	if ((catalogRadius || catalogPolygon) && !catalogGeoQuery(geoFile, &q))
+		return 1;
+
+	return 0;
+}
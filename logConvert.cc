@@ -0,0 +1,428 @@
+/*
+ * logConvert.cc
+ *
+ *  Converts legacy AqL logs (a whole loggerRecord_t of doubles per record) to AqM logs with
+ *  only the fields which are used, each in the narrowest type which holds all its values.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+The log is split in to chunks of CONVERT_CHUNK_SIZE bytes, each of which is read by one of
+the threads from the first AqL packet at or after its start (see loggerStreamSync()) up
+to the first one at or after its end. Three passes are made over the chunks:
+
+ 1. the values of each field are checked: a field which is always zero is left out, and
+    the others get the narrowest type (u8/s8, u16/s16, u32/s32, float, or double) which
+    holds every value exactly. The records of each chunk are counted too.
+ 2. each record is written as an AqM packet (after the new AqH header). As the packets
+    all have the same size, each chunk knows where its records go in the new log.
+ 3. the new log is read back and each record is checked to decode to exactly (bit for
+    bit) the values of data[] of the AqL record. The quat[], voltages[], motors[] and
+    radioChannels[] arrays of loggerRecord_t are copies of data[] fields and are not
+    checked on their own.
+*/
+
+#include "logger.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <algorithm>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define CONVERT_CHUNK_SIZE	(4<<20)			// bytes of AqL log per work unit
+#define CONVERT_BUF_RECS	256				// records written at once
+
+// what the values of a field need
+typedef struct {
+	bool used;						// any value not +0.0
+	bool notInt;					// any value which is not an integer (or is -0.0)
+	bool notFloat;					// any value which a float does not hold exactly
+	double min, max;
+} convertField_t;
+
+typedef struct {
+	long start, end;				// byte range of the AqL log
+	long records;
+	long firstRec;					// number of the first record in the log
+	convertField_t fields[LOG_NUM_IDS];
+	long mismatches;
+} convertChunk_t;
+
+typedef struct {
+	const char *inFile, *outFile;
+	int pass;
+	convertChunk_t *chunks;
+	int numChunks;
+	loggerSchema_t schema;
+	long headerLen;
+	int next;						// next chunk
+	bool failed;
+} convertJob_t;
+
+static int numThreads;
+static bool noVerify;
+static char *outFile;
+
+static const char *convertTypeNames[] = {"double", "float", "u32", "s32", "u16", "s16", "u8", "s8"};
+
+static void convertUsage(void) {
+	fprintf(stderr, "usage: logConvert [--help] [--threads num] [--no-verify] --out file <AqL_log_file>\n\
+\n\
+ --out (-o) file\n\
+	AqM log file to write.\n\
+\n\
+ --threads (-j) number\n\
+	Threads to use (default the number of CPUs).\n\
+\n\
+ --no-verify (-V)\n\
+	Do not read the new log back to check it.\n\
+\n");
+}
+
+static void convertOpts(int argc, char **argv) {
+	int ch;
+
+	static struct option longopts[] = {
+		{"help",		no_argument,		NULL,		'h'},
+		{"out",			required_argument,	NULL,		'o'},
+		{"threads",		required_argument,	NULL,		'j'},
+		{"no-verify",	no_argument,		NULL,		'V'},
+		{NULL,			0,					NULL,		0}
+	};
+
+	while ((ch = getopt_long(argc, argv, "ho:j:V", longopts, NULL)) != -1) {
+		switch (ch) {
+			case 'h':
+				convertUsage();
+				exit(0);
+			case 'o':
+				outFile = optarg;
+				break;
+			case 'j':
+				numThreads = atoi(optarg);
+				break;
+			case 'V':
+				noVerify = true;
+				break;
+			default:
+				convertUsage();
+				exit(1);
+		}
+	}
+}
+
+static void convertCheckValue(convertField_t *f, double v) {
+	if (v == 0.0 && !signbit(v))
+		return;
+
+	if (!f->used) {
+		f->min = f->max = v;
+		f->used = true;
+	}
+	if (v < f->min)
+		f->min = v;
+	if (v > f->max)
+		f->max = v;
+
+	if (!(v == floor(v)) || v == 0.0 || isinf(v))		// NaN, fractions, -0.0 and infinities
+		f->notInt = true;
+	if (!((double)(float)v == v) && !isinf(v))
+		f->notFloat = true;
+}
+
+// narrowest type which holds the values of a field exactly
+static int convertFieldType(const convertField_t *f) {
+	if (!f->notInt) {
+		if (f->min >= 0 && f->max <= UINT8_MAX)
+			return LOG_TYPE_U8;
+		if (f->min >= INT8_MIN && f->max <= INT8_MAX)
+			return LOG_TYPE_S8;
+		if (f->min >= 0 && f->max <= UINT16_MAX)
+			return LOG_TYPE_U16;
+		if (f->min >= INT16_MIN && f->max <= INT16_MAX)
+			return LOG_TYPE_S16;
+		if (f->min >= 0 && f->max <= UINT32_MAX)
+			return LOG_TYPE_U32;
+		if (f->min >= INT32_MIN && f->max <= INT32_MAX)
+			return LOG_TYPE_S32;
+	}
+
+	return f->notFloat ? LOG_TYPE_DOUBLE : LOG_TYPE_FLOAT;
+}
+
+// opens a log for a thread; exits on failure as there is nothing to be done without it
+static FILE *convertOpen(const char *fname, const char *mode) {
+	FILE *fp;
+
+	if (!(fp = fopen(fname, mode))) {
+		fprintf(stderr, "logConvert: cannot open '%s'\n", fname);
+		exit(1);
+	}
+
+	return fp;
+}
+
+// reads the next record of a chunk; returns false at its end
+static bool convertRead(loggerStream_t *s, const convertChunk_t *c, loggerRecord_t *r) {
+	int type;
+
+	while ((type = loggerReadPacket(s, r)) != EOF && s->pktPos < c->end)
+		if (type == 'L')
+			return true;
+
+	return false;
+}
+
+static void convertChunk(convertJob_t *job, convertChunk_t *c) {
+	loggerStream_t *s = (loggerStream_t *)malloc(sizeof(loggerStream_t));
+	loggerStream_t *v = NULL;
+	loggerRecord_t r, d;
+	unsigned char *buf = NULL;
+	long n = 0, len = 0, pktLen = job->schema.packetSize + 5;
+	FILE *out = NULL;
+	int i;
+
+	loggerStreamInit(s, convertOpen(job->inFile, "rb"));
+
+	if (job->pass == 2) {
+		out = convertOpen(job->outFile, "r+b");
+		fseek(out, job->headerLen + c->firstRec * pktLen, SEEK_SET);
+		buf = (unsigned char *)malloc(CONVERT_BUF_RECS * pktLen);
+	}
+	else if (job->pass == 3) {
+		v = (loggerStream_t *)malloc(sizeof(loggerStream_t));
+		loggerStreamInit(v, convertOpen(job->outFile, "rb"));
+		v->schema = job->schema;
+		fseek(v->fp, job->headerLen + c->firstRec * pktLen, SEEK_SET);
+	}
+
+	if (loggerStreamSync(s, c->start, 'L')) {
+		while (convertRead(s, c, &r)) {
+			switch (job->pass) {
+				case 1:
+					for (i = 0; i < LOG_NUM_IDS; i++)
+						convertCheckValue(&c->fields[i], r.data[i]);
+					break;
+				case 2:
+					len += loggerEncodePacket(&job->schema, &r, buf + len);
+					if (len == CONVERT_BUF_RECS * pktLen) {
+						if (fwrite(buf, len, 1, out) != 1)
+							job->failed = true;
+						len = 0;
+					}
+					break;
+				case 3:
+					memset(&d, 0, sizeof(d));
+					if (loggerReadPacket(v, &d) != 'M' || v->pktPos != job->headerLen + (c->firstRec + n) * pktLen) {
+						c->mismatches++;
+						break;
+					}
+					loggerDecodePacket(&v->schema, v->buf, &d);
+					if (memcmp(d.data, r.data, sizeof(r.data)))
+						c->mismatches++;
+					break;
+			}
+			n++;
+		}
+	}
+
+	if (out) {
+		if ((len && fwrite(buf, len, 1, out) != 1) || (ferror(out) | fclose(out)))
+			job->failed = true;
+		free(buf);
+	}
+	if (v) {
+		fclose(v->fp);
+		free(v);
+	}
+	if (job->pass == 1)
+		c->records = n;
+	else if (n != c->records)
+		c->mismatches++;
+
+	fclose(s->fp);
+	free(s);
+}
+
+static void *convertThread(void *arg) {
+	convertJob_t *job = (convertJob_t *)arg;
+	int i;
+
+	while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->numChunks)
+		convertChunk(job, &job->chunks[i]);
+
+	return NULL;
+}
+
+// runs a pass over all chunks
+static void convertPass(convertJob_t *job, int pass) {
+	pthread_t *threads;
+	int n = std::min(numThreads, job->numChunks);
+	int i;
+
+	job->pass = pass;
+	job->next = 0;
+
+	if (n < 2) {
+		convertThread(job);
+		return;
+	}
+
+	threads = (pthread_t *)calloc(n, sizeof(pthread_t));
+	for (i = 0; i < n; i++) {
+		if (pthread_create(&threads[i], NULL, convertThread, job)) {
+			fprintf(stderr, "logConvert: cannot create thread\n");
+			exit(1);
+		}
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
+
+int main(int argc, char **argv) {
+	convertJob_t job;
+	convertField_t *f;
+	loggerStream_t *s;
+	loggerRecord_t r;
+	unsigned char hbuf[LOGGER_MAX_HEADER];
+	struct stat st;
+	long records = 0, mismatches = 0, outSize;
+	int i, j, type;
+	FILE *fp;
+
+	convertOpts(argc, argv);
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1) {
+		fprintf(stderr, "logConvert: need one log file argument\n");
+		convertUsage();
+		return 1;
+	}
+	if (!outFile) {
+		fprintf(stderr, "logConvert: need an output file (--out)\n");
+		return 1;
+	}
+	if (!numThreads)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads < 1)
+		numThreads = 1;
+
+	memset(&job, 0, sizeof(job));
+	job.inFile = argv[0];
+	job.outFile = outFile;
+
+	// it must be an AqL log
+	fp = convertOpen(job.inFile, "rb");
+	s = (loggerStream_t *)malloc(sizeof(loggerStream_t));
+	loggerStreamInit(s, fp);
+	type = loggerReadPacket(s, &r);
+	fstat(fileno(fp), &st);
+	fclose(fp);
+	free(s);
+	if (type != 'L') {
+		fprintf(stderr, "logConvert: '%s' is not an AqL log\n", job.inFile);
+		return 1;
+	}
+
+	job.numChunks = (st.st_size + CONVERT_CHUNK_SIZE - 1) / CONVERT_CHUNK_SIZE;
+	job.chunks = (convertChunk_t *)calloc(job.numChunks, sizeof(convertChunk_t));
+	for (i = 0; i < job.numChunks; i++) {
+		job.chunks[i].start = (long)i * CONVERT_CHUNK_SIZE;
+		job.chunks[i].end = (i == job.numChunks - 1) ? st.st_size : (long)(i + 1) * CONVERT_CHUNK_SIZE;
+	}
+
+	// 1. the fields and their types
+	convertPass(&job, 1);
+
+	for (i = 0; i < job.numChunks; i++) {
+		job.chunks[i].firstRec = records;
+		records += job.chunks[i].records;
+		if (i) {
+			for (j = 0; j < LOG_NUM_IDS; j++) {
+				f = &job.chunks[0].fields[j];
+				const convertField_t *g = &job.chunks[i].fields[j];
+				if (!g->used)
+					continue;
+				if (!f->used || g->min < f->min)
+					f->min = g->min;
+				if (!f->used || g->max > f->max)
+					f->max = g->max;
+				f->used = true;
+				f->notInt |= g->notInt;
+				f->notFloat |= g->notFloat;
+			}
+		}
+	}
+
+	for (j = 0; j < LOG_NUM_IDS; j++) {
+		if (!job.chunks[0].fields[j].used)
+			continue;
+		job.schema.fields[job.schema.numFields].fieldId = j;
+		job.schema.fields[job.schema.numFields].fieldType = convertFieldType(&job.chunks[0].fields[j]);
+		job.schema.numFields++;
+	}
+	loggerSchemaLayout(&job.schema);
+
+	if (!job.schema.numFields) {
+		fprintf(stderr, "logConvert: no records with values in '%s'\n", job.inFile);
+		return 1;
+	}
+
+	fprintf(stderr, "logConvert: %ld records, %d of %d fields used:", records, job.schema.numFields, LOG_NUM_IDS);
+	for (i = 0; i < job.schema.numFields; i++)
+		fprintf(stderr, "%s %s %s", (i % 6 ? "," : (i ? ",\n   " : "\n   ")), loggerFieldLabels[job.schema.fields[i].fieldId],
+			convertTypeNames[job.schema.fields[i].fieldType]);
+	fprintf(stderr, "\n");
+
+	// 2. the new log: the header, then each chunk writes its records in place
+	job.headerLen = loggerEncodeHeader(&job.schema, hbuf);
+	outSize = job.headerLen + records * (job.schema.packetSize + 5);
+	fp = convertOpen(job.outFile, "wb");
+	if (fwrite(hbuf, job.headerLen, 1, fp) != 1 || (ferror(fp) | fclose(fp))) {
+		fprintf(stderr, "logConvert: error writing '%s'\n", job.outFile);
+		return 1;
+	}
+	convertPass(&job, 2);
+
+	for (i = 0; i < job.numChunks; i++)
+		mismatches += job.chunks[i].mismatches;
+	if (job.failed || mismatches || stat(job.outFile, &st) || st.st_size != outSize) {
+		fprintf(stderr, "logConvert: error writing '%s'\n", job.outFile);
+		return 1;
+	}
+
+	fprintf(stderr, "logConvert: wrote %s, %d bytes per record instead of %d, %.1f MB (%.1f%%)\n", job.outFile,
+		job.schema.packetSize + 5, (int)sizeof(loggerRecord_t) + 3, outSize / 1e6, 100.0 * outSize / (records * (sizeof(loggerRecord_t) + 3.0)));
+
+	// 3. check it
+	if (!noVerify) {
+		convertPass(&job, 3);
+		for (i = 0; i < job.numChunks; i++)
+			mismatches += job.chunks[i].mismatches;
+		if (mismatches) {
+			fprintf(stderr, "logConvert: %ld records of '%s' do not match the AqL log\n", mismatches, job.outFile);
+			return 1;
+		}
+		fprintf(stderr, "logConvert: verified %ld records\n", records);
+	}
+
+	return 0;
+}
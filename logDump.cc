@@ -20,7 +20,19 @@
 #ifdef USE_MAVLINK
 	#include "logDump_mavlink.h"
 #endif
+#include "logDump_filter.h"
+#include "logDump_resample.h"
+#include "logDump_stats.h"
+#include "logDump_simplify.h"
+#include "logDump_npy.h"
+#include "logDump_merge.h"
+#include "logDump_flights.h"
+#include "logDump_psd.h"
+#include "logDump_geofence.h"
+#include "logDump_pyramid.h"
+#include "logDump_server.h"
 #include "plotter.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <errno.h>
 #include <stdio.h>
@@ -29,6 +41,10 @@
 #include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <algorithm>
 
 // include export formatting templates (gpx/kml)
@@ -51,9 +67,52 @@ double homeLat, homeLon;
 double *dumpYMin, *dumpYMax;
 double *dumpXMin, *dumpXMax;
 char *trackDateStr;
-char *gpxWaypoints;
+FILE *gpxWaypoints;		// GPX/KML waypoints are spooled here until the track is finished
+char *whereExpr;
+bool useExportFilter;
+logFilter_t exportFilter;
+int resampleMode;
+bool resampleStarted;
+bool resampleFlushed;
+bool recRangeEnd;
+uint32_t recCount;		// total log records read
+uint32_t resampleCount;	// total resampled records generated
+bool dumpStats;
+int numThreads;
+logStats_t *dumpFieldStats;	// [dumpNum] --stats results
+logDumpQueue_t *pipeIn;		// [pipeWorkers] export pipeline reader -> worker queues
+logDumpQueue_t *pipeOut;	// [pipeWorkers] worker -> writer queues
+logDumpQueue_t pipeFree;	// writer -> reader, batches for re-use
+int pipeWorkers;
+bool pipeReaderFilters;		// the filter is evaluated by the reader
+int pipeStateCols[NUM_FIELDS];	// export columns calculated by the reader
+int pipeNumStateCols;
+int pipeReaderFields[FILTER_MAX_FIELDS + NUM_FIELDS * 4 + 4];	// fields the reader decodes
+int pipeNumReaderFields;
+double simplifyTolerance;	// --simplify distance, meters
+char *outFileName;			// --out-file
+expFields_t *trackBuf;		// track points waiting to be simplified
+bool *trackBufFixed;
+int trackBufLen;
+uint32_t trackPtsIn, trackPtsOut;
+int flightNum;				// --flight, 0 for the whole log
+bool listFlights;			// --flights
+long logStartPos;			// file offset and record number reading starts at
+long logStartSchemaPos = -1;	// and the file offset of the AqH header in effect there
+uint32_t logStartRec;
+bool dumpPsd;				// --psd
+bool dumpSpectrogram;		// --spectrogram
+int psdLen;					// --fft-len
+char *geofenceFile;			// --geofence
+int pyramidWidth;			// --pyramid, 0 if not used
+char *daemonSocket;			// --daemon
+char *serverSocket;			// --server
+int cacheSizeMb;			// --cache-size
 
 filespec_t logfilespec;
+loggerStream_t logStream;
+logMergeSet_t logMerge;		// more than one log file given
+bool mergeLogs;
 loggerRecord_t logEntry;
 time_t towStartTime;
 FILE *outFP;
@@ -61,24 +120,51 @@ FILE *outFP;
 static const char *blnk = "";
 
 void usage(void) {
-	char outTxt[8000] = "\n\
-Usage: logDump [options] [values] [plot options] logfile [ > outfile.ext ]\n\n\
+	char outTxt[] = "\n\
+Usage: logDump [options] [values] [plot options] logfile [logfile ...] [ > outfile.ext ]\n\n\
 Options Summary (see below for shorthand option names):\n\n\
-	[--exp-format (csv|tab|gpx|kml)] [--col-headers] [--plot]\n\
+	[--exp-format (csv|tab|gpx|kml|npy|npz)] [--col-headers] [--plot]\n\
+	[--out-file name] [--mav-rate MESSAGE=HZ]\n\
 	[--out-freq HZ] [--range-min num] [--range-max num]\n\
+	[--where expression] [--resample (linear|cubic)]\n\
+	[--stats] [--threads num] [--flights] [--flight num]\n\
+	[--psd] [--spectrogram] [--fft-len num] [--trace file.json]\n\
+	[--perf-counters] [--geofence file.kml] [--pyramid[=points]]\n\
+	[--daemon[=socket] [--cache-size MB]] [--server[=socket]]\n\
 	[ --gps-track\n\
 		[--gps-wpoints (include|only)]\n\
 		[--alt-source (press|ukf)] [--alt-offset num]\n\
+		[--simplify meters]\n\
 		[--track-min-hacc num] [--track-min-vacc num]\n\
 	]\n\
 	[--localtime] [--log-date DDMMYY]\n\
 	[--trig-chan num] [--trig-val num] [--trig-only] [--trig-delay num]\n\
 \n\
+When more than one log file is given (eg. a mission logged over a power\n\
+cycle), their records are merged in GPS time order and exported as one log;\n\
+LASTUPDATE (--micros) then counts on from the first record of the first log.\n\
+\n\
 Option Details:\n\
 \n\
  --exp-format (-e) type\n\
-	Defines the export format. One of: txt, csv, tab, gpx, or kml.\n\
+	Defines the export format. One of: txt, csv, tab, gpx, kml, npy or npz.\n\
 	(KML and GPX only work with the --gps-track option).\n\
+	npy writes each value to a NumPy array file, <name>_<VALUE>.npy,\n\
+	using the logged data type (double if it changes in the log, an\n\
+	unsigned count for triggers); npz writes them all to <name>.npz\n\
+	(up to 4 GB).\n\
+	mav writes a MAVLink telemetry log, <name>.tlog (only if logDump\n\
+	was built with MAVLink support; values are not needed).\n\
+	<name> is the log file name, or as given with --out-file.\n\
+\n\
+ --out-file (-F) name\n\
+	Output file name for npz and mav export, or file name prefix for npy\n\
+	export (if it ends with a path separator the files are named <VALUE>.npy).\n\
+\n\
+ --mav-rate (-T) MESSAGE=HZ\n\
+	Rate of a message in a mav export (zero leaves it out). Messages and\n\
+	default rates: HEARTBEAT=1 SYS_STATUS=2 ATTITUDE=50 GPS_RAW_INT=5\n\
+	SCALED_IMU=50 RC_CHANNELS_RAW=10 SERVO_OUTPUT_RAW=10.\n\
 \n\
  --col-headers (-c)\n\
 	Include column headings row in the export.\n\
@@ -90,13 +176,119 @@ Option Details:\n\
  --out-freq (-f) number\n\
 	Frequency of log dump output in whole Hz. Valid values are\n\
 	1 to 200; default is 200 except when --gps-track is used,\n\
-	in which case it is 5.\n\
+	in which case it is 5. Without --resample, every Nth record\n\
+	is exported assuming the log was recorded at 200Hz.\n\
+\n\
+ --resample (-R) (linear|cubic)\n\
+	Generate records at exactly the --out-freq rate (any rate is\n\
+	valid), based on the log timestamps. Values are low-pass filtered\n\
+	first when the output rate is below the logging rate, and then\n\
+	interpolated (linear or cubic) at each output time. With this\n\
+	option REC in --where expressions is the output record number.\n\
 \n\
  --range-min (-m) number\n\
 	Start export at this record number (default is 1).\n\
 \n\
  --range-max (-M) number\n\
 	End export at this record number (zero means all records until end).\n\
+\n\
+ --where (-W) expression\n\
+	Only export records for which expression is true (non-zero), eg.\n\
+	--where \"MOT_THROTTLE > 0 && GPS_HACC < 1.5\". Operands are field\n\
+	names (as in the column headings, or calculated values GPS_H_SPEED,\n\
+	GPS_UTC_TIME, CAM_TRIGGER, ROLL, PITCH, YAW, BRG_TO_HOME, MAG_MAGNITUDE,\n\
+	ACC_MAGNITUDE, ACC_PITCH, ACC_ROLL), numbers, and REC (record number).\n\
+	Operators: || && ! == != < <= > >= + - * / % ( ) and abs(x).\n\
+	Can be given more than once (all must be true).\n\
+\n\
+ --flights (-N)\n\
+	List the flights found in the log (motors running and altitude\n\
+	changing) with their record range, file offsets, duration, and\n\
+	max. altitude above the start. The list is saved in logfile.flights.\n\
+\n\
+ --flight (-n) number\n\
+	Only export (or plot) the given flight, as numbered by --flights.\n\
+	Replaces --range-min/max. The flight index is made if needed.\n\
+\n\
+ --stats (-S)\n\
+	Instead of exporting values, print a table of statistics for each\n\
+	one: count, min, max, mean, variance, standard deviation, and 50th,\n\
+	95th & 99th percentiles (percentiles are approximate, usually within\n\
+	1% in rank). Records are selected as for an export.\n\
+\n\
+ --threads (-j) number\n\
+	Number of threads used for --stats and for flat text (txt, csv, tab)\n\
+	exports (default is the number of CPUs; 1 to use no extra threads).\n\
+	With --stats the log is read by one thread when --range-min/max,\n\
+	--out-freq, --resample, trigger values, or REC in --where are used.\n\
+\n\
+ --psd (-P)\n\
+	Instead of exporting values, print their power spectral density\n\
+	(Welch's method: Hann window, segments overlapping by half, mean\n\
+	removed) in units^2/Hz, one row per frequency. The sample rate is\n\
+	taken from the log timestamps of the selected records (--out-freq\n\
+	with --resample). With --plot the spectra are plotted in dB.\n\
+\n\
+ --spectrogram (-G)\n\
+	As --psd, but print the spectrum of each segment, one row per time\n\
+	(seconds from the first record, at the segment center) and frequency.\n\
+	With --plot each value is drawn as a time/frequency color map.\n\
+\n\
+ --fft-len (-L) number\n\
+	Samples per --psd or --spectrogram segment, a power of 2 (default\n\
+	1024). The frequency resolution is the sample rate divided by this.\n\
+	Segments are processed by --threads threads.\n\
+\n\
+ --trace (-X) file.json\n\
+	Record where the time goes (per thread: file reading, packet search,\n\
+	decoding, calculated values, filtering, formatting, writing, and plot\n\
+	rendering) to a Chrome trace event file (open it in chrome://tracing\n\
+	or ui.perfetto.dev), and print records/s and MB/s at the end.\n\
+\n\
+ --perf-counters (-K)\n\
+	Also count CPU cycles, instructions, cache misses and branch misses\n\
+	of each of the --trace activities, and print them per record at the\n\
+	end (can be used without --trace). Needs Linux performance counters;\n\
+	if they are not available only the times are printed. Slows the run.\n\
+\n\
+ --geofence (-Z) file.kml\n\
+	Instead of exporting values, test the GPS position of every selected\n\
+	record against the polygons of a KML file and print the intervals\n\
+	spent outside all of them (breaches), with their start and end time,\n\
+	and the furthest distance from an area. Positions less accurate than\n\
+	--track-min-hacc are left out (altitudes less accurate than\n\
+	--track-min-vacc are not checked). A polygon's ceiling is the\n\
+	altitude of its outer boundary (if its altitudeMode is absolute, MSL,\n\
+	or relativeToGround, above the first position), or the \"ceiling\"\n\
+	Data of its Placemark; \"floor\" Data gives a floor. Altitudes are\n\
+	as for --gps-track (see --alt-source and --alt-offset).\n\
+\n\
+ --pyramid[=points] (-Y)\n\
+	Instead of every record, print (or --plot) the min, max and mean of\n\
+	each value over this many equal parts of the selected records\n\
+	(default 2000), for a quick look at any range of a long log. They\n\
+	come from min/max pyramids saved next to the log (logfile.pyr),\n\
+	which are made on first use of a value, so later views of any\n\
+	--range-min/max or --flight take about the same time whatever their\n\
+	length. Only logged values can be used, without --where, --resample\n\
+	or --out-freq, and with a single log file.\n\
+\n\
+ --daemon[=socket] (-D)\n\
+	Instead of exporting, wait for queries from --server (or eg. socat;\n\
+	see logDump_server.h) on a UNIX domain socket (default\n\
+	logDump-<uid>.sock in $TMPDIR or /tmp), keeping the logs they ask\n\
+	for in memory with each value decoded once. No log file is given.\n\
+\n\
+ --cache-size (-C) MB\n\
+	Memory for the logs kept by --daemon (default 1024); the least\n\
+	recently used logs are let go first.\n\
+\n\
+ --server[=socket] (-Q)\n\
+	Have a --daemon select and calculate the values instead of reading\n\
+	the log, so repeated exports of the same log are quick. For flat\n\
+	text exports and --stats of one log, with the usual values (except\n\
+	trigger values and bearing to home), --range-min/max, --flight,\n\
+	--out-freq, and --where.\n\
 \n\
  --gps-track (-g)\n\
 	Dumps a GPS track log with date & time, lat, lon, altitude, and\n\
@@ -129,6 +321,11 @@ Options for use with --gps-track:\n\
  --alt-offset (-O)\n\
 	Meters to add to altitude to get true MSL;\n\
 	can be negative (decimal; default is 0).\n\
+\n\
+ --simplify (-s)\n\
+	Leave out GPX/KML track points which are not needed to keep the\n\
+	track within this many meters (decimal) of the full track.\n\
+	Triggered points and breaks between track segments are kept.\n\
 \n\
  --gps-min-hacc (-a)\n\
 	Min. GPS horizontal accuracy for track log output\n\
@@ -216,6 +413,9 @@ Examples:\n\
 }
 
 void logDumpOpts(int argc, char **argv) {
+#ifdef USE_MAVLINK
+	char *p;
+#endif
 	int ch, i;
 	static int longOpt;
 
@@ -277,6 +477,25 @@ void logDumpOpts(int argc, char **argv) {
 		{"alt-offset",		required_argument,	NULL,		'O'},
 		{"range-min",		required_argument,	NULL,		'm'},
 		{"range-max",		required_argument,	NULL,		'M'},
+		{"where",			required_argument,	NULL,		'W'},
+		{"resample",		required_argument,	NULL,		'R'},
+		{"stats",			no_argument,		NULL,		'S'},
+		{"threads",			required_argument,	NULL,		'j'},
+		{"simplify",		required_argument,	NULL,		's'},
+		{"out-file",		required_argument,	NULL,		'F'},
+		{"flight",			required_argument,	NULL,		'n'},
+		{"flights",			no_argument,		NULL,		'N'},
+		{"mav-rate",		required_argument,	NULL,		'T'},
+		{"psd",				no_argument,		NULL,		'P'},
+		{"spectrogram",		no_argument,		NULL,		'G'},
+		{"fft-len",			required_argument,	NULL,		'L'},
+		{"trace",			required_argument,	NULL,		'X'},
+		{"perf-counters",	no_argument,		NULL,		'K'},
+		{"geofence",		required_argument,	NULL,		'Z'},
+		{"pyramid",			optional_argument,	NULL,		'Y'},
+		{"daemon",			optional_argument,	NULL,		'D'},
+		{"server",			optional_argument,	NULL,		'Q'},
+		{"cache-size",		required_argument,	NULL,		'C'},
 		{"all",				no_argument,		&longOpt,	O_ALL},
 		{"micros",			no_argument,		&longOpt,	O_MICROS},
 		{"voltages",		no_argument,		&longOpt,	O_VOLTAGES},
@@ -321,7 +540,7 @@ void logDumpOpts(int argc, char **argv) {
 		{NULL,				0,					NULL,		0}
 	};
 
-	while ((ch = getopt_long(argc, argv, "hpglcyf:a:v:d:t::r:i:e:w:A:O:m:M:", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "hpglcySNPGf:a:v:d:t::r:i:e:w:A:O:m:M:W:R:j:s:F:n:T:L:X:KZ:Y::D::Q::C:", longopts, NULL)) != -1) {
 		switch (ch) {
 			case 'h':
 				usage();
@@ -393,9 +612,15 @@ void logDumpOpts(int argc, char **argv) {
 					exportGPX = true;
 				else if (strcmp(optarg, "kml") == 0)
 					exportKML = true;
+				else if (strcmp(optarg, "npy") == 0)
+					exportNPY = true;
+				else if (strcmp(optarg, "npz") == 0)
+					exportNPZ = true;
 #ifdef USE_MAVLINK
-				else if (strcmp(optarg, "mav") == 0)
+				else if (strcmp(optarg, "mav") == 0) {
 					exportMAV = true;
+					outputRealDate = true;	// for tlog time stamps
+				}
 #endif
 				break;
 			case 'w':
@@ -419,6 +644,100 @@ void logDumpOpts(int argc, char **argv) {
 			case 'M':
 				dumpRangeMax = strtoul(optarg, 0, 0);
 				break;
+			case 'W':
+				// multiple expressions must all be true
+				if (whereExpr) {
+					whereExpr = (char *)realloc(whereExpr, strlen(whereExpr) + strlen(optarg) + 9);
+					strcat(whereExpr, " && (");
+				}
+				else {
+					whereExpr = (char *)calloc(strlen(optarg) + 3, sizeof(char));
+					strcat(whereExpr, "(");
+				}
+				strcat(whereExpr, optarg);
+				strcat(whereExpr, ")");
+				break;
+			case 'R':
+				if (!strcmp(optarg, "l") || !strcmp(optarg, "lin") || !strcmp(optarg, "linear"))
+					resampleMode = RESAMPLE_LINEAR;
+				else if (!strcmp(optarg, "c") || !strcmp(optarg, "cub") || !strcmp(optarg, "cubic"))
+					resampleMode = RESAMPLE_CUBIC;
+				else {
+					fprintf(stderr, "logDump: unknown --resample mode '%s'\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'S':
+				dumpStats = true;
+				break;
+			case 'P':
+				dumpPsd = true;
+				break;
+			case 'G':
+				dumpSpectrogram = true;
+				break;
+			case 'L':
+				psdLen = atoi(optarg);
+				break;
+			case 'X':
+				if (!traceOpen(optarg)) {
+					fprintf(stderr, "logDump: cannot open trace file '%s'\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'K':
+				traceCountersOpen();
+				break;
+			case 'Z':
+				geofenceFile = strdup(optarg);
+				break;
+			case 'Y':
+				pyramidWidth = optarg ? atoi(optarg) : PYRAMID_DEF_WIDTH;
+				if (pyramidWidth < 1) {
+					fprintf(stderr, "logDump: --pyramid needs a number of points above 0\n");
+					exit(1);
+				}
+				break;
+			case 'D':
+				daemonSocket = optarg ? strdup(optarg) : logServerSocketName();
+				break;
+			case 'Q':
+				serverSocket = optarg ? strdup(optarg) : logServerSocketName();
+				break;
+			case 'C':
+				cacheSizeMb = atoi(optarg);
+				break;
+			case 'j':
+				numThreads = atoi(optarg);
+				break;
+			case 's':
+				simplifyTolerance = atof(optarg);
+				break;
+			case 'F':
+				outFileName = strdup(optarg);
+				break;
+			case 'n':
+				flightNum = atoi(optarg);
+				break;
+			case 'N':
+				listFlights = true;
+				break;
+			case 'T':
+#ifdef USE_MAVLINK
+				if ((p = strchr(optarg, '=')) == NULL) {
+					fprintf(stderr, "logDump: --mav-rate needs MESSAGE=HZ\n");
+					exit(1);
+				}
+				*p = 0;
+				if (!mavlinkSetRate(optarg, atof(p + 1))) {
+					fprintf(stderr, "logDump: unknown MAVLink message '%s'\n", optarg);
+					exit(1);
+				}
+#else
+				fprintf(stderr, "logDump: built without MAVLink support\n");
+				exit(1);
+#endif
+				break;
 			case 0:
 				switch (longOpt) {
 					case O_ALL:
@@ -643,39 +962,69 @@ filespec_t extractFileName(char *fp) {
 	return r;
 }
 
-// return the UTC offset in seconds
+// return the UTC offset in seconds (pipeline workers call this at the same time)
 int getUTCOffset(void) {
 	time_t now = time(NULL);
+	struct tm ltime, utime;
 
-	struct tm ltime = *localtime(&now);
-	struct tm utime = *gmtime(&now);
+	localtime_r(&now, &ltime);
+	gmtime_r(&now, &utime);
 	int utcOffset = difftime(mktime(&ltime), mktime(&utime));
 
 	return utcOffset;
 }
 
-// format iTOW to full ISO8601 date-time
+// format iTOW to full ISO8601 date-time; the UTC offset is only determined once, and the
+// date & time up to the minute is only formatted again when the minute changes
 void formatIsoTime(char *s, double v) {
-	char timeStr[31], buff[10];
+	// (per thread, for the export pipeline; localtime_r() as localtime() shares its result)
+	static __thread char minuteStr[31], zoneStr[16];
+	static __thread int minuteLen;
+	static __thread time_t minuteStart, minuteEnd;
+	static __thread int utcOffset;
+	static __thread bool init;
+	struct tm tm;
 	time_t timeVal;
-	int utcOffset = getUTCOffset();
-	int utcOffsetHrs = utcOffset / 3600;
-	int utcOffsetMin = (utcOffset % 3600) / 60;
+	int sec, ms;
+
+	if (!init) {
+		utcOffset = getUTCOffset();
+		if (utcToLocal)
+			sprintf(zoneStr, "%.2d:%.2d", utcOffset / 3600, (utcOffset % 3600) / 60);
+		else
+			strcpy(zoneStr, "Z");
+		init = true;
+	}
 
 	timeVal = towStartTime + (v/1000);
 	if (utcToLocal)
 		timeVal += utcOffset;
-	strftime(timeStr, 31, "%Y-%m-%dT%H:%M:%S", localtime(&timeVal));
-	sprintf(buff, ".%.3d", (int)v % 1000);
-	strcat(timeStr, buff);
-	if (utcToLocal) {
-		sprintf(buff, "%.2d:%.2d", utcOffsetHrs, utcOffsetMin);
-		strcat(timeStr, buff);
-	} else {
-		strcat(timeStr, "Z");
+
+	if (timeVal < minuteStart || timeVal >= minuteEnd) {
+		localtime_r(&timeVal, &tm);
+		minuteLen = strftime(minuteStr, 31, "%Y-%m-%dT%H:%M:", &tm);
+		minuteStart = timeVal - tm.tm_sec;
+		minuteEnd = minuteStart + 60;
+	}
+
+	memcpy(s, minuteStr, minuteLen);
+	s += minuteLen;
+
+	sec = timeVal - minuteStart;
+	*s++ = '0' + sec / 10;
+	*s++ = '0' + sec % 10;
+
+	ms = (int)v % 1000;
+	if (ms >= 0) {
+		*s++ = '.';
+		*s++ = '0' + ms / 100;
+		*s++ = '0' + ms / 10 % 10;
+		*s++ = '0' + ms % 10;
 	}
+	else
+		s += sprintf(s, ".%.3d", ms);
 
-	sprintf(s, "%s", timeStr);
+	strcpy(s, zoneStr);
 }
 
 // input lat/lon in degrees, returns bearing in radians
@@ -773,6 +1122,58 @@ double logDumpGetValue(loggerRecord_t *l, int field) {
 	return val;
 }
 
+// logged fields which a value depends on; returns number of field IDs written to deps
+int logDumpFieldDeps(int field, int *deps) {
+	int n = 0;
+
+	switch (field) {
+		case FLD_GPS_H_SPEED:
+			deps[n++] = LOG_GPS_VELN;
+			deps[n++] = LOG_GPS_VELE;
+			break;
+		case FLD_GPS_UTC_TIME:
+			deps[n++] = LOG_GPS_ITOW;
+			break;
+		case FLD_CAM_TRIGGER:
+		case LOG_GMBL_TRIGGER:
+			deps[n++] = LOG_GMBL_TRIGGER;
+			deps[n++] = LOG_LASTUPDATE;
+			if (camTrigChannel > 0 && camTrigChannel < 19)
+				deps[n++] = LOG_RADIO_CHANNEL0 + camTrigChannel - 1;
+			break;
+		case FLD_ROLL:
+		case FLD_PITCH:
+		case FLD_YAW:
+			deps[n++] = LOG_UKF_Q1;
+			deps[n++] = LOG_UKF_Q2;
+			deps[n++] = LOG_UKF_Q3;
+			deps[n++] = LOG_UKF_Q4;
+			break;
+		case FLD_BRG_TO_HOME:
+			deps[n++] = LOG_GPS_LAT;
+			deps[n++] = LOG_GPS_LON;
+			break;
+		case FLD_MAG_MAGNITUDE:
+			deps[n++] = LOG_IMU_MAGX;
+			deps[n++] = LOG_IMU_MAGY;
+			deps[n++] = LOG_IMU_MAGZ;
+			break;
+		case FLD_ACC_MAGNITUDE:
+		case FLD_ACC_PITCH:
+		case FLD_ACC_ROLL:
+			deps[n++] = LOG_IMU_ACCX;
+			deps[n++] = LOG_IMU_ACCY;
+			deps[n++] = LOG_IMU_ACCZ;
+			break;
+		default:
+			if (field < LOG_NUM_IDS)
+				deps[n++] = field;
+			break;
+	}
+
+	return n;
+}
+
 void logDumpStats(loggerRecord_t *l) {
 	int i, j;
 	double val;
@@ -797,18 +1198,110 @@ void logDumpHeaders(void) {
 	}
 }
 
-void logDumpText(loggerRecord_t *l) {
-	int i, mkwpt;
-	double logVal, gpsFixTime;
-	char outStr[31];
-	char gpxTrkptOut[1000];
-	char *trackName;
-	char lclTrigWptName[40];
+// save a GPX/KML waypoint for output after the track
+void logDumpSpoolWaypoint(const char *wpt) {
+	if (!gpxWaypoints && !(gpxWaypoints = tmpfile())) {
+		fprintf(stderr, "logDump: cannot create temporary file for waypoints\n");
+		exit(1);
+	}
+	fputs(wpt, gpxWaypoints);
+}
+
+// copy spooled waypoints to the output; returns false if there are none
+bool logDumpWriteWaypoints(void) {
+	char buf[BUFSIZ];
+	size_t n;
+
+	if (!gpxWaypoints || !ftell(gpxWaypoints))
+		return false;
+
+	rewind(gpxWaypoints);
+	while ((n = fread(buf, 1, sizeof(buf), gpxWaypoints)) > 0)
+		fwrite(buf, 1, n, stdout);
+	fclose(gpxWaypoints);
+	gpxWaypoints = NULL;
+
+	return true;
+}
+
+void logDumpTrackPoint(const expFields_t *exp) {
+	if (exportGPX)
+		// template value order: lat, lon, ele, time, heading, speed
+		printf(gpxTrkptTempl, exp->lat, exp->lon, exp->alt, exp->time, exp->hdg, exp->speed);
+	else {
+		printf(kmlTrkTimestamp, exp->time);
+		// template value order: lon, lat, ele
+		printf(kmlTrkCoords, exp->lon, exp->lat, exp->alt);
+		// template value order: heading, tilt, roll
+		printf(kmlTrkAngles, exp->hdg, exp->pitch, exp->roll);
+	}
+	trackPtsOut++;
+}
+
+// Simplify and write buffered track points. Unless this is the end of a track segment
+// the last point is held back to start the next chunk.
+void logDumpTrackFlush(bool segmentEnd) {
+	logSimplifyPt_t *pts;
+	bool *keep;
+	int n, i;
+
+	if (!trackBufLen)
+		return;
+
+	pts = (logSimplifyPt_t *)malloc(trackBufLen * sizeof(logSimplifyPt_t));
+	keep = (bool *)malloc(trackBufLen * sizeof(bool));
+	for (i = 0; i < trackBufLen; i++) {
+		pts[i].lat = trackBuf[i].lat;
+		pts[i].lon = trackBuf[i].lon;
+		pts[i].alt = trackBuf[i].alt;
+		pts[i].fixed = trackBufFixed[i];
+	}
+	logSimplify(pts, trackBufLen, simplifyTolerance, keep);
+
+	n = segmentEnd ? trackBufLen : trackBufLen - 1;
+	for (i = 0; i < n; i++)
+		if (keep[i])
+			logDumpTrackPoint(&trackBuf[i]);
+
+	if (segmentEnd)
+		trackBufLen = 0;
+	else {
+		trackBuf[0] = trackBuf[trackBufLen-1];
+		trackBufFixed[0] = true;
+		trackBufLen = 1;
+	}
+
+	free(pts);
+	free(keep);
+}
+
+void logDumpTrackAdd(const expFields_t *exp, bool fixed) {
+	trackPtsIn++;
+
+	if (simplifyTolerance <= 0.0) {
+		logDumpTrackPoint(exp);
+		return;
+	}
+
+	if (!trackBuf) {
+		trackBuf = (expFields_t *)calloc(TRACK_SIMPLIFY_CHUNK, sizeof(expFields_t));
+		trackBufFixed = (bool *)calloc(TRACK_SIMPLIFY_CHUNK, sizeof(bool));
+	}
+	trackBuf[trackBufLen] = *exp;
+	trackBufFixed[trackBufLen] = fixed;
+	if (++trackBufLen == TRACK_SIMPLIFY_CHUNK)
+		logDumpTrackFlush(false);
+}
+
+// values which depend on earlier records, so must be calculated in log order
+bool logDumpIsStateField(int field) {
+	return (field == FLD_CAM_TRIGGER || field == LOG_GMBL_TRIGGER || field == FLD_BRG_TO_HOME);
+}
+
+// check for home position being set
+void logDumpCheckHome(loggerRecord_t *l) {
 	static bool homeSet;
-	unsigned trigCount;
-	expFields_t exp;
 
-	// check for home position being set
 	if (homeSetChannel && posHoldChannel) {
 		if (!homeSet && (l->radioChannels[homeSetChannel-1] > 250 ||
 				(homeLat == 0.0f && l->radioChannels[posHoldChannel-1] > 250))) {
@@ -819,29 +1312,82 @@ void logDumpText(loggerRecord_t *l) {
 		else if (l->radioChannels[homeSetChannel-1] < 250)
 			homeSet = false;
 	}
+}
 
-	// flat text format
-	if (!exportGPX && !exportKML && !exportMAV) {
+// value of export column i (updates trigger state)
+double logDumpColumnValue(loggerRecord_t *l, int i) {
+	double logVal = logDumpGetValue(l, dumpOrder[i]);
 
-		for (i = 0; i < dumpNum; i++) {
-			logVal = logDumpGetValue(l, dumpOrder[i]);
+	if ((dumpOrder[i] == FLD_CAM_TRIGGER || dumpOrder[i] == LOG_GMBL_TRIGGER) && (bool)logVal)
+		camTrigLastActive = logVal;
 
-			if (dumpOrder[i] == FLD_GPS_UTC_TIME)
-				formatIsoTime(outStr, logVal);
-			else
-				sprintf(outStr, "%.15G", logVal);
+	return logVal;
+}
 
-			if ((dumpOrder[i] == FLD_CAM_TRIGGER || dumpOrder[i] == LOG_GMBL_TRIGGER) && (bool)logVal)
-				camTrigLastActive = logVal;
+// format a flat text export row from the column values into out, which must have room for
+// dumpNum * LOGDUMP_MAX_VALUE_LEN + 1 characters; returns the length
+int logDumpFormatRow(char *out, const double *vals) {
+	char *p = out;
+	double t0 = TRACE_START();
+	int i;
 
-			printf(outStr);
+	for (i = 0; i < dumpNum; i++) {
+		if (dumpOrder[i] == FLD_GPS_UTC_TIME) {
+			formatIsoTime(p, vals[i]);
+			p += strlen(p);
+		}
+		else
+			p += sprintf(p, "%.15G", vals[i]);
 
-			if (i < dumpNum-1)
-				printf("%c", valueSep);
+		if (i < dumpNum-1)
+			*p++ = valueSep;
+	}
+	*p++ = '\n'; // end of export row
 
-		}
-		printf("\n"); // end of export row
+	TRACE_ADD(TRACE_FORMAT, t0);
+
+	return p - out;
+}
+
+// altitude of a GPS track point (see --alt-source and --alt-offset)
+double logDumpTrackAlt(loggerRecord_t *l) {
+	double alt;
+
+	if (gpsTrackUsePresAlt)
+		alt = logDumpGetValue(l, LOG_UKF_PRES_ALT);
+	else if (gpsTrackUseUkfAlt)
+		alt = logDumpGetValue(l, LOG_UKF_POSD);
+	else
+		alt = logDumpGetValue(l, LOG_GPS_HEIGHT);
+
+	return alt + gpsTrackAltOffset;
+}
+
+void logDumpText(loggerRecord_t *l) {
+	int i, mkwpt;
+	double vals[NUM_FIELDS];
+	double gpsFixTime;
+	char outStr[31];
+	char row[NUM_FIELDS * LOGDUMP_MAX_VALUE_LEN + 1];
+	char gpxTrkptOut[1000];
+	char *trackName;
+	char lclTrigWptName[40];
+	unsigned trigCount;
+	expFields_t exp;
+	double t0;
+
+	logDumpCheckHome(l);
 
+	// flat text format
+	if (!exportGPX && !exportKML && !exportMAV) {
+		t0 = TRACE_START();
+		for (i = 0; i < dumpNum; i++)
+			vals[i] = logDumpColumnValue(l, i);
+		TRACE_ADD(TRACE_DERIVE, t0);
+		i = logDumpFormatRow(row, vals);
+		t0 = TRACE_START();
+		fwrite(row, 1, i, stdout);
+		TRACE_ADD(TRACE_WRITE, t0);
 	}
 #ifdef USE_MAVLINK
 	// mavlink log format (experimental)
@@ -860,13 +1406,7 @@ void logDumpText(loggerRecord_t *l) {
 
 		exp.lat = logDumpGetValue(l, LOG_GPS_LAT);
 		exp.lon = logDumpGetValue(l, LOG_GPS_LON);
-		if (gpsTrackUsePresAlt)
-			exp.alt = logDumpGetValue(l, LOG_UKF_PRES_ALT);
-		else if (gpsTrackUseUkfAlt)
-			exp.alt = logDumpGetValue(l, LOG_UKF_POSD);
-		else
-			exp.alt = logDumpGetValue(l, LOG_GPS_HEIGHT);
-		exp.alt += gpsTrackAltOffset;
+		exp.alt = logDumpTrackAlt(l);
 		exp.speed = logDumpGetValue(l, FLD_GPS_H_SPEED);
 		exp.climb = logDumpGetValue(l, LOG_UKF_VELD);
 		exp.hdg = logDumpGetValue(l, FLD_YAW);
@@ -899,6 +1439,7 @@ void logDumpText(loggerRecord_t *l) {
 			// this is to avoid interpolated lines between the end/start points
 			gpsFixTime = logDumpGetValue(l, FLD_GPS_UTC_TIME);
 			if (lastGpsFixTime && gpsFixTime - lastGpsFixTime > GPS_TRACK_MAX_TM_GAP) {
+				logDumpTrackFlush(true);
 				gpxTrkCnt++;
 				sprintf(trackName, "%s-%d", logfilespec.name, gpxTrkCnt);
 				if (exportGPX) {
@@ -912,17 +1453,7 @@ void logDumpText(loggerRecord_t *l) {
 			}
 			lastGpsFixTime = gpsFixTime;
 
-			if (exportGPX)
-				// template value order: lat, lon, ele, time, heading, speed
-				printf(gpxTrkptTempl, exp.lat, exp.lon, exp.alt, exp.time, exp.hdg, exp.speed);
-			else {
-				printf(kmlTrkTimestamp, exp.time);
-				// template value order: lon, lat, ele
-				printf(kmlTrkCoords, exp.lon, exp.lat, exp.alt);
-				// template value order: heading, tilt, roll
-				printf(kmlTrkAngles, exp.hdg, exp.pitch, exp.roll);
-			}
-
+			logDumpTrackAdd(&exp, mkwpt);
 		}
 
 		if (mkwpt || gpsTrackAsWpts || gpsTrackInclWpts) {
@@ -938,19 +1469,61 @@ void logDumpText(loggerRecord_t *l) {
 			if (gpsTrackAsWpts)
 				printf(gpxTrkptOut);
 			else {
-				gpxWaypoints = (char *) realloc(gpxWaypoints, (strlen(gpxWaypoints) + (strlen(gpxTrkptOut)+1)) * sizeof(char));
-				strcat(gpxWaypoints, gpxTrkptOut);
+				logDumpSpoolWaypoint(gpxTrkptOut);
 			}
 		}
 
 	} // export format
 }
 
-bool logDumpCheckRecordForExport(const uint32_t count, loggerRecord_t *logEntry) {
-	return count >= dumpRangeMin &&
-		!(count % OUTPUT_FREQ_DIVISOR) &&
-		( !dumpTriggeredOnly || logDumpGetValue(logEntry, FLD_CAM_TRIGGER) ) &&
-		( !dumpGpsTrack || ( logDumpGetValue(logEntry, LOG_GPS_HACC) <= gpsTrackMinHAcc && logDumpGetValue(logEntry, LOG_GPS_VACC) <= gpsTrackMinVAcc) );
+// Combine the built-in record filters (--trig-only, GPS track accuracy) and any --where
+// expressions into one compiled predicate, in that order of evaluation.
+void logDumpBuildFilter(void) {
+	char *expr;
+	int len;
+
+	len = (whereExpr ? strlen(whereExpr) : 0) + 200;
+	expr = (char *)calloc(len, sizeof(char));
+
+	if (dumpTriggeredOnly)
+		strcat(expr, "CAM_TRIGGER");
+	if (dumpGpsTrack)
+		snprintf(expr + strlen(expr), len - strlen(expr), "%sGPS_HACC <= %.17g && GPS_VACC <= %.17g",
+			(strlen(expr) ? " && " : ""), (double)gpsTrackMinHAcc, (double)gpsTrackMinVAcc);
+	if (whereExpr)
+		snprintf(expr + strlen(expr), len - strlen(expr), "%s%s", (strlen(expr) ? " && " : ""), whereExpr);
+
+	if (strlen(expr)) {
+		if (!logFilterCompile(&exportFilter, expr))
+			exit(1);
+		useExportFilter = true;
+	}
+
+	free(expr);
+}
+
+// Tests a record read with loggerReadPacket() against the export filter. Only the fields the
+// filter needs are decoded before it is tested; the rest only for accepted records.
+bool logDumpFilterRecord(const uint32_t count, loggerStream_t *s, int pktType, loggerRecord_t *logEntry) {
+	if (useExportFilter) {
+		if (pktType == 'M')
+			loggerDecodeFieldIds(&s->schema, s->buf, logEntry, exportFilter.rawFields, exportFilter.numRawFields);
+		if (!logFilterEval(&exportFilter, count, logEntry))
+			return false;
+	}
+
+	if (pktType == 'M')
+		loggerDecodePacket(&s->schema, s->buf, logEntry);
+
+	return true;
+}
+
+// Decides if a record read with loggerReadPacket() gets exported.
+bool logDumpCheckRecordForExport(const uint32_t count, loggerStream_t *s, int pktType, loggerRecord_t *logEntry) {
+	if (count < dumpRangeMin || (count % OUTPUT_FREQ_DIVISOR))
+		return false;
+
+	return logDumpFilterRecord(count, s, pktType, logEntry);
 }
 
 bool logDumpProgress(const uint32_t count) {
@@ -962,128 +1535,1522 @@ bool logDumpProgress(const uint32_t count) {
 	return !dumpRangeMax || count <= dumpRangeMax;
 }
 
-int main(int argc, char **argv) {
-	FILE *lf;
-	int i, j;
-	uint32_t count = 0; // total log line counter
-	uint32_t exp_count = 0; // total exported lines counter
-	struct stat sbuf; // file stat() buffer
+// Reads the next record of the log, or of the merged logs, in to r; returns the packet type or EOF.
+int logDumpReadPacket(loggerRecord_t *r) {
+	if (mergeLogs)
+		return logMergeNext(&logMerge, r);
 
-	outFP = stdout;
-	dumpNum = 0;
+	return loggerReadPacket(&logStream, r);
+}
 
-	plotterOpts(argc, argv);
-	logDumpOpts(argc, argv);
-	argc -= optind;
-	argv += optind;
+// feed records within the export range through the resampler, returning the next output record which passes the filters
+bool logDumpNextResampled(loggerRecord_t *r) {
+	static loggerRecord_t in;
+	int fields[LOG_NUM_IDS];
+	int pktType, i, n;
+
+	for (;;) {
+		if (resampleStarted && logResamplePop(r)) {
+			if (!useExportFilter || logFilterEval(&exportFilter, resampleCount++, r))
+				return true;
+			continue;
+		}
 
-	fprintf(stderr, "\n");
-	if (argc < 1) {
-		fprintf(stderr, "logDump: need log file argument. Type logDump --help for usage details.\n");
-		exit(1);
-	}
-	if (dumpNum < 1) {
-		fprintf(stderr, "logDump: need at least one value to export. Type logDump --help for usage details.\n");
-		exit(1);
-	}
+		if (recRangeEnd || (pktType = logDumpReadPacket(&in)) == EOF) {
+			if (!resampleStarted || resampleFlushed)
+				return false;
+			logResampleFlush();
+			resampleFlushed = true;
+			continue;
+		}
 
-	// init waypoint storage
-	gpxWaypoints = (char *) calloc(1, sizeof(char));
+		if (pktType == 'M')
+			loggerDecodePacket(&logStream.schema, logStream.buf, &in);
+
+		if (!resampleStarted) {
+			// resample the fields present in the log
+			n = 0;
+			for (i = 0; i < LOG_NUM_IDS; i++)
+				if (mergeLogs ? logMergeHasField(&logMerge, i) : (pktType == 'L' || logStream.schema.fieldIndex[i] >= 0))
+					fields[n++] = i;
+			logResampleInit(resampleMode, outputFreq, fields, n);
+			resampleStarted = true;
+		}
 
-	// determine output frequency
-	if (dumpGpsTrack && !usrSpecOutFreq) // use lower default setting for gps track log
-		outputFreq = gpsTrackFreq;
+		if (recCount >= dumpRangeMin)
+			logResamplePush(&in);
+		recRangeEnd = !logDumpProgress(++recCount);
+	}
+}
 
-	// set up field labels (combine from logger.h and logdump.h)
-	for (i=0; i < LOG_NUM_IDS; i++)
-		dumpHeaders[i] = loggerFieldLabels[i];
-	j = 0;
-	for (i++; i < NUM_FIELDS; i++)
-		dumpHeaders[i] = logDumpFieldLabels[j++];
+// Reads the next record to be exported into r; returns false at end of log or export range.
+bool logDumpNextRecord(loggerRecord_t *r) {
+	int pktType;
+	bool ok;
 
-	fprintf(stderr, "logDump: opening logfile: %s\n", argv[0]);
+	if (resampleMode)
+		return logDumpNextResampled(r);
 
-	if ( !stat(argv[0], &sbuf) ) {
+	while (!recRangeEnd && (pktType = logDumpReadPacket(r)) != EOF) {
+		ok = logDumpCheckRecordForExport(recCount++, &logStream, pktType, r);
+		recRangeEnd = !logDumpProgress(recCount);
+		if (ok)
+			return true;
+	}
 
-		// if asked to output a real date column, need to get a base date to start from
-		if (outputRealDate) {
+	return false;
+}
 
-			char fileDateStr[30] = "";
-			time_t now = time(NULL);
-			// init gps track log time with current UTC time
-			struct tm* trackTime = gmtime(&now);
+// start reading the log from the beginning again
+void logDumpRewind(void) {
+	if (mergeLogs)
+		logMergeRewind(&logMerge);
+	else
+		loggerStreamSeek(&logStream, logStartSchemaPos, logStartPos);
+	recCount = logStartRec;
+	resampleCount = 0;
+	recRangeEnd = resampleFlushed = false;
+	if (resampleStarted)
+		logResampleReset();
+}
 
-			strftime(fileDateStr, 100, "%d-%m-%Y %H:%M:%S", localtime(&sbuf.st_mtime));
-			fprintf(stderr, "logDump: Logfile last modified: %s (UTC)\n", fileDateStr);
+void logDumpQueuePush(logDumpQueue_t *q, logDumpBatch_t *b) {
+	while (q->tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == PIPE_QUEUE_LEN)
+		sched_yield();
+	q->items[q->tail % PIPE_QUEUE_LEN] = b;
+	__atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+}
 
-			// set track date to log file date unless date was specified via options
-			if ( trackDateStr == NULL || strlen(trackDateStr) != 6 ) {
-				trackTime = localtime(&sbuf.st_mtime); // log date is actually in UTC time even though system thinks it's local
-			} else {
-				char tday[3], tmon[3], tyr[3];
-				strncpy(tday, trackDateStr, 2);
-				strncpy(tmon, trackDateStr+2, 2);
-				strncpy(tyr, trackDateStr+4, 2);
-				trackTime->tm_year = atoi(tyr + 0) + 100;
-				trackTime->tm_mon = atoi(tmon + 0) - 1;
-				trackTime->tm_mday = atoi(tday + 0);
-			}
+logDumpBatch_t *logDumpQueuePop(logDumpQueue_t *q) {
+	logDumpBatch_t *b;
 
-			// zero time values for start of week calculation (GPS Time Of Week starts on each Sunday at 00:00:00)
-			trackTime->tm_hour = 0;
-			trackTime->tm_min = 0;
-			trackTime->tm_sec = 0;
+	while (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == q->head)
+		sched_yield();
+	b = q->items[q->head % PIPE_QUEUE_LEN];
+	__atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
 
-			// seconds to add to GPS ToW from log
-			towStartTime = mktime(trackTime);
+	return b;
+}
 
-			// find the previous Sunday if we don't have it already
-			while (trackTime->tm_wday != 0) {
-				trackTime->tm_mday -= 1;
-				// TOW always starts on a Sunday
-				towStartTime = mktime(trackTime);
-			}
+// Export pipeline, first stage: reads packets and selects records by position. Anything which
+// depends on earlier records (trigger and home position state, and the filter if it uses
+// them) is also done here, in log order. Batches of raw records go to the workers in turn.
+void *logDumpPipeReader(void *arg) {
+	loggerRecord_t rec;
+	loggerSchema_t *sc = &logStream.schema;
+	logDumpBatch_t *b = NULL;
+	double state[NUM_FIELDS];
+	double batchStart = 0.0, t0;
+	uint32_t seq = 0, count;
+	int pktType, recSize, i, k;
+
+	traceThreadName("pipeline reader", 0);
+	memset(&rec, 0, sizeof(rec));
+
+	while (!recRangeEnd && (pktType = loggerReadPacket(&logStream, &rec)) != EOF) {
+		count = recCount++;
+		recRangeEnd = !logDumpProgress(recCount);
+		if (count < dumpRangeMin || (count % OUTPUT_FREQ_DIVISOR))
+			continue;
+
+		if (pipeReaderFilters) {
+			if (pktType == 'M')
+				loggerDecodeFieldIds(sc, logStream.buf, &rec, pipeReaderFields, pipeNumReaderFields);
+			if (useExportFilter && !logFilterEval(&exportFilter, count, &rec))
+				continue;
+			t0 = TRACE_START();
+			logDumpCheckHome(&rec);
+			for (k = 0; k < pipeNumStateCols; k++)
+				state[k] = logDumpColumnValue(&rec, pipeStateCols[k]);
+			TRACE_ADD(TRACE_DERIVE, t0);
+		}
 
-			strftime(fileDateStr, 100, "%d-%b-%Y %H:%M:%S", trackTime);
-			fprintf(stderr, "logDump: using GPS Time of Week reference date: %s\n", fileDateStr);
+		recSize = (pktType == 'M') ? sc->packetSize : sizeof(loggerRecord_t);
 
-			if (utcToLocal) {
-				// use local time in track log
-				// towStartTime += getUTCOffset();
-				fprintf(stderr, "logDump: adjusting date/time output to local time (UTC %.1fh).\n", getUTCOffset() / 3600.0f);
+		// start a new batch when this one is full, or the record layout changes
+		if (b && (b->n == PIPE_BATCH_RECS || b->pktType != pktType || (pktType == 'M' && (b->schema.numFields != sc->numFields ||
+				memcmp(b->schema.fields, sc->fields, sc->numFields * sizeof(loggerFields_t)))))) {
+			TRACE_SPAN("read batch", TRACE_PHASE, batchStart);
+			logDumpQueuePush(&pipeIn[b->seq % pipeWorkers], b);
+			b = NULL;
+		}
+
+		if (!b) {
+			batchStart = TRACE_START();
+			b = logDumpQueuePop(&pipeFree);
+			b->seq = seq++;
+			b->n = 0;
+			b->eof = false;
+			b->pktType = pktType;
+			b->recSize = recSize;
+			if (pktType == 'M')
+				b->schema = *sc;
+			if (b->rawAlloc < PIPE_BATCH_RECS * recSize) {
+				b->rawAlloc = PIPE_BATCH_RECS * recSize;
+				b->raw = (char *)realloc(b->raw, b->rawAlloc);
 			}
+		}
 
-		} // if outputRealDate
+		i = b->n++;
+		b->count[i] = count;
+		memcpy(b->raw + i * recSize, (pktType == 'M') ? logStream.buf : (char *)&rec, recSize);
+		memcpy(b->state + i * pipeNumStateCols, state, pipeNumStateCols * sizeof(double));
+	}
 
-	} else {
-		fprintf(stderr, "logDump: could not access logfile: %s\n", argv[0]);
-		exit(1);
+	if (b) {
+		TRACE_SPAN("read batch", TRACE_PHASE, batchStart);
+		logDumpQueuePush(&pipeIn[b->seq % pipeWorkers], b);
 	}
 
-#if defined (__WIN32__)
-	lf = fopen(argv[0], "rb");
+	// end marker for the writer, then stop the workers
+	b = logDumpQueuePop(&pipeFree);
+	b->seq = seq;
+	b->n = 0;
+	b->eof = true;
+	logDumpQueuePush(&pipeIn[b->seq % pipeWorkers], b);
+	for (i = 0; i < pipeWorkers; i++)
+		logDumpQueuePush(&pipeIn[i], NULL);
+
+	return NULL;
+}
+
+// Export pipeline, second stage: decodes, filters and formats the records of a batch.
+void *logDumpPipeWorker(void *arg) {
+	logDumpQueue_t *in = &pipeIn[(intptr_t)arg];
+	logDumpQueue_t *out = &pipeOut[(intptr_t)arg];
+	loggerRecord_t rec;
+	logDumpBatch_t *b;
+	double vals[NUM_FIELDS];
+	const double *state;
+	const char *raw;
+	double batchStart, t0;
+	int i, j, k;
+
+	traceThreadName("pipeline worker %d", (int)(intptr_t)arg + 1);
+	memset(&rec, 0, sizeof(rec));
+
+	while ((b = logDumpQueuePop(in))) {
+		batchStart = TRACE_START();
+		b->textLen = 0;
+		b->rows = 0;
+
+		// batches come from anywhere in the log; fields not in this one's schema are zero,
+		// as they are when the log is read in order (see loggerReadPacket())
+		if (b->pktType == 'M')
+			memset(&rec, 0, sizeof(rec));
+
+		if (b->textAlloc < b->n * (dumpNum * LOGDUMP_MAX_VALUE_LEN + 1)) {
+			b->textAlloc = b->n * (dumpNum * LOGDUMP_MAX_VALUE_LEN + 1);
+			b->text = (char *)realloc(b->text, b->textAlloc);
+		}
+
+		for (i = 0; i < b->n; i++) {
+			raw = b->raw + i * b->recSize;
+			if (b->pktType == 'M')
+				loggerDecodePacket(&b->schema, raw, &rec);
+			else
+				memcpy(&rec, raw, sizeof(rec));
+
+			if (!pipeReaderFilters && useExportFilter && !logFilterEval(&exportFilter, b->count[i], &rec))
+				continue;
+
+			t0 = TRACE_START();
+			state = b->state + i * pipeNumStateCols;
+			for (j = 0, k = 0; j < dumpNum; j++)
+				vals[j] = logDumpIsStateField(dumpOrder[j]) ? state[k++] : logDumpGetValue(&rec, dumpOrder[j]);
+			TRACE_ADD(TRACE_DERIVE, t0);
+
+			b->textLen += logDumpFormatRow(b->text + b->textLen, vals);
+			b->rows++;
+		}
+
+		TRACE_SPAN("format batch", TRACE_PHASE, batchStart);
+		logDumpQueuePush(out, b);
+	}
+
+	return NULL;
+}
+
+// flat text exports can be done by the pipeline
+bool logDumpPipeCanRun(void) {
+	return (numThreads > 1 && !mergeLogs && !exportGPX && !exportKML && !exportMAV && !exportNPY && !exportNPZ && !resampleMode);
+}
+
+// Runs the export pipeline: a reader thread, worker threads, and this thread writing the
+// formatted batches in order. Output is identical to the sequential export. Returns the
+// number of records exported.
+uint32_t logDumpPipeRun(void) {
+	pthread_t reader, workers[PIPE_MAX_WORKERS];
+	logDumpBatch_t *batches, *b;
+	uint32_t exported = 0, seq;
+	double t0;
+	int deps[LOG_NUM_IDS];
+	int numBatches, i, j, n;
+
+	pipeWorkers = std::min(numThreads, PIPE_MAX_WORKERS);
+
+	// columns calculated by the reader
+	pipeNumStateCols = 0;
+	for (i = 0; i < dumpNum; i++)
+		if (logDumpIsStateField(dumpOrder[i]))
+			pipeStateCols[pipeNumStateCols++] = i;
+
+	pipeReaderFilters = (pipeNumStateCols || (useExportFilter && exportFilter.usesState));
+
+	// fields the reader needs to decode for that
+	pipeNumReaderFields = 0;
+	if (pipeReaderFilters) {
+		for (i = 0; useExportFilter && i < exportFilter.numRawFields; i++)
+			pipeReaderFields[pipeNumReaderFields++] = exportFilter.rawFields[i];
+		for (i = 0; i < pipeNumStateCols; i++) {
+			n = logDumpFieldDeps(dumpOrder[pipeStateCols[i]], deps);
+			for (j = 0; j < n; j++)
+				pipeReaderFields[pipeNumReaderFields++] = deps[j];
+		}
+		pipeReaderFields[pipeNumReaderFields++] = LOG_GPS_LAT;
+		pipeReaderFields[pipeNumReaderFields++] = LOG_GPS_LON;
+		if (homeSetChannel && posHoldChannel) {
+			pipeReaderFields[pipeNumReaderFields++] = LOG_RADIO_CHANNEL0 + homeSetChannel - 1;
+			pipeReaderFields[pipeNumReaderFields++] = LOG_RADIO_CHANNEL0 + posHoldChannel - 1;
+		}
+	}
+
+	pipeIn = (logDumpQueue_t *)calloc(pipeWorkers, sizeof(logDumpQueue_t));
+	pipeOut = (logDumpQueue_t *)calloc(pipeWorkers, sizeof(logDumpQueue_t));
+	memset(&pipeFree, 0, sizeof(pipeFree));
+
+	numBatches = std::min(pipeWorkers * 4, PIPE_QUEUE_LEN);
+	batches = (logDumpBatch_t *)calloc(numBatches, sizeof(logDumpBatch_t));
+	for (i = 0; i < numBatches; i++) {
+		batches[i].state = (double *)calloc(PIPE_BATCH_RECS * pipeNumStateCols + 1, sizeof(double));
+		logDumpQueuePush(&pipeFree, &batches[i]);
+	}
+
+	fprintf(stderr, "logDump: exporting with %d worker threads\n", pipeWorkers);
+
+	for (i = 0; i < pipeWorkers; i++) {
+		if (pthread_create(&workers[i], NULL, logDumpPipeWorker, (void *)(intptr_t)i)) {
+			fprintf(stderr, "logDump: cannot create thread\n");
+			exit(1);
+		}
+	}
+	if (pthread_create(&reader, NULL, logDumpPipeReader, NULL)) {
+		fprintf(stderr, "logDump: cannot create thread\n");
+		exit(1);
+	}
+
+	// write batches in log order
+	for (seq = 0; ; seq++) {
+		b = logDumpQueuePop(&pipeOut[seq % pipeWorkers]);
+		if (b->eof)
+			break;
+		t0 = TRACE_START();
+		fwrite(b->text, 1, b->textLen, stdout);
+		TRACE_SPAN("write batch", TRACE_WRITE, t0);
+		exported += b->rows;
+		logDumpQueuePush(&pipeFree, b);
+	}
+
+	pthread_join(reader, NULL);
+	for (i = 0; i < pipeWorkers; i++)
+		pthread_join(workers[i], NULL);
+
+	for (i = 0; i < numBatches; i++) {
+		free(batches[i].raw);
+		free(batches[i].state);
+		free(batches[i].text);
+	}
+	free(batches);
+	free(pipeIn);
+	free(pipeOut);
+
+	return exported;
+}
+
+// identifier of a field, eg. for file names (caller frees)
+char *logDumpFieldName(int field) {
+	if (field < LOG_NUM_IDS)
+		return strndup(loggerFieldLabels[field], strcspn(loggerFieldLabels[field], " "));
+	else
+		return strdup(logDumpFieldNames[field - LOG_NUM_IDS - 1]);
+}
+
+// open an array for each export column; types are taken from the log header if it has been read
+// the array type of the i-th exported value: the logged type of a field in the current AqH
+// header, a count for the triggers (CAM_TRIGGER and GMBL_TRIGGER), otherwise double
+int logDumpNpyType(int i) {
+	loggerSchema_t *sc = &logStream.schema;
+	int idx;
+
+	if (dumpOrder[i] == FLD_CAM_TRIGGER || dumpOrder[i] == LOG_GMBL_TRIGGER)
+		return LOG_TYPE_U32;
+	idx = (dumpOrder[i] < LOG_NUM_IDS && sc->numFields) ? sc->fieldIndex[dumpOrder[i]] : -1;
+
+	return (idx >= 0 && !resampleMode) ? sc->fields[idx].fieldType : LOG_TYPE_DOUBLE;
+}
+
+void logDumpNpyOpen(logNpy_t *arrays, char **names) {
+	char *fname;
+	int i;
+	FILE *fp;
+
+	for (i = 0; i < dumpNum; i++) {
+		names[i] = logDumpFieldName(dumpOrder[i]);
+
+		if (exportNPZ) {
+			fname = strdup("temporary file");
+			fp = tmpfile();
+		}
+		else {
+			fname = (char *)calloc(strlen(outFileName) + strlen(names[i]) + 6, sizeof(char));
+			sprintf(fname, "%s%s%s.npy", outFileName, (strchr("/\\", outFileName[strlen(outFileName)-1]) ? "" : "_"), names[i]);
+			fp = fopen(fname, "wb+");
+		}
+		if (!fp) {
+			fprintf(stderr, "logDump: cannot open output file '%s'\n", fname);
+			exit(1);
+		}
+		free(fname);
+
+		logNpyOpen(&arrays[i], fp, logDumpNpyType(i));
+	}
+}
+
+// export each column as a NumPy array; returns number of records exported
+uint32_t logDumpNpyRun(void) {
+	logNpy_t *arrays;
+	char **names;
+	char *fname;
+	uint32_t exported = 0;
+	long schemaPos = -1;
+	double t0;
+	int i;
+
+	if (!outFileName)
+		outFileName = strdup(logfilespec.name);
+
+	arrays = (logNpy_t *)calloc(dumpNum, sizeof(logNpy_t));
+	names = (char **)calloc(dumpNum, sizeof(char *));
+
+	while (logDumpNextRecord(&logEntry)) {
+		// the log header has been read by now
+		if (!exported) {
+			logDumpNpyOpen(arrays, names);
+			schemaPos = logStream.schemaPos;
+		}
+		// a field whose type changes with a later header is kept as a double
+		else if (logStream.schemaPos != schemaPos) {
+			schemaPos = logStream.schemaPos;
+			for (i = 0; i < dumpNum; i++) {
+				if (logDumpNpyType(i) != arrays[i].type && !logNpyToDouble(&arrays[i])) {
+					fprintf(stderr, "logDump: error writing %s array\n", names[i]);
+					exit(1);
+				}
+			}
+		}
+
+		logDumpCheckHome(&logEntry);
+		for (i = 0; i < dumpNum; i++)
+			logNpyAppend(&arrays[i], logDumpColumnValue(&logEntry, i));
+		exported++;
+	}
+	if (!exported)
+		logDumpNpyOpen(arrays, names);
+
+	t0 = TRACE_START();
+	for (i = 0; i < dumpNum; i++) {
+		if (!logNpyFinish(&arrays[i])) {
+			fprintf(stderr, "logDump: error writing %s array\n", names[i]);
+			exit(1);
+		}
+	}
+
+	if (exportNPZ) {
+		fname = (char *)calloc(strlen(outFileName) + 5, sizeof(char));
+		strcpy(fname, outFileName);
+		if (!strstr(fname, ".npz"))
+			strcat(fname, ".npz");
+		if (!logNpzWrite(fname, (const char **)names, arrays, dumpNum))
+			exit(1);
+		fprintf(stderr, "\nlogDump: wrote %d arrays to %s\n", dumpNum, fname);
+		free(fname);
+	}
+	else
+		fprintf(stderr, "\nlogDump: wrote %d array files %s*.npy\n", dumpNum, outFileName);
+	TRACE_SPAN("write arrays", TRACE_WRITE, t0);
+
+	for (i = 0; i < dumpNum; i++) {
+		fclose(arrays[i].fp);
+		free(names[i]);
+	}
+	free(arrays);
+	free(names);
+
+	return exported;
+}
+
+// summarize the records of one part of the log (--stats); runs in its own thread
+void *logDumpStatsChunk(void *arg) {
+	logDumpStatsChunk_t *c = (logDumpStatsChunk_t *)arg;
+	loggerStream_t s;
+	loggerRecord_t rec;
+	long firstPos;
+	int pktType, i;
+	double t0 = TRACE_START();
+	FILE *fp;
+
+	traceThreadName("stats reader", 0);
+
+#if defined (__WIN32__)
+	fp = fopen(c->fname, "rb");
+#else
+	fp = fopen(c->fname, "r");
+#endif
+	if (!fp)
+		return NULL;
+
+	loggerStreamInit(&s, fp);
+	memset(&rec, 0, sizeof(rec));
+
+	// the first packet tells the log type (and gets the AqM header read)
+	if ((pktType = loggerReadPacket(&s, &rec)) != EOF) {
+		firstPos = s.pktPos;
+		if (c->startSchemaPos < 0)
+			c->startSchemaPos = s.schemaPos;
+		if (c->start > firstPos) {
+			if (loggerStreamSeek(&s, c->startSchemaPos, c->start) && loggerStreamSync(&s, c->start, pktType))
+				pktType = loggerReadPacket(&s, &rec);
+			else
+				pktType = EOF;
+		}
+
+		// packets belong to the chunk they start in
+		while (pktType != EOF && s.pktPos < c->end) {
+			c->recs++;
+			// the first record is never exported (see dumpRangeMin)
+			if (s.pktPos != firstPos && logDumpFilterRecord(0, &s, pktType, &rec)) {
+				for (i = 0; i < dumpNum; i++)
+					logStatsAdd(&c->stats[i], logDumpGetValue(&rec, dumpOrder[i]));
+				c->accepted++;
+			}
+			pktType = loggerReadPacket(&s, &rec);
+		}
+	}
+	c->endSchemaPos = s.schemaPos;
+
+	fclose(fp);
+
+	TRACE_SPAN("stats chunk", TRACE_PHASE, t0);
+
+	return NULL;
+}
+
+// records can be summarized in any order unless they are selected by position, or values depend on earlier records
+bool logDumpStatsCanSplit(void) {
+	int i;
+
+	if (mergeLogs || resampleMode || dumpRangeMin != 1 || dumpRangeMax || OUTPUT_FREQ_DIVISOR != 1 || (useExportFilter && (exportFilter.usesRec || exportFilter.usesState)))
+		return false;
+
+	for (i = 0; i < dumpNum; i++)
+		if (dumpOrder[i] == FLD_CAM_TRIGGER || dumpOrder[i] == LOG_GMBL_TRIGGER)
+			return false;
+
+	return true;
+}
+
+// Calculates dumpFieldStats in one pass over the log, split in to chunks read by separate
+// threads if possible. Returns the number of records which were selected.
+uint32_t logDumpStatsRun(const char *fname, long fsize) {
+	logDumpStatsChunk_t *chunks;
+	uint32_t accepted = 0;
+	int n, i, j;
+
+	dumpFieldStats = (logStats_t *)calloc(dumpNum, sizeof(logStats_t));
+	for (i = 0; i < dumpNum; i++)
+		logStatsInit(&dumpFieldStats[i], 0);
+
+	n = logDumpStatsCanSplit() ? std::min((long)numThreads, fsize / STATS_MIN_CHUNK) : 1;
+
+	if (n < 2) {
+		while (logDumpNextRecord(&logEntry)) {
+			for (i = 0; i < dumpNum; i++)
+				logStatsAdd(&dumpFieldStats[i], logDumpGetValue(&logEntry, dumpOrder[i]));
+			accepted++;
+		}
+		return accepted;
+	}
+
+	fprintf(stderr, "logDump: reading log with %d threads\n", n);
+
+	chunks = (logDumpStatsChunk_t *)calloc(n, sizeof(logDumpStatsChunk_t));
+	for (i = 0; i < n; i++) {
+		chunks[i].fname = fname;
+		chunks[i].start = fsize / n * i;
+		chunks[i].end = (i < n-1) ? fsize / n * (i+1) : fsize;
+		chunks[i].startSchemaPos = -1;
+		chunks[i].stats = (logStats_t *)calloc(dumpNum, sizeof(logStats_t));
+		for (j = 0; j < dumpNum; j++)
+			logStatsInit(&chunks[i].stats[j], i+1);
+		if (pthread_create(&chunks[i].thread, NULL, logDumpStatsChunk, &chunks[i])) {
+			fprintf(stderr, "logDump: cannot create thread\n");
+			exit(1);
+		}
+	}
+
+	// merge partial results in log order
+	for (i = 0; i < n; i++) {
+		pthread_join(chunks[i].thread, NULL);
+
+		// Chunks start with the first AqH header of the log. Where the schema changed before
+		// a chunk, it is read again with the header the chunk before it ended with.
+		if (i && chunks[i].startSchemaPos != chunks[i-1].endSchemaPos) {
+			chunks[i].startSchemaPos = chunks[i-1].endSchemaPos;
+			chunks[i].recs = chunks[i].accepted = 0;
+			for (j = 0; j < dumpNum; j++) {
+				logStatsFree(&chunks[i].stats[j]);
+				logStatsInit(&chunks[i].stats[j], i+1);
+			}
+			if (pthread_create(&chunks[i].thread, NULL, logDumpStatsChunk, &chunks[i])) {
+				fprintf(stderr, "logDump: cannot create thread\n");
+				exit(1);
+			}
+			pthread_join(chunks[i].thread, NULL);
+		}
+
+		for (j = 0; j < dumpNum; j++) {
+			logStatsMerge(&dumpFieldStats[j], &chunks[i].stats[j]);
+			logStatsFree(&chunks[i].stats[j]);
+		}
+		recCount += chunks[i].recs;
+		accepted += chunks[i].accepted;
+		free(chunks[i].stats);
+	}
+	free(chunks);
+
+	return accepted;
+}
+
+void logDumpStatsTable(FILE *fp) {
+	logStats_t *st;
+	int i;
+
+	fprintf(fp, "FIELD%cCOUNT%cMIN%cMAX%cMEAN%cVARIANCE%cSTDDEV%cP50%cP95%cP99\n",
+		valueSep, valueSep, valueSep, valueSep, valueSep, valueSep, valueSep, valueSep, valueSep);
+
+	for (i = 0; i < dumpNum; i++) {
+		st = &dumpFieldStats[i];
+		fprintf(fp, "%s%c%llu", dumpHeaders[dumpOrder[i]], valueSep, (unsigned long long)st->n);
+		fprintf(fp, "%c%.10G%c%.10G", valueSep, (st->n ? st->min : nan("")), valueSep, (st->n ? st->max : nan("")));
+		fprintf(fp, "%c%.10G", valueSep, (st->n ? st->mean : nan("")));
+		fprintf(fp, "%c%.10G%c%.10G", valueSep, logStatsVariance(st), valueSep, sqrt(logStatsVariance(st)));
+		fprintf(fp, "%c%.10G%c%.10G%c%.10G\n", valueSep, logStatsQuantile(st, 0.50), valueSep, logStatsQuantile(st, 0.95), valueSep, logStatsQuantile(st, 0.99));
+	}
+}
+
+// plot the spectra in dB: the PSD of all values as lines, or the spectrogram of each as a color map
+void logDumpPsdPlot(const logPsd_t *p, const double *dens, const float *spec, int nseg) {
+	double *xVals, *yVals, *z;
+	double t0, t1, zmin, zmax;
+	int i, k;
+
+	dumpYMin = (double *)calloc(dumpNum, sizeof(double));
+	dumpYMax = (double *)calloc(dumpNum, sizeof(double));
+	dumpXMin = (double *)calloc(dumpNum, sizeof(double));
+	dumpXMax = (double *)calloc(dumpNum, sizeof(double));
+
+	// spectrogram times are at the segment centers
+	t0 = p->n / 2 / p->fs;
+	t1 = ((double)(nseg - 1) * p->step + p->n / 2) / p->fs;
+
+	for (i = 0; i < dumpNum; i++) {
+		if (dumpSpectrogram) {
+			dumpXMin[i] = t0;
+			dumpXMax[i] = t1;
+			dumpYMin[i] = 0.0;
+			dumpYMax[i] = logPsdFreq(p, p->bins - 1);
+			continue;
+		}
+		dumpXMin[i] = 0.0;
+		dumpXMax[i] = logPsdFreq(p, p->bins - 1);
+		dumpYMax[i] = logPsdDb(*std::max_element(dens + i * p->bins, dens + (i+1) * p->bins));
+		dumpYMin[i] = std::max(logPsdDb(*std::min_element(dens + i * p->bins, dens + (i+1) * p->bins)), dumpYMax[i] - PSD_PLOT_RANGE_DB);
+	}
+
+	if (!plotterInit(dumpNum, dumpYMin, dumpYMax, dumpXMin, dumpXMax))
+		exit(1);
+
+	if (dumpSpectrogram) {
+		z = (double *)calloc((long)nseg * p->bins, sizeof(double));
+		for (i = 0; i < dumpNum; i++) {
+			zmin = zmax = logPsdDb(spec[(long)i * nseg * p->bins]);
+			for (k = 0; k < nseg * p->bins; k++) {
+				z[k] = logPsdDb(spec[(long)i * nseg * p->bins + k]);
+				zmin = std::min(zmin, z[k]);
+				zmax = std::max(zmax, z[k]);
+			}
+			plotterImage(nseg, p->bins, z, t0, t1, 0.0, logPsdFreq(p, p->bins - 1), std::max(zmin, zmax - PSD_PLOT_RANGE_DB), zmax, dumpHeaders[dumpOrder[i]]);
+		}
+		free(z);
+	}
+	else {
+		xVals = (double *)calloc(p->bins, sizeof(double));
+		yVals = (double *)calloc(p->bins, sizeof(double));
+		for (k = 0; k < p->bins; k++)
+			xVals[k] = logPsdFreq(p, k);
+		for (i = 0; i < dumpNum; i++) {
+			for (k = 0; k < p->bins; k++)
+				yVals[k] = std::max(logPsdDb(dens[i * p->bins + k]), dumpYMin[i]);
+			plotterLine(p->bins, i, xVals, yVals, dumpHeaders[dumpOrder[i]]);
+		}
+		free(xVals);
+		free(yVals);
+	}
+
+	plotterEnd();
+
+	free(dumpYMin);
+	free(dumpYMax);
+	free(dumpXMin);
+	free(dumpXMax);
+}
+
+// Reads the values of the export columns and prints (or plots) their power spectral density
+// (--psd) or spectrogram (--spectrogram). Returns the number of records read.
+uint32_t logDumpPsdRun(void) {
+	logPsd_t psd;
+	float **cols;
+	float *dt, *spec = NULL;
+	double *dens;
+	double fs, lu, lastLu = 0.0, sumDt = 0.0, med;
+	long nsamp = 0, alloc = 0, ndt = 0, n = 0, s, k;
+	int nseg, i;
+
+	cols = (float **)calloc(dumpNum, sizeof(float *));
+	dt = NULL;
+
+	while (logDumpNextRecord(&logEntry)) {
+		if (nsamp == alloc) {
+			alloc = alloc ? alloc * 2 : 65536;
+			for (i = 0; i < dumpNum; i++)
+				cols[i] = (float *)realloc(cols[i], alloc * sizeof(float));
+			dt = (float *)realloc(dt, alloc * sizeof(float));
+		}
+
+		logDumpCheckHome(&logEntry);
+		for (i = 0; i < dumpNum; i++)
+			cols[i][nsamp] = logDumpColumnValue(&logEntry, i);
+
+		lu = logDumpGetValue(&logEntry, LOG_LASTUPDATE);
+		if (nsamp && lu > lastLu)
+			dt[ndt++] = lu - lastLu;
+		lastLu = lu;
+		nsamp++;
+	}
+
+	if (nsamp < psdLen) {
+		fprintf(stderr, "logDump: %ld records selected, need at least %d (see --fft-len)\n", nsamp, psdLen);
+		exit(1);
+	}
+
+	// sample rate: the mean time between records, leaving out gaps (eg. from --where) around the median
+	if (resampleMode) {
+		fs = outputFreq;
+	}
+	else if (ndt) {
+		std::nth_element(dt, dt + ndt / 2, dt + ndt);
+		med = dt[ndt / 2];
+		for (k = 0; k < ndt; k++) {
+			if (dt[k] > med * 0.5 && dt[k] < med * 1.5) {
+				sumDt += dt[k];
+				n++;
+			}
+		}
+		fs = 1e6 * n / sumDt;
+	}
+	else {
+		fs = (double)AQ_LOGGING_FREQUENCY / OUTPUT_FREQ_DIVISOR;
+	}
+	free(dt);
+
+	if (!logPsdInit(&psd, psdLen, fs)) {
+		fprintf(stderr, "logDump: cannot determine the sample rate\n");
+		exit(1);
+	}
+
+	nseg = logPsdSegments(&psd, nsamp);
+	fprintf(stderr, "logDump: %s of %ld samples at %.3fHz, %d segments of %d (%.4fHz resolution)\n",
+		(dumpSpectrogram ? "spectrogram" : "PSD"), nsamp, fs, nseg, psdLen, fs / psdLen);
+
+	dens = (double *)calloc((long)dumpNum * psd.bins, sizeof(double));
+	if (dumpSpectrogram)
+		spec = (float *)calloc((long)dumpNum * nseg * psd.bins, sizeof(float));
+
+	logPsdRun(&psd, cols, dumpNum, nsamp, numThreads, dens, spec);
+
+	if (dumpPlot) {
+		logDumpPsdPlot(&psd, dens, spec, nseg);
+	}
+	else if (dumpSpectrogram) {
+		printf("TIME_S%cFREQ_HZ", valueSep);
+		for (i = 0; i < dumpNum; i++)
+			printf("%c%s", valueSep, dumpHeaders[dumpOrder[i]]);
+		printf("\n");
+		for (s = 0; s < nseg; s++) {
+			for (k = 0; k < psd.bins; k++) {
+				printf("%.4f%c%.10G", ((double)s * psd.step + psdLen / 2) / fs, valueSep, logPsdFreq(&psd, k));
+				for (i = 0; i < dumpNum; i++)
+					printf("%c%.7G", valueSep, spec[((long)i * nseg + s) * psd.bins + k]);
+				printf("\n");
+			}
+		}
+	}
+	else {
+		printf("FREQ_HZ");
+		for (i = 0; i < dumpNum; i++)
+			printf("%c%s", valueSep, dumpHeaders[dumpOrder[i]]);
+		printf("\n");
+		for (k = 0; k < psd.bins; k++) {
+			printf("%.10G", logPsdFreq(&psd, k));
+			for (i = 0; i < dumpNum; i++)
+				printf("%c%.10G", valueSep, dens[i * psd.bins + k]);
+			printf("\n");
+		}
+	}
+
+	for (i = 0; i < dumpNum; i++)
+		free(cols[i]);
+	free(cols);
+	free(dens);
+	free(spec);
+	logPsdFree(&psd);
+
+	return nsamp;
+}
+
+// one interval outside the geofences
+typedef struct {
+	uint32_t startRec, endRec;
+	double startTow, endTow;		// GPS time of week, ms
+	uint32_t positions;
+	double maxExcursion, maxLat, maxLon;
+	int fence;						// nearest to the furthest position
+} logDumpBreach_t;
+
+void logDumpBreachPrint(const logDumpBreach_t *b, const logFenceSet_t *set) {
+	char start[40], end[40];
+	double dur = b->endTow - b->startTow;
+
+	if (dur < 0.0)
+		dur += 7 * 86400e3;		// week rollover
+	formatIsoTime(start, b->startTow);
+	formatIsoTime(end, b->endTow);
+	printf("%u%c%u%c%s%c%s%c%.3f%c%u%c%.2f%c%.7f%c%.7f%c%s\n", b->startRec, valueSep, b->endRec, valueSep, start, valueSep, end, valueSep,
+		dur / 1e3, valueSep, b->positions, valueSep, b->maxExcursion, valueSep, b->maxLat, valueSep, b->maxLon, valueSep,
+		(b->fence >= 0 ? set->fences[b->fence].name : ""));
+}
+
+// Tests the GPS positions of the selected records against the fences of --geofence, a batch
+// at a time, and prints the intervals spent outside all of them. Returns the positions tested.
+uint32_t logDumpGeofenceRun(void) {
+	logFenceSet_t fences;
+	logDumpBreach_t b;
+	double *lat, *lon, *altMsl, *altRel, *tow;
+	double home = nan(""), alt, ex, outside = 0.0;
+	uint32_t *rec, tested = 0;
+	bool *inside, more, open = false;
+	int n = 0, breaches = 0, fence, i;
+
+	if (!logFenceLoad(geofenceFile, &fences))
+		exit(1);
+
+	lat = (double *)malloc(FENCE_BATCH * sizeof(double));
+	lon = (double *)malloc(FENCE_BATCH * sizeof(double));
+	altMsl = (double *)malloc(FENCE_BATCH * sizeof(double));
+	altRel = (double *)malloc(FENCE_BATCH * sizeof(double));
+	tow = (double *)malloc(FENCE_BATCH * sizeof(double));
+	rec = (uint32_t *)malloc(FENCE_BATCH * sizeof(uint32_t));
+	inside = (bool *)malloc(FENCE_BATCH * sizeof(bool));
+	memset(&b, 0, sizeof(b));
+
+	printf("START_REC%cEND_REC%cSTART_TIME%cEND_TIME%cDURATION_S%cPOSITIONS%cMAX_EXCURSION_M%cMAX_LAT%cMAX_LON%cNEAREST_FENCE\n",
+		valueSep, valueSep, valueSep, valueSep, valueSep, valueSep, valueSep, valueSep, valueSep);
+
+	do {
+		// the accurate positions
+		if ((more = logDumpNextRecord(&logEntry))) {
+			if (logEntry.data[LOG_GPS_HACC] > gpsTrackMinHAcc || (logEntry.data[LOG_GPS_LAT] == 0.0 && logEntry.data[LOG_GPS_LON] == 0.0))
+				continue;
+			alt = (logEntry.data[LOG_GPS_VACC] > gpsTrackMinVAcc) ? nan("") : logDumpTrackAlt(&logEntry);
+			if (isnan(home))
+				home = alt;
+			lat[n] = logEntry.data[LOG_GPS_LAT];
+			lon[n] = logEntry.data[LOG_GPS_LON];
+			altMsl[n] = alt;
+			altRel[n] = alt - home;
+			tow[n] = logEntry.data[LOG_GPS_ITOW];
+			rec[n++] = (resampleMode ? resampleCount : recCount) - 1;
+		}
+		if (n < FENCE_BATCH && (more || !n))
+			continue;
+
+		logFenceTest(&fences, lat, lon, altMsl, altRel, n, inside);
+
+		for (i = 0; i < n; i++) {
+			if (inside[i]) {
+				if (open) {
+					logDumpBreachPrint(&b, &fences);
+					open = false;
+				}
+				continue;
+			}
+			ex = logFenceExcursion(&fences, lat[i], lon[i], altMsl[i], altRel[i], &fence);
+			if (!open) {
+				memset(&b, 0, sizeof(b));
+				b.startRec = rec[i];
+				b.startTow = tow[i];
+				b.maxExcursion = -1.0;
+				breaches++;
+				open = true;
+			}
+			else {
+				outside += (tow[i] > b.endTow) ? tow[i] - b.endTow : 0.0;
+			}
+			b.endRec = rec[i];
+			b.endTow = tow[i];
+			b.positions++;
+			if (ex > b.maxExcursion) {
+				b.maxExcursion = ex;
+				b.maxLat = lat[i];
+				b.maxLon = lon[i];
+				b.fence = fence;
+			}
+		}
+		tested += n;
+		n = 0;
+	} while (more);
+
+	if (open)
+		logDumpBreachPrint(&b, &fences);
+
+	fprintf(stderr, "logDump: %u GPS positions tested against %d geofences: %d breaches, %.1f seconds outside\n",
+		tested, fences.numFences, breaches, outside / 1e3);
+
+	free(lat);
+	free(lon);
+	free(altMsl);
+	free(altRel);
+	free(tow);
+	free(rec);
+	free(inside);
+	logFenceFree(&fences);
+
+	return tested;
+}
+
+// Prints (or plots) the min, max and mean of each value over --pyramid parts of the export
+// range, from the pyramids of the log. Returns the number of parts.
+uint32_t logDumpPyramidRun(const char *fname) {
+	logPyramid_t pyr;
+	logPyramidBin_t **bins;
+	uint32_t *recs, rec1;
+	double *xVals, *yVals;
+	int n = 0, i, k;
+
+	if (!logPyramidIndex(fname, dumpOrder, dumpNum, &pyr)) {
+		fprintf(stderr, "logDump: cannot read log file %s\n", fname);
+		exit(1);
+	}
+
+	rec1 = dumpRangeMax ? dumpRangeMax : pyr.numRecords - 1;
+	bins = (logPyramidBin_t **)calloc(dumpNum, sizeof(logPyramidBin_t *));
+	recs = (uint32_t *)calloc(pyramidWidth, sizeof(uint32_t));
+	for (i = 0; i < dumpNum; i++) {
+		bins[i] = (logPyramidBin_t *)calloc(pyramidWidth, sizeof(logPyramidBin_t));
+		n = logPyramidQuery(&pyr, dumpOrder[i], dumpRangeMin, rec1, pyramidWidth, bins[i], recs);
+	}
+
+	if (dumpPlot && n > 0) {
+		dumpYMin = (double *)calloc(dumpNum, sizeof(double));
+		dumpYMax = (double *)calloc(dumpNum, sizeof(double));
+		dumpXMin = (double *)calloc(dumpNum, sizeof(double));
+		dumpXMax = (double *)calloc(dumpNum, sizeof(double));
+		xVals = (double *)calloc(n * 2, sizeof(double));
+		yVals = (double *)calloc(n * 2, sizeof(double));
+
+		for (i = 0; i < dumpNum; i++) {
+			dumpYMin[i] = bins[i][0].min;
+			dumpYMax[i] = bins[i][0].max;
+			for (k = 1; k < n; k++) {
+				dumpYMin[i] = std::min(dumpYMin[i], (double)bins[i][k].min);
+				dumpYMax[i] = std::max(dumpYMax[i], (double)bins[i][k].max);
+			}
+			dumpXMin[i] = recs[0];
+			dumpXMax[i] = recs[n-1];
+		}
+
+		if (!plotterInit(dumpNum, dumpYMin, dumpYMax, dumpXMin, dumpXMax))
+			exit(1);
+
+		// the envelope: min then max of each part
+		for (i = 0; i < dumpNum; i++) {
+			for (k = 0; k < n; k++) {
+				xVals[k*2] = xVals[k*2+1] = recs[k];
+				yVals[k*2] = bins[i][k].min;
+				yVals[k*2+1] = bins[i][k].max;
+			}
+			plotterLine(n * 2, i, xVals, yVals, dumpHeaders[dumpOrder[i]]);
+		}
+
+		plotterEnd();
+
+		free(dumpYMin);
+		free(dumpYMax);
+		free(dumpXMin);
+		free(dumpXMax);
+		free(xVals);
+		free(yVals);
+	}
+	else if (!dumpPlot) {
+		printf("REC");
+		for (i = 0; i < dumpNum; i++)
+			printf("%c%s_MIN%c%s_MAX%c%s_MEAN", valueSep, dumpHeaders[dumpOrder[i]], valueSep, dumpHeaders[dumpOrder[i]], valueSep, dumpHeaders[dumpOrder[i]]);
+		printf("\n");
+
+		for (k = 0; k < n; k++) {
+			printf("%u", recs[k]);
+			for (i = 0; i < dumpNum; i++)
+				printf("%c%.8g%c%.8g%c%.8g", valueSep, bins[i][k].min, valueSep, bins[i][k].max, valueSep, bins[i][k].mean);
+			printf("\n");
+		}
+	}
+
+	fprintf(stderr, "logDump: records %u to %u of %u in %d parts\n", dumpRangeMin, std::min(rec1, pyr.numRecords - 1), pyr.numRecords, std::max(n, 0));
+
+	for (i = 0; i < dumpNum; i++)
+		free(bins[i]);
+	free(bins);
+	free(recs);
+	logPyramidFree(&pyr);
+
+	return std::max(n, 0);
+}
+
+// the logged fields a query needs for a record into rec
+static void logDumpDaemonFill(logServerLog_t *l, const int *need, int numNeed, uint32_t r, loggerRecord_t *rec) {
+	int j;
+
+	for (j = 0; j < numNeed; j++) {
+		if (!l->cols[need[j]])
+			continue;
+		rec->data[need[j]] = l->cols[need[j]][r];
+		if (need[j] >= LOG_UKF_Q1 && need[j] <= LOG_UKF_Q4)
+			rec->quat[need[j] - LOG_UKF_Q1] = rec->data[need[j]];
+	}
+}
+
+// Answers one query from --server (see logDump_server.h): the values of the selected records
+// of a log, from the cache, as rows or statistics. Returns the number of records selected.
+uint32_t logDumpDaemonQuery(logServerCache_t *cache, FILE *in, FILE *out) {
+	logServerRequest_t q;
+	logServerLog_t *l = NULL;
+	loggerRecord_t rec;
+	logFilter_t filter;
+	double vals[NUM_FIELDS];
+	char row[NUM_FIELDS * LOGDUMP_MAX_VALUE_LEN + 1];
+	char err[256] = "";
+	bool isNeeded[LOG_NUM_IDS];
+	int need[LOG_NUM_IDS], deps[LOG_NUM_IDS];
+	int numNeed = 0, n, i, j;
+	uint32_t rec1, r, *sel = NULL, numSel = 0;
+	bool ok;
+
+	ok = logServerReadRequest(in, &q, err, sizeof(err));
+
+	// logged fields the values and the filter need, each once
+	memset(isNeeded, 0, sizeof(isNeeded));
+	for (i = 0; ok && i < q.numFields; i++) {
+		// values which depend on the records before them need the whole log read in order
+		if (logDumpIsStateField(q.fields[i])) {
+			snprintf(err, sizeof(err), "trigger values and bearing to home cannot be queried");
+			ok = false;
+		}
+		else if (q.fields[i] == FLD_GPS_UTC_TIME && q.format != SERVER_FMT_BIN && !q.stats) {
+			snprintf(err, sizeof(err), "GPS_UTC_TIME can only be queried in bin format");
+			ok = false;
+		}
+		else {
+			n = logDumpFieldDeps(q.fields[i], deps);
+			for (j = 0; j < n; j++)
+				if (!isNeeded[deps[j]]) {
+					isNeeded[deps[j]] = true;
+					need[numNeed++] = deps[j];
+				}
+		}
+	}
+	if (ok && q.where) {
+		if (!logFilterCompile(&filter, q.where) || filter.usesState) {
+			snprintf(err, sizeof(err), "bad where expression '%s'", q.where);
+			ok = false;
+		}
+		for (i = 0; ok && i < filter.numRawFields; i++)
+			if (!isNeeded[filter.rawFields[i]]) {
+				isNeeded[filter.rawFields[i]] = true;
+				need[numNeed++] = filter.rawFields[i];
+			}
+	}
+	if (ok)
+		ok = ((l = logServerCacheGet(cache, q.log, need, numNeed, err, sizeof(err))) != NULL);
+
+	if (!ok) {
+		fprintf(out, "ERR %s\n", err);
+		fprintf(stderr, "logDump: query refused: %s\n", err);
+		logServerFreeRequest(&q);
+		return 0;
+	}
+
+	// the selected records first, so that the answer can say how many follow
+	memset(&rec, 0, sizeof(rec));
+	if (l->log.numRecords)
+		sel = (uint32_t *)malloc(l->log.numRecords * sizeof(uint32_t));
+	rec1 = (q.rangeMax && q.rangeMax < (uint32_t)l->log.numRecords) ? q.rangeMax : l->log.numRecords - 1;
+	for (r = q.rangeMin; l->log.numRecords && r <= rec1; r++) {
+		if (r % q.divisor)
+			continue;
+		if (q.where) {
+			logDumpDaemonFill(l, need, numNeed, r, &rec);
+			if (!logFilterEval(&filter, r, &rec))
+				continue;
+		}
+		sel[numSel++] = r;
+	}
+	fprintf(out, "OK %u\n", numSel);
+
+	// the export options of the query
+	dumpNum = q.numFields;
+	for (i = 0; i < dumpNum; i++)
+		dumpOrder[i] = q.fields[i];
+	valueSep = (q.format == SERVER_FMT_BIN) ? ',' : q.format;
+	if (q.stats) {
+		dumpFieldStats = (logStats_t *)calloc(dumpNum, sizeof(logStats_t));
+		for (i = 0; i < dumpNum; i++)
+			logStatsInit(&dumpFieldStats[i], 0);
+	}
+	else if (q.headers && q.format != SERVER_FMT_BIN) {
+		for (i = 0; i < dumpNum; i++)
+			fprintf(out, "%s%c", dumpHeaders[dumpOrder[i]], (i < dumpNum-1 ? valueSep : '\n'));
+	}
+
+	for (r = 0; r < numSel; r++) {
+		logDumpDaemonFill(l, need, numNeed, sel[r], &rec);
+		for (i = 0; i < dumpNum; i++)
+			vals[i] = logDumpGetValue(&rec, dumpOrder[i]);
+		if (q.stats)
+			for (i = 0; i < dumpNum; i++)
+				logStatsAdd(&dumpFieldStats[i], vals[i]);
+		else if (q.format == SERVER_FMT_BIN)
+			fwrite(vals, sizeof(double), dumpNum, out);
+		else
+			fwrite(row, 1, logDumpFormatRow(row, vals), out);
+	}
+
+	if (q.stats) {
+		logDumpStatsTable(out);
+		for (i = 0; i < dumpNum; i++)
+			logStatsFree(&dumpFieldStats[i]);
+		free(dumpFieldStats);
+		dumpFieldStats = NULL;
+	}
+	fprintf(out, "END %u\n", numSel);
+
+	free(sel);
+	logServerFreeRequest(&q);
+
+	return numSel;
+}
+
+// Waits for queries from --server (--daemon) and answers them, one at a time.
+int logDumpDaemonRun(void) {
+	logServerCache_t *cache;
+	FILE *in, *out;
+	uint32_t n;
+	double t0;
+	int fd;
+
+	if ((fd = logServerListen(daemonSocket)) < 0)
+		return 1;
+#if !defined (__WIN32__)
+	signal(SIGPIPE, SIG_IGN);		// a client which goes away only ends its query
+#endif
+
+	cache = (logServerCache_t *)calloc(1, sizeof(logServerCache_t));
+	cache->maxBytes = (size_t)(cacheSizeMb > 0 ? cacheSizeMb : SERVER_DEF_CACHE_MB) << 20;
+	fprintf(stderr, "logDump: waiting for queries on %s\n", daemonSocket);
+
+	while (logServerAccept(fd, &in, &out)) {
+		t0 = traceNow();
+		n = logDumpDaemonQuery(cache, in, out);
+		fclose(in);
+		fclose(out);
+		fprintf(stderr, "logDump: %u records in %.1f ms, %d logs in %.1f MB\n", n, (traceNow() - t0) / 1e3,
+			cache->numLogs, cache->bytes / 1048576.0);
+	}
+
+	fprintf(stderr, "logDump: cannot accept queries on %s\n", daemonSocket);
+
+	return 1;
+}
+
+// Has a --daemon do the export (--server) and writes out the answer as the export would be.
+// Returns the number of records exported.
+uint32_t logDumpServerRun(const char *fname) {
+	logServerRequest_t q;
+	FILE *in, *out;
+	double vals[NUM_FIELDS];
+	char row[NUM_FIELDS * LOGDUMP_MAX_VALUE_LEN + 1];
+	char line[SERVER_MAX_LINE];
+	uint32_t exported = 0, total, n32;
+	size_t n;
+
+	memset(&q, 0, sizeof(q));
+#if defined (__WIN32__)
+	q.log = _fullpath(NULL, fname, 0);
 #else
-	lf = fopen(argv[0], "r");
+	q.log = realpath(fname, NULL);
 #endif
+	if (!q.log) {
+		fprintf(stderr, "logDump: cannot access log file %s\n", fname);
+		exit(1);
+	}
+	q.fields = dumpOrder;
+	q.numFields = dumpNum;
+	q.rangeMin = dumpRangeMin;
+	q.rangeMax = dumpRangeMax;
+	q.divisor = OUTPUT_FREQ_DIVISOR;
+	q.where = whereExpr;
+	q.format = dumpStats ? valueSep : SERVER_FMT_BIN;
+	q.stats = dumpStats;
+
+	if (!logServerConnect(serverSocket, &in, &out))
+		exit(1);
+	if (!logServerWriteRequest(out, &q) || !fgets(line, sizeof(line), in)) {
+		fprintf(stderr, "logDump: no answer from the daemon on %s\n", serverSocket);
+		exit(1);
+	}
+	if (sscanf(line, "OK %u", &total) != 1) {
+		fprintf(stderr, "logDump: daemon: %s", strncmp(line, "ERR ", 4) ? line : line + 4);
+		exit(1);
+	}
+
+	// statistics come as the table, values as rows of doubles; both are followed by "END <n>"
+	if (dumpStats) {
+		while (fgets(line, sizeof(line), in) && strncmp(line, "END ", 4))
+			fputs(line, stdout);
+		exported = total;
+	}
+	else {
+		while (exported < total && fread(vals, sizeof(double), dumpNum, in) == (size_t)dumpNum) {
+			n = logDumpFormatRow(row, vals);
+			fwrite(row, 1, n, stdout);
+			exported++;
+		}
+		if (!fgets(line, sizeof(line), in))
+			line[0] = 0;
+	}
+	if (sscanf(line, "END %u", &n32) != 1 || n32 != total || exported != total) {
+		fprintf(stderr, "logDump: the answer of the daemon on %s ended early\n", serverSocket);
+		exit(1);
+	}
+
+	fclose(in);
+	fclose(out);
+	free(q.log);
+
+	return exported;
+}
+
+// Lists the flights of the log (--flights) and exits, or positions the log at the start of
+// the selected flight (--flight) and limits the export to it.
+void logDumpFlights(const char *fname) {
+	logFlight_t *flights, *f;
+	double t0;
+	int n, i;
+
+	if (mergeLogs) {
+		fprintf(stderr, "logDump: --flight and --flights need a single log file\n");
+		exit(1);
+	}
+
+	t0 = TRACE_START();
+	n = logFlightsIndex(fname, &logStream, &flights);
+	TRACE_SPAN("flight index", TRACE_PHASE, t0);
+
+	if (listFlights) {
+		printf("FLIGHT%cSTART_REC%cEND_REC%cSTART_OFFSET%cEND_OFFSET%cDURATION_S%cMAX_ALT_M\n",
+			valueSep, valueSep, valueSep, valueSep, valueSep, valueSep);
+		for (i = 0; i < n; i++)
+			printf("%d%c%u%c%u%c%ld%c%ld%c%.3f%c%.2f\n", i+1, valueSep, flights[i].startRec, valueSep, flights[i].endRec, valueSep,
+				flights[i].startPos, valueSep, flights[i].endPos, valueSep, flights[i].duration, valueSep, flights[i].maxAlt);
+		fprintf(stderr, "logDump: %d flights found\n", n);
+		exit(0);
+	}
+
+	if (flightNum < 1 || flightNum > n) {
+		fprintf(stderr, "logDump: no flight %d, the log has %d flights\n", flightNum, n);
+		exit(1);
+	}
+
+	f = &flights[flightNum-1];
+	dumpRangeMin = f->startRec;
+	dumpRangeMax = f->endRec;
+	fprintf(stderr, "logDump: flight %d: records %u to %u, %.1f seconds\n", flightNum, f->startRec, f->endRec, f->duration);
+
+	// skip to the flight, with the AqH header in effect there
+	logStartSchemaPos = f->schemaPos;
+	logStartPos = f->startPos;
+	logStartRec = f->startRec;
+	if (!loggerStreamSeek(&logStream, logStartSchemaPos, logStartPos)) {
+		fprintf(stderr, "logDump: cannot read the log header in effect at flight %d\n", flightNum);
+		exit(1);
+	}
+	recCount = logStartRec;
+
+	free(flights);
+}
+
+int main(int argc, char **argv) {
+	FILE *lf;
+	char *logFileName;
+	int i, j;
+	uint32_t exp_count = 0; // total exported lines counter
+	struct stat sbuf; // file stat() buffer
+	struct stat tbuf;
+	loggerPack_t pack;
+	double logBytes = 0.0, t0;
+
+	outFP = stdout;
+	dumpNum = 0;
+
+	plotterOpts(argc, argv);
+	logDumpOpts(argc, argv);
+	argc -= optind;
+	argv += optind;
+
+	if (traceEnabled)
+		loggerTrace = plotTrace = &traceHooks;
+	traceThreadName("main", 0);
+
+	fprintf(stderr, "\n");
+	if (argc < 1 && !daemonSocket) {
+		fprintf(stderr, "logDump: need log file argument. Type logDump --help for usage details.\n");
+		exit(1);
+	}
+	if (dumpNum < 1 && !listFlights && !exportMAV && !geofenceFile && !daemonSocket) {
+		fprintf(stderr, "logDump: need at least one value to export. Type logDump --help for usage details.\n");
+		exit(1);
+	}
+
+	// statistics replace any export
+	if (dumpStats) {
+		dumpPlot = false;
+		exportGPX = exportKML = exportMAV = exportNPY = exportNPZ = false;
+		includeHeaders = false;
+	}
+
+	// so do spectra, which can be plotted
+	if (dumpPsd || dumpSpectrogram) {
+		dumpStats = false;
+		exportGPX = exportKML = exportMAV = exportNPY = exportNPZ = false;
+		includeHeaders = false;
+		if (!psdLen)
+			psdLen = PSD_DEF_LEN;
+		if (psdLen < PSD_MIN_LEN || psdLen > PSD_MAX_LEN || (psdLen & (psdLen - 1))) {
+			fprintf(stderr, "logDump: --fft-len must be a power of 2 from %d to %d\n", PSD_MIN_LEN, PSD_MAX_LEN);
+			exit(1);
+		}
+	}
+
+	// and geofence checks, which need the date of the GPS times
+	if (geofenceFile) {
+		dumpPlot = dumpStats = dumpPsd = dumpSpectrogram = false;
+		exportGPX = exportKML = exportMAV = exportNPY = exportNPZ = false;
+		includeHeaders = false;
+		outputRealDate = true;
+		pyramidWidth = 0;
+	}
+
+	// and pyramid views, which can be plotted
+	if (pyramidWidth) {
+		dumpStats = dumpPsd = dumpSpectrogram = false;
+		exportGPX = exportKML = exportMAV = exportNPY = exportNPZ = false;
+		includeHeaders = false;
+		if (whereExpr || resampleMode || usrSpecOutFreq || dumpTrigger || dumpGpsTrack || argc > 1) {
+			fprintf(stderr, "logDump: --pyramid cannot be used with --where, --resample, --out-freq, trigger values, --gps-track, or more than one log\n");
+			exit(1);
+		}
+		for (i = 0; i < dumpNum; i++) {
+			if (dumpOrder[i] >= LOG_NUM_IDS) {
+				fprintf(stderr, "logDump: --pyramid can only be used with logged values\n");
+				exit(1);
+			}
+		}
+	}
+
+	// and exports answered by a --daemon, which has the log in memory
+	if (serverSocket && !daemonSocket) {
+		if (argc > 1 || resampleMode || dumpTrigger || dumpGpsTrack || dumpPlot || dumpPsd || dumpSpectrogram || geofenceFile || pyramidWidth ||
+				exportGPX || exportKML || exportMAV || exportNPY || exportNPZ) {
+			fprintf(stderr, "logDump: --server can only be used for flat text exports and --stats of one log\n");
+			exit(1);
+		}
+		for (i = 0; i < dumpNum; i++) {
+			if (logDumpIsStateField(dumpOrder[i])) {
+				fprintf(stderr, "logDump: --server cannot export trigger values or bearing to home\n");
+				exit(1);
+			}
+		}
+	}
 
+#if !defined (__WIN32__)
+	if (!numThreads)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (numThreads < 1)
+		numThreads = 1;
+
+	logDumpBuildFilter();
+
+	// determine output frequency
+	if (dumpGpsTrack && !usrSpecOutFreq) // use lower default setting for gps track log
+		outputFreq = gpsTrackFreq;
+
+	// set up field labels (combine from logger.h and logdump.h)
+	for (i=0; i < LOG_NUM_IDS; i++)
+		dumpHeaders[i] = loggerFieldLabels[i];
+	j = 0;
+	for (i++; i < NUM_FIELDS; i++)
+		dumpHeaders[i] = logDumpFieldLabels[j++];
+
+	if (daemonSocket)
+		return logDumpDaemonRun();
+
+	if (argc == 1)
+		fprintf(stderr, "logDump: opening logfile: %s\n", argv[0]);
+
+	if ( !stat(argv[0], &sbuf) ) {
+
+		// if asked to output a real date column, need to get a base date to start from
+		if (outputRealDate) {
+
+			char fileDateStr[30] = "";
+			time_t now = time(NULL);
+			// init gps track log time with current UTC time
+			struct tm* trackTime = gmtime(&now);
+
+			strftime(fileDateStr, 100, "%d-%m-%Y %H:%M:%S", localtime(&sbuf.st_mtime));
+			fprintf(stderr, "logDump: Logfile last modified: %s (UTC)\n", fileDateStr);
+
+			// set track date to log file date unless date was specified via options
+			if ( trackDateStr == NULL || strlen(trackDateStr) != 6 ) {
+				trackTime = localtime(&sbuf.st_mtime); // log date is actually in UTC time even though system thinks it's local
+			} else {
+				char tday[3], tmon[3], tyr[3];
+				strncpy(tday, trackDateStr, 2);
+				strncpy(tmon, trackDateStr+2, 2);
+				strncpy(tyr, trackDateStr+4, 2);
+				trackTime->tm_year = atoi(tyr + 0) + 100;
+				trackTime->tm_mon = atoi(tmon + 0) - 1;
+				trackTime->tm_mday = atoi(tday + 0);
+			}
+
+			// zero time values for start of week calculation (GPS Time Of Week starts on each Sunday at 00:00:00)
+			trackTime->tm_hour = 0;
+			trackTime->tm_min = 0;
+			trackTime->tm_sec = 0;
+
+			// seconds to add to GPS ToW from log
+			towStartTime = mktime(trackTime);
+
+			// find the previous Sunday if we don't have it already
+			while (trackTime->tm_wday != 0) {
+				trackTime->tm_mday -= 1;
+				// TOW always starts on a Sunday
+				towStartTime = mktime(trackTime);
+			}
+
+			strftime(fileDateStr, 100, "%d-%b-%Y %H:%M:%S", trackTime);
+			fprintf(stderr, "logDump: using GPS Time of Week reference date: %s\n", fileDateStr);
+
+			if (utcToLocal) {
+				// use local time in track log
+				// towStartTime += getUTCOffset();
+				fprintf(stderr, "logDump: adjusting date/time output to local time (UTC %.1fh).\n", getUTCOffset() / 3600.0f);
+			}
+
+		} // if outputRealDate
+
+	} else {
+		fprintf(stderr, "logDump: could not access logfile: %s\n", argv[0]);
+		exit(1);
+	}
+
+	// AqZ archives can only be read whole (loggerReadLog()), as a --daemon does
+	for (i = 0; !serverSocket && i < argc; i++) {
+		if (loggerPackOpen(argv[i], &pack)) {
+			loggerPackClose(&pack);
+			fprintf(stderr, "logDump: '%s' is an AqZ archive; unpack it with logPack --unpack, or export it with --server\n", argv[i]);
+			exit(1);
+		}
+	}
+
+	// for the trace summary
+	for (i = 0; traceEnabled && i < argc; i++)
+		if (!stat(argv[i], &tbuf))
+			logBytes += tbuf.st_size;
+
+	if (argc > 1) {
+		mergeLogs = true;
+		t0 = TRACE_START();
+		if (!logMergeOpen(&logMerge, argv, argc))
+			exit(1);
+		TRACE_SPAN("open logs", TRACE_PHASE, t0);
+		lf = logMerge.src[0].stream.fp;
+	}
+	else {
+#if defined (__WIN32__)
+		lf = fopen(argv[0], "rb");
+#else
+		lf = fopen(argv[0], "r");
+#endif
+	}
+
+	// (extractFileName() modifies its argument)
+	logFileName = strdup(argv[0]);
 	logfilespec = extractFileName(argv[0]);
+	loggerStreamInit(&logStream, mergeLogs ? NULL : lf);
 
 	if (lf) {
 		fprintf(stderr, "\n");
 
+		if (listFlights || flightNum)
+			logDumpFlights(logFileName);
+
 #ifdef USE_MAVLINK
 		if (exportMAV) {
 			mavlinkInit();
-			char outfileName[] = "test.mavlink";
-			outFP = fopen(outfileName, "wb");
+			if (!outFileName) {
+				outFileName = (char *)calloc(strlen(logfilespec.name) + 6, sizeof(char));
+				sprintf(outFileName, "%s.tlog", logfilespec.name);
+			}
+			outFP = fopen(outFileName, "wb");
 			if (outFP == NULL) {
-				fprintf(stderr, "logDump: cannot open output file '%s'\n", outfileName);
-				exit(0);
+				fprintf(stderr, "logDump: cannot open output file '%s'\n", outFileName);
+				exit(1);
 			}
 		}
 #endif
 
-		if (includeHeaders && !exportGPX && !exportKML && !exportMAV && !dumpPlot) {
+		if (includeHeaders && !exportGPX && !exportKML && !exportMAV && !exportNPY && !exportNPZ && !dumpPlot) {
 			// write text header
 			logDumpHeaders();
 		} else if (exportGPX) {
@@ -1108,8 +3075,26 @@ int main(int argc, char **argv) {
 			gpxTrkCnt++;
 		}
 
+		t0 = TRACE_START();
+
+		// answered by a --daemon
+		if (serverSocket) {
+			exp_count = logDumpServerRun(logFileName);
+		}
+		// geofence breaches
+		else if (geofenceFile) {
+			exp_count = logDumpGeofenceRun();
+		}
+		// min/max/mean of each part of the range, printed or plotted
+		else if (pyramidWidth) {
+			exp_count = logDumpPyramidRun(logFileName);
+		}
+		// spectra, printed or plotted
+		else if (dumpPsd || dumpSpectrogram) {
+			exp_count = logDumpPsdRun();
+		}
 		// plot output
-		if (dumpPlot) {
+		else if (dumpPlot) {
 			double *xVals, *yVals;
 
 			// need to get X & Y extents for all plotted values to initialize plotter
@@ -1122,18 +3107,10 @@ int main(int argc, char **argv) {
 			std::fill(dumpYMin, dumpYMin + dumpNum, +9999999.99);
 			std::fill(dumpYMax, dumpYMax + dumpNum, -9999999.99);
 
-			// force header read
-			loggerReadEntry(lf, &logEntry);
-			rewind(lf);
-
 			// read through entire log to update dumpYMin/dumpYMax extents for each value being exported
-			while (loggerReadEntry(lf, &logEntry) != EOF) {
-				if (logDumpCheckRecordForExport(count++, &logEntry)) {
-					logDumpStats(&logEntry);
-					exp_count++;
-				}
-				if (!logDumpProgress(count))
-					break;
+			while (logDumpNextRecord(&logEntry)) {
+				logDumpStats(&logEntry);
+				exp_count++;
 			}
 
 			// NOTE: everything below assumes that all logged columns (values) have the same number of samples (exp_count).
@@ -1144,7 +3121,7 @@ int main(int argc, char **argv) {
 
 			// populate X graph values with zero through n samples
 			for (i = 0; i < exp_count; i++)
-				xVals[i] = (double)(i * OUTPUT_FREQ_DIVISOR + dumpRangeMin);
+				xVals[i] = (resampleMode ? (double)i * AQ_LOGGING_FREQUENCY / outputFreq : (double)(i * OUTPUT_FREQ_DIVISOR)) + dumpRangeMin;
 
 			std::fill(dumpXMin, dumpXMin + dumpNum, *std::min_element(xVals, xVals + exp_count));
 			std::fill(dumpXMax, dumpXMax + dumpNum, *std::max_element(xVals, xVals + exp_count));
@@ -1153,15 +3130,10 @@ int main(int argc, char **argv) {
 				exit(1);
 
 			for (i = 0; i < dumpNum; i++) {
-				rewind(lf);
-				count = exp_count = 0;
-				while (loggerReadEntry(lf, &logEntry) != EOF) {
-					if (logDumpCheckRecordForExport(count++, &logEntry))
-						yVals[exp_count++] = logDumpGetValue(&logEntry, dumpOrder[i]);
-
-					if (!logDumpProgress(count))
-						break;
-				}
+				logDumpRewind();
+				exp_count = 0;
+				while (logDumpNextRecord(&logEntry))
+					yVals[exp_count++] = logDumpGetValue(&logEntry, dumpOrder[i]);
 				plotterLine(exp_count, i, xVals, yVals, dumpHeaders[dumpOrder[i]]);
 			}
 
@@ -1174,26 +3146,48 @@ int main(int argc, char **argv) {
 			free(xVals);
 			free(yVals);
 		}
+		// statistics
+		else if (dumpStats) {
+			exp_count = logDumpStatsRun(logFileName, sbuf.st_size);
+			logDumpStatsTable(stdout);
+		}
+		// NumPy arrays
+		else if (exportNPY || exportNPZ) {
+			exp_count = logDumpNpyRun();
+		}
 		// file export
+		else if (logDumpPipeCanRun()) {
+			exp_count = logDumpPipeRun();
+		}
 		else {
-			while (loggerReadEntry(lf, &logEntry) != EOF) {
-				if (logDumpCheckRecordForExport(count++, &logEntry)) {
-					logDumpText(&logEntry);
-					exp_count++;
-				}
-				if (!logDumpProgress(count))
-					break;
+			while (logDumpNextRecord(&logEntry)) {
+				logDumpText(&logEntry);
+				exp_count++;
 			}
 		}
 
+		TRACE_SPAN("export", TRACE_PHASE, t0);
+
+#ifdef USE_MAVLINK
+		if (exportMAV) {
+			if ((!mavlinkFlush()) | (fclose(outFP) != 0)) {
+				fprintf(stderr, "logDump: error writing output file '%s'\n", outFileName);
+				exit(1);
+			}
+			outFP = stdout;
+			fprintf(stderr, "\nlogDump: wrote MAVLink log %s\n", outFileName);
+			mavlinkSummary();
+		}
+#endif
+
 		// finish up writing GPX/KML export
+		logDumpTrackFlush(true);
 		if (exportGPX) {
 			if (!gpsTrackAsWpts)
 				// close track log
 				printf(gpxTrkEnd);
 			// write waypoints, if any
-			if (strlen(gpxWaypoints))
-				printf(gpxWaypoints);
+			logDumpWriteWaypoints();
 			// close gpx
 			printf(gpxFooter);
 		}
@@ -1206,9 +3200,9 @@ int main(int argc, char **argv) {
 			}
 			printf(kmlFolderFooter);
 			// write waypoints, if any
-			if (strlen(gpxWaypoints)) {
+			if (gpxWaypoints && ftell(gpxWaypoints)) {
 				printf(kmlFolderHeader, "Points", "Points");
-				printf(gpxWaypoints);
+				logDumpWriteWaypoints();
 				printf(kmlFolderFooter);
 			}
 			// close kml
@@ -1216,14 +3210,22 @@ int main(int argc, char **argv) {
 		}
 
 
-		fprintf(stderr, "\n\nlogDump: %d total records X %lu bytes = %4.1f MB\n", count, sizeof(logEntry), (float)count*sizeof(logEntry)/1024/1000);
-		fprintf(stderr, "logDump: %d mins %d seconds @ %dHz exported %d records\n", count/200/60, count/200 % 60, outputFreq, exp_count);
+		fprintf(stderr, "\n\nlogDump: %d total records X %lu bytes = %4.1f MB\n", recCount, sizeof(logEntry), (float)recCount*sizeof(logEntry)/1024/1000);
+		fprintf(stderr, "logDump: %d mins %d seconds @ %dHz exported %d records\n", recCount/200/60, recCount/200 % 60, outputFreq, exp_count);
+		if (resampleStarted)
+			fprintf(stderr, "logDump: resampled from %.2fHz log rate (%s interpolation)\n", logResampleInputHz(), (resampleMode == RESAMPLE_CUBIC ? "cubic" : "linear"));
 		if (dumpTriggeredOnly)
 			fprintf(stderr, "logDump: only triggered records were exported\n");
 		if (dumpGpsTrack)
 			fprintf(stderr, "logDump: GPS accuracy filters were applied (h=%.1fm; v=%.1fm); starttime: %u\n", gpsTrackMinHAcc, gpsTrackMinVAcc, towStartTime);
 		if (gpxWptCnt)
 			fprintf(stderr, "logDump: %d waypoints exported to GPX\n", gpxWptCnt);
+		if (simplifyTolerance > 0.0 && trackPtsIn)
+			fprintf(stderr, "logDump: track simplified to %u of %u points (%.1f%%) within %gm\n", trackPtsOut, trackPtsIn, 100.0 * trackPtsOut / trackPtsIn, simplifyTolerance);
+
+		fflush(stdout);
+		if (!traceClose(recCount, logBytes))
+			exit(1);
 	}
 	else {
 		fprintf(stderr, "logDump: cannot open logfile\n");
@@ -8,6 +8,10 @@
 #ifndef LOGDUMP_H_
 #define LOGDUMP_H_
 
+#include "logDump_fields.h"
+#include "logDump_stats.h"
+#include <pthread.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,7 +37,12 @@ extern "C" {
 #define GPS_TRACK_MAX_TM_GAP	3000	// milliseconds w/out GPS position after which to start new track segment
 #define TRIG_ZERO_BUFFER		100		// pulse width ms +/- buffer for zero (center) position
 
-#define AQ_LOGGING_FREQUENCY	200		// assume this logging rate for AQ logs
+#define TRACK_SIMPLIFY_CHUNK	8192		// max. GPS track points simplified at once
+#define LOGDUMP_MAX_VALUE_LEN	40			// max. characters of a formatted export value, incl. separator
+#define PIPE_BATCH_RECS			256			// records per export pipeline batch
+#define PIPE_QUEUE_LEN			64			// export pipeline queue size (power of 2)
+#define PIPE_MAX_WORKERS		16			// max. export pipeline worker threads
+#define STATS_MIN_CHUNK			(4L << 20)	// min. bytes of log per --stats thread
 #define OUTPUT_FREQ_DIVISOR		(int)(AQ_LOGGING_FREQUENCY / outputFreq)	// divide 200Hz logging rate by this to set output frequency (eg 200/40=5Hz)
 
 // default options
@@ -61,6 +70,8 @@ static bool includeHeaders = 0;				// include column headers in flat text export
 static bool dumpTriggeredOnly = 0;			// only export records with trigger indicator (see help)
 static bool exportGPX = 0;					// export GPX format
 static bool exportKML = 0;					// export KML format
+static bool exportNPY = 0;					// export NumPy array files
+static bool exportNPZ = 0;					// export NumPy zip archive
 
 // GPX/KML export settings
 static const char trigWptName[30] = "trig"; // what to name waypoints made from triggered track points
@@ -75,22 +86,6 @@ static const char waypointTrigColor[] = "990000ca"; // KML triggered waypoint la
 static const char waypointIconURL[] = "http://maps.google.com/mapfiles/kml/shapes/arrow.png";
 static const char waypointAltMode[] = "absolute"; // KML waypoint altitude mode (clampToGround, relativeToGround, or absolute)
 
-// this "extends" the log_fields enum from logger.h
-enum calculated_fields {
-	FLD_GPS_H_SPEED = LOG_NUM_IDS + 1,
-	FLD_GPS_UTC_TIME,	// formatted time derived from GPS time and log file time
-	FLD_CAM_TRIGGER,	// triggering action
-	FLD_ROLL,			// roll, pitch, heading, in degrees
-	FLD_PITCH,
-	FLD_YAW,
-	FLD_BRG_TO_HOME,
-	FLD_MAG_MAGNITUDE,
-	FLD_ACC_MAGNITUDE,
-	FLD_ACC_PITCH,		// pure ACC-derived pitch
-	FLD_ACC_ROLL,		// pure ACC-derived roll
-	NUM_FIELDS
-};
-
 static const char *logDumpFieldLabels[] = {
 	"GPS GND SPEED (m/s)",
 	"TIME",
@@ -115,11 +110,44 @@ typedef struct {
 	char time[31], name[30], wptstyle[20];
 } expFields_t;
 
+// one part of the log read by a --stats thread
+typedef struct {
+	pthread_t thread;
+	const char *fname;
+	long start, end;		// file offsets; packets starting in this range are read
+	long startSchemaPos;	// AqH header to start with, -1 for the first in the log
+	long endSchemaPos;		// and the one in effect at the end
+	uint32_t recs;			// records read
+	uint32_t accepted;		// records passing the filters
+	logStats_t *stats;		// [dumpNum]
+} logDumpStatsChunk_t;
+
+// a batch of records passing through the export pipeline
+typedef struct {
+	uint32_t seq;						// batches are written in this order
+	int n;								// number of records
+	bool eof;							// end marker
+	int pktType;						// 'M' or 'L'
+	loggerSchema_t schema;				// field layout of AqM records
+	int recSize;
+	char *raw;							// [PIPE_BATCH_RECS][recSize] undecoded records
+	int rawAlloc;
+	uint32_t count[PIPE_BATCH_RECS];	// record numbers
+	double *state;						// [PIPE_BATCH_RECS][pipeNumStateCols] values calculated by the reader
+	char *text;							// formatted rows
+	int textLen, textAlloc;
+	uint32_t rows;
+} logDumpBatch_t;
+
+// lock-free single producer, single consumer queue
+typedef struct {
+	logDumpBatch_t *items[PIPE_QUEUE_LEN];
+	unsigned head, tail;
+} logDumpQueue_t;
+
 extern time_t towStartTime; // will hold date to add with GPS ToW to arrive at actual date/time
 extern FILE *outFP;
 
-extern double logDumpGetValue(loggerRecord_t *l, int field);
-
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,36 @@
+/*
+ * logDump_fields.cc
+ *
+ *  Calculated fields of logDump, shared by the modules that name or evaluate them.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_fields.h"
+
+const char *logDumpFieldNames[] = {
+	"GPS_H_SPEED",
+	"GPS_UTC_TIME",
+	"CAM_TRIGGER",
+	"ROLL",
+	"PITCH",
+	"YAW",
+	"BRG_TO_HOME",
+	"MAG_MAGNITUDE",
+	"ACC_MAGNITUDE",
+	"ACC_PITCH",
+	"ACC_ROLL",
+	0  // terminate
+};
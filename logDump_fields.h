@@ -0,0 +1,58 @@
+/*
+ * logDump_fields.h
+ *
+ *  Calculated fields of logDump, shared by the modules that name or evaluate them.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOGDUMP_FIELDS_H_
+#define LOGDUMP_FIELDS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "logger.h"
+
+#define AQ_LOGGING_FREQUENCY	200		// assume this logging rate for AQ logs
+
+// this "extends" the log_fields enum from logger.h
+enum calculated_fields {
+	FLD_GPS_H_SPEED = LOG_NUM_IDS + 1,
+	FLD_GPS_UTC_TIME,	// formatted time derived from GPS time and log file time
+	FLD_CAM_TRIGGER,	// triggering action
+	FLD_ROLL,			// roll, pitch, heading, in degrees
+	FLD_PITCH,
+	FLD_YAW,
+	FLD_BRG_TO_HOME,
+	FLD_MAG_MAGNITUDE,
+	FLD_ACC_MAGNITUDE,
+	FLD_ACC_PITCH,		// pure ACC-derived pitch
+	FLD_ACC_ROLL,		// pure ACC-derived roll
+	NUM_FIELDS
+};
+
+// identifiers of calculated fields (eg. for use in --where expressions), [field - LOG_NUM_IDS - 1]
+extern const char *logDumpFieldNames[];
+
+extern double logDumpGetValue(loggerRecord_t *l, int field);
+extern int logDumpFieldDeps(int field, int *deps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGDUMP_FIELDS_H_ */
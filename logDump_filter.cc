@@ -0,0 +1,423 @@
+/*
+ * logDump_filter.cc
+ *
+ *  Compiled record filter predicates for logDump (--where option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_fields.h"
+#include "logDump_filter.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+enum filterOps {
+	F_CONST = 0,
+	F_FIELD,		// logged value, read straight from the record
+	F_DERIVED,		// calculated value, via logDumpGetValue()
+	F_REC,
+	F_NEG,
+	F_NOT,
+	F_ABS,
+	F_ADD,
+	F_SUB,
+	F_MUL,
+	F_DIV,
+	F_MOD,
+	F_LT,
+	F_LE,
+	F_GT,
+	F_GE,
+	F_EQ,
+	F_NE,
+	F_BOOL,
+	F_JFALSE,		// if top of stack is false jump (leaving it), else pop it
+	F_JTRUE			// if top of stack is true jump (leaving it), else pop it
+};
+
+// parser state
+typedef struct {
+	logFilter_t *f;
+	const char *expr;
+	const char *p;
+	int depth, maxDepth;
+	bool err;
+} filterParser_t;
+
+static void filterExpr(filterParser_t *ps);
+
+// return field ID matching name (case insensitive), or -1 if not found;
+// logged field labels are matched up to any units suffix, eg. "UKF_ALT (m)"
+int logFilterFieldId(const char *name, int len) {
+	int i, n;
+
+	for (i = 0; loggerFieldLabels[i]; i++) {
+		n = strcspn(loggerFieldLabels[i], " ");
+		if (n == len && !strncasecmp(loggerFieldLabels[i], name, len))
+			return i;
+	}
+	for (i = 0; logDumpFieldNames[i]; i++) {
+		if ((int)strlen(logDumpFieldNames[i]) == len && !strncasecmp(logDumpFieldNames[i], name, len))
+			return LOG_NUM_IDS + 1 + i;
+	}
+
+	return -1;
+}
+
+static void filterError(filterParser_t *ps, const char *msg) {
+	if (!ps->err)
+		fprintf(stderr, "logDump: --where: %s at position %d: '%s'\n", msg, (int)(ps->p - ps->expr) + 1, ps->p);
+	ps->err = true;
+}
+
+static int filterEmit(filterParser_t *ps, unsigned char op, short arg = 0, double val = 0.0) {
+	logFilter_t *f = ps->f;
+
+	if (f->codeLen >= FILTER_MAX_CODE) {
+		filterError(ps, "expression too long");
+		return 0;
+	}
+
+	// track evaluation stack use
+	switch (op) {
+		case F_CONST:
+		case F_FIELD:
+		case F_DERIVED:
+		case F_REC:
+			if (++ps->depth > ps->maxDepth)
+				ps->maxDepth = ps->depth;
+			break;
+		case F_NEG:
+		case F_NOT:
+		case F_ABS:
+		case F_BOOL:
+			break;
+		default:
+			ps->depth--;
+			break;
+	}
+
+	f->code[f->codeLen].op = op;
+	f->code[f->codeLen].arg = arg;
+	f->code[f->codeLen].val = val;
+
+	return f->codeLen++;
+}
+
+static void filterAddRawField(filterParser_t *ps, int field) {
+	logFilter_t *f = ps->f;
+	int i;
+
+	for (i = 0; i < f->numRawFields; i++)
+		if (f->rawFields[i] == field)
+			return;
+
+	if (f->numRawFields < FILTER_MAX_FIELDS)
+		f->rawFields[f->numRawFields++] = field;
+	else
+		filterError(ps, "too many fields");
+}
+
+static void filterSkipSpace(filterParser_t *ps) {
+	while (isspace(*ps->p))
+		ps->p++;
+}
+
+static bool filterMatch(filterParser_t *ps, const char *tok) {
+	int n = strlen(tok);
+
+	filterSkipSpace(ps);
+	if (strncmp(ps->p, tok, n))
+		return false;
+	// do not mistake "<=" for "<", etc.
+	if (n == 1 && (*tok == '<' || *tok == '>' || *tok == '!' || *tok == '=') && ps->p[1] == '=')
+		return false;
+	ps->p += n;
+
+	return true;
+}
+
+static void filterPrimary(filterParser_t *ps) {
+	const char *start;
+	char *end;
+	double val;
+	int deps[LOG_NUM_IDS];
+	int field, len, i, n;
+
+	filterSkipSpace(ps);
+
+	if (*ps->p == '(') {
+		ps->p++;
+		filterExpr(ps);
+		if (!filterMatch(ps, ")"))
+			filterError(ps, "expected ')'");
+	}
+	else if (isdigit(*ps->p) || *ps->p == '.') {
+		val = strtod(ps->p, &end);
+		if (end == ps->p)
+			filterError(ps, "bad number");
+		ps->p = end;
+		filterEmit(ps, F_CONST, 0, val);
+	}
+	else if (isalpha(*ps->p) || *ps->p == '_') {
+		start = ps->p;
+		while (isalnum(*ps->p) || *ps->p == '_')
+			ps->p++;
+		len = ps->p - start;
+
+		if (len == 3 && !strncasecmp(start, "abs", 3) && filterMatch(ps, "(")) {
+			filterExpr(ps);
+			if (!filterMatch(ps, ")"))
+				filterError(ps, "expected ')'");
+			filterEmit(ps, F_ABS);
+		}
+		else if (len == 3 && !strncasecmp(start, "rec", 3)) {
+			ps->f->usesRec = true;
+			filterEmit(ps, F_REC);
+		}
+		else if ((field = logFilterFieldId(start, len)) < 0) {
+			ps->p = start;
+			filterError(ps, "unknown field name");
+		}
+		else if (field < LOG_NUM_IDS) {
+			filterAddRawField(ps, field);
+			filterEmit(ps, F_FIELD, field);
+		}
+		else {
+			n = logDumpFieldDeps(field, deps);
+			for (i = 0; i < n; i++)
+				filterAddRawField(ps, deps[i]);
+			if (field == FLD_CAM_TRIGGER || field == FLD_BRG_TO_HOME)
+				ps->f->usesState = true;
+			filterEmit(ps, F_DERIVED, field);
+		}
+	}
+	else {
+		filterError(ps, *ps->p ? "unexpected character" : "unexpected end of expression");
+	}
+}
+
+static void filterUnary(filterParser_t *ps) {
+	if (filterMatch(ps, "-")) {
+		filterUnary(ps);
+		filterEmit(ps, F_NEG);
+	}
+	else if (filterMatch(ps, "!")) {
+		filterUnary(ps);
+		filterEmit(ps, F_NOT);
+	}
+	else
+		filterPrimary(ps);
+}
+
+static void filterMul(filterParser_t *ps) {
+	filterUnary(ps);
+	while (!ps->err) {
+		if (filterMatch(ps, "*")) {
+			filterUnary(ps);
+			filterEmit(ps, F_MUL);
+		}
+		else if (filterMatch(ps, "/")) {
+			filterUnary(ps);
+			filterEmit(ps, F_DIV);
+		}
+		else if (filterMatch(ps, "%")) {
+			filterUnary(ps);
+			filterEmit(ps, F_MOD);
+		}
+		else
+			break;
+	}
+}
+
+static void filterAdd(filterParser_t *ps) {
+	filterMul(ps);
+	while (!ps->err) {
+		if (filterMatch(ps, "+")) {
+			filterMul(ps);
+			filterEmit(ps, F_ADD);
+		}
+		else if (filterMatch(ps, "-")) {
+			filterMul(ps);
+			filterEmit(ps, F_SUB);
+		}
+		else
+			break;
+	}
+}
+
+static void filterCompare(filterParser_t *ps) {
+	static const char *toks[] = { "<=", ">=", "==", "!=", "<", ">", 0 };
+	static const unsigned char ops[] = { F_LE, F_GE, F_EQ, F_NE, F_LT, F_GT };
+	int i;
+
+	filterAdd(ps);
+	for (i = 0; toks[i]; i++) {
+		if (filterMatch(ps, toks[i])) {
+			filterAdd(ps);
+			filterEmit(ps, ops[i]);
+			break;
+		}
+	}
+}
+
+static void filterAnd(filterParser_t *ps) {
+	int jmp;
+
+	filterCompare(ps);
+	while (!ps->err && filterMatch(ps, "&&")) {
+		jmp = filterEmit(ps, F_JFALSE);
+		filterCompare(ps);
+		filterEmit(ps, F_BOOL);
+		ps->f->code[jmp].arg = ps->f->codeLen;
+	}
+}
+
+static void filterExpr(filterParser_t *ps) {
+	int jmp;
+
+	filterAnd(ps);
+	while (!ps->err && filterMatch(ps, "||")) {
+		jmp = filterEmit(ps, F_JTRUE);
+		filterAnd(ps);
+		filterEmit(ps, F_BOOL);
+		ps->f->code[jmp].arg = ps->f->codeLen;
+	}
+}
+
+// compile expression into f; returns false (after printing the reason) on error
+bool logFilterCompile(logFilter_t *f, const char *expr) {
+	filterParser_t ps;
+
+	memset(f, 0, sizeof(logFilter_t));
+	ps.f = f;
+	ps.expr = ps.p = expr;
+	ps.depth = ps.maxDepth = 0;
+	ps.err = false;
+
+	filterExpr(&ps);
+	filterSkipSpace(&ps);
+	if (!ps.err && *ps.p)
+		filterError(&ps, "unexpected input");
+	if (!ps.err && ps.maxDepth > FILTER_MAX_STACK)
+		filterError(&ps, "expression too complex");
+
+	return !ps.err;
+}
+
+double logFilterEval(const logFilter_t *f, const uint32_t rec, loggerRecord_t *l) {
+	double stack[FILTER_MAX_STACK];
+	const logFilterOp_t *op;
+	int sp = -1;
+	int pc;
+	double t0 = TRACE_START();
+
+	for (pc = 0; pc < f->codeLen; pc++) {
+		op = &f->code[pc];
+		switch (op->op) {
+			case F_CONST:
+				stack[++sp] = op->val;
+				break;
+			case F_FIELD:
+				stack[++sp] = l->data[op->arg];
+				break;
+			case F_DERIVED:
+				stack[++sp] = logDumpGetValue(l, op->arg);
+				break;
+			case F_REC:
+				stack[++sp] = rec;
+				break;
+			case F_NEG:
+				stack[sp] = -stack[sp];
+				break;
+			case F_NOT:
+				stack[sp] = !stack[sp];
+				break;
+			case F_ABS:
+				stack[sp] = fabs(stack[sp]);
+				break;
+			case F_BOOL:
+				stack[sp] = (stack[sp] != 0.0);
+				break;
+			case F_ADD:
+				sp--;
+				stack[sp] += stack[sp+1];
+				break;
+			case F_SUB:
+				sp--;
+				stack[sp] -= stack[sp+1];
+				break;
+			case F_MUL:
+				sp--;
+				stack[sp] *= stack[sp+1];
+				break;
+			case F_DIV:
+				sp--;
+				stack[sp] /= stack[sp+1];
+				break;
+			case F_MOD:
+				sp--;
+				stack[sp] = fmod(stack[sp], stack[sp+1]);
+				break;
+			case F_LT:
+				sp--;
+				stack[sp] = stack[sp] < stack[sp+1];
+				break;
+			case F_LE:
+				sp--;
+				stack[sp] = stack[sp] <= stack[sp+1];
+				break;
+			case F_GT:
+				sp--;
+				stack[sp] = stack[sp] > stack[sp+1];
+				break;
+			case F_GE:
+				sp--;
+				stack[sp] = stack[sp] >= stack[sp+1];
+				break;
+			case F_EQ:
+				sp--;
+				stack[sp] = stack[sp] == stack[sp+1];
+				break;
+			case F_NE:
+				sp--;
+				stack[sp] = stack[sp] != stack[sp+1];
+				break;
+			case F_JFALSE:
+				if (!stack[sp])
+					pc = op->arg - 1;
+				else
+					sp--;
+				break;
+			case F_JTRUE:
+				if (stack[sp]) {
+					stack[sp] = 1.0;
+					pc = op->arg - 1;
+				}
+				else
+					sp--;
+				break;
+		}
+	}
+
+	TRACE_ADD(TRACE_FILTER, t0);
+
+	return (sp >= 0) ? stack[sp] : 1.0;
+}
@@ -0,0 +1,62 @@
+/*
+ * logDump_filter.h
+ *
+ *  Compiled record filter predicates for logDump (--where option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+Expression syntax:
+------------------
+	operands:    field names (eg. MOT_THROTTLE, GPS_HACC, ROLL), numbers, REC (record number)
+	operators:   || && ! == != < <= > >= + - * / % and parentheses
+	functions:   abs(x)
+
+	Any non-zero result means "true". Example:  MOT_THROTTLE > 0 && GPS_HACC < 1.5
+
+The expression is compiled once into a small stack program. logFilter_t.rawFields lists every
+logged field the program reads (including those needed by derived fields) so that only those
+need to be decoded before the filter is tested.
+*/
+
+#ifndef LOGDUMP_FILTER_H_
+#define LOGDUMP_FILTER_H_
+
+#include "logger.h"
+#include <stdint.h>
+
+#define FILTER_MAX_CODE			256		// max. compiled program length
+#define FILTER_MAX_STACK		32		// max. evaluation stack depth
+#define FILTER_MAX_FIELDS		64		// max. number of logged fields referenced
+
+typedef struct {
+	unsigned char op;
+	short arg;							// field ID or jump target
+	double val;							// constant value
+} logFilterOp_t;
+
+typedef struct {
+	logFilterOp_t code[FILTER_MAX_CODE];
+	int codeLen;
+	int rawFields[FILTER_MAX_FIELDS];	// logged field IDs which the program depends on
+	int numRawFields;
+	bool usesRec;						// uses the record number
+	bool usesState;						// uses values which depend on earlier records (trigger, home position)
+} logFilter_t;
+
+extern int logFilterFieldId(const char *name, int len);
+extern bool logFilterCompile(logFilter_t *f, const char *expr);
+extern double logFilterEval(const logFilter_t *f, const uint32_t rec, loggerRecord_t *l);
+
+#endif /* LOGDUMP_FILTER_H_ */
@@ -0,0 +1,217 @@
+/*
+ * logDump_flights.cc
+ *
+ *  Flight detection and flight index for logDump (--flights and --flight options).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_flights.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FLIGHTS_INDEX_VERSION	2
+
+typedef struct {
+	logFlight_t f;
+	bool active;
+	double elapsed;					// seconds since the start of the motor run
+	double runElapsed;				// at the last record with the motors running
+	double lastUpdate;
+	double startAlt, minAlt, maxAlt;
+} flightsRun_t;
+
+// adds a finished motor run to the list if it was a flight
+static void flightsEnd(flightsRun_t *run, logFlight_t **flights, int *n, int *alloc) {
+	run->active = false;
+
+	if (run->runElapsed < FLIGHT_MIN_TIME || run->maxAlt - run->minAlt < FLIGHT_MIN_CLIMB)
+		return;
+
+	if (*n == *alloc) {
+		*alloc = *alloc ? *alloc * 2 : 16;
+		*flights = (logFlight_t *)realloc(*flights, *alloc * sizeof(logFlight_t));
+	}
+
+	run->f.duration = run->runElapsed;
+	run->f.maxAlt = run->maxAlt - run->startAlt;
+	(*flights)[(*n)++] = run->f;
+}
+
+// Finds the flights in the rest of the log, in one pass. Returns the number found; the list
+// is allocated and must be freed.
+int logFlightsScan(loggerStream_t *s, logFlight_t **flights) {
+	loggerRecord_t rec;
+	flightsRun_t run;
+	int ids[LOG_NUM_MOTORS + 4];
+	int numIds = 0, altField = LOG_UKF_ALT;
+	int n = 0, alloc = 0, pktType, i;
+	uint32_t count = 0;
+	double alt, lu;
+	bool running;
+
+	*flights = NULL;
+	memset(&rec, 0, sizeof(rec));
+	memset(&run, 0, sizeof(run));
+
+	for (; (pktType = loggerReadPacket(s, &rec)) != EOF; count++) {
+		if (pktType == 'M') {
+			if (!numIds) {
+				if (s->schema.fieldIndex[LOG_UKF_ALT] < 0 && s->schema.fieldIndex[LOG_GPS_HEIGHT] >= 0)
+					altField = LOG_GPS_HEIGHT;
+				ids[numIds++] = LOG_LASTUPDATE;
+				ids[numIds++] = LOG_MOT_THROTTLE;
+				ids[numIds++] = altField;
+				for (i = 0; i < LOG_NUM_MOTORS; i++)
+					ids[numIds++] = LOG_MOT_MOTOR0 + i;
+			}
+			loggerDecodeFieldIds(&s->schema, s->buf, &rec, ids, numIds);
+		}
+
+		running = (rec.data[LOG_MOT_THROTTLE] > 0.0);
+		for (i = 0; i < LOG_NUM_MOTORS && !running; i++)
+			running = (rec.data[LOG_MOT_MOTOR0 + i] > 0.0);
+
+		alt = rec.data[altField];
+		lu = rec.data[LOG_LASTUPDATE];
+
+		if (run.active) {
+			// LASTUPDATE is in micros; assume the normal logging rate if it went backwards
+			run.elapsed += (lu > run.lastUpdate) ? (lu - run.lastUpdate) / 1e6 : 1.0 / FLIGHT_REC_RATE;
+			run.lastUpdate = lu;
+
+			if (running) {
+				run.f.endRec = count;
+				run.f.endPos = s->pktPos;
+				run.runElapsed = run.elapsed;
+			}
+			else if (run.elapsed - run.runElapsed > FLIGHT_MAX_STOP) {
+				flightsEnd(&run, flights, &n, &alloc);
+			}
+		}
+		else if (running) {
+			memset(&run, 0, sizeof(run));
+			run.active = true;
+			run.f.startRec = run.f.endRec = count;
+			run.f.startPos = run.f.endPos = s->pktPos;
+			run.f.schemaPos = s->schemaPos;
+			run.lastUpdate = lu;
+			run.startAlt = run.minAlt = run.maxAlt = alt;
+		}
+
+		if (run.active && running) {
+			if (alt < run.minAlt)
+				run.minAlt = alt;
+			if (alt > run.maxAlt)
+				run.maxAlt = alt;
+		}
+	}
+
+	if (run.active)
+		flightsEnd(&run, flights, &n, &alloc);
+
+	return n;
+}
+
+static char *flightsIndexName(const char *fname) {
+	char *iname = (char *)calloc(strlen(fname) + strlen(FLIGHTS_INDEX_EXT) + 1, sizeof(char));
+
+	strcpy(iname, fname);
+	strcat(iname, FLIGHTS_INDEX_EXT);
+
+	return iname;
+}
+
+// Reads the flight index of a log with the given stat() info. Returns the number of flights,
+// or -1 if there is no index or it is out of date.
+int logFlightsLoad(const char *fname, const struct stat *st, logFlight_t **flights) {
+	char *iname = flightsIndexName(fname);
+	char line[256];
+	long long size, mtime;
+	int version, n = -1, num, i;
+	logFlight_t f;
+	FILE *fp;
+
+	*flights = NULL;
+
+	if ((fp = fopen(iname, "r"))) {
+		if (fgets(line, sizeof(line), fp) && sscanf(line, "# logDump flights %d %lld %lld %d", &version, &size, &mtime, &num) == 4 &&
+				version == FLIGHTS_INDEX_VERSION && size == (long long)st->st_size && mtime == (long long)st->st_mtime && num >= 0) {
+			*flights = (logFlight_t *)calloc(num + 1, sizeof(logFlight_t));
+			for (n = 0; n < num && fgets(line, sizeof(line), fp); ) {
+				if (line[0] == '#')
+					continue;
+				if (sscanf(line, "%d %u %u %ld %ld %lf %lf %ld", &i, &f.startRec, &f.endRec, &f.startPos, &f.endPos, &f.duration, &f.maxAlt, &f.schemaPos) != 8)
+					break;
+				(*flights)[n++] = f;
+			}
+			if (n != num) {
+				free(*flights);
+				*flights = NULL;
+				n = -1;
+			}
+		}
+		fclose(fp);
+	}
+
+	free(iname);
+
+	return n;
+}
+
+bool logFlightsSave(const char *fname, const struct stat *st, const logFlight_t *flights, int n) {
+	char *iname = flightsIndexName(fname);
+	FILE *fp;
+	int i;
+
+	if (!(fp = fopen(iname, "w"))) {
+		free(iname);
+		return false;
+	}
+
+	fprintf(fp, "# logDump flights %d %lld %lld %d\n", FLIGHTS_INDEX_VERSION, (long long)st->st_size, (long long)st->st_mtime, n);
+	fprintf(fp, "# FLIGHT START_REC END_REC START_OFFSET END_OFFSET DURATION_S MAX_ALT_M SCHEMA_OFFSET\n");
+	for (i = 0; i < n; i++)
+		fprintf(fp, "%d %u %u %ld %ld %.3f %.2f %ld\n", i+1, flights[i].startRec, flights[i].endRec,
+				flights[i].startPos, flights[i].endPos, flights[i].duration, flights[i].maxAlt, flights[i].schemaPos);
+
+	free(iname);
+
+	return !(ferror(fp) | fclose(fp));
+}
+
+// Gets the flights of a log from its index, or by reading the log (from the start) and
+// saving a new index. The stream is left at the start of the log.
+int logFlightsIndex(const char *fname, loggerStream_t *s, logFlight_t **flights) {
+	struct stat st;
+	int n;
+
+	if (stat(fname, &st))
+		return 0;
+
+	if ((n = logFlightsLoad(fname, &st, flights)) >= 0)
+		return n;
+
+	fprintf(stderr, "logDump: finding flights in %s\n", fname);
+
+	rewind(s->fp);
+	n = logFlightsScan(s, flights);
+	rewind(s->fp);
+
+	if (!logFlightsSave(fname, &st, *flights, n))
+		fprintf(stderr, "logDump: cannot write flight index %s%s\n", fname, FLIGHTS_INDEX_EXT);
+
+	return n;
+}
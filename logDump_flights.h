@@ -0,0 +1,57 @@
+/*
+ * logDump_flights.h
+ *
+ *  Flight detection and flight index for logDump (--flights and --flight options).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+A flight is a stretch of the log during which the motors run (MOT_THROTTLE or any motor
+output above zero, with stops of up to FLIGHT_MAX_STOP seconds), which lasts at least
+FLIGHT_MIN_TIME seconds and over which the altitude (UKF_ALT, or GPS_HEIGHT if that is not
+logged) changes by at least FLIGHT_MIN_CLIMB meters. Motor runs on the ground are skipped.
+
+The flights found in a log are saved to an index file next to it (<logfile>.flights) so
+they can be looked up without reading the log again. The index is only used while the size
+and modification time of the log match the ones it was made for.
+*/
+
+#ifndef LOGDUMP_FLIGHTS_H_
+#define LOGDUMP_FLIGHTS_H_
+
+#include "logger.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define FLIGHT_MIN_TIME			3.0			// seconds
+#define FLIGHT_MIN_CLIMB		1.0			// meters
+#define FLIGHT_MAX_STOP			2.0			// seconds
+#define FLIGHT_REC_RATE			200			// records per second assumed where LASTUPDATE is not usable
+#define FLIGHTS_INDEX_EXT		".flights"
+
+typedef struct {
+	uint32_t startRec, endRec;		// record numbers, as counted by logDump
+	long startPos, endPos;			// file offsets of the first and last packet
+	long schemaPos;					// file offset of the AqH header in effect at the start, -1 if none
+	double duration;				// seconds
+	double maxAlt;					// meters above the start altitude
+} logFlight_t;
+
+extern int logFlightsScan(loggerStream_t *s, logFlight_t **flights);
+extern int logFlightsLoad(const char *fname, const struct stat *st, logFlight_t **flights);
+extern bool logFlightsSave(const char *fname, const struct stat *st, const logFlight_t *flights, int n);
+extern int logFlightsIndex(const char *fname, loggerStream_t *s, logFlight_t **flights);
+
+#endif /* LOGDUMP_FLIGHTS_H_ */
@@ -0,0 +1,370 @@
+/*
+ * logDump_geofence.cc
+ *
+ *  Geofence checks for logDump (--geofence option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_geofence.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+// The edge loop needs SSE4.1 (or AVX2) to be vectorized, which baseline x86-64 does not
+// have; where it can, it is built for each and the best one for the CPU is used.
+#if defined (__linux__) && defined (__x86_64__) && defined (__GNUC__)
+	#define FENCE_TARGETS	__attribute__((target_clones("avx2", "sse4.1", "default")))
+#else
+	#define FENCE_TARGETS
+#endif
+
+// Finds the first <tag> element between s and end; returns its contents (up to *contentEnd),
+// and where its start tag starts in *tagStart, or NULL if there is none. Empty elements
+// (<tag/>) are skipped.
+static const char *fenceFind(const char *s, const char *end, const char *tag, const char **tagStart, const char **contentEnd) {
+	char open[64], close[64];
+	const char *p, *q;
+	int len;
+
+	snprintf(open, sizeof(open), "<%s", tag);
+	snprintf(close, sizeof(close), "</%s>", tag);
+	len = strlen(open);
+
+	for (p = s; (p = strstr(p, open)) && p < end; p += len) {
+		if (p[len] != '>' && !isspace((unsigned char)p[len]))
+			continue;
+		if (!(q = strchr(p, '>')) || q >= end)
+			return NULL;
+		if (q[-1] == '/')
+			continue;
+		if (!(*contentEnd = strstr(q + 1, close)) || *contentEnd > end)
+			return NULL;
+		if (tagStart)
+			*tagStart = p;
+		return q + 1;
+	}
+
+	return NULL;
+}
+
+// the contents of an element, without surrounding white space
+static char *fenceText(const char *s, const char *end) {
+	char *t;
+
+	while (s < end && isspace((unsigned char)*s))
+		s++;
+	while (end > s && isspace((unsigned char)end[-1]))
+		end--;
+	t = (char *)malloc(end - s + 1);
+	memcpy(t, s, end - s);
+	t[end - s] = 0;
+
+	return t;
+}
+
+// adds the edges of a ring of "lon,lat[,alt]" coordinates to a fence; returns the highest altitude
+static double fenceAddRing(logFence_t *f, const char *s, const char *end) {
+	double lat, lon, alt, maxAlt = -HUGE_VAL, firstLat = 0.0, firstLon = 0.0, lastLat = 0.0, lastLon = 0.0;
+	char *q;
+	int n = 0;
+
+	for (;;) {
+		while (s < end && isspace((unsigned char)*s))
+			s++;
+		if (s >= end)
+			break;
+		lon = strtod(s, &q);
+		if (q == s || *q != ',')
+			break;
+		s = q + 1;
+		lat = strtod(s, &q);
+		if (q == s)
+			break;
+		s = q;
+		alt = 0.0;
+		if (*s == ',') {
+			alt = strtod(s + 1, &q);
+			s = q;
+		}
+		if (alt > maxAlt)
+			maxAlt = alt;
+
+		if (n) {
+			f->lat0 = (double *)realloc(f->lat0, (f->numEdges + 2) * sizeof(double));
+			f->lon0 = (double *)realloc(f->lon0, (f->numEdges + 2) * sizeof(double));
+			f->lat1 = (double *)realloc(f->lat1, (f->numEdges + 2) * sizeof(double));
+			f->lon1 = (double *)realloc(f->lon1, (f->numEdges + 2) * sizeof(double));
+			f->lat0[f->numEdges] = lastLat;
+			f->lon0[f->numEdges] = lastLon;
+			f->lat1[f->numEdges] = lat;
+			f->lon1[f->numEdges] = lon;
+			f->numEdges++;
+		}
+		else {
+			firstLat = lat;
+			firstLon = lon;
+		}
+		lastLat = lat;
+		lastLon = lon;
+		n++;
+	}
+
+	// KML rings end with their first point; close those which do not
+	if (n > 2 && (lastLat != firstLat || lastLon != firstLon)) {
+		f->lat0[f->numEdges] = lastLat;
+		f->lon0[f->numEdges] = lastLon;
+		f->lat1[f->numEdges] = firstLat;
+		f->lon1[f->numEdges] = firstLon;
+		f->numEdges++;
+	}
+
+	return maxAlt;
+}
+
+// a fence from a <Polygon> element
+static bool fenceAddPolygon(logFenceSet_t *set, const char *name, const char *s, const char *end, double floor, double ceiling) {
+	logFence_t *f;
+	const char *b, *be, *c, *ce, *mode;
+	double maxAlt;
+	char *modeStr = NULL;
+	int i;
+
+	set->fences = (logFence_t *)realloc(set->fences, (set->numFences + 1) * sizeof(logFence_t));
+	f = &set->fences[set->numFences];
+	memset(f, 0, sizeof(logFence_t));
+
+	if ((mode = fenceFind(s, end, "altitudeMode", NULL, &ce)))
+		modeStr = fenceText(mode, ce);
+
+	if (!(b = fenceFind(s, end, "outerBoundaryIs", NULL, &be)) || !(c = fenceFind(b, be, "coordinates", NULL, &ce))) {
+		free(modeStr);
+		return false;
+	}
+	maxAlt = fenceAddRing(f, c, ce);
+	for (; (b = fenceFind(be, end, "innerBoundaryIs", NULL, &be)); )
+		if ((c = fenceFind(b, be, "coordinates", NULL, &ce)))
+			fenceAddRing(f, c, ce);
+	if (f->numEdges < 3) {
+		free(modeStr);
+		free(f->lat0);
+		free(f->lon0);
+		free(f->lat1);
+		free(f->lon1);
+		return false;
+	}
+
+	f->name = strdup(name);
+	f->relative = !(modeStr && !strcmp(modeStr, "absolute"));
+	f->floor = floor;
+	f->ceiling = ceiling;
+	if (isinf(ceiling) && modeStr && strcmp(modeStr, "clampToGround") && maxAlt != 0.0)
+		f->ceiling = maxAlt;
+	free(modeStr);
+
+	f->slope = (double *)malloc(f->numEdges * sizeof(double));
+	f->latMin = f->lonMin = HUGE_VAL;
+	f->latMax = f->lonMax = -HUGE_VAL;
+	for (i = 0; i < f->numEdges; i++) {
+		f->slope[i] = (f->lat1[i] != f->lat0[i]) ? (f->lon1[i] - f->lon0[i]) / (f->lat1[i] - f->lat0[i]) : 0.0;
+		f->latMin = fmin(f->latMin, f->lat0[i]);
+		f->latMax = fmax(f->latMax, f->lat0[i]);
+		f->lonMin = fmin(f->lonMin, f->lon0[i]);
+		f->lonMax = fmax(f->lonMax, f->lon0[i]);
+	}
+	set->numFences++;
+
+	return true;
+}
+
+bool logFenceLoad(const char *fname, logFenceSet_t *set) {
+	const char *p, *pe, *c, *ce, *d, *de, *t, *v, *ve, *bufEnd;
+	char *buf, *name, *dataName;
+	double floor, ceiling;
+	long len;
+	FILE *fp;
+
+	memset(set, 0, sizeof(logFenceSet_t));
+
+	if (!(fp = fopen(fname, "rb"))) {
+		fprintf(stderr, "logDump: cannot open geofence file '%s'\n", fname);
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	rewind(fp);
+	buf = (char *)malloc(len + 1);
+	len = fread(buf, 1, len, fp);
+	buf[len] = 0;
+	bufEnd = buf + len;
+	fclose(fp);
+
+	for (p = buf; (c = fenceFind(p, bufEnd, "Placemark", NULL, &pe)); p = pe) {
+		name = (t = fenceFind(c, pe, "name", NULL, &ce)) ? fenceText(t, ce) : strdup("");
+
+		// altitude limits given as data
+		floor = -HUGE_VAL;
+		ceiling = HUGE_VAL;
+		for (d = c; (v = fenceFind(d, pe, "Data", &t, &de)); d = de) {
+			if (!(dataName = (char *)strstr(t, "name=\"")) || dataName > v || !(v = fenceFind(v, de, "value", NULL, &ve)))
+				continue;
+			dataName += 6;
+			if (!strncmp(dataName, "floor\"", 6))
+				floor = atof(v);
+			else if (!strncmp(dataName, "ceiling\"", 8))
+				ceiling = atof(v);
+		}
+
+		for (d = c; (t = fenceFind(d, pe, "Polygon", NULL, &de)); d = de)
+			if (!fenceAddPolygon(set, name, t, de, floor, ceiling))
+				fprintf(stderr, "logDump: geofence '%s': skipped a polygon without an outer boundary\n", name);
+		free(name);
+	}
+	free(buf);
+
+	if (!set->numFences) {
+		fprintf(stderr, "logDump: no polygons in geofence file '%s'\n", fname);
+		return false;
+	}
+
+	set->lat = (double *)malloc(FENCE_BATCH * sizeof(double));
+	set->lon = (double *)malloc(FENCE_BATCH * sizeof(double));
+	set->idx = (int *)malloc(FENCE_BATCH * sizeof(int));
+	set->in = (int *)malloc(FENCE_BATCH * sizeof(int));
+
+	return true;
+}
+
+// Sets in[i] to 1 for each of the n positions which is inside the polygon of a fence. Each
+// edge which reaches the latitudes of the positions (latMin to latMax) is tested against all
+// of them, without branches so it is vectorized.
+FENCE_TARGETS static void fenceCrossings(const logFence_t *f, const double *lat, const double *lon, int n, double latMin, double latMax, int *in) {
+	double lat0, lat1, lon0, slope;
+	int e, i;
+
+	for (i = 0; i < n; i++)
+		in[i] = 0;
+
+	for (e = 0; e < f->numEdges; e++) {
+		lat0 = f->lat0[e];
+		lat1 = f->lat1[e];
+		if ((lat0 < latMin && lat1 < latMin) || (lat0 > latMax && lat1 > latMax))
+			continue;
+		lon0 = f->lon0[e];
+		slope = f->slope[e];
+		for (i = 0; i < n; i++)
+			in[i] ^= ((lat0 > lat[i]) != (lat1 > lat[i])) & (lon[i] < lon0 + (lat[i] - lat0) * slope);
+	}
+}
+
+void logFenceTest(logFenceSet_t *set, const double *lat, const double *lon, const double *altMsl, const double *altRel, int n, bool *inside) {
+	const logFence_t *f;
+	double latMin, latMax, alt;
+	int i, j, k, m;
+
+	for (i = 0; i < n; i++)
+		inside[i] = false;
+
+	for (j = 0; j < set->numFences; j++) {
+		f = &set->fences[j];
+
+		// the positions not yet inside, in the bounding box of the fence
+		latMin = HUGE_VAL;
+		latMax = -HUGE_VAL;
+		for (i = 0, m = 0; i < n; i++) {
+			if (inside[i] || lat[i] < f->latMin || lat[i] > f->latMax || lon[i] < f->lonMin || lon[i] > f->lonMax)
+				continue;
+			set->lat[m] = lat[i];
+			set->lon[m] = lon[i];
+			set->idx[m++] = i;
+			latMin = fmin(latMin, lat[i]);
+			latMax = fmax(latMax, lat[i]);
+		}
+		if (!m)
+			continue;
+
+		fenceCrossings(f, set->lat, set->lon, m, latMin, latMax, set->in);
+
+		for (k = 0; k < m; k++) {
+			if (!set->in[k])
+				continue;
+			i = set->idx[k];
+			alt = f->relative ? altRel[i] : altMsl[i];
+			if (!(alt > f->ceiling) && !(alt < f->floor))
+				inside[i] = true;
+		}
+	}
+}
+
+double logFenceExcursion(const logFenceSet_t *set, double lat, double lon, double altMsl, double altRel, int *fence) {
+	const logFence_t *f;
+	double best = HUGE_VAL, scale, cosLat, h, v, alt, ax, ay, dx, dy, len2, t;
+	int in, e, j;
+
+	scale = FENCE_EARTH_RADIUS * M_PI / 180.0;
+	cosLat = cos(lat * M_PI / 180.0);
+	*fence = -1;
+
+	for (j = 0; j < set->numFences; j++) {
+		f = &set->fences[j];
+
+		// horizontally: zero if inside, else to the nearest edge (on a plane at the position)
+		fenceCrossings(f, &lat, &lon, 1, lat, lat, &in);
+		h = in ? 0.0 : HUGE_VAL;
+		for (e = 0; !in && e < f->numEdges; e++) {
+			ax = (f->lon0[e] - lon) * cosLat * scale;
+			ay = (f->lat0[e] - lat) * scale;
+			dx = (f->lon1[e] - lon) * cosLat * scale - ax;
+			dy = (f->lat1[e] - lat) * scale - ay;
+			len2 = dx*dx + dy*dy;
+			t = (len2 > 0.0) ? -(ax*dx + ay*dy) / len2 : 0.0;
+			t = (t < 0.0) ? 0.0 : (t > 1.0 ? 1.0 : t);
+			h = fmin(h, hypot(ax + t*dx, ay + t*dy));
+		}
+
+		alt = f->relative ? altRel : altMsl;
+		v = (alt > f->ceiling) ? alt - f->ceiling : ((alt < f->floor) ? f->floor - alt : 0.0);
+
+		if (hypot(h, v) < best) {
+			best = hypot(h, v);
+			*fence = j;
+		}
+	}
+
+	return best;
+}
+
+void logFenceFree(logFenceSet_t *set) {
+	logFence_t *f;
+	int j;
+
+	for (j = 0; j < set->numFences; j++) {
+		f = &set->fences[j];
+		free(f->name);
+		free(f->lat0);
+		free(f->lon0);
+		free(f->lat1);
+		free(f->lon1);
+		free(f->slope);
+	}
+	free(set->fences);
+	free(set->lat);
+	free(set->lon);
+	free(set->idx);
+	free(set->in);
+	memset(set, 0, sizeof(logFenceSet_t));
+}
@@ -0,0 +1,76 @@
+/*
+ * logDump_geofence.h
+ *
+ *  Geofence checks for logDump (--geofence option): which GPS positions of a log are outside
+ *  the areas, with altitude limits, given as polygons in a KML file.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+The fences are the Polygons of the Placemarks of a KML file (inner boundaries are holes). A
+position inside any fence, and between its floor and ceiling, is inside; any other position
+is a breach. The ceiling of a fence is <Data name="ceiling"> of the ExtendedData of its
+Placemark or else, unless the altitude mode is clampToGround (the default), the highest
+altitude of its outer boundary; the floor is <Data name="floor">. Altitudes are meters
+above mean sea level with the absolute altitude mode, otherwise above the first position
+of the log. A fence without limits has no ceiling or floor.
+
+Positions are tested in batches, one fence at a time: those in the bounding box of the fence
+are gathered, then each edge of the fence (which reaches the latitudes of the batch) is
+tested against all of them at once, counting the crossings of a ray to the east (even-odd),
+in a loop without branches which the compiler vectorizes.
+
+Usage:
+	logFenceLoad(fname, &set);
+	logFenceTest(&set, lat, lon, altMsl, altRel, n, inside);
+	logFenceExcursion(&set, lat, lon, altMsl, altRel, &fence);
+	logFenceFree(&set);
+*/
+
+#ifndef LOGDUMP_GEOFENCE_H_
+#define LOGDUMP_GEOFENCE_H_
+
+#define FENCE_BATCH				4096		// positions tested at once
+#define FENCE_EARTH_RADIUS		6378137.0	// meters
+
+typedef struct {
+	char *name;
+	int numEdges;
+	double *lat0, *lon0, *lat1, *lon1;		// [numEdges] edge ends, degrees
+	double *slope;							// [numEdges] longitude change per degree of latitude
+	double latMin, latMax, lonMin, lonMax;
+	double floor, ceiling;					// meters, -HUGE_VAL and HUGE_VAL if not limited
+	bool relative;							// altitudes are above the start, not MSL
+} logFence_t;
+
+typedef struct {
+	logFence_t *fences;
+	int numFences;
+	double *lat, *lon;						// [FENCE_BATCH] positions in the bounding box of a fence
+	int *idx, *in;							// [FENCE_BATCH] their index in the batch, and crossings
+} logFenceSet_t;
+
+// reads the fences of a KML file; returns false (with a message) if there are none
+extern bool logFenceLoad(const char *fname, logFenceSet_t *set);
+
+// sets inside[i] for each of the n (up to FENCE_BATCH) positions which is inside a fence;
+// altitudes which are NaN (eg. not accurate) are not checked
+extern void logFenceTest(logFenceSet_t *set, const double *lat, const double *lon, const double *altMsl, const double *altRel, int n, bool *inside);
+
+// meters from a position to the nearest point inside a fence, and that fence
+extern double logFenceExcursion(const logFenceSet_t *set, double lat, double lon, double altMsl, double altRel, int *fence);
+
+extern void logFenceFree(logFenceSet_t *set);
+
+#endif /* LOGDUMP_GEOFENCE_H_ */
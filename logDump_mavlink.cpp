@@ -6,6 +6,8 @@
  */
 
 #include <string.h>
+#include <strings.h>
+#include <math.h>
 #include "logDump_mavlink.h"
 #include "logDump.h"
 #include "mavlink.h"
@@ -13,7 +15,25 @@
 mavlinkStruct_t mavlinkData;
 mavlink_system_t mavlink_system;
 
+static uint8_t mavOutBuf[MAVLOG_BUF_LEN];
+static int mavOutLen;
+
+static const char *mavlogNames[MAVLOG_NUM_MESSAGES] = {
+	"HEARTBEAT",
+	"SYS_STATUS",
+	"ATTITUDE",
+	"GPS_RAW_INT",
+	"SCALED_IMU",
+	"RC_CHANNELS_RAW",
+	"SERVO_OUTPUT_RAW"
+};
+
+// default rates, Hz
+static const double mavlogRates[MAVLOG_NUM_MESSAGES] = { 1, 2, 50, 5, 50, 10, 10 };
+
 void mavlinkInit(void) {
+	int i;
+
 	mavlinkData.wpCount = 0;
 	mavlinkData.wpCurrent = mavlinkData.wpCount + 1;
 
@@ -26,6 +46,32 @@ void mavlinkInit(void) {
 	mavlinkData.status = MAV_STATE_ACTIVE;
 	mavlinkData.idlePercent = 999;
 	mavlinkData.packetDrops = 0;
+
+	for (i = 0; i < MAVLOG_NUM_MESSAGES; i++) {
+		if (!mavlinkData.streamInterval[i])
+			mavlinkData.streamInterval[i] = 1e6 / mavlogRates[i];
+		mavlinkData.streamNext[i] = 0;
+		mavlinkData.streamCount[i] = 0;
+	}
+
+	mavlinkData.timeOffset = (uint64_t)towStartTime * 1000000;
+	mavlinkData.lastMicros = 0;
+	mavlinkData.timeSet = false;
+	mavOutLen = 0;
+}
+
+// set the rate of a message by name (--mav-rate); zero Hz leaves it out
+bool mavlinkSetRate(const char *name, double hz) {
+	int i;
+
+	for (i = 0; i < MAVLOG_NUM_MESSAGES; i++) {
+		if (!strcasecmp(name, mavlogNames[i])) {
+			mavlinkData.streamInterval[i] = (hz > 0) ? 1e6 / hz : -1;
+			return true;
+		}
+	}
+
+	return false;
 }
 
 void mavlinkWpReached(uint16_t seqId) {
@@ -36,166 +82,167 @@ void mavlinkWpAnnounceCurrent(uint16_t seqId) {
 	//mavlink_msg_mission_current_send(MAVLINK_COMM_0, seqId);
 }
 
-void mavlogWritePacket(mavlink_message_t *msg, uint64_t ts) {
-	uint8_t buf[mavBufLen];
-
-//	printf("ts: %llu; len: %d; seq: %d; sysid: %d; compid: %d; magic: %d; msgid: %d; payload: %llu; chk: %lu\n",
-//			ts, msg->len, msg->seq, msg->sysid, msg->compid, msg->magic, msg->msgid, msg->payload64, msg->checksum);
-	memcpy(buf, (void*)&ts, sizeof(uint64_t));
-	//memcpy(buf+sizeof(uint64_t), (const mavlink_message_t *)msg, MAVLINK_NUM_NON_PAYLOAD_BYTES + msg->len);
-	int buflen = mavlink_msg_to_send_buffer(buf+sizeof(uint64_t), msg);
-	fwrite(buf, sizeof(uint8_t), sizeof(buf), outFP);
-	fflush(outFP);
-	memset(msg->payload64, 0x0, sizeof(msg->payload64));
+// write the buffered packets to outFP; returns false on a write error
+bool mavlinkFlush(void) {
+	bool ok = (fwrite(mavOutBuf, 1, mavOutLen, outFP) == (size_t)mavOutLen);
+
+	mavOutLen = 0;
+
+	return ok;
+}
+
+// Buffers one tlog entry of message m: a big endian timestamp (micros since 1970) followed by the packet.
+void mavlogWritePacket(mavlink_message_t *msg, uint64_t ts, int m) {
+	uint8_t *buf;
+	int i;
+
+	if (mavOutLen + mavBufLen > MAVLOG_BUF_LEN && !mavlinkFlush()) {
+		fprintf(stderr, "logDump: error writing MAVLink log\n");
+		exit(1);
+	}
+
+	buf = mavOutBuf + mavOutLen;
+	for (i = 0; i < 8; i++)
+		buf[i] = ts >> (56 - i * 8);
+
+	mavOutLen += sizeof(uint64_t) + mavlink_msg_to_send_buffer(buf + sizeof(uint64_t), msg);
+	mavlinkData.streamCount[m]++;
+}
+
+// is message m due at this time? (keeps to its rate, and starts over after a gap or LASTUPDATE reset)
+static bool mavlogDue(int m, double micros) {
+	double interval = mavlinkData.streamInterval[m];
+	double *next = &mavlinkData.streamNext[m];
+
+	if (interval <= 0 || (micros < *next && *next - micros <= interval))
+		return false;
+
+	*next = (micros >= *next && micros < *next + interval) ? *next + interval : micros + interval;
+
+	return true;
+}
+
+static int16_t mavlogInt16(double v) {
+	if (!(v == v))
+		return 0;
+	return (v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : (int16_t)v;
+}
+
+static uint16_t mavlogUint16(double v) {
+	if (!(v == v) || v < 0)
+		return 0;
+	return (v > UINT16_MAX) ? UINT16_MAX : (uint16_t)v;
 }
 
 void mavlinkDo(loggerRecord_t *l) {
-	// StatusType result;
 	mavlink_message_t msg;
-	uint16_t msgLen;
-	uint64_t ts = ((uint64_t)towStartTime*1000 + (uint64_t)logDumpGetValue(l, FLD_GPS_UTC_TIME)) * 1000;
 	double micros = logDumpGetValue(l, LOG_LASTUPDATE);
+	double itow = logDumpGetValue(l, FLD_GPS_UTC_TIME);
+	double vIn, yaw, veln, vele;
+	uint32_t millis = micros / 1000;
+	uint16_t v[8];
+	uint64_t ts;
+	int i, j;
+
+	// tlog time stamps follow LASTUPDATE, set from GPS time when it is first available
+	if (micros < mavlinkData.lastMicros)
+		mavlinkData.timeOffset += (uint64_t)(mavlinkData.lastMicros - micros) + 1000000 / AQ_LOGGING_FREQUENCY;
+	if (!mavlinkData.timeSet && itow > 0) {
+		mavlinkData.timeOffset = (uint64_t)towStartTime * 1000000 + (uint64_t)(itow * 1000) - (uint64_t)micros;
+		mavlinkData.timeSet = true;
+	}
+	mavlinkData.lastMicros = micros;
+	ts = mavlinkData.timeOffset + (uint64_t)micros;
+
+	if (mavlogDue(MAVLOG_HEARTBEAT, micros)) {
+		double modeChan = logDumpGetValue(l, LOG_RADIO_CHANNEL5);
+		if (modeChan < 250) 		// manual
+			mavlinkData.mode = MAV_MODE_FLAG_SAFETY_ARMED + MAV_MODE_FLAG_MANUAL_INPUT_ENABLED;
+		else if (modeChan > 250) 	// mission
+			mavlinkData.mode = MAV_MODE_FLAG_SAFETY_ARMED + MAV_MODE_FLAG_GUIDED_ENABLED;
+		else 						// pos/alt hold
+			mavlinkData.mode = MAV_MODE_FLAG_SAFETY_ARMED + MAV_MODE_FLAG_STABILIZE_ENABLED + MAV_MODE_FLAG_CUSTOM_MODE_ENABLED;
+
+		mavlink_msg_heartbeat_pack(mavlink_system.sysid, mavlink_system.compid, &msg, mavlink_system.type,
+				MAV_AUTOPILOT_GENERIC_WAYPOINTS_ONLY, mavlinkData.mode,
+				mavlinkData.nav_mode, mavlinkData.status);
+		mavlogWritePacket(&msg, ts, MAVLOG_HEARTBEAT);
+	}
 
-	//fprintf(stderr, "logDump: TIMESTAMP: %llu; START: %u; TOW: %lld\n", ts, towStartTime, (uint64_t)logDumpGetValue(l, GPS_UTC_TIME));
-
-	mavlinkData.status = MAV_STATE_ACTIVE;
+	if (mavlogDue(MAVLOG_SYS_STATUS, micros)) {
+		vIn = logDumpGetValue(l, LOG_ADC_VIN);
+		if (!vIn)
+			vIn = logDumpGetValue(l, LOG_VIN_PDB);
+		mavlink_msg_sys_status_pack(mavlink_system.sysid, mavlink_system.compid, &msg, 0, 0, 0,
+				1000 - mavlinkData.idlePercent, mavlogUint16(vIn * 1000), mavlogInt16(logDumpGetValue(l, LOG_CURRENT_PDB) * 100), -1,
+				0, mavlinkData.packetDrops, 0, 0, 0, 0);
+		mavlogWritePacket(&msg, ts, MAVLOG_SYS_STATUS);
+	}
 
-	double modeChan = logDumpGetValue(l, LOG_RADIO_CHANNEL5);
-	if (modeChan < 250) 		// manual
-		mavlinkData.mode = MAV_MODE_FLAG_SAFETY_ARMED + MAV_MODE_FLAG_MANUAL_INPUT_ENABLED;
-	else if (modeChan > 250) 	// mission
-		mavlinkData.mode = MAV_MODE_FLAG_SAFETY_ARMED + MAV_MODE_FLAG_GUIDED_ENABLED;
-	else 						// pos/alt hold
-		mavlinkData.mode = MAV_MODE_FLAG_SAFETY_ARMED + MAV_MODE_FLAG_STABILIZE_ENABLED + MAV_MODE_FLAG_CUSTOM_MODE_ENABLED;
+	if (mavlogDue(MAVLOG_ATTITUDE, micros)) {
+		yaw = logDumpGetValue(l, FLD_YAW);
+		if (yaw > 180)
+			yaw -= 360;
+		mavlink_msg_attitude_pack(mavlink_system.sysid, mavlink_system.compid, &msg, millis,
+				logDumpGetValue(l, FLD_ROLL) * DEG_TO_RAD, logDumpGetValue(l, FLD_PITCH) * DEG_TO_RAD, yaw * DEG_TO_RAD,
+				logDumpGetValue(l, LOG_IMU_RATEX), logDumpGetValue(l, LOG_IMU_RATEY), logDumpGetValue(l, LOG_IMU_RATEZ));
+		mavlogWritePacket(&msg, ts, MAVLOG_ATTITUDE);
+	}
 
-	// heartbeat
-	msgLen = mavlink_msg_heartbeat_pack(mavlink_system.sysid, mavlink_system.compid, &msg, mavlink_system.type,
-			MAV_AUTOPILOT_GENERIC_WAYPOINTS_ONLY, mavlinkData.mode,
-			mavlinkData.nav_mode, mavlinkData.status);
+	if (mavlogDue(MAVLOG_GPS_RAW_INT, micros)) {
+		veln = logDumpGetValue(l, LOG_GPS_VELN);
+		vele = logDumpGetValue(l, LOG_GPS_VELE);
+		yaw = atan2(vele, veln) * RAD_TO_DEG;
+		if (yaw < 0)
+			yaw += 360;
+		mavlink_msg_gps_raw_int_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros,
+				(logDumpGetValue(l, LOG_GPS_LAT) && logDumpGetValue(l, LOG_GPS_HACC) < MAVLOG_GPS_MAX_HACC) ? 3 : 1,
+				logDumpGetValue(l, LOG_GPS_LAT) * 1e7, logDumpGetValue(l, LOG_GPS_LON) * 1e7, logDumpGetValue(l, LOG_GPS_HEIGHT) * 1e3,
+				mavlogUint16(logDumpGetValue(l, LOG_GPS_HDOP) * 100), mavlogUint16(logDumpGetValue(l, LOG_GPS_VDOP) * 100),
+				mavlogUint16(sqrt(veln*veln + vele*vele) * 100), mavlogUint16(yaw * 100), 255);
+		mavlogWritePacket(&msg, ts, MAVLOG_GPS_RAW_INT);
+	}
 
-	mavlogWritePacket(&msg, ts);
-/*
-	// status
-	double vIn = logDumpGetValue(l, VIN);
-	msgLen = mavlink_msg_sys_status_pack(mavlink_system.sysid, mavlink_system.compid, &msg, 0, 0, 0,
-			1000 - mavlinkData.idlePercent, vIn * 1000, -1,
-			(vIn - 9.8f) / 12.6f * 1000, 0,
-			mavlinkData.packetDrops, 0, 0, 0, 0);
-
-	mavlogWritePacket(&msg, ts);
-
-
-	// raw acc, rate, mag sensors
-	mavlink_msg_scaled_imu_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros,
-			logDumpGetValue(l, ACCX) * 1000.0f, logDumpGetValue(l, ACCY) * 1000.0f, logDumpGetValue(l, ACCZ) * 1000.0f,
-			logDumpGetValue(l, RATEX) * 1000.0f, logDumpGetValue(l, RATEY) * 1000.0f, logDumpGetValue(l, RATEZ) * 1000.0f,
-			logDumpGetValue(l, MAGX) * 1000.0f, logDumpGetValue(l, MAGY) * 1000.0f, logDumpGetValue(l, MAGZ) * 1000.0f);
-
-	mavlogWritePacket(&msg, ts);
-
-	// pressure and temp
-	mavlink_msg_scaled_pressure_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros,
-			logDumpGetValue(l, PRESSURE1) * 0.01f, 0.0f, logDumpGetValue(l, TEMP1) * 100);
-
-	mavlogWritePacket(&msg, ts);
-
-
-	// position
-	mavlink_msg_gps_raw_int_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros,
-			3, logDumpGetValue(l, LAT) * 1e7, logDumpGetValue(l, LON) * 1e7,
-			logDumpGetValue(l, GPS_ALT) * 1e3, logDumpGetValue(l, AUX_RATEY), logDumpGetValue(l, AUX_RATEZ),
-			logDumpGetValue(l, GPS_H_SPEED), 65535, 255);
-		//	    mavlink_msg_gps_raw_send(MAVLINK_COMM_0, micros, 3, gpsData.lat, gpsData.lon, gpsData.height, gpsData.hDOP, gpsData.vDOP, gpsData.speed, gpsData.heading);
-
-	mavlogWritePacket(&msg, ts);
-
-	// rc channels
-	mavlink_msg_rc_channels_raw_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros, 0,
-			logDumpGetValue(l, RADIO_CHANNEL1) + 1024, logDumpGetValue(l, RADIO_CHANNEL2) + 1024, logDumpGetValue(l, RADIO_CHANNEL3) + 1024,
-			logDumpGetValue(l, RADIO_CHANNEL4) + 1024, logDumpGetValue(l, RADIO_CHANNEL5) + 1024, logDumpGetValue(l, RADIO_CHANNEL6) + 1024,
-			logDumpGetValue(l, RADIO_CHANNEL7) + 1024, logDumpGetValue(l, RADIO_CHANNEL8) + 1024, logDumpGetValue(l, RADIO_QUALITY));
-
-	mavlogWritePacket(&msg, ts);
-
-	// motor outputs
-	mavlink_msg_servo_output_raw_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros, 0,
-			logDumpGetValue(l, MOTOR1), logDumpGetValue(l, MOTOR2),
-			logDumpGetValue(l, MOTOR2), logDumpGetValue(l, MOTOR4),
-			logDumpGetValue(l, MOTOR5), logDumpGetValue(l, MOTOR6),
-			logDumpGetValue(l, MOTOR7), logDumpGetValue(l, MOTOR8));
-
-	mavlogWritePacket(&msg, ts);
-
-	mavlink_msg_servo_output_raw_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros, 1,
-			logDumpGetValue(l, MOTOR9), logDumpGetValue(l, MOTOR10),
-			logDumpGetValue(l, MOTOR11), logDumpGetValue(l, MOTOR12),
-			logDumpGetValue(l, MOTOR13), logDumpGetValue(l, MOTOR14),
-			0, 0);
-
-	mavlogWritePacket(&msg, ts);
-	*/
-	/*
-	// rc channels
-	else if ((mavlinkData.streamInterval[MAV_DATA_STREAM_ALL]
-			|| mavlinkData.streamInterval[MAV_DATA_STREAM_RC_CHANNELS])
-			&& mavlinkData.streamNext[MAV_DATA_STREAM_RC_CHANNELS]
-					< micros) {
-		mavlink_msg_rc_channels_raw_send(MAVLINK_COMM_0, micros, 0,
-				RADIO_THROT + 1024, RADIO_ROLL + 1024, RADIO_PITCH + 1024,
-				RADIO_RUDD + 1024, RADIO_GEAR + 1024, RADIO_FLAPS + 1024,
-				RADIO_AUX2 + 1024, RADIO_AUX3 + 1024, RADIO_QUALITY);
-		mavlink_msg_rc_channels_scaled_send(MAVLINK_COMM_0, micros, 0,
-				(RADIO_THROT - 750) * 13, RADIO_ROLL * 13, RADIO_PITCH * 13,
-				RADIO_RUDD * 13, RADIO_GEAR * 13, RADIO_FLAPS * 13,
-				RADIO_AUX2 * 13, RADIO_AUX3 * 13, RADIO_QUALITY);
-		mavlinkData.streamNext[MAV_DATA_STREAM_RC_CHANNELS] = micros
-				+ mavlinkData.streamInterval[MAV_DATA_STREAM_RC_CHANNELS];
+	// acc in mg, rates in mrad/s, mag in milli-units
+	if (mavlogDue(MAVLOG_SCALED_IMU, micros)) {
+		mavlink_msg_scaled_imu_pack(mavlink_system.sysid, mavlink_system.compid, &msg, millis,
+				mavlogInt16(logDumpGetValue(l, LOG_IMU_ACCX) / 9.80665 * 1000.0), mavlogInt16(logDumpGetValue(l, LOG_IMU_ACCY) / 9.80665 * 1000.0),
+				mavlogInt16(logDumpGetValue(l, LOG_IMU_ACCZ) / 9.80665 * 1000.0),
+				mavlogInt16(logDumpGetValue(l, LOG_IMU_RATEX) * 1000.0), mavlogInt16(logDumpGetValue(l, LOG_IMU_RATEY) * 1000.0),
+				mavlogInt16(logDumpGetValue(l, LOG_IMU_RATEZ) * 1000.0),
+				mavlogInt16(logDumpGetValue(l, LOG_IMU_MAGX) * 1000.0), mavlogInt16(logDumpGetValue(l, LOG_IMU_MAGY) * 1000.0),
+				mavlogInt16(logDumpGetValue(l, LOG_IMU_MAGZ) * 1000.0));
+		mavlogWritePacket(&msg, ts, MAVLOG_SCALED_IMU);
 	}
-	// raw controller
-	else if ((mavlinkData.streamInterval[MAV_DATA_STREAM_ALL]
-			|| mavlinkData.streamInterval[MAV_DATA_STREAM_RAW_CONTROLLER])
-			&& mavlinkData.streamNext[MAV_DATA_STREAM_RAW_CONTROLLER]
-					< micros) {
-		mavlink_msg_attitude_send(MAVLINK_COMM_0, micros,
-				AQ_ROLL * DEG_TO_RAD, AQ_PITCH * DEG_TO_RAD,
-				AQ_YAW * DEG_TO_RAD,
-				-(IMU_RATEX - UKF_GYO_BIAS_X) * DEG_TO_RAD,
-				(IMU_RATEY - UKF_GYO_BIAS_Y) * DEG_TO_RAD,
-				(IMU_RATEZ - UKF_GYO_BIAS_Z) * DEG_TO_RAD);
-		mavlink_msg_servo_output_raw_send(MAVLINK_COMM_0, micros, 0,
-				motorsData.value[0], motorsData.value[1],
-				motorsData.value[2], motorsData.value[3],
-				motorsData.value[4], motorsData.value[5],
-				motorsData.value[6], motorsData.value[7]);
-		mavlinkData.streamNext[MAV_DATA_STREAM_RAW_CONTROLLER] =
-				micros
-						+ mavlinkData.streamInterval[MAV_DATA_STREAM_RAW_CONTROLLER];
+
+	// radio channels 1-8 on port 0, 9-16 on port 1
+	if (mavlogDue(MAVLOG_RC_CHANNELS_RAW, micros)) {
+		for (i = 0; i < 2; i++) {
+			for (j = 0; j < 8; j++)
+				v[j] = mavlogUint16(logDumpGetValue(l, LOG_RADIO_CHANNEL0 + i*8 + j) + 1024);
+			mavlink_msg_rc_channels_raw_pack(mavlink_system.sysid, mavlink_system.compid, &msg, millis, i,
+					v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], logDumpGetValue(l, LOG_RADIO_QUALITY) * 2.55);
+			mavlogWritePacket(&msg, ts, MAVLOG_RC_CHANNELS_RAW);
+		}
 	}
 
-	// send pending notices
-	msg = CoAcceptQueueMail(mavlinkData.notices, &result);
-	if (result == E_OK)
-		mavlink_msg_statustext_send(MAVLINK_COMM_0, 0, (const char *) msg);
-
-	// list all parameters
-	if (mavlinkData.currentParam < mavlinkData.numParams
-			&& mavlinkData.nextParam < micros) {
-		mavlink_msg_param_value_send(MAVLINK_COMM_0,
-				configParameterStrings[mavlinkData.currentParam],
-				p[mavlinkData.currentParam], MAVLINK_TYPE_FLOAT,
-				mavlinkData.numParams, mavlinkData.currentParam);
-		mavlinkData.currentParam++;
-		mavlinkData.nextParam = micros + MAVLINK_PARAM_INTERVAL;
-	} else if (mavlinkData.wpCurrent < mavlinkData.wpCount
-			&& mavlinkData.wpNext < micros) {
-		mavlink_msg_mission_request_send(MAVLINK_COMM_0,
-				mavlinkData.wpTargetSysId, mavlinkData.wpTargetCompId,
-				mavlinkData.wpCurrent);
-		mavlinkData.wpNext = micros + MAVLINK_WP_TIMEOUT;
-	} else if (mavlinkData.wpCurrent == mavlinkData.wpCount) {
-		mavlink_msg_mission_ack_send(MAVLINK_COMM_0,
-				mavlinkData.wpTargetSysId, mavlinkData.wpTargetCompId, 0);
-		mavlinkData.wpCurrent++;
+	// motor outputs 1-8 on port 0, 9-14 on port 1
+	if (mavlogDue(MAVLOG_SERVO_OUTPUT_RAW, micros)) {
+		for (i = 0; i < 2; i++) {
+			for (j = 0; j < 8; j++)
+				v[j] = (i*8 + j < LOG_NUM_MOTORS) ? mavlogUint16(logDumpGetValue(l, LOG_MOT_MOTOR0 + i*8 + j)) : 0;
+			mavlink_msg_servo_output_raw_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros, i,
+					v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+			mavlogWritePacket(&msg, ts, MAVLOG_SERVO_OUTPUT_RAW);
+		}
 	}
-	*/
+}
+
+// print the number of packets of each type written
+void mavlinkSummary(void) {
+	int i;
+
+	for (i = 0; i < MAVLOG_NUM_MESSAGES; i++)
+		if (mavlinkData.streamCount[i])
+			fprintf(stderr, "logDump: %u %s packets (%.4gHz)\n", mavlinkData.streamCount[i], mavlogNames[i], 1e6 / mavlinkData.streamInterval[i]);
 }
@@ -20,16 +20,30 @@ extern "C" {
 #define MAVLINK_WP_TIMEOUT		    1e6	    // 1 second
 #define MAVLINK_NOTICE_DEPTH		    20
 #define MAVLINK_PARAMID_LEN		    16
+#define MAVLOG_BUF_LEN			    (1<<20)  // tlog output buffer size
+#define MAVLOG_GPS_MAX_HACC		    10.0     // meters; worse GPS positions are sent as no fix
 //#define MAVLINK_USE_CONVENIENCE_FUNCTIONS
 
+// messages written to the tlog, each at its own rate
+enum mavlogMessages {
+	MAVLOG_HEARTBEAT = 0,
+	MAVLOG_SYS_STATUS,
+	MAVLOG_ATTITUDE,
+	MAVLOG_GPS_RAW_INT,
+	MAVLOG_SCALED_IMU,
+	MAVLOG_RC_CHANNELS_RAW,
+	MAVLOG_SERVO_OUTPUT_RAW,
+	MAVLOG_NUM_MESSAGES
+};
+
 typedef struct {
     unsigned long nextHeartbeat;
     unsigned long nextParam;
     unsigned int currentParam;
 
-    // TODO: pull actual count from header files
-//    unsigned long streamInterval[13];
-//    unsigned long streamNext[13];
+    double streamInterval[MAVLOG_NUM_MESSAGES];	// micros, zero if not sent
+    double streamNext[MAVLOG_NUM_MESSAGES];
+    uint32_t streamCount[MAVLOG_NUM_MESSAGES];
 
     // this is a temporary implementation until we adopt mavlink completely
     int numParams;
@@ -47,6 +61,10 @@ typedef struct {
 
     unsigned long lastCounter;
 
+    uint64_t timeOffset;		// added to LASTUPDATE to get the tlog timestamp (us since 1970)
+    double lastMicros;
+    bool timeSet;			// offset is based on GPS time
+
 } mavlinkStruct_t;
 
 static const int mavBufLen = MAVLINK_MAX_PACKET_LEN + sizeof(uint64_t);
@@ -55,9 +73,12 @@ extern mavlinkStruct_t mavlinkData;
 extern mavlink_system_t mavlink_system;
 
 extern void mavlinkInit(void);
+extern bool mavlinkSetRate(const char *name, double hz);
 extern void mavlinkWpReached(uint16_t seqId);
 extern void mavlinkWpAnnounceCurrent(uint16_t seqId);
 extern void mavlinkDo(loggerRecord_t *l);
+extern bool mavlinkFlush(void);
+extern void mavlinkSummary(void);
 //static inline void comm_send_ch(mavlink_channel_t chan, uint8_t ch) {}
 
 
@@ -0,0 +1,266 @@
+/*
+ * logDump_merge.cc
+ *
+ *  Merging of several log files in to one timeline for logDump.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_merge.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define MERGE_TAIL_LEN		(1L << 16)	// bytes read at the end of a log to find its end time
+
+// update the clock with the next record of its log
+static void mergeClockUpdate(logMergeClock_t *c, const loggerRecord_t *r) {
+	double itow = r->data[LOG_GPS_ITOW];
+	uint32_t stamp = (uint32_t)r->data[LOG_LASTUPDATE];
+	uint32_t dt = stamp - c->lastStamp;
+	double lu;
+
+	// unwrap the 32 bit micros clock; going back is a power cycle, which continues the time
+	// line at the normal logging rate
+	c->reset = (c->valid && dt > 0x80000000u);
+	if (c->reset) {
+		lu = stamp;
+		c->itowLastUpdate = lu - (c->time + MERGE_REC_PERIOD - c->itow) * 1000.0;
+	}
+	else {
+		lu = c->valid ? c->lastUpdate + dt : stamp;
+	}
+
+	if (itow > 0.0) {
+		itow += c->weekOffset;
+		if (c->valid && itow < c->itow - MERGE_GPS_WEEK / 2) {
+			c->weekOffset += MERGE_GPS_WEEK;
+			itow += MERGE_GPS_WEEK;
+		}
+		if (!c->valid || itow != c->itow) {
+			c->itow = itow;
+			c->itowLastUpdate = lu;
+			c->valid = true;
+		}
+	}
+
+	c->lastUpdate = lu;
+	c->lastStamp = stamp;
+	c->time = c->itow + (lu - c->itowLastUpdate) / 1000.0;
+}
+
+static int mergeRead(logMergeSource_t *s) {
+	s->pktType = loggerReadPacket(&s->stream, &s->rec);
+
+	if (s->pktType == 'M')
+		loggerDecodePacket(&s->stream.schema, s->stream.buf, &s->rec);
+	if (s->pktType != EOF)
+		mergeClockUpdate(&s->clock, &s->rec);
+
+	return s->pktType;
+}
+
+static bool mergeBefore(const logMergeSet_t *m, int a, int b) {
+	if (m->src[a].clock.time != m->src[b].clock.time)
+		return m->src[a].clock.time < m->src[b].clock.time;
+	return a < b;
+}
+
+static void mergeSiftDown(logMergeSet_t *m, int i) {
+	int c, tmp;
+
+	while ((c = 2 * i + 1) < m->heapLen) {
+		if (c + 1 < m->heapLen && mergeBefore(m, m->heap[c+1], m->heap[c]))
+			c++;
+		if (!mergeBefore(m, m->heap[c], m->heap[i]))
+			break;
+		tmp = m->heap[i];
+		m->heap[i] = m->heap[c];
+		m->heap[c] = tmp;
+		i = c;
+	}
+}
+
+// Finds the GPS time of the first record of the log (its start clock), given the end time of
+// the logs before it. Returns the end time of this log.
+static double mergeScan(logMergeSet_t *m, logMergeSource_t *s, double prevEnd) {
+	double elapsed = 0.0, itow;
+	uint32_t firstLu = 0, prevLu = 0, lu;
+	long tail;
+	int type = EOF, n = 0, i;
+
+	loggerStreamInit(&s->stream, s->stream.fp);
+	memset(&s->clock, 0, sizeof(s->clock));
+	memset(&s->start, 0, sizeof(s->start));
+
+	// read up to the first GPS time
+	while ((s->pktType = loggerReadPacket(&s->stream, &s->rec)) != EOF) {
+		if (s->pktType == 'M')
+			loggerDecodePacket(&s->stream.schema, s->stream.buf, &s->rec);
+
+		lu = (uint32_t)s->rec.data[LOG_LASTUPDATE];
+		if (!n++) {
+			type = s->pktType;
+			firstLu = prevLu = lu;
+			for (i = 0; i < LOG_NUM_IDS; i++)
+				m->fields[i] |= (type == 'L' || s->stream.schema.fieldIndex[i] >= 0);
+		}
+		elapsed += (lu - prevLu < 0x80000000u) ? lu - prevLu : MERGE_REC_PERIOD * 1000.0;
+		prevLu = lu;
+
+		if (s->rec.data[LOG_GPS_ITOW] > 0.0)
+			break;
+	}
+
+	if (!n)
+		return prevEnd;
+
+	s->start.valid = true;
+	s->start.lastUpdate = firstLu;
+	s->start.lastStamp = firstLu;
+	if (s->pktType == EOF) {
+		// no GPS time, the log follows the one before it
+		s->start.itow = prevEnd + MERGE_REC_PERIOD;
+		s->start.itowLastUpdate = firstLu;
+		s->start.time = s->start.itow;
+		fprintf(stderr, "logDump: %s has no GPS time, placed after the logs before it\n", s->fname);
+		return s->start.itow + elapsed / 1000.0;
+	}
+
+	// in the week nearest the first log with GPS time
+	itow = s->rec.data[LOG_GPS_ITOW];
+	if (!m->weekRefSet) {
+		m->weekRef = itow;
+		m->weekRefSet = true;
+	}
+	s->start.weekOffset = MERGE_GPS_WEEK * floor((m->weekRef - itow) / MERGE_GPS_WEEK + 0.5);
+
+	s->start.itow = itow + s->start.weekOffset;
+	s->start.itowLastUpdate = firstLu + elapsed;
+	s->start.time = s->start.itow - elapsed / 1000.0;
+
+	// end time, from the last records of the log
+	s->clock = s->start;
+	fseek(s->stream.fp, 0, SEEK_END);
+	tail = ftell(s->stream.fp) - MERGE_TAIL_LEN;
+	if (tail < s->stream.pktPos)
+		tail = s->stream.pktPos;
+	if (loggerStreamSync(&s->stream, tail, type))
+		while (mergeRead(s) != EOF)
+			;
+
+	return s->clock.time;
+}
+
+// Opens the n logs and reads the start of each one. Returns false if one cannot be opened.
+bool logMergeOpen(logMergeSet_t *m, char **fnames, int n) {
+	double end = 0.0, e;
+	FILE *fp;
+	int i;
+
+	memset(m, 0, sizeof(*m));
+	m->src = (logMergeSource_t *)calloc(n, sizeof(logMergeSource_t));
+	m->heap = (int *)calloc(n, sizeof(int));
+	m->n = n;
+
+	for (i = 0; i < n; i++) {
+		fprintf(stderr, "logDump: opening logfile: %s\n", fnames[i]);
+#if defined (__WIN32__)
+		fp = fopen(fnames[i], "rb");
+#else
+		fp = fopen(fnames[i], "r");
+#endif
+		if (!fp) {
+			fprintf(stderr, "logDump: cannot open logfile: %s\n", fnames[i]);
+			return false;
+		}
+
+		m->src[i].fname = fnames[i];
+		m->src[i].stream.fp = fp;
+		if ((e = mergeScan(m, &m->src[i], end)) > end)
+			end = e;
+	}
+
+	logMergeRewind(m);
+
+	return true;
+}
+
+// start reading all logs from the beginning again
+void logMergeRewind(logMergeSet_t *m) {
+	logMergeSource_t *s;
+	int i;
+
+	m->heapLen = 0;
+	m->started = false;
+
+	for (i = 0; i < m->n; i++) {
+		s = &m->src[i];
+		rewind(s->stream.fp);
+		loggerStreamInit(&s->stream, s->stream.fp);
+		s->clock = s->start;
+		s->offsetSet = false;
+		if (mergeRead(s) != EOF)
+			m->heap[m->heapLen++] = i;
+	}
+
+	for (i = m->heapLen / 2 - 1; i >= 0; i--)
+		mergeSiftDown(m, i);
+}
+
+// Reads the next record of the merged logs in to r, decoded; returns 'L', or EOF after the end of all logs.
+int logMergeNext(logMergeSet_t *m, loggerRecord_t *r) {
+	logMergeSource_t *s;
+	double lu;
+
+	if (!m->heapLen)
+		return EOF;
+
+	s = &m->src[m->heap[0]];
+	memcpy(r, &s->rec, sizeof(loggerRecord_t));
+
+	lu = s->clock.lastUpdate;
+	if (!m->started) {
+		m->startTime = s->clock.time;
+		m->startLastUpdate = lu;
+		m->started = true;
+	}
+	if (!s->offsetSet || s->clock.reset) {
+		s->lastUpdateOffset = floor((s->clock.time - m->startTime) * 1000.0 + m->startLastUpdate - lu + 0.5);
+		s->offsetSet = true;
+	}
+	r->data[LOG_LASTUPDATE] = lu + s->lastUpdateOffset;
+
+	if (mergeRead(s) == EOF)
+		m->heap[0] = m->heap[--m->heapLen];
+	mergeSiftDown(m, 0);
+
+	return 'L';
+}
+
+bool logMergeHasField(const logMergeSet_t *m, int field) {
+	return m->fields[field];
+}
+
+void logMergeClose(logMergeSet_t *m) {
+	int i;
+
+	for (i = 0; i < m->n; i++)
+		if (m->src[i].stream.fp)
+			fclose(m->src[i].stream.fp);
+	free(m->src);
+	free(m->heap);
+	m->n = m->heapLen = 0;
+}
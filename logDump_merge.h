@@ -0,0 +1,90 @@
+/*
+ * logDump_merge.h
+ *
+ *  Merging of several log files in to one timeline for logDump.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+Records are ordered by GPS time. GPS_ITOW only changes with each GPS solution and LASTUPDATE
+(the flight controller's microsecond timer) starts over at each power up, so the time of a
+record is the last GPS_ITOW seen plus the LASTUPDATE time passed since it changed. Records
+logged before the first GPS solution of a file are placed relative to that first solution;
+a file without any GPS time is placed right after the end of the files given before it.
+
+The files are read at the same time, one record ahead each, and the earliest record is
+returned next (a k-way merge), so memory use does not depend on the length of the logs.
+
+LASTUPDATE of the returned records is changed to run on continuously from the first
+record, across power cycles, wraps of its 32 bits (after about 71 minutes) and gaps between
+the files.
+
+GPS_ITOW starts over every week. A log is placed in the week nearest the start of the first
+log with GPS time, and the week is counted on within each log, so logs which cross a week
+rollover (or start on either side of one) keep the same time line.
+*/
+
+#ifndef LOGDUMP_MERGE_H_
+#define LOGDUMP_MERGE_H_
+
+#include "logger.h"
+#include <stdio.h>
+#include <stdint.h>
+
+#define MERGE_REC_PERIOD	5.0				// ms between records (200Hz) assumed across a LASTUPDATE reset
+#define MERGE_GPS_WEEK		604800000.0		// ms
+
+// GPS time of the records of one log
+typedef struct {
+	double itow;					// last GPS_ITOW (ms), continued across week rollover
+	double itowLastUpdate;			// LASTUPDATE (us) when it was seen
+	double lastUpdate;				// LASTUPDATE of the last record, continued across 32 bit wraps
+	uint32_t lastStamp;				// and as logged
+	double weekOffset;
+	double time;					// of the last record (ms)
+	bool valid;
+	bool reset;						// LASTUPDATE started over at the last record
+} logMergeClock_t;
+
+typedef struct {
+	const char *fname;
+	loggerStream_t stream;
+	loggerRecord_t rec;				// next record of this log
+	int pktType;					// of rec; EOF at end of log
+	logMergeClock_t clock;
+	logMergeClock_t start;			// clock at the first record
+	double lastUpdateOffset;		// added to LASTUPDATE of returned records
+	bool offsetSet;
+} logMergeSource_t;
+
+typedef struct {
+	logMergeSource_t *src;
+	int n;
+	int *heap;						// sources with records left, earliest first
+	int heapLen;
+	bool fields[LOG_NUM_IDS];		// logged in any of the files
+	bool started;
+	bool weekRefSet;
+	double weekRef;					// GPS time (ms) which the week of each log is chosen by
+	double startTime;				// GPS time and LASTUPDATE of the first record returned
+	double startLastUpdate;
+} logMergeSet_t;
+
+extern bool logMergeOpen(logMergeSet_t *m, char **fnames, int n);
+extern int logMergeNext(logMergeSet_t *m, loggerRecord_t *r);
+extern void logMergeRewind(logMergeSet_t *m);
+extern bool logMergeHasField(const logMergeSet_t *m, int field);
+extern void logMergeClose(logMergeSet_t *m);
+
+#endif /* LOGDUMP_MERGE_H_ */
@@ -0,0 +1,284 @@
+/*
+ * logDump_npy.cc
+ *
+ *  NumPy .npy/.npz export for logDump (-e npy and -e npz options).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_npy.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+static const char *npyDescr[] = {
+	"f8",		// LOG_TYPE_DOUBLE
+	"f4",		// LOG_TYPE_FLOAT
+	"u4",		// LOG_TYPE_U32
+	"i4",		// LOG_TYPE_S32
+	"u2",		// LOG_TYPE_U16
+	"i2",		// LOG_TYPE_S16
+	"u1",		// LOG_TYPE_U8
+	"i1"		// LOG_TYPE_S8
+};
+
+static const int npySize[] = { 8, 4, 4, 4, 2, 2, 1, 1 };
+
+static uint32_t npzCrcTable[256];
+
+static void npyWriteHeader(logNpy_t *a) {
+	char hdr[NPY_HEADER_LEN];
+	uint16_t one = 1;
+	int len;
+
+	memset(hdr, ' ', sizeof(hdr));
+	memcpy(hdr, "\x93NUMPY\x01\x00", 8);
+	hdr[8] = (NPY_HEADER_LEN - 10) & 0xff;
+	hdr[9] = (NPY_HEADER_LEN - 10) >> 8;
+
+	len = sprintf(hdr + 10, "{'descr': '%c%s', 'fortran_order': False, 'shape': (%llu,), }",
+		(npySize[a->type] == 1) ? '|' : (*(char *)&one ? '<' : '>'), npyDescr[a->type], (unsigned long long)a->n);
+	hdr[10 + len] = ' ';
+	hdr[NPY_HEADER_LEN - 1] = '\n';
+
+	fwrite(hdr, 1, sizeof(hdr), a->fp);
+}
+
+static void npyFlush(logNpy_t *a) {
+	fwrite(a->buf, npySize[a->type], a->bufLen, a->fp);
+	a->bufLen = 0;
+}
+
+void logNpyOpen(logNpy_t *a, FILE *fp, int type) {
+	a->fp = fp;
+	a->type = (type >= LOG_TYPE_DOUBLE && type <= LOG_TYPE_S8) ? type : LOG_TYPE_DOUBLE;
+	a->n = 0;
+	a->bufLen = 0;
+
+	// shape is filled in at the end
+	npyWriteHeader(a);
+}
+
+void logNpyAppend(logNpy_t *a, double val) {
+	char *p = a->buf + a->bufLen * npySize[a->type];
+
+	if (a->type > LOG_TYPE_FLOAT && isnan(val))
+		val = 0.0;
+
+	switch (a->type) {
+		case LOG_TYPE_DOUBLE:
+			*(double *)p = val;
+			break;
+		case LOG_TYPE_FLOAT:
+			*(float *)p = val;
+			break;
+		case LOG_TYPE_U32:
+			*(uint32_t *)p = val;
+			break;
+		case LOG_TYPE_S32:
+			*(int32_t *)p = val;
+			break;
+		case LOG_TYPE_U16:
+			*(uint16_t *)p = val;
+			break;
+		case LOG_TYPE_S16:
+			*(int16_t *)p = val;
+			break;
+		case LOG_TYPE_U8:
+			*(uint8_t *)p = val;
+			break;
+		case LOG_TYPE_S8:
+			*(int8_t *)p = val;
+			break;
+	}
+
+	a->n++;
+	if (++a->bufLen == NPY_BUF_LEN)
+		npyFlush(a);
+}
+
+// Converts the values written so far to doubles, which hold any logged type, and goes on as a
+// double array. The file is rewritten in place, from the end, as doubles take at least as much
+// room as the values they replace. Returns false on a read or write error.
+bool logNpyToDouble(logNpy_t *a) {
+	double v[NPY_BUF_LEN];
+	uint64_t start, end, k;
+	int size = npySize[a->type];
+	bool ok = true;
+
+	if (a->type == LOG_TYPE_DOUBLE)
+		return true;
+
+	npyFlush(a);
+	for (end = a->n; ok && end > 0; end = start) {
+		start = (end > NPY_BUF_LEN) ? end - NPY_BUF_LEN : 0;
+		ok = (fseek(a->fp, NPY_HEADER_LEN + start * size, SEEK_SET) == 0 && fread(a->buf, size, end - start, a->fp) == end - start);
+		for (k = 0; ok && k < end - start; k++)
+			v[k] = loggerFieldValue(a->type, a->buf + k * size);
+		ok = ok && fseek(a->fp, NPY_HEADER_LEN + start * 8, SEEK_SET) == 0 && fwrite(v, 8, end - start, a->fp) == end - start;
+	}
+	a->type = LOG_TYPE_DOUBLE;
+
+	return ok && fseek(a->fp, NPY_HEADER_LEN + a->n * 8, SEEK_SET) == 0;
+}
+
+// write remaining values and the final header; returns false on a write error
+bool logNpyFinish(logNpy_t *a) {
+	npyFlush(a);
+	rewind(a->fp);
+	npyWriteHeader(a);
+	fflush(a->fp);
+
+	return !ferror(a->fp);
+}
+
+static uint32_t npzCrc(uint32_t crc, const unsigned char *p, size_t n) {
+	uint32_t c;
+	int i, k;
+
+	if (!npzCrcTable[1]) {
+		for (i = 0; i < 256; i++) {
+			c = i;
+			for (k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			npzCrcTable[i] = c;
+		}
+	}
+
+	crc = ~crc;
+	while (n--)
+		crc = npzCrcTable[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static void npzPut16(unsigned char *p, uint16_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void npzPut32(unsigned char *p, uint32_t v) {
+	npzPut16(p, v);
+	npzPut16(p + 2, v >> 16);
+}
+
+// Writes the finished arrays (which must be readable files) as <name>.npy entries of a
+// stored zip archive. Returns false after printing the reason on error.
+bool logNpzWrite(const char *fname, const char **names, logNpy_t *arrays, int n) {
+	unsigned char hdr[46], buf[1<<16];
+	uint32_t *crcs, *sizes, *offsets;
+	uint16_t dosTime, dosDate;
+	struct tm *tm;
+	time_t now;
+	size_t len;
+	long pos, dirPos, dirLen;
+	uint64_t total = 0;
+	char entry[300];
+	FILE *fp;
+	int i;
+
+	// offsets and sizes in the archive are 32 bits
+	for (i = 0; i < n; i++)
+		total += 30 + 46 + 2 * (strlen(names[i]) + 4) + NPY_HEADER_LEN + arrays[i].n * npySize[arrays[i].type];
+	if (total + 22 > 0xffffffffULL) {
+		fprintf(stderr, "logDump: the arrays are too large for an npz file (%.1f GB), use -e npy\n", total / 1073741824.0);
+		return false;
+	}
+
+	if (!(fp = fopen(fname, "wb+"))) {
+		fprintf(stderr, "logDump: cannot open output file '%s'\n", fname);
+		return false;
+	}
+
+	now = time(NULL);
+	tm = localtime(&now);
+	dosTime = (tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec / 2);
+	dosDate = ((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday;
+
+	crcs = (uint32_t *)calloc(n, sizeof(uint32_t));
+	sizes = (uint32_t *)calloc(n, sizeof(uint32_t));
+	offsets = (uint32_t *)calloc(n, sizeof(uint32_t));
+
+	for (i = 0; i < n; i++) {
+		snprintf(entry, sizeof(entry), "%s.npy", names[i]);
+		offsets[i] = ftell(fp);
+
+		// local file header; CRC and sizes are filled in after the data
+		memset(hdr, 0, 30);
+		npzPut32(hdr, 0x04034b50);
+		npzPut16(hdr + 4, 10);
+		npzPut16(hdr + 10, dosTime);
+		npzPut16(hdr + 12, dosDate);
+		npzPut16(hdr + 26, strlen(entry));
+		fwrite(hdr, 1, 30, fp);
+		fwrite(entry, 1, strlen(entry), fp);
+
+		rewind(arrays[i].fp);
+		while ((len = fread(buf, 1, sizeof(buf), arrays[i].fp)) > 0) {
+			crcs[i] = npzCrc(crcs[i], buf, len);
+			sizes[i] += len;
+			fwrite(buf, 1, len, fp);
+		}
+
+		pos = ftell(fp);
+		fseek(fp, offsets[i] + 14, SEEK_SET);
+		npzPut32(hdr, crcs[i]);
+		npzPut32(hdr + 4, sizes[i]);
+		npzPut32(hdr + 8, sizes[i]);
+		fwrite(hdr, 1, 12, fp);
+		fseek(fp, pos, SEEK_SET);
+	}
+
+	// central directory
+	dirPos = ftell(fp);
+	for (i = 0; i < n; i++) {
+		snprintf(entry, sizeof(entry), "%s.npy", names[i]);
+		memset(hdr, 0, 46);
+		npzPut32(hdr, 0x02014b50);
+		npzPut16(hdr + 4, 20);
+		npzPut16(hdr + 6, 10);
+		npzPut16(hdr + 12, dosTime);
+		npzPut16(hdr + 14, dosDate);
+		npzPut32(hdr + 16, crcs[i]);
+		npzPut32(hdr + 20, sizes[i]);
+		npzPut32(hdr + 24, sizes[i]);
+		npzPut16(hdr + 28, strlen(entry));
+		npzPut32(hdr + 42, offsets[i]);
+		fwrite(hdr, 1, 46, fp);
+		fwrite(entry, 1, strlen(entry), fp);
+	}
+	dirLen = ftell(fp) - dirPos;
+
+	// end of central directory record
+	memset(hdr, 0, 22);
+	npzPut32(hdr, 0x06054b50);
+	npzPut16(hdr + 8, n);
+	npzPut16(hdr + 10, n);
+	npzPut32(hdr + 12, dirLen);
+	npzPut32(hdr + 16, dirPos);
+	fwrite(hdr, 1, 22, fp);
+
+	free(crcs);
+	free(sizes);
+	free(offsets);
+
+	if (ferror(fp) | fclose(fp)) {
+		fprintf(stderr, "logDump: error writing output file '%s'\n", fname);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,55 @@
+/*
+ * logDump_npy.h
+ *
+ *  NumPy .npy/.npz export for logDump (-e npy and -e npz options).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+Each array is a one dimensional, little endian .npy (format version 1.0) file of the logged
+field type. The number of values is not known until the end of the log, so a fixed size header
+is written first and re-written by logNpyFinish() with the final shape. The header is padded to
+NPY_HEADER_LEN bytes, so the data is aligned for memory mapping. If the type of a field changes
+in the log (a new AqH header), logNpyToDouble() rewrites its array as doubles so far.
+
+An .npz file is an uncompressed (stored) zip archive of .npy files, which logNpzWrite() builds
+from finished arrays (usually spooled to temporary files). It has no ZIP64 records, so it must
+be smaller than 4 GB.
+*/
+
+#ifndef LOGDUMP_NPY_H_
+#define LOGDUMP_NPY_H_
+
+#include "logger.h"
+#include <stdio.h>
+#include <stdint.h>
+
+#define NPY_HEADER_LEN			128		// bytes, incl. magic string and version
+#define NPY_BUF_LEN				4096	// values buffered before writing
+
+typedef struct {
+	FILE *fp;
+	int type;							// LOG_TYPE_xxx
+	uint64_t n;							// values written
+	int bufLen;
+	char buf[NPY_BUF_LEN * 8];
+} logNpy_t;
+
+extern void logNpyOpen(logNpy_t *a, FILE *fp, int type);
+extern void logNpyAppend(logNpy_t *a, double val);
+extern bool logNpyToDouble(logNpy_t *a);
+extern bool logNpyFinish(logNpy_t *a);
+extern bool logNpzWrite(const char *fname, const char **names, logNpy_t *arrays, int n);
+
+#endif /* LOGDUMP_NPY_H_ */
@@ -0,0 +1,300 @@
+/*
+ * logDump_psd.cc
+ *
+ *  Power spectral density (Welch's method) and spectrograms for logDump (--psd and
+ *  --spectrogram options).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_psd.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+// work shared by the logPsdRun() threads
+typedef struct {
+	const logPsd_t *p;
+	float **cols;
+	int ncols;
+	int nseg, nblocks;
+	double *blockSums;				// [ncols][nblocks][bins]
+	float *spec;					// [ncols][nseg][bins], or NULL
+	int next;						// next work unit (column * nblocks + block)
+} psdJob_t;
+
+bool logPsdInit(logPsd_t *p, int n, double fs) {
+	double sumSq = 0.0;
+	int i;
+
+	memset(p, 0, sizeof(logPsd_t));
+
+	if (n < PSD_MIN_LEN || n > PSD_MAX_LEN || (n & (n - 1)) || !(fs > 0.0))
+		return false;
+
+	p->n = n;
+	p->bins = n / 2 + 1;
+	p->step = n / 2;
+	p->fs = fs;
+
+	p->window = (double *)calloc(n, sizeof(double));
+	for (i = 0; i < n; i++) {
+		p->window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / n);
+		sumSq += p->window[i] * p->window[i];
+	}
+	p->scale = 1.0 / (fs * sumSq);
+
+#ifdef HAS_FFTW
+	double *in = fftw_alloc_real(n);
+	fftw_complex *out = fftw_alloc_complex(p->bins);
+	p->plan = fftw_plan_dft_r2c_1d(n, in, out, FFTW_ESTIMATE);
+	fftw_free(in);
+	fftw_free(out);
+#else
+	int m = n / 2, bits = 0, j;
+
+	p->wr = (double *)calloc(m, sizeof(double));
+	p->wi = (double *)calloc(m, sizeof(double));
+	for (i = 0; i < m; i++) {
+		p->wr[i] = cos(2.0 * M_PI * i / n);
+		p->wi[i] = -sin(2.0 * M_PI * i / n);
+	}
+
+	while ((1 << bits) < m)
+		bits++;
+	p->rev = (int *)calloc(m, sizeof(int));
+	for (i = 0; i < m; i++) {
+		p->rev[i] = 0;
+		for (j = 0; j < bits; j++)
+			if (i & (1 << j))
+				p->rev[i] |= 1 << (bits - 1 - j);
+	}
+#endif
+
+	return true;
+}
+
+void logPsdWorkInit(const logPsd_t *p, logPsdWork_t *w) {
+#ifdef HAS_FFTW
+	w->in = fftw_alloc_real(p->n);
+	w->out = fftw_alloc_complex(p->bins);
+#else
+	w->in = (double *)calloc(p->n, sizeof(double));
+	w->re = (double *)calloc(p->n / 2, sizeof(double));
+	w->im = (double *)calloc(p->n / 2, sizeof(double));
+#endif
+	w->pow = (double *)calloc(p->bins, sizeof(double));
+}
+
+void logPsdWorkFree(logPsdWork_t *w) {
+#ifdef HAS_FFTW
+	fftw_free(w->in);
+	fftw_free(w->out);
+#else
+	free(w->in);
+	free(w->re);
+	free(w->im);
+#endif
+	free(w->pow);
+}
+
+#ifndef HAS_FFTW
+// in place complex FFT of the m = n/2 points in w->re/im (input in bit reversed order)
+static void psdFft(const logPsd_t *p, logPsdWork_t *w) {
+	int m = p->n / 2;
+	int len, half, stride, i, j, k;
+	double *re = w->re, *im = w->im;
+	double tr, ti, cr, ci;
+
+	for (len = 2; len <= m; len <<= 1) {
+		half = len / 2;
+		stride = p->n / len;		// twiddles of a length len FFT are every stride-th of the n point ones
+		for (i = 0; i < m; i += len) {
+			for (j = 0; j < half; j++) {
+				k = i + j;
+				cr = p->wr[j * stride];
+				ci = p->wi[j * stride];
+				tr = re[k + half] * cr - im[k + half] * ci;
+				ti = re[k + half] * ci + im[k + half] * cr;
+				re[k + half] = re[k] - tr;
+				im[k + half] = im[k] - ti;
+				re[k] += tr;
+				im[k] += ti;
+			}
+		}
+	}
+}
+#endif
+
+// Calculates the one-sided PSD of the n samples at x in to w->pow.
+void logPsdSegment(const logPsd_t *p, logPsdWork_t *w, const float *x) {
+	int n = p->n, m = n / 2;
+	double mean = 0.0, xr, xi;
+	int i;
+
+	for (i = 0; i < n; i++)
+		mean += x[i];
+	mean /= n;
+
+	for (i = 0; i < n; i++)
+		w->in[i] = (x[i] - mean) * p->window[i];
+
+#ifdef HAS_FFTW
+	fftw_execute_dft_r2c(p->plan, w->in, w->out);
+	for (i = 0; i < p->bins; i++) {
+		xr = w->out[i][0];
+		xi = w->out[i][1];
+		w->pow[i] = (xr * xr + xi * xi) * p->scale;
+	}
+#else
+	double er, ei, or_, oi;
+	int k;
+
+	// even samples as real, odd as imaginary parts
+	for (i = 0; i < m; i++) {
+		w->re[p->rev[i]] = w->in[2 * i];
+		w->im[p->rev[i]] = w->in[2 * i + 1];
+	}
+	psdFft(p, w);
+
+	// split Z in to the spectra of the even (E) and odd (O) samples: X(k) = E(k) + W^k * O(k)
+	w->pow[0] = (w->re[0] + w->im[0]) * (w->re[0] + w->im[0]) * p->scale;
+	w->pow[m] = (w->re[0] - w->im[0]) * (w->re[0] - w->im[0]) * p->scale;
+	for (k = 1; k < m; k++) {
+		er = 0.5 * (w->re[k] + w->re[m - k]);
+		ei = 0.5 * (w->im[k] - w->im[m - k]);
+		or_ = 0.5 * (w->im[k] + w->im[m - k]);
+		oi = -0.5 * (w->re[k] - w->re[m - k]);
+		xr = er + p->wr[k] * or_ - p->wi[k] * oi;
+		xi = ei + p->wr[k] * oi + p->wi[k] * or_;
+		w->pow[k] = (xr * xr + xi * xi) * p->scale;
+	}
+#endif
+
+	// one-sided: fold in the negative frequencies
+	for (i = 1; i < m; i++)
+		w->pow[i] *= 2.0;
+}
+
+static void *psdThread(void *arg) {
+	psdJob_t *job = (psdJob_t *)arg;
+	const logPsd_t *p = job->p;
+	logPsdWork_t w;
+	double *sum;
+	float *sp;
+	double t0;
+	int unit, col, blk, seg, last, k;
+
+	traceThreadName("spectrum", 0);
+	logPsdWorkInit(p, &w);
+
+	while ((unit = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->ncols * job->nblocks) {
+		t0 = TRACE_START();
+		col = unit / job->nblocks;
+		blk = unit % job->nblocks;
+		sum = job->blockSums + (long)unit * p->bins;
+
+		seg = blk * PSD_BLOCK_SEGS;
+		last = seg + PSD_BLOCK_SEGS;
+		if (last > job->nseg)
+			last = job->nseg;
+
+		for (; seg < last; seg++) {
+			logPsdSegment(p, &w, job->cols[col] + (long)seg * p->step);
+			for (k = 0; k < p->bins; k++)
+				sum[k] += w.pow[k];
+			if (job->spec) {
+				sp = job->spec + ((long)col * job->nseg + seg) * p->bins;
+				for (k = 0; k < p->bins; k++)
+					sp[k] = w.pow[k];
+			}
+		}
+		TRACE_SPAN("spectrum block", TRACE_DERIVE, t0);
+	}
+
+	logPsdWorkFree(&w);
+
+	return NULL;
+}
+
+// Calculates the PSD of each of the ncols series of nsamp samples in to psd[ncols][bins] and,
+// if spec is not NULL, their spectrograms in to spec[ncols][segments][bins].
+void logPsdRun(const logPsd_t *p, float **cols, int ncols, long nsamp, int numThreads, double *psd, float *spec) {
+	psdJob_t job;
+	pthread_t *threads;
+	double *sum;
+	int n, i, k;
+
+	memset(&job, 0, sizeof(job));
+	job.p = p;
+	job.cols = cols;
+	job.ncols = ncols;
+	job.nseg = logPsdSegments(p, nsamp);
+	job.nblocks = (job.nseg + PSD_BLOCK_SEGS - 1) / PSD_BLOCK_SEGS;
+	job.blockSums = (double *)calloc((long)ncols * job.nblocks * p->bins, sizeof(double));
+	job.spec = spec;
+
+	n = ncols * job.nblocks;
+	if (n > numThreads)
+		n = numThreads;
+
+	if (n < 2) {
+		psdThread(&job);
+	}
+	else {
+		threads = (pthread_t *)calloc(n, sizeof(pthread_t));
+		for (i = 0; i < n; i++) {
+			if (pthread_create(&threads[i], NULL, psdThread, &job)) {
+				fprintf(stderr, "logDump: cannot create thread\n");
+				exit(1);
+			}
+		}
+		for (i = 0; i < n; i++)
+			pthread_join(threads[i], NULL);
+		free(threads);
+	}
+
+	// mean over the segments, adding the blocks in order
+	memset(psd, 0, (long)ncols * p->bins * sizeof(double));
+	for (i = 0; i < ncols * job.nblocks; i++) {
+		sum = job.blockSums + (long)i * p->bins;
+		for (k = 0; k < p->bins; k++)
+			psd[(i / job.nblocks) * p->bins + k] += sum[k];
+	}
+	if (job.nseg)
+		for (i = 0; i < ncols * p->bins; i++)
+			psd[i] /= job.nseg;
+
+	free(job.blockSums);
+}
+
+void logPsdFree(logPsd_t *p) {
+	free(p->window);
+#ifdef HAS_FFTW
+	fftw_destroy_plan(p->plan);
+#else
+	free(p->wr);
+	free(p->wi);
+	free(p->rev);
+#endif
+}
+
+// in dB, with zero (eg. the DC bin after removing the mean) as a very small value
+double logPsdDb(double v) {
+	return 10.0 * log10(v > 1e-30 ? v : 1e-30);
+}
@@ -0,0 +1,92 @@
+/*
+ * logDump_psd.h
+ *
+ *  Power spectral density (Welch's method) and spectrograms for logDump (--psd and
+ *  --spectrogram options).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+A series of samples is cut in to segments of n samples (a power of 2) which overlap by half.
+The mean of each segment is removed, a (periodic) Hann window applied, and the FFT taken.
+The one-sided power spectral density of a segment is |X(k)|^2 / (fs * sum(w^2)), doubled
+for all bins but DC and Nyquist, in units^2/Hz. The PSD of the series is the mean over the
+segments; a spectrogram is the PSD of each segment. These are the same as the defaults of
+scipy.signal.welch() and spectrogram() with a Hann window and nperseg=n.
+
+The FFT is a radix-2 one of n/2 complex points, of the even and odd samples packed in to
+real and imaginary parts, split in to the n/2+1 bins of the real input. If logDump is built
+with FFTW (HAS_FFTW) that is used instead.
+
+Segments are processed in blocks by several threads. Block sums are added in order, so the
+results do not depend on the number of threads.
+
+Usage:
+	logPsdInit(&p, n, fs);
+	logPsdRun(&p, cols, ncols, nsamp, threads, psd, spec);
+	logPsdFree(&p);
+*/
+
+#ifndef LOGDUMP_PSD_H_
+#define LOGDUMP_PSD_H_
+
+#include <stdint.h>
+#ifdef HAS_FFTW
+	#include <fftw3.h>
+#endif
+
+#define PSD_DEF_LEN			1024		// default samples per segment
+#define PSD_MIN_LEN			16
+#define PSD_MAX_LEN			(1 << 20)
+#define PSD_BLOCK_SEGS		16			// segments per thread work unit
+#define PSD_PLOT_RANGE_DB	80.0		// dynamic range of spectrogram plots
+
+typedef struct {
+	int n;							// samples per segment
+	int bins;						// n/2 + 1
+	int step;						// samples between segment starts
+	double fs;						// sample rate, Hz
+	double scale;					// 1 / (fs * sum(w^2))
+	double *window;					// [n]
+#ifdef HAS_FFTW
+	fftw_plan plan;
+#else
+	double *wr, *wi;				// [n/2] exp(-2*pi*i*k/n)
+	int *rev;						// [n/2] bit reversed indexes
+#endif
+} logPsd_t;
+
+// per thread buffers
+typedef struct {
+	double *in;						// [n] windowed segment
+#ifdef HAS_FFTW
+	fftw_complex *out;				// [bins]
+#else
+	double *re, *im;				// [n/2]
+#endif
+	double *pow;					// [bins] PSD of the segment
+} logPsdWork_t;
+
+#define logPsdSegments(p, nsamp)	((nsamp) < (p)->n ? 0 : (int)(((nsamp) - (p)->n) / (p)->step + 1))
+#define logPsdFreq(p, k)			((double)(k) * (p)->fs / (p)->n)
+
+extern bool logPsdInit(logPsd_t *p, int n, double fs);
+extern void logPsdWorkInit(const logPsd_t *p, logPsdWork_t *w);
+extern void logPsdWorkFree(logPsdWork_t *w);
+extern void logPsdSegment(const logPsd_t *p, logPsdWork_t *w, const float *x);
+extern void logPsdRun(const logPsd_t *p, float **cols, int ncols, long nsamp, int numThreads, double *psd, float *spec);
+extern void logPsdFree(logPsd_t *p);
+extern double logPsdDb(double v);
+
+#endif /* LOGDUMP_PSD_H_ */
@@ -0,0 +1,355 @@
+/*
+ * logDump_pyramid.cc
+ *
+ *  Min/max/mean pyramids of log values for logDump (--pyramid option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_pyramid.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#define PYRAMID_VERSION		1
+
+// The pyramid file is this header, the field IDs (int32), then the bins of each field.
+typedef struct {
+	char magic[4];						// "AqPY"
+	uint32_t version;
+	int64_t size, mtime;				// of the log
+	uint32_t numRecords, shift, numFields, totalBins;
+} pyramidHeader_t;
+
+static char *pyramidFileName(const char *fname) {
+	char *pname = (char *)calloc(strlen(fname) + strlen(PYRAMID_EXT) + 1, sizeof(char));
+
+	strcpy(pname, fname);
+	strcat(pname, PYRAMID_EXT);
+
+	return pname;
+}
+
+// sets the levels of a pyramid of numRecords records
+static void pyramidLevels(logPyramid_t *p, uint32_t numRecords) {
+	uint32_t bins = (numRecords + (1 << PYRAMID_SHIFT) - 1) >> PYRAMID_SHIFT;
+
+	p->numRecords = numRecords;
+	p->numLevels = 0;
+	p->totalBins = 0;
+	do {
+		p->levelBins[p->numLevels] = bins;
+		p->levelStart[p->numLevels++] = p->totalBins;
+		p->totalBins += bins;
+		bins = (bins + 1) / 2;
+	} while (p->levelBins[p->numLevels-1] > 1 && p->numLevels < PYRAMID_MAX_LEVELS);
+}
+
+// records in bin b of a level
+static inline uint32_t pyramidBinRecords(const logPyramid_t *p, int level, uint32_t b) {
+	uint32_t size = 1U << (PYRAMID_SHIFT + level);
+	uint32_t start = b << (PYRAMID_SHIFT + level);
+
+	return (p->numRecords - start < size) ? p->numRecords - start : size;
+}
+
+// adds bin b of a level to a sum (min, max, and the total in mean), with the records in it
+static inline void pyramidAdd(const logPyramid_t *p, const logPyramidBin_t *bins, int level, uint32_t b, logPyramidBin_t *sum, double *total, uint32_t *count) {
+	const logPyramidBin_t *bin = &bins[p->levelStart[level] + b];
+	uint32_t n = pyramidBinRecords(p, level, b);
+
+	if (!*count || bin->min < sum->min)
+		sum->min = bin->min;
+	if (!*count || bin->max > sum->max)
+		sum->max = bin->max;
+	*total += (double)bin->mean * n;
+	*count += n;
+}
+
+static bool pyramidLoad(const char *pname, const struct stat *st, logPyramid_t *p) {
+	pyramidHeader_t h;
+	int32_t id;
+	uint32_t i;
+	bool ok;
+	FILE *fp;
+
+	if (!(fp = fopen(pname, "rb")))
+		return false;
+
+	ok = (fread(&h, sizeof(h), 1, fp) == 1 && !memcmp(h.magic, "AqPY", 4) && h.version == PYRAMID_VERSION &&
+		h.size == (int64_t)st->st_size && h.mtime == (int64_t)st->st_mtime && h.shift == PYRAMID_SHIFT && h.numFields <= LOG_NUM_IDS);
+	if (ok) {
+		pyramidLevels(p, h.numRecords);
+		ok = (p->totalBins == h.totalBins);
+	}
+	if (ok) {
+		p->fields = (logPyramidField_t *)calloc(h.numFields + 1, sizeof(logPyramidField_t));
+		for (i = 0; ok && i < h.numFields; i++) {
+			ok = (fread(&id, sizeof(id), 1, fp) == 1 && id >= 0 && id < LOG_NUM_IDS);
+			p->fields[i].field = id;
+		}
+		for (i = 0; ok && i < h.numFields; i++) {
+			p->fields[i].bins = (logPyramidBin_t *)malloc((p->totalBins + 1) * sizeof(logPyramidBin_t));
+			ok = (fread(p->fields[i].bins, sizeof(logPyramidBin_t), p->totalBins, fp) == p->totalBins);
+			p->numFields++;
+		}
+	}
+	fclose(fp);
+
+	if (!ok)
+		logPyramidFree(p);
+
+	return ok;
+}
+
+static bool pyramidSave(const char *pname, const struct stat *st, const logPyramid_t *p) {
+	pyramidHeader_t h;
+	int32_t id;
+	bool ok = true;
+	int i;
+	FILE *fp;
+
+	if (!(fp = fopen(pname, "wb")))
+		return false;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "AqPY", 4);
+	h.version = PYRAMID_VERSION;
+	h.size = st->st_size;
+	h.mtime = st->st_mtime;
+	h.numRecords = p->numRecords;
+	h.shift = PYRAMID_SHIFT;
+	h.numFields = p->numFields;
+	h.totalBins = p->totalBins;
+
+	ok = (fwrite(&h, sizeof(h), 1, fp) == 1);
+	for (i = 0; ok && i < p->numFields; i++) {
+		id = p->fields[i].field;
+		ok = (fwrite(&id, sizeof(id), 1, fp) == 1);
+	}
+	for (i = 0; ok && i < p->numFields; i++)
+		ok = (fwrite(p->fields[i].bins, sizeof(logPyramidBin_t), p->totalBins, fp) == p->totalBins);
+
+	return !(ferror(fp) | fclose(fp)) && ok;
+}
+
+// Adds the pyramids of n more fields, reading the log once (decoding only those fields) for
+// the first level and making each level after from the one before.
+static bool pyramidBuild(const char *fname, logPyramid_t *p, const int *ids, int n) {
+	loggerStream_t *s;
+	loggerRecord_t r;
+	logPyramidBin_t *bin;
+	logPyramidField_t *f;
+	double *sums;
+	uint32_t count = 0, binRecs = 0, numBins = 0, allocBins = 0, b, k, cnt;
+	int type, level, i;
+	FILE *fp;
+
+	if (!(fp = fopen(fname, "rb")))
+		return false;
+
+	s = (loggerStream_t *)malloc(sizeof(loggerStream_t));
+	loggerStreamInit(s, fp);
+	memset(&r, 0, sizeof(r));
+
+	p->fields = (logPyramidField_t *)realloc(p->fields, (p->numFields + n) * sizeof(logPyramidField_t));
+	f = &p->fields[p->numFields];
+	sums = (double *)calloc(n, sizeof(double));
+	for (i = 0; i < n; i++) {
+		f[i].field = ids[i];
+		f[i].bins = NULL;
+	}
+
+	// the first level
+	for (; (type = loggerReadPacket(s, &r)) != EOF; count++) {
+		if (type == 'M')
+			loggerDecodeFieldIds(&s->schema, s->buf, &r, ids, n);
+
+		if (!binRecs && numBins == allocBins) {
+			allocBins = allocBins ? allocBins * 2 : 4096;
+			for (i = 0; i < n; i++)
+				f[i].bins = (logPyramidBin_t *)realloc(f[i].bins, allocBins * sizeof(logPyramidBin_t));
+		}
+		for (i = 0; i < n; i++) {
+			bin = &f[i].bins[numBins];
+			if (!binRecs) {
+				bin->min = bin->max = r.data[ids[i]];
+				sums[i] = 0.0;
+			}
+			else if (r.data[ids[i]] < bin->min) {
+				bin->min = r.data[ids[i]];
+			}
+			else if (r.data[ids[i]] > bin->max) {
+				bin->max = r.data[ids[i]];
+			}
+			sums[i] += r.data[ids[i]];
+		}
+		if (++binRecs == (1U << PYRAMID_SHIFT)) {
+			for (i = 0; i < n; i++)
+				f[i].bins[numBins].mean = sums[i] / binRecs;
+			numBins++;
+			binRecs = 0;
+		}
+	}
+	if (binRecs) {
+		for (i = 0; i < n; i++)
+			f[i].bins[numBins].mean = sums[i] / binRecs;
+		numBins++;
+	}
+
+	free(sums);
+	free(s);
+	fclose(fp);
+
+	// the pyramids already there are of the same records (the log has not changed)
+	if (p->numFields && count != p->numRecords) {
+		for (i = 0; i < n; i++)
+			free(f[i].bins);
+		return false;
+	}
+	pyramidLevels(p, count);
+
+	// the other levels
+	for (i = 0; i < n; i++) {
+		f[i].bins = (logPyramidBin_t *)realloc(f[i].bins, (p->totalBins + 1) * sizeof(logPyramidBin_t));
+		for (level = 1; level < p->numLevels; level++) {
+			for (b = 0; b < p->levelBins[level]; b++) {
+				bin = &f[i].bins[p->levelStart[level] + b];
+				memset(bin, 0, sizeof(logPyramidBin_t));
+				double total = 0.0;
+				cnt = 0;
+				for (k = 2 * b; k < 2 * b + 2 && k < p->levelBins[level-1]; k++)
+					pyramidAdd(p, f[i].bins, level - 1, k, bin, &total, &cnt);
+				bin->mean = cnt ? total / cnt : 0.0;
+			}
+		}
+	}
+	p->numFields += n;
+
+	return true;
+}
+
+bool logPyramidIndex(const char *fname, const int *fields, int n, logPyramid_t *p) {
+	struct stat st;
+	char *pname;
+	int *missing;
+	int numMissing = 0, i, j;
+	bool ok = true;
+
+	memset(p, 0, sizeof(logPyramid_t));
+	if (stat(fname, &st))
+		return false;
+
+	pname = pyramidFileName(fname);
+	pyramidLoad(pname, &st, p);
+
+	missing = (int *)calloc(n + 1, sizeof(int));
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < p->numFields && p->fields[j].field != fields[i]; j++)
+			;
+		if (j < p->numFields)
+			continue;
+		for (j = 0; j < numMissing && missing[j] != fields[i]; j++)
+			;
+		if (j == numMissing)
+			missing[numMissing++] = fields[i];
+	}
+
+	if (numMissing) {
+		fprintf(stderr, "logDump: making min/max pyramids of %d values of %s\n", numMissing, fname);
+		if (!pyramidBuild(fname, p, missing, numMissing)) {
+			// the pyramid file is of another version of the log; start again
+			logPyramidFree(p);
+			ok = pyramidBuild(fname, p, fields, n);
+		}
+		if (ok && !pyramidSave(pname, &st, p))
+			fprintf(stderr, "logDump: cannot write pyramid file %s\n", pname);
+	}
+
+	free(missing);
+	free(pname);
+
+	return ok;
+}
+
+int logPyramidQuery(const logPyramid_t *p, int field, uint32_t rec0, uint32_t rec1, int width, logPyramidBin_t *bins, uint32_t *recs) {
+	const logPyramidField_t *f = NULL;
+	double perPart, total;
+	uint32_t start, end, lo, hi, cnt;
+	long last = -1;
+	int n = 0, level, x, i;
+
+	for (i = 0; i < p->numFields && !f; i++)
+		if (p->fields[i].field == field)
+			f = &p->fields[i];
+	if (!f)
+		return -1;
+
+	if (rec1 >= p->numRecords)
+		rec1 = p->numRecords - 1;
+	if (!p->numRecords || rec0 > rec1 || width < 1)
+		return 0;
+
+	perPart = (rec1 - rec0 + 1.0) / width;
+
+	for (x = 0; x < width; x++) {
+		start = rec0 + (uint32_t)(x * perPart);
+		end = rec0 + (uint32_t)((x + 1) * perPart);
+		end = (end > start) ? end - 1 : start;
+		if (end > rec1)
+			end = rec1;
+		lo = start >> PYRAMID_SHIFT;
+		hi = (end >> PYRAMID_SHIFT) + 1;
+
+		// parts smaller than a bin of the first level share it
+		if ((long)hi <= last + 1)
+			continue;
+		if ((long)lo <= last)
+			lo = last + 1;
+		last = hi - 1;
+		recs[n] = (lo << PYRAMID_SHIFT > start) ? lo << PYRAMID_SHIFT : start;
+
+		// bins [lo, hi) from the fewest bins of any level: the odd ones at the ends of a level,
+		// then the rest from the level above
+		total = 0.0;
+		cnt = 0;
+		for (level = 0; lo < hi; level++, lo >>= 1, hi >>= 1) {
+			if (level == p->numLevels - 1) {
+				for (; lo < hi; lo++)
+					pyramidAdd(p, f->bins, level, lo, &bins[n], &total, &cnt);
+				break;
+			}
+			if (lo & 1)
+				pyramidAdd(p, f->bins, level, lo++, &bins[n], &total, &cnt);
+			if (hi & 1)
+				pyramidAdd(p, f->bins, level, --hi, &bins[n], &total, &cnt);
+		}
+		bins[n++].mean = total / cnt;
+	}
+
+	return n;
+}
+
+void logPyramidFree(logPyramid_t *p) {
+	int i;
+
+	for (i = 0; i < p->numFields; i++)
+		free(p->fields[i].bins);
+	free(p->fields);
+	memset(p, 0, sizeof(logPyramid_t));
+}
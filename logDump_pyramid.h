@@ -0,0 +1,80 @@
+/*
+ * logDump_pyramid.h
+ *
+ *  Min/max/mean pyramids of log values for logDump (--pyramid option), to plot or print any
+ *  range of a long log at the level of detail of the output without reading the log again.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+The records of a log are taken in bins of 2^PYRAMID_SHIFT records (the first level), then
+of twice as many at each level, up to one bin for the whole log. Each bin of a field has
+the min, max and mean of the field over its records (the last bin of a level may have
+fewer). A range of records shown at a given width is split in as many parts, and each part
+is made of the fewest bins which cover it (at most two of each level), so the work is in
+proportion to the width, not to the records. Parts start and end on bins of the first level.
+
+The pyramids are saved next to the log (<logfile>.pyr) for the fields they were made for,
+and only used while the size and modification time of the log match the ones they were
+made for. Fields not yet in the file are added with one pass of the log, in which only
+those fields are decoded.
+
+Usage:
+	logPyramidIndex(fname, fields, n, &p);
+	logPyramidQuery(&p, field, rec0, rec1, width, bins, recs);
+	logPyramidFree(&p);
+*/
+
+#ifndef LOGDUMP_PYRAMID_H_
+#define LOGDUMP_PYRAMID_H_
+
+#include <stdint.h>
+
+#define PYRAMID_EXT				".pyr"
+#define PYRAMID_SHIFT			4			// records per bin of the first level: 2^PYRAMID_SHIFT
+#define PYRAMID_MAX_LEVELS		32
+#define PYRAMID_DEF_WIDTH		2000		// output points of a range, if not given
+
+typedef struct {
+	float min, max, mean;
+} logPyramidBin_t;
+
+typedef struct {
+	int field;								// LOG_ id
+	logPyramidBin_t *bins;					// [totalBins] the levels, one after the other
+} logPyramidField_t;
+
+typedef struct {
+	uint32_t numRecords;
+	int numLevels;
+	uint32_t levelBins[PYRAMID_MAX_LEVELS];	// bins of each level
+	uint32_t levelStart[PYRAMID_MAX_LEVELS];	// first bin of each level
+	uint32_t totalBins;
+	int numFields;
+	logPyramidField_t *fields;
+} logPyramid_t;
+
+// Gets the pyramids of the n fields of a log from its pyramid file, adding those not in it
+// (and saving the file again). Returns false if the log cannot be read.
+extern bool logPyramidIndex(const char *fname, const int *fields, int n, logPyramid_t *p);
+
+// Fills bins[] with the min, max and mean of a field over up to width equal parts of records
+// rec0 to rec1 (limited to the log), and recs[] with the first record of each. Returns the
+// number of parts: fewer than width if the bins of the first level are bigger than a part
+// (then such parts are taken together), or -1 if the field has no pyramid.
+extern int logPyramidQuery(const logPyramid_t *p, int field, uint32_t rec0, uint32_t rec1, int width, logPyramidBin_t *bins, uint32_t *recs);
+
+extern void logPyramidFree(logPyramid_t *p);
+
+#endif /* LOGDUMP_PYRAMID_H_ */
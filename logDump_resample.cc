@@ -0,0 +1,318 @@
+/*
+ * logDump_resample.cc
+ *
+ *  Timestamp based resampling of log records (--resample option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_resample.h"
+#include "logDump_fields.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+
+#define RESAMPLE_MASK		(RESAMPLE_RING - 1)
+
+static int resampleMode;
+static double resampleOutHz;
+static double resampleInHz;
+static double resamplePeriod;					// output period, micros
+static int resampleNumCh;
+static int resampleCh[LOG_NUM_IDS];				// field IDs of filtered/interpolated channels
+static int resampleHalfTaps;
+static double resampleTaps[2 * RESAMPLE_MAX_HALF_TAPS + 1];
+static double *resampleX;						// [RESAMPLE_RING][resampleNumCh] input channel values
+static double *resampleF;						// [RESAMPLE_RING][resampleNumCh] filtered values cache
+static double *resampleY;						// [resampleNumCh] interpolated output
+static int64_t resampleFIdx[RESAMPLE_RING];		// input index of filtered values in each cache row
+static int64_t resampleT[RESAMPLE_RING];		// input timestamps, micros (unwrapped)
+static loggerRecord_t *resampleRec;				// [RESAMPLE_RING] input records, for held values
+static uint32_t resampleLastStamp;
+static int64_t resampleT0;						// time of first input record, micros
+static int64_t resampleN;						// number of input records pushed
+static int64_t resampleCur;						// input index at or before next output time
+static int64_t resampleOutIdx;					// next output sample number
+static bool resampleDesigned;
+static bool resampleFlushing;
+static bool resampleRestart;					// resampleNext starts a new segment once the outputs so far are done
+static loggerRecord_t resampleNext;
+
+// values which are held (not filtered or interpolated)
+static bool resampleIsHeld(int field) {
+	if (field >= LOG_RADIO_CHANNEL0 && field <= LOG_RADIO_CHANNEL17)
+		return true;
+
+	switch (field) {
+		case LOG_LASTUPDATE:
+		case LOG_GPS_ITOW:
+		case LOG_GPS_POS_UPDATE:
+		case LOG_GPS_VEL_UPDATE:
+		case LOG_ADC_MAG_SIGN:
+		case LOG_RADIO_ERRORS:
+		case LOG_GMBL_TRIGGER:
+			return true;
+	}
+
+	return false;
+}
+
+void logResampleInit(int mode, double outHz, const int *fields, int n) {
+	int i;
+
+	resampleMode = mode;
+	resampleOutHz = outHz;
+	resamplePeriod = 1e6 / outHz;
+
+	resampleNumCh = 0;
+	for (i = 0; i < n; i++)
+		if (fields[i] < LOG_NUM_IDS && !resampleIsHeld(fields[i]))
+			resampleCh[resampleNumCh++] = fields[i];
+
+	free(resampleX);
+	free(resampleF);
+	free(resampleY);
+	free(resampleRec);
+	resampleX = (double *)calloc(RESAMPLE_RING * resampleNumCh + 1, sizeof(double));
+	resampleF = (double *)calloc(RESAMPLE_RING * resampleNumCh + 1, sizeof(double));
+	resampleY = (double *)calloc(resampleNumCh + 1, sizeof(double));
+	resampleRec = (loggerRecord_t *)calloc(RESAMPLE_RING, sizeof(loggerRecord_t));
+
+	logResampleReset();
+}
+
+void logResampleReset(void) {
+	resampleN = 0;
+	resampleCur = 0;
+	resampleOutIdx = 0;
+	resampleDesigned = false;
+	resampleFlushing = false;
+	resampleRestart = false;
+}
+
+double logResampleInputHz(void) {
+	return resampleInHz;
+}
+
+// measure input rate and design the anti-alias filter
+static void resampleDesign(void) {
+	double d[RESAMPLE_RATE_SAMPLES];
+	double ratio, fc, w, sum;
+	int n, k, m;
+
+	n = std::min(resampleN, (int64_t)RESAMPLE_RATE_SAMPLES) - 1;
+	for (k = 0; k < n; k++)
+		d[k] = resampleT[k+1] - resampleT[k];
+	if (n > 0) {
+		std::nth_element(d, d + n/2, d + n);
+		resampleInHz = 1e6 / d[n/2];
+	}
+	else
+		resampleInHz = AQ_LOGGING_FREQUENCY;
+
+	ratio = resampleInHz / resampleOutHz;
+
+	if (ratio > 1.0) {
+		// windowed-sinc low-pass (Blackman), cutoff at 80% of output Nyquist frequency
+		fc = 0.4 / ratio;
+		m = (int)ceil(14.0 * ratio);
+		if (m > RESAMPLE_MAX_HALF_TAPS) {
+			m = RESAMPLE_MAX_HALF_TAPS;
+			fprintf(stderr, "logDump: resampling %.0f:1 limits the anti-alias filter to %d taps, values above %.2fHz may alias\n",
+				ratio, 2 * m + 1, resampleOutHz / 2.0);
+		}
+		sum = 0.0;
+		for (k = -m; k <= m; k++) {
+			w = 0.42 + 0.5 * cos(M_PI * k / (m + 1)) + 0.08 * cos(2.0 * M_PI * k / (m + 1));
+			resampleTaps[k+m] = w * (k ? sin(2.0 * M_PI * fc * k) / (M_PI * k) : 2.0 * fc);
+			sum += resampleTaps[k+m];
+		}
+		for (k = 0; k <= 2*m; k++)
+			resampleTaps[k] /= sum;
+	}
+	else {
+		m = 0;
+		resampleTaps[0] = 1.0;
+	}
+
+	resampleHalfTaps = m;
+	resampleDesigned = true;
+}
+
+void logResamplePush(const loggerRecord_t *r) {
+	uint32_t stamp = (uint32_t)r->data[LOG_LASTUPDATE];
+	uint32_t dt;
+	double *x;
+	int row, c;
+
+	row = resampleN & RESAMPLE_MASK;
+
+	if (resampleN) {
+		// unwrap the 32 bit micros clock, drop repeated records
+		dt = stamp - resampleLastStamp;
+		if (dt == 0)
+			return;
+
+		// the clock went back (eg. the FC restarted): finish the outputs so far, then
+		// start a new segment, with its own T0, at this record
+		if (dt > 0x80000000u) {
+			if (!resampleDesigned)
+				resampleDesign();
+			resampleNext = *r;
+			resampleRestart = resampleFlushing = true;
+			return;
+		}
+		resampleT[row] = resampleT[(resampleN - 1) & RESAMPLE_MASK] + dt;
+	}
+	else
+		resampleT0 = resampleT[row] = stamp;
+
+	resampleLastStamp = stamp;
+	resampleRec[row] = *r;
+	resampleFIdx[row] = -1;
+	x = resampleX + row * resampleNumCh;
+	for (c = 0; c < resampleNumCh; c++)
+		x[c] = r->data[resampleCh[c]];
+
+	if (++resampleN == RESAMPLE_RATE_SAMPLES && !resampleDesigned)
+		resampleDesign();
+}
+
+void logResampleFlush(void) {
+	if (!resampleDesigned && resampleN)
+		resampleDesign();
+	resampleFlushing = true;
+}
+
+// filtered channel values at input index i (cached)
+static double *resampleFiltered(int64_t i) {
+	int row = i & RESAMPLE_MASK;
+	double *f = resampleF + row * resampleNumCh;
+	const double *x;
+	double h;
+	int64_t j, jmin, jmax;
+	int k, c;
+
+	if (resampleFIdx[row] == i)
+		return f;
+
+	jmin = std::max((int64_t)0, resampleN - RESAMPLE_RING);
+	jmax = resampleN - 1;
+
+	if (!resampleHalfTaps) {
+		memcpy(f, resampleX + row * resampleNumCh, resampleNumCh * sizeof(double));
+	}
+	else {
+		memset(f, 0, resampleNumCh * sizeof(double));
+		for (k = -resampleHalfTaps; k <= resampleHalfTaps; k++) {
+			j = std::min(std::max(i + k, jmin), jmax);
+			x = resampleX + (j & RESAMPLE_MASK) * resampleNumCh;
+			h = resampleTaps[k + resampleHalfTaps];
+			for (c = 0; c < resampleNumCh; c++)
+				f[c] += h * x[c];
+		}
+	}
+	resampleFIdx[row] = i;
+
+	return f;
+}
+
+bool logResamplePop(loggerRecord_t *r) {
+	const double *p0, *p1, *p2, *p3;
+	double u, norm;
+	int64_t tOut, ta, tb, need;
+	int c, i;
+
+	if (!resampleDesigned || !resampleN)
+		return false;
+
+	for (;;) {
+		tOut = resampleT0 + (int64_t)llround(resampleOutIdx * resamplePeriod);
+
+		// find the input records bracketing the output time
+		while (resampleCur + 1 < resampleN && resampleT[(resampleCur + 1) & RESAMPLE_MASK] <= tOut)
+			resampleCur++;
+		if (resampleCur + 1 >= resampleN) {
+			if (resampleRestart) {
+				resampleRestart = resampleFlushing = false;
+				resampleN = resampleCur = resampleOutIdx = 0;
+				logResamplePush(&resampleNext);
+			}
+			return false;
+		}
+
+		// wait for enough look-ahead for the filter and interpolator
+		need = resampleCur + (resampleMode == RESAMPLE_CUBIC ? 2 : 1) + resampleHalfTaps;
+		if (need >= resampleN && !resampleFlushing)
+			return false;
+
+		ta = resampleT[resampleCur & RESAMPLE_MASK];
+		tb = resampleT[(resampleCur + 1) & RESAMPLE_MASK];
+
+		// skip output times inside a gap in the log
+		if (tb - ta > RESAMPLE_MAX_GAP * 1e6 / resampleInHz) {
+			resampleOutIdx = (int64_t)ceil((tb - resampleT0) / resamplePeriod);
+			continue;
+		}
+		break;
+	}
+
+	u = (double)(tOut - ta) / (double)(tb - ta);
+	p1 = resampleFiltered(resampleCur);
+	p2 = resampleFiltered(resampleCur + 1);
+
+	if (resampleMode == RESAMPLE_CUBIC) {
+		// Catmull-Rom spline through the four nearest (filtered) samples
+		p0 = resampleFiltered(std::max(resampleCur - 1, std::max((int64_t)0, resampleN - RESAMPLE_RING)));
+		p3 = resampleFiltered(std::min(resampleCur + 2, resampleN - 1));
+		for (c = 0; c < resampleNumCh; c++)
+			resampleY[c] = p1[c] + 0.5 * u * (p2[c] - p0[c] + u * (2.0*p0[c] - 5.0*p1[c] + 4.0*p2[c] - p3[c] + u * (3.0*(p1[c] - p2[c]) + p3[c] - p0[c])));
+	}
+	else {
+		for (c = 0; c < resampleNumCh; c++)
+			resampleY[c] = p1[c] + u * (p2[c] - p1[c]);
+	}
+
+	// held values come from the record at or before the output time
+	*r = resampleRec[resampleCur & RESAMPLE_MASK];
+	for (c = 0; c < resampleNumCh; c++)
+		r->data[resampleCh[c]] = resampleY[c];
+	r->data[LOG_LASTUPDATE] = (uint32_t)tOut;
+
+	// interpolated quaternion needs to be re-normalized
+	norm = 0.0;
+	for (i = 0; i < 4; i++)
+		norm += r->data[LOG_UKF_Q1+i] * r->data[LOG_UKF_Q1+i];
+	if (norm > 0.0) {
+		norm = sqrt(norm);
+		for (i = 0; i < 4; i++)
+			r->data[LOG_UKF_Q1+i] /= norm;
+	}
+
+	// keep convenience arrays in sync
+	for (i = 0; i < 4; i++)
+		r->quat[i] = r->data[LOG_UKF_Q1+i];
+	for (i = 0; i < LOG_NUM_VOLTAGES; i++)
+		r->voltages[i] = r->data[LOG_VOLTAGE0+i];
+	for (i = 0; i < LOG_NUM_MOTORS; i++)
+		r->motors[i] = lrint(r->data[LOG_MOT_MOTOR0+i]);
+
+	resampleOutIdx++;
+
+	return true;
+}
@@ -0,0 +1,68 @@
+/*
+ * logDump_resample.h
+ *
+ *  Timestamp based resampling of log records (--resample option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+Output records are generated at exact multiples of the output period, measured on the
+LOG_LASTUPDATE clock (so missing records do not cause drift). When the output rate is below
+the logging rate, continuous values are first low-pass filtered with a windowed-sinc FIR
+(zero phase, cutoff below the output Nyquist frequency) to avoid aliasing. Values are then
+linearly or cubically (Catmull-Rom) interpolated at the output time.
+
+State-like values (timestamps, GPS update times, triggers, radio channels, etc.) are not
+filtered; they are taken from the last record at or before the output time.
+
+A record whose LOG_LASTUPDATE is earlier than that of the record before it (eg. after the
+flight controller restarted) starts a new segment: the outputs up to it are finished, and
+output times start again at that record. The filter designed for the first segment is kept.
+
+Usage:
+	logResampleInit(mode, outputHz, fieldIds, numFields);	// fields which are present in the log
+	for each record {
+		logResamplePush(&rec);
+		while (logResamplePop(&out))
+			...
+	}
+	logResampleFlush();
+	while (logResamplePop(&out))
+		...
+*/
+
+#ifndef LOGDUMP_RESAMPLE_H_
+#define LOGDUMP_RESAMPLE_H_
+
+#include "logger.h"
+
+#define RESAMPLE_RING			2048	// records of history kept (power of 2)
+#define RESAMPLE_MAX_HALF_TAPS	512		// max. FIR taps on each side of center
+#define RESAMPLE_RATE_SAMPLES	64		// records used to measure the input rate
+#define RESAMPLE_MAX_GAP		10		// don't interpolate across gaps of this many input periods
+
+enum resampleModes {
+	RESAMPLE_NONE = 0,
+	RESAMPLE_LINEAR,
+	RESAMPLE_CUBIC
+};
+
+extern void logResampleInit(int mode, double outHz, const int *fields, int n);
+extern void logResampleReset(void);
+extern void logResamplePush(const loggerRecord_t *r);
+extern void logResampleFlush(void);
+extern bool logResamplePop(loggerRecord_t *r);
+extern double logResampleInputHz(void);
+
+#endif /* LOGDUMP_RESAMPLE_H_ */
@@ -0,0 +1,390 @@
+/*
+ * logDump_server.cc
+ *
+ *  Query daemon for logDump (--daemon option) and its client (--server option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_fields.h"
+#include "logDump_server.h"
+#include "logDump_filter.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if !defined (__WIN32__)
+	#include <sys/socket.h>
+	#include <sys/un.h>
+#endif
+
+char *logServerSocketName(void) {
+	const char *dir = getenv("TMPDIR");
+	char *path;
+
+	if (!dir || !*dir)
+		dir = "/tmp";
+	path = (char *)calloc(strlen(dir) + strlen(SERVER_SOCKET_NAME) + 16, sizeof(char));
+#if defined (__WIN32__)
+	sprintf(path, "%s/" SERVER_SOCKET_NAME, dir, 0U);
+#else
+	sprintf(path, "%s/" SERVER_SOCKET_NAME, dir, (unsigned)getuid());
+#endif
+
+	return path;
+}
+
+#if defined (__WIN32__)
+
+int logServerListen(const char *path) {
+	fprintf(stderr, "logDump: --daemon is not supported on Windows\n");
+	return -1;
+}
+
+bool logServerAccept(int fd, FILE **in, FILE **out) {
+	return false;
+}
+
+bool logServerConnect(const char *path, FILE **in, FILE **out) {
+	fprintf(stderr, "logDump: --server is not supported on Windows\n");
+	return false;
+}
+
+#else
+
+static bool serverAddress(const char *path, struct sockaddr_un *addr) {
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "logDump: socket path too long: %s\n", path);
+		return false;
+	}
+	strcpy(addr->sun_path, path);
+
+	return true;
+}
+
+int logServerListen(const char *path) {
+	struct sockaddr_un addr;
+	mode_t mask;
+	int fd, ret;
+
+	if (!serverAddress(path, &addr))
+		return -1;
+
+	// a socket left by a daemon which has gone is replaced, a working one is not
+	if (!access(path, F_OK)) {
+		if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0 && !connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+			fprintf(stderr, "logDump: a daemon is already listening on %s\n", path);
+			close(fd);
+			return -1;
+		}
+		if (fd >= 0)
+			close(fd);
+		unlink(path);
+	}
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		fprintf(stderr, "logDump: cannot listen on %s\n", path);
+		return -1;
+	}
+
+	// only this user may connect, from the moment the socket exists
+	mask = umask(S_IRWXG | S_IRWXO);
+	ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+
+	if (ret || listen(fd, 16)) {
+		fprintf(stderr, "logDump: cannot listen on %s\n", path);
+		close(fd);
+		return -1;
+	}
+	chmod(path, S_IRUSR | S_IWUSR);
+
+	return fd;
+}
+
+// a stream to read and one to write a connection (stdio cannot do both on a socket)
+static bool serverStreams(int fd, FILE **in, FILE **out) {
+	int fd2 = dup(fd);
+
+	*in = fdopen(fd, "r");
+	*out = (fd2 >= 0) ? fdopen(fd2, "w") : NULL;
+	if (*in && *out)
+		return true;
+
+	if (*in)
+		fclose(*in);
+	else
+		close(fd);
+	if (fd2 >= 0 && !*out)
+		close(fd2);
+
+	return false;
+}
+
+bool logServerAccept(int fd, FILE **in, FILE **out) {
+	int c;
+
+	while ((c = accept(fd, NULL, NULL)) < 0)
+		if (errno != EINTR && errno != ECONNABORTED)
+			return false;
+
+	return serverStreams(c, in, out);
+}
+
+bool logServerConnect(const char *path, FILE **in, FILE **out) {
+	struct sockaddr_un addr;
+	int fd;
+
+	if (!serverAddress(path, &addr))
+		return false;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		fprintf(stderr, "logDump: no logDump --daemon listening on %s\n", path);
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+
+	return serverStreams(fd, in, out);
+}
+
+#endif
+
+bool logServerWriteRequest(FILE *fp, const logServerRequest_t *q) {
+	int i;
+
+	fprintf(fp, "log %s\nfields", q->log);
+	for (i = 0; i < q->numFields; i++) {
+		if (q->fields[i] < LOG_NUM_IDS)
+			fprintf(fp, " %.*s", (int)strcspn(loggerFieldLabels[q->fields[i]], " "), loggerFieldLabels[q->fields[i]]);
+		else
+			fprintf(fp, " %s", logDumpFieldNames[q->fields[i] - LOG_NUM_IDS - 1]);
+	}
+	fprintf(fp, "\nrange %u %u %u\n", q->rangeMin, q->rangeMax, q->divisor);
+	if (q->where)
+		fprintf(fp, "where %s\n", q->where);
+	switch (q->format) {
+		case SERVER_FMT_BIN:	fprintf(fp, "format bin\n");	break;
+		case ',':				fprintf(fp, "format csv\n");	break;
+		case '\t':				fprintf(fp, "format tab\n");	break;
+		default:				fprintf(fp, "format text\n");	break;
+	}
+	if (q->headers)
+		fprintf(fp, "headers\n");
+	if (q->stats)
+		fprintf(fp, "stats\n");
+	fprintf(fp, "\n");
+
+	return !fflush(fp);
+}
+
+bool logServerReadRequest(FILE *fp, logServerRequest_t *q, char *err, int errLen) {
+	char line[SERVER_MAX_LINE];
+	char *arg, *p;
+	int len, id;
+
+	memset(q, 0, sizeof(logServerRequest_t));
+	q->rangeMin = 1;
+	q->divisor = 1;
+	q->format = ',';
+	q->fields = (int *)calloc(NUM_FIELDS, sizeof(int));
+
+	while (fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\r\n")] = 0;
+		if (!*line)
+			break;
+
+		arg = line + strcspn(line, " ");
+		if (*arg)
+			*arg++ = 0;
+
+		if (!strcmp(line, "log")) {
+			free(q->log);
+			q->log = strdup(arg);
+		}
+		else if (!strcmp(line, "fields")) {
+			for (p = arg; *(p += strspn(p, " \t")); p += len) {
+				len = strcspn(p, " \t");
+				if ((id = logFilterFieldId(p, len)) < 0) {
+					snprintf(err, errLen, "unknown value '%.*s'", len, p);
+					return false;
+				}
+				if (q->numFields == NUM_FIELDS) {
+					snprintf(err, errLen, "too many fields, at most %d", NUM_FIELDS);
+					return false;
+				}
+				q->fields[q->numFields++] = id;
+			}
+		}
+		else if (!strcmp(line, "range")) {
+			if (sscanf(arg, "%u %u %u", &q->rangeMin, &q->rangeMax, &q->divisor) < 1 || !q->divisor) {
+				snprintf(err, errLen, "bad range '%s'", arg);
+				return false;
+			}
+		}
+		else if (!strcmp(line, "where")) {
+			free(q->where);
+			q->where = strdup(arg);
+		}
+		else if (!strcmp(line, "format")) {
+			if (!strcmp(arg, "bin"))
+				q->format = SERVER_FMT_BIN;
+			else if (!strcmp(arg, "csv"))
+				q->format = ',';
+			else if (!strcmp(arg, "tab"))
+				q->format = '\t';
+			else if (!strcmp(arg, "text"))
+				q->format = ' ';
+			else {
+				snprintf(err, errLen, "unknown format '%s'", arg);
+				return false;
+			}
+		}
+		else if (!strcmp(line, "headers")) {
+			q->headers = true;
+		}
+		else if (!strcmp(line, "stats")) {
+			q->stats = true;
+		}
+		else {
+			snprintf(err, errLen, "unknown query line '%s'", line);
+			return false;
+		}
+	}
+
+	if (!q->log || !q->numFields) {
+		snprintf(err, errLen, "a query needs a log and fields");
+		return false;
+	}
+
+	return true;
+}
+
+void logServerFreeRequest(logServerRequest_t *q) {
+	free(q->log);
+	free(q->fields);
+	free(q->where);
+	memset(q, 0, sizeof(logServerRequest_t));
+}
+
+static void serverCacheDrop(logServerCache_t *c, int i) {
+	logServerLog_t *l = &c->logs[i];
+	int j;
+
+	for (j = 0; j < LOG_NUM_IDS; j++)
+		free(l->cols[j]);
+	loggerFree(&l->log);
+	free(l->path);
+	c->bytes -= l->bytes;
+
+	c->logs[i] = c->logs[--c->numLogs];
+}
+
+// Lets go of the least recently used logs, other than keep, until the cache fits (and has
+// room for one more log if asked). Returns where keep is then.
+static logServerLog_t *serverCacheTrim(logServerCache_t *c, logServerLog_t *keep, bool room) {
+	int lru, i;
+
+	while (c->numLogs > 1 && (c->bytes > c->maxBytes || (room && c->numLogs == SERVER_MAX_LOGS))) {
+		lru = -1;
+		for (i = 0; i < c->numLogs; i++)
+			if (&c->logs[i] != keep && (lru < 0 || c->logs[i].lastUse < c->logs[lru].lastUse))
+				lru = i;
+		if (lru < 0)
+			break;
+		fprintf(stderr, "logDump: letting go of %s\n", c->logs[lru].path);
+		if (keep == &c->logs[c->numLogs-1])
+			keep = &c->logs[lru];
+		serverCacheDrop(c, lru);
+		room = false;
+	}
+
+	return keep;
+}
+
+logServerLog_t *logServerCacheGet(logServerCache_t *c, const char *path, const int *fields, int n, char *err, int errLen) {
+	logServerLog_t *l = NULL;
+	loggerRecord_t r;
+	struct stat st;
+	const char *p;
+	int ids[LOG_NUM_IDS], idx[LOG_NUM_IDS];
+	int numIds = 0, rec, i, j;
+
+	if (stat(path, &st)) {
+		snprintf(err, errLen, "cannot access log file %s", path);
+		return NULL;
+	}
+
+	for (i = 0; i < c->numLogs && !l; i++)
+		if (!strcmp(c->logs[i].path, path))
+			l = &c->logs[i];
+
+	// a log which has changed is read again
+	if (l && (l->size != (int64_t)st.st_size || l->mtime != (int64_t)st.st_mtime)) {
+		serverCacheDrop(c, l - c->logs);
+		l = NULL;
+	}
+
+	if (!l) {
+		serverCacheTrim(c, NULL, true);
+		l = &c->logs[c->numLogs];
+		memset(l, 0, sizeof(logServerLog_t));
+		if (!loggerReadLog(path, &l->log)) {
+			snprintf(err, errLen, "cannot read log file %s", path);
+			return NULL;
+		}
+		l->path = strdup(path);
+		l->size = st.st_size;
+		l->mtime = st.st_mtime;
+		l->bytes = (size_t)l->log.numRecords * l->log.schema.packetSize;
+		c->bytes += l->bytes;
+		c->numLogs++;
+		fprintf(stderr, "logDump: loaded %s, %d records\n", path, l->log.numRecords);
+	}
+	l->lastUse = ++c->clock;
+
+	// the columns not decoded yet, all in one sweep of the records
+	for (i = 0; i < n; i++) {
+		if (fields[i] < 0 || fields[i] >= LOG_NUM_IDS || l->cols[fields[i]] || l->log.schema.fieldIndex[fields[i]] < 0)
+			continue;
+		for (j = 0; j < numIds && ids[j] != fields[i]; j++)
+			;
+		if (j == numIds) {
+			idx[numIds] = l->log.schema.fieldIndex[fields[i]];
+			ids[numIds++] = fields[i];
+		}
+	}
+	if (numIds) {
+		for (j = 0; j < numIds; j++)
+			l->cols[ids[j]] = (double *)malloc((l->log.numRecords + 1) * sizeof(double));
+		memset(&r, 0, sizeof(r));
+		for (rec = 0; rec < l->log.numRecords; rec++) {
+			p = l->log.data + (long)rec * l->log.schema.packetSize;
+			for (j = 0; j < numIds; j++) {
+				loggerDecodeField(&l->log.schema, p, &r, idx[j]);
+				l->cols[ids[j]][rec] = r.data[ids[j]];
+			}
+		}
+		l->bytes += (size_t)numIds * l->log.numRecords * sizeof(double);
+		c->bytes += (size_t)numIds * l->log.numRecords * sizeof(double);
+	}
+
+	return serverCacheTrim(c, l, false);
+}
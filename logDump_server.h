@@ -0,0 +1,120 @@
+/*
+ * logDump_server.h
+ *
+ *  Query daemon for logDump (--daemon option) and its client (--server option): logs stay
+ *  loaded between queries so that repeated exports of the same logs need not read them again.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+The daemon listens on a UNIX domain socket (by default logDump-<uid>.sock in $TMPDIR or
+/tmp) and answers one query per connection. A query is a few lines of text, ended by an
+empty line:
+
+	log /full/path/of/logfile
+	fields IMU_ACCX IMU_ACCY ACC_MAGNITUDE
+	range 1 0 1						(first and last record, 0 for the end; every n-th record)
+	where MOT_THROTTLE > 0			(optional, as --where)
+	format bin|csv|tab|text
+	headers							(optional, a header row for csv, tab and text)
+	stats							(optional, as --stats)
+
+The answer is a line "OK <n>" with the number of records selected, or "ERR <message>". After
+OK comes the result: the --stats table (in csv for bin), or for bin a row of doubles (in the
+byte order of the machine) per selected record, otherwise the rows as text; and then a line
+"END <n>", so that a client can tell a whole answer from one cut short. So a query can also
+be sent with eg. socat or nc -U.
+
+The logs are kept with loggerReadLog() (at about their file size), and each field asked for
+is decoded once into a column of doubles. Logs are let go, least recently used first, when
+the cache is bigger than --cache-size, and loaded again when their size or modification
+time change.
+
+Usage:
+	fd = logServerListen(path);					(daemon)
+	logServerAccept(fd, &in, &out);
+	logServerReadRequest(in, &q, err, errLen);
+	log = logServerCacheGet(&cache, q.log, fields, n, err, errLen);
+	logServerFreeRequest(&q);
+
+	logServerConnect(path, &in, &out);			(client)
+	logServerWriteRequest(out, &q);
+*/
+
+#ifndef LOGDUMP_SERVER_H_
+#define LOGDUMP_SERVER_H_
+
+#include "logger.h"
+#include <stdio.h>
+#include <stdint.h>
+
+#define SERVER_SOCKET_NAME		"logDump-%u.sock"
+#define SERVER_DEF_CACHE_MB		1024		// --cache-size default
+#define SERVER_MAX_LOGS			256
+#define SERVER_MAX_LINE			4096		// longest line of a query
+
+#define SERVER_FMT_BIN			'b'		// format of an answer, other than the value separator of text
+
+typedef struct {
+	char *log;
+	int *fields;							// [numFields] as logFilterFieldId()
+	int numFields;
+	uint32_t rangeMin, rangeMax;			// records, rangeMax 0 for the end of the log
+	uint32_t divisor;						// every divisor-th record
+	char *where;							// NULL for all records
+	char format;							// SERVER_FMT_BIN, or ',' '\t' ' '
+	bool headers;
+	bool stats;
+} logServerRequest_t;
+
+typedef struct {
+	char *path;
+	int64_t size, mtime;
+	loggerLog_t log;
+	double *cols[LOG_NUM_IDS];				// [log.numRecords] decoded fields, NULL if not yet
+	size_t bytes;
+	uint64_t lastUse;
+} logServerLog_t;
+
+typedef struct {
+	logServerLog_t logs[SERVER_MAX_LOGS];
+	int numLogs;
+	size_t bytes, maxBytes;
+	uint64_t clock;
+} logServerCache_t;
+
+// the socket path for --daemon/--server without a name (allocated)
+extern char *logServerSocketName(void);
+
+// a listening socket, replacing a stale one; -1 (with a message) on error
+extern int logServerListen(const char *path);
+
+// the next connection to a listening socket; false on error
+extern bool logServerAccept(int fd, FILE **in, FILE **out);
+
+// a connection to the daemon; false (with a message) on error
+extern bool logServerConnect(const char *path, FILE **in, FILE **out);
+
+extern bool logServerWriteRequest(FILE *fp, const logServerRequest_t *q);
+
+// reads a query; returns false with err set if it is not understood
+extern bool logServerReadRequest(FILE *fp, logServerRequest_t *q, char *err, int errLen);
+
+extern void logServerFreeRequest(logServerRequest_t *q);
+
+// The log of path with the n logged fields decoded (other IDs are ignored), loaded or
+// brought up to date as needed. Returns NULL with err set if the log cannot be read.
+extern logServerLog_t *logServerCacheGet(logServerCache_t *c, const char *path, const int *fields, int n, char *err, int errLen);
+
+#endif /* LOGDUMP_SERVER_H_ */
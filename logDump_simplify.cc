@@ -0,0 +1,126 @@
+/*
+ * logDump_simplify.cc
+ *
+ *  Polyline simplification for GPS track exports (--simplify option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_simplify.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define SIMPLIFY_EARTH_RADIUS	6378137.0	// meters
+
+typedef struct {
+	double x, y, z;
+} simplifyVec_t;
+
+// distance from p to the segment a-b
+static double simplifySegDist(const simplifyVec_t *p, const simplifyVec_t *a, const simplifyVec_t *b) {
+	double dx, dy, dz, px, py, pz, len2, t;
+
+	dx = b->x - a->x;
+	dy = b->y - a->y;
+	dz = b->z - a->z;
+	px = p->x - a->x;
+	py = p->y - a->y;
+	pz = p->z - a->z;
+
+	len2 = dx*dx + dy*dy + dz*dz;
+	t = (len2 > 0.0) ? (px*dx + py*dy + pz*dz) / len2 : 0.0;
+	if (t < 0.0)
+		t = 0.0;
+	else if (t > 1.0)
+		t = 1.0;
+
+	px -= t * dx;
+	py -= t * dy;
+	pz -= t * dz;
+
+	return sqrt(px*px + py*py + pz*pz);
+}
+
+int logSimplify(const logSimplifyPt_t *pts, int n, double tolerance, bool *keep) {
+	simplifyVec_t *v;
+	int *stack;
+	double lat0, lon0, cosLat, d, dMax;
+	int sp, first, last, iMax, i, kept;
+
+	if (n <= 2) {
+		for (i = 0; i < n; i++)
+			keep[i] = true;
+		return n;
+	}
+
+	v = (simplifyVec_t *)malloc(n * sizeof(simplifyVec_t));
+	stack = (int *)malloc(2 * n * sizeof(int));
+
+	// local flat projection, in meters
+	lat0 = pts[0].lat * M_PI / 180.0;
+	lon0 = pts[0].lon * M_PI / 180.0;
+	cosLat = cos(lat0);
+	for (i = 0; i < n; i++) {
+		v[i].x = (pts[i].lon * M_PI / 180.0 - lon0) * cosLat * SIMPLIFY_EARTH_RADIUS;
+		v[i].y = (pts[i].lat * M_PI / 180.0 - lat0) * SIMPLIFY_EARTH_RADIUS;
+		v[i].z = pts[i].alt;
+		keep[i] = pts[i].fixed;
+	}
+	keep[0] = keep[n-1] = true;
+
+	// split at fixed points first, then subdivide each span
+	sp = 0;
+	first = 0;
+	for (i = 1; i < n; i++) {
+		if (keep[i]) {
+			stack[sp++] = first;
+			stack[sp++] = i;
+			first = i;
+		}
+	}
+
+	while (sp) {
+		last = stack[--sp];
+		first = stack[--sp];
+
+		dMax = 0.0;
+		iMax = 0;
+		for (i = first + 1; i < last; i++) {
+			d = simplifySegDist(&v[i], &v[first], &v[last]);
+			if (d > dMax) {
+				dMax = d;
+				iMax = i;
+			}
+		}
+
+		if (dMax > tolerance) {
+			keep[iMax] = true;
+			stack[sp++] = first;
+			stack[sp++] = iMax;
+			stack[sp++] = iMax;
+			stack[sp++] = last;
+		}
+	}
+
+	kept = 0;
+	for (i = 0; i < n; i++)
+		kept += keep[i];
+
+	free(stack);
+	free(v);
+
+	return kept;
+}
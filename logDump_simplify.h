@@ -0,0 +1,41 @@
+/*
+ * logDump_simplify.h
+ *
+ *  Polyline simplification for GPS track exports (--simplify option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+Douglas-Peucker simplification: of the points between two kept points, the one farthest from
+the straight line between them is kept if it is more than the tolerance away, and both halves
+are processed the same way. Distances are in meters, in 3D (latitude and longitude are
+projected on a plane tangent at the first point, which is accurate over the length of a track).
+
+The first and last points, and points marked as fixed (eg. trigger waypoints), are always kept.
+*/
+
+#ifndef LOGDUMP_SIMPLIFY_H_
+#define LOGDUMP_SIMPLIFY_H_
+
+typedef struct {
+	double lat, lon;			// degrees
+	double alt;					// meters
+	bool fixed;					// must be kept
+} logSimplifyPt_t;
+
+// sets keep[i] for each of the n points which is needed to stay within tolerance meters of the
+// original track; returns the number of points kept
+extern int logSimplify(const logSimplifyPt_t *pts, int n, double tolerance, bool *keep);
+
+#endif /* LOGDUMP_SIMPLIFY_H_ */
@@ -0,0 +1,225 @@
+/*
+ * logDump_stats.cc
+ *
+ *  Streaming per-field statistics for logDump (--stats option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "logDump_stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#define STATS_KLL_MIN_CAP		8		// smallest capacity of any sketch level
+
+typedef struct {
+	double val;
+	uint64_t weight;
+} statsWeighted_t;
+
+static bool statsWeightedLess(const statsWeighted_t &a, const statsWeighted_t &b) {
+	return a.val < b.val;
+}
+
+// capacity of level h; levels below the top shrink geometrically (by 2/3)
+static int statsKllCapacity(const logStatsKll_t *k, int h) {
+	int cap = (int)ceil(STATS_KLL_K * pow(2.0 / 3.0, k->numLevels - 1 - h));
+
+	return std::max(cap, STATS_KLL_MIN_CAP);
+}
+
+static void statsKllReserve(logStatsKll_t *k, int h, int n) {
+	if (n > k->alloc[h]) {
+		k->alloc[h] = std::max(n, 2 * k->alloc[h]);
+		k->items[h] = (double *)realloc(k->items[h], k->alloc[h] * sizeof(double));
+	}
+}
+
+static uint32_t statsKllRandom(logStatsKll_t *k) {
+	k->rnd ^= k->rnd << 13;
+	k->rnd ^= k->rnd >> 17;
+	k->rnd ^= k->rnd << 5;
+
+	return k->rnd;
+}
+
+// sort level h and promote every other item (from a random start) to the next level
+static void statsKllCompact(logStatsKll_t *k, int h) {
+	double *items;
+	int n, pairs, up, i;
+
+	if (h + 1 == k->numLevels) {
+		if (k->numLevels == STATS_KLL_MAX_LEVELS)
+			return;
+		k->numLevels++;
+	}
+
+	n = k->size[h];
+	pairs = n / 2;
+	up = k->size[h+1];
+	statsKllReserve(k, h+1, up + pairs);
+
+	items = k->items[h];
+	std::sort(items, items + n);
+	for (i = statsKllRandom(k) & 1; i < 2 * pairs; i += 2)
+		k->items[h+1][up++] = items[i];
+	k->size[h+1] = up;
+
+	// an odd item out stays at this level
+	if (n & 1)
+		items[0] = items[n-1];
+	k->size[h] = n & 1;
+}
+
+static void statsKllCompress(logStatsKll_t *k) {
+	bool done;
+	int h;
+
+	do {
+		done = true;
+		for (h = 0; h < k->numLevels; h++) {
+			if (k->size[h] >= statsKllCapacity(k, h)) {
+				statsKllCompact(k, h);
+				done = false;
+			}
+		}
+	} while (!done);
+}
+
+void logStatsInit(logStats_t *st, uint32_t seed) {
+	memset(st, 0, sizeof(logStats_t));
+	st->min = +INFINITY;
+	st->max = -INFINITY;
+	st->kll.numLevels = 1;
+	st->kll.rnd = seed ? seed : 0x9e3779b9;
+}
+
+void logStatsAdd(logStats_t *st, double val) {
+	logStatsKll_t *k = &st->kll;
+	double delta;
+	int h;
+
+	if (isnan(val))
+		return;
+
+	// Welford
+	st->n++;
+	delta = val - st->mean;
+	st->mean += delta / st->n;
+	st->m2 += delta * (val - st->mean);
+
+	if (val < st->min)
+		st->min = val;
+	if (val > st->max)
+		st->max = val;
+
+	statsKllReserve(k, 0, k->size[0] + 1);
+	k->items[0][k->size[0]++] = val;
+
+	// a compaction can only overflow the level above it
+	for (h = 0; h < k->numLevels && k->size[h] >= statsKllCapacity(k, h); h++)
+		statsKllCompact(k, h);
+}
+
+void logStatsMerge(logStats_t *st, const logStats_t *other) {
+	logStatsKll_t *k = &st->kll;
+	const logStatsKll_t *o = &other->kll;
+	double delta;
+	uint64_t n;
+	int h;
+
+	if (!other->n)
+		return;
+
+	// Chan et al. pairwise combination of mean and M2
+	n = st->n + other->n;
+	delta = other->mean - st->mean;
+	st->mean += delta * other->n / n;
+	st->m2 += other->m2 + delta * delta * ((double)st->n * other->n / n);
+	st->n = n;
+
+	st->min = std::min(st->min, other->min);
+	st->max = std::max(st->max, other->max);
+
+	k->numLevels = std::max(k->numLevels, o->numLevels);
+	for (h = 0; h < o->numLevels; h++) {
+		if (!o->size[h])
+			continue;
+		statsKllReserve(k, h, k->size[h] + o->size[h]);
+		memcpy(k->items[h] + k->size[h], o->items[h], o->size[h] * sizeof(double));
+		k->size[h] += o->size[h];
+	}
+	statsKllCompress(k);
+}
+
+// sample variance
+double logStatsVariance(const logStats_t *st) {
+	return (st->n > 1) ? st->m2 / (st->n - 1) : nan("");
+}
+
+double logStatsQuantile(const logStats_t *st, double q) {
+	const logStatsKll_t *k = &st->kll;
+	statsWeighted_t *w;
+	uint64_t total, cum;
+	double ret;
+	int h, i, n;
+
+	if (!st->n)
+		return nan("");
+	if (q <= 0.0)
+		return st->min;
+	if (q >= 1.0)
+		return st->max;
+
+	n = 0;
+	for (h = 0; h < k->numLevels; h++)
+		n += k->size[h];
+
+	w = (statsWeighted_t *)malloc(n * sizeof(statsWeighted_t));
+	n = 0;
+	total = 0;
+	for (h = 0; h < k->numLevels; h++) {
+		for (i = 0; i < k->size[h]; i++) {
+			w[n].val = k->items[h][i];
+			w[n].weight = (uint64_t)1 << h;
+			total += w[n++].weight;
+		}
+	}
+	std::sort(w, w + n, statsWeightedLess);
+
+	ret = st->max;
+	cum = 0;
+	for (i = 0; i < n; i++) {
+		cum += w[i].weight;
+		if (cum >= q * total) {
+			ret = w[i].val;
+			break;
+		}
+	}
+
+	free(w);
+
+	return ret;
+}
+
+void logStatsFree(logStats_t *st) {
+	int h;
+
+	for (h = 0; h < STATS_KLL_MAX_LEVELS; h++)
+		free(st->kll.items[h]);
+	memset(&st->kll, 0, sizeof(logStatsKll_t));
+}
@@ -0,0 +1,67 @@
+/*
+ * logDump_stats.h
+ *
+ *  Streaming per-field statistics for logDump (--stats option).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+Count, min, max, mean and variance are exact (Welford's running update). Percentiles come
+from a KLL quantile sketch which keeps at most a few hundred values per field no matter how
+long the log is; the rank error is typically well below 1%.
+
+Summaries of separate parts of a log (or of separate logs) can be merged with logStatsMerge(),
+so a log can be processed in chunks by several threads. Merging is order independent for the
+exact values; sketches merged in the same order give the same percentiles.
+
+Usage:
+	logStatsInit(&st, seed);
+	for each value
+		logStatsAdd(&st, val);
+	logStatsMerge(&total, &st);
+	p95 = logStatsQuantile(&total, 0.95);
+	logStatsFree(&st);
+*/
+
+#ifndef LOGDUMP_STATS_H_
+#define LOGDUMP_STATS_H_
+
+#include <stdint.h>
+
+#define STATS_KLL_K				400		// sketch size (accuracy) parameter
+#define STATS_KLL_MAX_LEVELS	48		// enough for 2^48 values
+
+typedef struct {
+	double *items[STATS_KLL_MAX_LEVELS];	// level h items each stand for 2^h values
+	int size[STATS_KLL_MAX_LEVELS];
+	int alloc[STATS_KLL_MAX_LEVELS];
+	int numLevels;
+	uint32_t rnd;							// xorshift state for compaction offsets
+} logStatsKll_t;
+
+typedef struct {
+	uint64_t n;
+	double min, max;
+	double mean, m2;						// running mean and sum of squared differences from it
+	logStatsKll_t kll;
+} logStats_t;
+
+extern void logStatsInit(logStats_t *st, uint32_t seed);
+extern void logStatsAdd(logStats_t *st, double val);
+extern void logStatsMerge(logStats_t *st, const logStats_t *other);
+extern double logStatsVariance(const logStats_t *st);
+extern double logStatsQuantile(const logStats_t *st, double q);
+extern void logStatsFree(logStats_t *st);
+
+#endif /* LOGDUMP_STATS_H_ */
@@ -0,0 +1,421 @@
+/*
+ * logInfo.cc
+ *
+ *  Quick summary of AutoQuad log files: duration, fields, records, GPS area, maximum
+ *  altitude, minimum voltage and flights.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+By default a log is not read through: after the header, records are read at a number of
+evenly spaced file offsets (finding the next packet from each with loggerStreamSync()),
+and the last record of the log. The record count comes from the file size, and the
+values and flights from the sampled records, so they are estimates (short flights and
+brief extremes can be missed). Flights are taken from an up to date flight index
+(<logfile>.flights, see logDump --flights) if there is one. With --exact every record
+is read and the flights are found as logDump does.
+*/
+
+#include "logger.h"
+#include "logDump_flights.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define INFO_DEF_SAMPLES	256				// records sampled per log
+#define INFO_GPS_MAX_HACC	10.0			// meters; less accurate positions are not in the GPS area
+#define INFO_MAX_RATE_ERR	4.0				// times the normal record rate a LASTUPDATE step may imply
+
+static const char *infoTypeNames[] = {"double", "float", "u32", "s32", "u16", "s16", "u8", "s8"};
+
+// fields read from each record
+static const int infoFieldIds[] = {
+	LOG_LASTUPDATE, LOG_GPS_LAT, LOG_GPS_LON, LOG_GPS_HACC, LOG_UKF_ALT, LOG_GPS_HEIGHT, LOG_ADC_VIN, LOG_VIN_PDB,
+	LOG_MOT_THROTTLE, LOG_MOT_MOTOR0, LOG_MOT_MOTOR1, LOG_MOT_MOTOR2, LOG_MOT_MOTOR3, LOG_MOT_MOTOR4, LOG_MOT_MOTOR5,
+	LOG_MOT_MOTOR6, LOG_MOT_MOTOR7, LOG_MOT_MOTOR8, LOG_MOT_MOTOR9, LOG_MOT_MOTOR10, LOG_MOT_MOTOR11, LOG_MOT_MOTOR12,
+	LOG_MOT_MOTOR13
+};
+#define INFO_NUM_FIELD_IDS	(int)(sizeof(infoFieldIds) / sizeof(int))
+
+typedef struct {
+	const char *fname;
+	long size;
+	int type;						// 'M' or 'L', 0 if no records found
+	loggerSchema_t schema;			// of the first header
+	long dataStart;					// file offset of the first record
+	long pktLen;					// bytes per record in the file
+	double records;
+	bool exact;
+	int altField, voltField;		// -1 if not logged
+	double duration;				// seconds
+	bool hasGps, hasAlt, hasVolt;
+	double latMin, latMax, lonMin, lonMax;
+	double maxAlt, minVolt;
+	int flights;
+	bool flightsEstimated;
+
+	// state kept between records
+	bool started;
+	uint32_t lastUpdate;
+	long lastPos;
+	bool inRun;
+	double runStart, runLast;		// seconds from the start of the log
+	double runMinAlt, runMaxAlt;
+	double lastAlt;
+} logInfo_t;
+
+static bool infoExact;
+static bool infoCsv;
+static int infoSamples = INFO_DEF_SAMPLES;
+
+static void infoUsage(void) {
+	fprintf(stderr, "usage: logInfo [--help] [--exact] [--samples num] [--csv] <log_file> ...\n\
+\n\
+ --exact (-e)\n\
+	Read every record (slower) instead of sampling the log.\n\
+\n\
+ --samples (-n) number\n\
+	Records to sample per log (default %d).\n\
+\n\
+ --csv (-c)\n\
+	One line per log, with a heading line.\n\
+\n", INFO_DEF_SAMPLES);
+}
+
+static void infoOpts(int argc, char **argv) {
+	int ch;
+
+	static struct option longopts[] = {
+		{"help",		no_argument,		NULL,		'h'},
+		{"exact",		no_argument,		NULL,		'e'},
+		{"samples",		required_argument,	NULL,		'n'},
+		{"csv",			no_argument,		NULL,		'c'},
+		{NULL,			0,					NULL,		0}
+	};
+
+	while ((ch = getopt_long(argc, argv, "hen:c", longopts, NULL)) != -1) {
+		switch (ch) {
+			case 'h':
+				infoUsage();
+				exit(0);
+			case 'e':
+				infoExact = true;
+				break;
+			case 'n':
+				infoSamples = atoi(optarg);
+				if (infoSamples < 2) {
+					fprintf(stderr, "logInfo: --samples must be at least 2\n");
+					exit(1);
+				}
+				break;
+			case 'c':
+				infoCsv = true;
+				break;
+			default:
+				infoUsage();
+				exit(1);
+		}
+	}
+}
+
+// ends a run of the motors, counting it if it was a flight (as in logFlightsScan())
+static void infoRunEnd(logInfo_t *inf, double extra) {
+	inf->inRun = false;
+
+	if (inf->runLast + extra - inf->runStart >= FLIGHT_MIN_TIME && inf->runMaxAlt - inf->runMinAlt >= FLIGHT_MIN_CLIMB)
+		inf->flights++;
+}
+
+// adds record r at file offset pos to the summary
+static void infoRecord(logInfo_t *inf, const loggerRecord_t *r, long pos) {
+	uint32_t lu = (uint32_t)r->data[LOG_LASTUPDATE];
+	double dt, expected, lat, lon, alt = 0.0, v;
+	bool first = !inf->started;
+	bool running;
+	int i;
+
+	if (!first) {
+		// LASTUPDATE is in micros and wraps; use the normal rate where it jumps (eg. reset)
+		expected = (double)(pos - inf->lastPos) / inf->pktLen / FLIGHT_REC_RATE;
+		dt = (uint32_t)(lu - inf->lastUpdate) / 1e6;
+		if (dt > expected * INFO_MAX_RATE_ERR + 1.0)
+			dt = expected;
+		inf->duration += dt;
+	}
+	inf->started = true;
+	inf->lastUpdate = lu;
+	inf->lastPos = pos;
+
+	lat = r->data[LOG_GPS_LAT];
+	lon = r->data[LOG_GPS_LON];
+	if ((lat != 0.0 || lon != 0.0) && (inf->schema.fieldIndex[LOG_GPS_HACC] < 0 || r->data[LOG_GPS_HACC] <= INFO_GPS_MAX_HACC)) {
+		if (!inf->hasGps) {
+			inf->latMin = inf->latMax = lat;
+			inf->lonMin = inf->lonMax = lon;
+			inf->hasGps = true;
+		}
+		if (lat < inf->latMin)
+			inf->latMin = lat;
+		if (lat > inf->latMax)
+			inf->latMax = lat;
+		if (lon < inf->lonMin)
+			inf->lonMin = lon;
+		if (lon > inf->lonMax)
+			inf->lonMax = lon;
+	}
+
+	if (inf->altField >= 0) {
+		alt = r->data[inf->altField];
+		if (!inf->hasAlt || alt > inf->maxAlt)
+			inf->maxAlt = alt;
+		inf->hasAlt = true;
+	}
+
+	if (inf->voltField >= 0 && (v = r->data[inf->voltField]) > 0.0) {
+		if (!inf->hasVolt || v < inf->minVolt)
+			inf->minVolt = v;
+		inf->hasVolt = true;
+	}
+
+	// flights are found by logDump_flights in exact mode
+	if (inf->exact)
+		return;
+
+	running = (r->data[LOG_MOT_THROTTLE] > 0.0);
+	for (i = 0; i < LOG_NUM_MOTORS && !running; i++)
+		running = (r->data[LOG_MOT_MOTOR0 + i] > 0.0);
+
+	if (running) {
+		if (!inf->inRun) {
+			inf->inRun = true;
+			inf->runStart = inf->duration;
+			// the record before is the nearest known ground altitude
+			inf->runMinAlt = inf->runMaxAlt = (first ? alt : inf->lastAlt);
+		}
+		inf->runLast = inf->duration;
+		if (alt < inf->runMinAlt)
+			inf->runMinAlt = alt;
+		if (alt > inf->runMaxAlt)
+			inf->runMaxAlt = alt;
+	}
+	else if (inf->inRun) {
+		// the run ended somewhere between the last two samples
+		infoRunEnd(inf, (inf->duration - inf->runLast) / 2.0);
+	}
+	inf->lastAlt = alt;
+}
+
+// reads the record at the stream position; returns false at the end of the log
+static bool infoRead(loggerStream_t *s, loggerRecord_t *r) {
+	int c;
+
+	if ((c = loggerReadPacket(s, r)) == EOF)
+		return false;
+	if (c == 'M')
+		loggerDecodeFieldIds(&s->schema, s->buf, r, infoFieldIds, INFO_NUM_FIELD_IDS);
+
+	return true;
+}
+
+static bool infoScan(logInfo_t *inf) {
+	loggerStream_t *s;
+	loggerRecord_t r, last;
+	struct stat st;
+	logFlight_t *flights;
+	long off, lastPos, pos;
+	int k, n;
+	FILE *fp;
+
+	memset(inf->schema.fieldIndex, -1, sizeof(inf->schema.fieldIndex));
+	inf->altField = inf->voltField = -1;
+
+	if (!(fp = fopen(inf->fname, "rb")) || fstat(fileno(fp), &st)) {
+		fprintf(stderr, "logInfo: cannot open log file '%s'\n", inf->fname);
+		if (fp)
+			fclose(fp);
+		return false;
+	}
+	inf->size = st.st_size;
+
+	s = (loggerStream_t *)malloc(sizeof(loggerStream_t));
+	loggerStreamInit(s, fp);
+	memset(&r, 0, sizeof(r));
+
+	// the first record, after the header
+	if ((inf->type = loggerReadPacket(s, &r)) != EOF) {
+		inf->dataStart = s->pktPos;
+		if (inf->type == 'M') {
+			inf->schema = s->schema;
+			inf->pktLen = s->schema.packetSize + 5;
+			loggerDecodeFieldIds(&s->schema, s->buf, &r, infoFieldIds, INFO_NUM_FIELD_IDS);
+		}
+		else {
+			for (k = 0; k < LOG_NUM_IDS; k++)
+				inf->schema.fieldIndex[k] = k;
+			inf->pktLen = sizeof(loggerRecord_t) + 3;
+		}
+
+		if (inf->schema.fieldIndex[LOG_UKF_ALT] >= 0)
+			inf->altField = LOG_UKF_ALT;
+		else if (inf->schema.fieldIndex[LOG_GPS_HEIGHT] >= 0)
+			inf->altField = LOG_GPS_HEIGHT;
+		if (inf->schema.fieldIndex[LOG_ADC_VIN] >= 0)
+			inf->voltField = LOG_ADC_VIN;
+		else if (inf->schema.fieldIndex[LOG_VIN_PDB] >= 0)
+			inf->voltField = LOG_VIN_PDB;
+	}
+	else {
+		inf->type = 0;
+	}
+
+	if (inf->type && inf->exact) {
+		inf->records = 0;
+		do {
+			infoRecord(inf, &r, s->pktPos);
+			inf->records++;
+		} while (infoRead(s, &r));
+
+		rewind(fp);
+		loggerStreamInit(s, fp);
+		inf->flights = logFlightsIndex(inf->fname, s, &flights);
+		free(flights);
+	}
+	else if (inf->type) {
+		inf->exact = false;
+		inf->records = (double)(inf->size - inf->dataStart) / inf->pktLen;
+		infoRecord(inf, &r, s->pktPos);
+
+		// evenly spaced records
+		lastPos = s->pktPos;
+		for (k = 1; k < infoSamples - 1; k++) {
+			off = inf->dataStart + (long)((double)(inf->size - inf->dataStart) * k / (infoSamples - 1));
+			if (off <= lastPos)
+				continue;
+			if (!loggerStreamSync(s, off, inf->type) || !infoRead(s, &r))
+				break;
+			if (s->pktPos > lastPos)
+				infoRecord(inf, &r, (lastPos = s->pktPos));
+		}
+
+		// and the last one
+		off = inf->size - 4 * inf->pktLen;
+		if (off > lastPos && loggerStreamSync(s, off, inf->type)) {
+			pos = -1;
+			while (infoRead(s, &r)) {
+				last = r;
+				pos = s->pktPos;
+			}
+			if (pos > lastPos)
+				infoRecord(inf, &last, pos);
+		}
+
+		if (inf->inRun)
+			infoRunEnd(inf, 0.0);
+
+		// an index has the exact flights
+		if ((n = logFlightsLoad(inf->fname, &st, &flights)) >= 0) {
+			inf->flights = n;
+			free(flights);
+		}
+		else {
+			inf->flightsEstimated = true;
+		}
+	}
+
+	free(s);
+	fclose(fp);
+
+	return true;
+}
+
+static void infoPrint(const logInfo_t *inf) {
+	int i, id, secs = (int)(inf->duration + 0.5);
+
+	if (infoCsv) {
+		printf("%s,%s,%ld,%.0f,%d,%.1f,", inf->fname, (inf->type == 'M' ? "AqM" : inf->type == 'L' ? "AqL" : ""),
+			inf->size, inf->records, inf->exact, inf->duration);
+		if (inf->hasGps)
+			printf("%.7f,%.7f,%.7f,%.7f,", inf->latMin, inf->latMax, inf->lonMin, inf->lonMax);
+		else
+			printf(",,,,");
+		if (inf->hasAlt)
+			printf("%.2f", inf->maxAlt);
+		printf(",");
+		if (inf->hasVolt)
+			printf("%.2f", inf->minVolt);
+		printf(",%d,%d\n", inf->flights, !inf->flightsEstimated);
+		return;
+	}
+
+	if (!inf->type) {
+		printf("%s: no records found (%ld bytes)\n\n", inf->fname, inf->size);
+		return;
+	}
+
+	printf("%s: %s log, %.1f MB, %s%.0f records, %d mins %d seconds\n", inf->fname, (inf->type == 'M' ? "AqM" : "AqL (legacy)"),
+		inf->size / 1e6, (inf->exact ? "" : "~"), inf->records, secs / 60, secs % 60);
+
+	if (inf->type == 'M') {
+		printf("  fields (%d, %d bytes per record):", inf->schema.numFields, inf->schema.packetSize);
+		for (i = 0; i < inf->schema.numFields; i++) {
+			id = inf->schema.fields[i].fieldId;
+			printf("%s %s %s", (i % 6 ? "," : (i ? ",\n   " : "\n   ")), (id < LOG_NUM_IDS ? loggerFieldLabels[id] : "?"),
+				(inf->schema.fields[i].fieldType <= LOG_TYPE_S8 ? infoTypeNames[inf->schema.fields[i].fieldType] : "?"));
+		}
+		printf("\n");
+	}
+
+	if (inf->hasGps)
+		printf("  GPS area: lat %.7f to %.7f, lon %.7f to %.7f\n", inf->latMin, inf->latMax, inf->lonMin, inf->lonMax);
+	else
+		printf("  GPS area: no position\n");
+	if (inf->hasAlt)
+		printf("  max altitude: %.2f m (%s)\n", inf->maxAlt, loggerFieldLabels[inf->altField]);
+	if (inf->hasVolt)
+		printf("  min voltage: %.2f V (%s)\n", inf->minVolt, loggerFieldLabels[inf->voltField]);
+	printf("  flights: %s%d\n\n", (inf->flightsEstimated ? "~" : ""), inf->flights);
+}
+
+int main(int argc, char **argv) {
+	logInfo_t inf;
+	int ret = 0;
+
+	infoOpts(argc, argv);
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1) {
+		infoUsage();
+		return 1;
+	}
+
+	if (infoCsv)
+		printf("FILE,FORMAT,BYTES,RECORDS,EXACT,DURATION_S,LAT_MIN,LAT_MAX,LON_MIN,LON_MAX,MAX_ALT_M,MIN_VOLT_V,FLIGHTS,FLIGHTS_EXACT\n");
+
+	for (; argc > 0; argc--, argv++) {
+		memset(&inf, 0, sizeof(inf));
+		inf.fname = *argv;
+		inf.exact = infoExact;
+
+		if (infoScan(&inf))
+			infoPrint(&inf);
+		else
+			ret = 1;
+	}
+
+	return ret;
+}
@@ -0,0 +1,283 @@
+/*
+ * logPack.cc
+ *
+ *  Packs an AutoQuad log in to a compressed AqZ archive, which loggerReadLog() reads like
+ *  any log, or unpacks an archive back to an AqM log.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+The log is loaded with loggerReadLog() and its records are split in to blocks of --block
+records, each coded on its own by one of the threads (see loggerPackEncodeBlock() and the
+AqZ format in logger.h). Each field of a block is coded column by column in whichever way
+takes the fewest bits: timestamps such as LASTUPDATE and GPS_ITOW by their change in step
+(delta of delta), counters and other integers by their steps, and sensor floats by the
+bits that changed from the last value (XOR). The archive is then read back with
+loggerReadLog() and its records checked to be the same, bit for bit, as those packed.
+
+An archive holds the records as loggerReadLog() loads them: a log whose AqH header changes
+is kept in the layout of all its fields (see loggerLog_t), so unpacking it gives a log with
+one header.
+*/
+
+#include "logger.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+typedef struct {
+	const loggerLog_t *log;
+	unsigned char **blocks;
+	uint32_t *blockLens;
+	int numBlocks;
+	int next;						// next block
+} packJob_t;
+
+static int numThreads;
+static int blockRecords = LOGGER_PACK_BLOCK;
+static bool unpack;
+static bool noVerify;
+static char *outFile;
+
+static void packUsage(void) {
+	fprintf(stderr, "usage: logPack [--help] [--unpack] [--block num] [--threads num] [--no-verify] --out file <log_file>\n\
+\n\
+ --out (-o) file\n\
+	AqZ archive to write (with --unpack, AqM log to write).\n\
+\n\
+ --unpack (-u)\n\
+	Write an AqM log of the records of an AqZ archive (or of any log).\n\
+\n\
+ --block (-b) number\n\
+	Records per block of the archive (default %d). Each block is\n\
+	decoded on its own, smaller blocks compress a little less.\n\
+\n\
+ --threads (-j) number\n\
+	Threads to use (default the number of CPUs).\n\
+\n\
+ --no-verify (-V)\n\
+	Do not read the archive back to check it.\n\
+\n", LOGGER_PACK_BLOCK);
+}
+
+static void packOpts(int argc, char **argv) {
+	int ch;
+
+	static struct option longopts[] = {
+		{"help",		no_argument,		NULL,		'h'},
+		{"out",			required_argument,	NULL,		'o'},
+		{"unpack",		no_argument,		NULL,		'u'},
+		{"block",		required_argument,	NULL,		'b'},
+		{"threads",		required_argument,	NULL,		'j'},
+		{"no-verify",	no_argument,		NULL,		'V'},
+		{NULL,			0,					NULL,		0}
+	};
+
+	while ((ch = getopt_long(argc, argv, "ho:ub:j:V", longopts, NULL)) != -1) {
+		switch (ch) {
+			case 'h':
+				packUsage();
+				exit(0);
+			case 'o':
+				outFile = optarg;
+				break;
+			case 'u':
+				unpack = true;
+				break;
+			case 'b':
+				blockRecords = atoi(optarg);
+				break;
+			case 'j':
+				numThreads = atoi(optarg);
+				break;
+			case 'V':
+				noVerify = true;
+				break;
+			default:
+				packUsage();
+				exit(1);
+		}
+	}
+}
+
+static double packTime(void) {
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *packThread(void *arg) {
+	packJob_t *job = (packJob_t *)arg;
+	const loggerLog_t *l = job->log;
+	int b, n;
+
+	while ((b = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->numBlocks) {
+		n = (b < job->numBlocks - 1) ? blockRecords : l->numRecords - b * blockRecords;
+		job->blockLens[b] = loggerPackEncodeBlock(&l->schema, l->data + (long)b * blockRecords * l->schema.packetSize, n, &job->blocks[b]);
+	}
+
+	return NULL;
+}
+
+// writes the records of l as an AqM log
+static int packUnpack(const loggerLog_t *l, FILE *out) {
+	unsigned char buf[LOGGER_MAX_PACKET + 5];
+	int len, i, j;
+
+	if ((len = loggerEncodeHeader(&l->schema, buf)) && fwrite(buf, len, 1, out) != 1)
+		return 0;
+
+	buf[0] = 'A';
+	buf[1] = 'q';
+	buf[2] = 'M';
+	len = l->schema.packetSize;
+	for (i = 0; i < l->numRecords; i++) {
+		memcpy(buf + 3, l->data + (long)i * len, len);
+		buf[len+3] = buf[len+4] = 0;
+		for (j = 3; j < len + 3; j++) {
+			buf[len+3] += buf[j];
+			buf[len+4] += buf[len+3];
+		}
+		if (fwrite(buf, len + 5, 1, out) != 1)
+			return 0;
+	}
+
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	packJob_t job;
+	loggerLog_t l, v;
+	pthread_t *threads;
+	unsigned char *hbuf;
+	struct stat st;
+	long inSize, outSize;
+	double t0, tRead;
+	int i, hlen;
+	bool ok;
+	FILE *fp;
+
+	packOpts(argc, argv);
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1) {
+		fprintf(stderr, "logPack: need one log file argument\n");
+		packUsage();
+		return 1;
+	}
+	if (!outFile) {
+		fprintf(stderr, "logPack: need an output file (--out)\n");
+		return 1;
+	}
+	if (blockRecords < 1) {
+		fprintf(stderr, "logPack: bad block size %d\n", blockRecords);
+		return 1;
+	}
+	if (!numThreads)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads < 1)
+		numThreads = 1;
+
+	t0 = packTime();
+	if (!loggerReadLog(argv[0], &l)) {
+		fprintf(stderr, "logPack: no records in '%s'\n", argv[0]);
+		return 1;
+	}
+	tRead = packTime() - t0;
+	inSize = stat(argv[0], &st) ? 0 : st.st_size;
+
+	if (!(fp = fopen(outFile, "wb"))) {
+		fprintf(stderr, "logPack: cannot create '%s'\n", outFile);
+		return 1;
+	}
+
+	if (unpack) {
+		if (!packUnpack(&l, fp) || (ferror(fp) | fclose(fp))) {
+			fprintf(stderr, "logPack: error writing '%s'\n", outFile);
+			return 1;
+		}
+		fprintf(stderr, "logPack: wrote %d records to %s\n", l.numRecords, outFile);
+		loggerFree(&l);
+		return 0;
+	}
+
+	// code the blocks
+	t0 = packTime();
+	memset(&job, 0, sizeof(job));
+	job.log = &l;
+	job.numBlocks = (l.numRecords + blockRecords - 1) / blockRecords;
+	job.blocks = (unsigned char **)calloc(job.numBlocks, sizeof(unsigned char *));
+	job.blockLens = (uint32_t *)calloc(job.numBlocks, sizeof(uint32_t));
+
+	if (numThreads > job.numBlocks)
+		numThreads = job.numBlocks;
+	threads = (pthread_t *)calloc(numThreads, sizeof(pthread_t));
+	for (i = 0; i < numThreads; i++) {
+		if (pthread_create(&threads[i], NULL, packThread, &job)) {
+			fprintf(stderr, "logPack: cannot create thread\n");
+			return 1;
+		}
+	}
+	for (i = 0; i < numThreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	hbuf = (unsigned char *)malloc(LOGGER_PACK_HEADER_SIZE(job.numBlocks));
+	hlen = loggerPackEncodeHeader(&l.schema, blockRecords, l.numRecords, job.numBlocks, job.blockLens, hbuf);
+	outSize = hlen;
+	ok = (fwrite(hbuf, hlen, 1, fp) == 1);
+	for (i = 0; i < job.numBlocks; i++) {
+		ok = ok && fwrite(job.blocks[i], job.blockLens[i], 1, fp) == 1;
+		outSize += job.blockLens[i];
+		free(job.blocks[i]);
+	}
+	if (!ok || (ferror(fp) | fclose(fp))) {
+		fprintf(stderr, "logPack: error writing '%s'\n", outFile);
+		return 1;
+	}
+
+	fprintf(stderr, "logPack: packed %d records (%d fields, %d blocks) in %.2fs, %.2f MB to %.2f MB (%.1fx, %.1f bytes per record)\n",
+		l.numRecords, l.schema.numFields, job.numBlocks, packTime() - t0, inSize / 1e6, outSize / 1e6, (double)inSize / outSize,
+		(double)outSize / l.numRecords);
+
+	// check it, reading it as any log is read
+	if (!noVerify) {
+		t0 = packTime();
+		loggerReadLog(outFile, &v);
+		t0 = packTime() - t0;
+
+		if (v.numRecords != l.numRecords || v.schema.numFields != l.schema.numFields ||
+				memcmp(v.schema.fields, l.schema.fields, l.schema.numFields * sizeof(loggerFields_t)) ||
+				memcmp(v.data, l.data, (long)l.numRecords * l.schema.packetSize)) {
+			fprintf(stderr, "logPack: '%s' does not read back as '%s'\n", outFile, argv[0]);
+			return 1;
+		}
+		fprintf(stderr, "logPack: verified, loaded in %.3fs (%.0f MB/s of records), the log in %.3fs\n", t0,
+			(double)l.numRecords * l.schema.packetSize / 1e6 / t0, tRead);
+		loggerFree(&v);
+	}
+
+	loggerFree(&l);
+
+	return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * logSlice.cc
+ *
+ *  Cuts a range of records (by record number, time or flight) out of an AutoQuad log in to
+ *  a new log, copying the packets as they are.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+The new log is the AqH header in effect at the first record of the range (which is the
+same bytes as the header packet of the log), followed by the bytes of the log from the
+first to the last record of the range. Packets are checked while looking for the range
+but not decoded (other than LASTUPDATE for a time range), and the bytes are copied by the
+kernel (copy_file_range(), or sendfile()) where it can, or read and written otherwise.
+*/
+
+#include "logger.h"
+#include "logDump_flights.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#ifdef __linux__
+	#include <unistd.h>
+	#include <sys/sendfile.h>
+#endif
+
+#define SLICE_BUF_SIZE		(1<<16)
+#define SLICE_MAX_STEP		1.0			// seconds; a bigger LASTUPDATE step between records is taken as a reset
+
+static uint32_t sliceRangeMin = 0;		// records, as counted by logDump (the first record is 0)
+static uint32_t sliceRangeMax = 0;		// zero for the end of the log
+static double sliceTimeMin = 0.0;		// seconds from the first record
+static double sliceTimeMax = 0.0;		// zero for the end of the log
+static bool sliceByTime;
+static int sliceFlight;
+static char *sliceOutFile;
+
+static void sliceUsage(void) {
+	fprintf(stderr, "usage: logSlice [--help] --out file (--range-min num --range-max num |\n\
+	--time-min secs --time-max secs | --flight num) <log_file>\n\
+\n\
+ --out (-o) file\n\
+	Log file to write (- for standard output).\n\
+\n\
+ --range-min (-m) number\n\
+ --range-max (-M) number\n\
+	First and last record to copy, numbered as by logDump (the first\n\
+	record of the log is 0). Without --range-max the rest of the log.\n\
+\n\
+ --time-min (-s) seconds\n\
+ --time-max (-t) seconds\n\
+	Copy the records of this time range, in seconds since the first\n\
+	record (by LASTUPDATE). Without --time-max the rest of the log.\n\
+\n\
+ --flight (-n) number\n\
+	Copy a flight, as numbered by logDump --flights. The flight index is\n\
+	made if needed.\n\
+\n");
+}
+
+static void sliceOpts(int argc, char **argv) {
+	int ch;
+
+	static struct option longopts[] = {
+		{"help",		no_argument,		NULL,		'h'},
+		{"out",			required_argument,	NULL,		'o'},
+		{"range-min",	required_argument,	NULL,		'm'},
+		{"range-max",	required_argument,	NULL,		'M'},
+		{"time-min",	required_argument,	NULL,		's'},
+		{"time-max",	required_argument,	NULL,		't'},
+		{"flight",		required_argument,	NULL,		'n'},
+		{NULL,			0,					NULL,		0}
+	};
+
+	while ((ch = getopt_long(argc, argv, "ho:m:M:s:t:n:", longopts, NULL)) != -1) {
+		switch (ch) {
+			case 'h':
+				sliceUsage();
+				exit(0);
+			case 'o':
+				sliceOutFile = optarg;
+				break;
+			case 'm':
+				sliceRangeMin = strtoul(optarg, 0, 0);
+				break;
+			case 'M':
+				sliceRangeMax = strtoul(optarg, 0, 0);
+				break;
+			case 's':
+				sliceTimeMin = atof(optarg);
+				sliceByTime = true;
+				break;
+			case 't':
+				sliceTimeMax = atof(optarg);
+				sliceByTime = true;
+				break;
+			case 'n':
+				sliceFlight = atoi(optarg);
+				break;
+			default:
+				sliceUsage();
+				exit(1);
+		}
+	}
+}
+
+// Copies len bytes at offset of in to the end of out.
+static bool sliceCopy(FILE *in, long offset, long len, FILE *out) {
+	char *buf;
+	size_t n;
+
+	fflush(out);
+
+#ifdef __linux__
+	off_t off = offset;
+	ssize_t r = 0;
+
+	// in the kernel: between files, then to anything (eg. a pipe)
+	while (len > 0 && (r = copy_file_range(fileno(in), &off, fileno(out), NULL, len, 0)) > 0)
+		len -= r;
+	if (len > 0 && r < 0 && errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP)
+		return false;
+
+	while (len > 0 && (r = sendfile(fileno(out), fileno(in), &off, len)) > 0)
+		len -= r;
+	if (len > 0 && r < 0 && errno != EINVAL && errno != ENOSYS)
+		return false;
+
+	offset = off;
+#endif
+
+	if (len > 0) {
+		buf = (char *)malloc(SLICE_BUF_SIZE);
+		fseek(in, offset, SEEK_SET);
+		while (len > 0 && (n = fread(buf, 1, (len < SLICE_BUF_SIZE ? len : SLICE_BUF_SIZE), in)) > 0) {
+			if (fwrite(buf, 1, n, out) != n)
+				break;
+			len -= n;
+		}
+		free(buf);
+	}
+
+	return (len == 0);
+}
+
+int main(int argc, char **argv) {
+	loggerStream_t *s;
+	loggerSchema_t header;
+	loggerRecord_t r;
+	logFlight_t *flights;
+	unsigned char hbuf[LOGGER_MAX_HEADER];
+	const int luId = LOG_LASTUPDATE;
+	long startPos = -1, endPos = -1;
+	uint32_t count = 0, startRec = 0, endRec = 0, lu, lastLu = 0;
+	double t = 0.0, dt;
+	bool in, started = false;
+	int c, n, hlen;
+	FILE *fp, *out;
+
+	sliceOpts(argc, argv);
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1) {
+		fprintf(stderr, "logSlice: need one log file argument\n");
+		sliceUsage();
+		return 1;
+	}
+	if (!sliceOutFile) {
+		fprintf(stderr, "logSlice: need an output file (--out)\n");
+		return 1;
+	}
+	if ((sliceByTime ? 1 : 0) + (sliceFlight ? 1 : 0) + (sliceRangeMin || sliceRangeMax ? 1 : 0) > 1) {
+		fprintf(stderr, "logSlice: use only one of a record, time or flight range\n");
+		return 1;
+	}
+
+	if (!(fp = fopen(argv[0], "rb"))) {
+		fprintf(stderr, "logSlice: cannot open log file '%s'\n", argv[0]);
+		return 1;
+	}
+
+	s = (loggerStream_t *)malloc(sizeof(loggerStream_t));
+	loggerStreamInit(s, fp);
+	memset(&r, 0, sizeof(r));
+
+	if (sliceFlight) {
+		n = logFlightsIndex(argv[0], s, &flights);
+		if (sliceFlight < 1 || sliceFlight > n) {
+			fprintf(stderr, "logSlice: no flight %d, the log has %d flights\n", sliceFlight, n);
+			return 1;
+		}
+		sliceRangeMin = flights[sliceFlight-1].startRec;
+		sliceRangeMax = flights[sliceFlight-1].endRec;
+
+		// skip to the flight, with the AqH header in effect there (as logDump does)
+		if (!loggerStreamSeek(s, flights[sliceFlight-1].schemaPos, flights[sliceFlight-1].startPos)) {
+			fprintf(stderr, "logSlice: cannot read the log header in effect at flight %d\n", sliceFlight);
+			return 1;
+		}
+		count = sliceRangeMin;
+		free(flights);
+	}
+
+	// find the range, checking packets but only decoding LASTUPDATE
+	for (; (c = loggerReadPacket(s, &r)) != EOF; count++) {
+		if (sliceByTime) {
+			if (c == 'M')
+				loggerDecodeFieldIds(&s->schema, s->buf, &r, &luId, 1);
+			lu = (uint32_t)r.data[LOG_LASTUPDATE];
+			if (started) {
+				dt = (uint32_t)(lu - lastLu) / 1e6;
+				t += (dt > SLICE_MAX_STEP) ? 1.0 / FLIGHT_REC_RATE : dt;
+			}
+			started = true;
+			lastLu = lu;
+			in = (t >= sliceTimeMin && (sliceTimeMax <= 0.0 || t <= sliceTimeMax));
+		}
+		else {
+			in = (count >= sliceRangeMin && (!sliceRangeMax || count <= sliceRangeMax));
+		}
+
+		if (in) {
+			if (startPos < 0) {
+				startPos = s->pktPos;
+				startRec = count;
+				header = s->schema;
+			}
+			endPos = ftell(fp);
+			endRec = count;
+		}
+		else if (startPos >= 0) {
+			break;
+		}
+	}
+
+	if (startPos < 0) {
+		fprintf(stderr, "logSlice: no records in the range\n");
+		return 1;
+	}
+	if (!strcmp(sliceOutFile, "-")) {
+		out = stdout;
+	}
+	else if (!(out = fopen(sliceOutFile, "wb"))) {
+		fprintf(stderr, "logSlice: cannot create '%s'\n", sliceOutFile);
+		return 1;
+	}
+
+	hlen = loggerEncodeHeader(&header, hbuf);
+	if ((hlen && fwrite(hbuf, hlen, 1, out) != 1) || !sliceCopy(fp, startPos, endPos - startPos, out) || (ferror(out) | fclose(out))) {
+		fprintf(stderr, "logSlice: error writing '%s': %s\n", sliceOutFile, strerror(errno));
+		return 1;
+	}
+
+	fprintf(stderr, "logSlice: wrote records %u to %u (%u records, %.1f KB) to %s\n", startRec, endRec, endRec - startRec + 1,
+		(hlen + endPos - startPos) / 1024.0, sliceOutFile);
+
+	free(s);
+	fclose(fp);
+
+	return 0;
+}
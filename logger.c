@@ -17,160 +17,442 @@
 */
 
 #include "logger.h"
+#include "trace.h"
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
 
-loggerFields_t *loggerFields;
-int loggerNumFields;
-int loggerPacketSize;
+// reader state used by the single-file loggerReadEntry() interface
+loggerStream_t loggerDefaultStream;
+
+const traceHooks_t *loggerTrace;
+
+const char *loggerFieldLabels[] = {
+	"LASTUPDATE",
+	"VOLTAGE0",
+	"VOLTAGE1",
+	"VOLTAGE2",
+	"VOLTAGE3",
+	"VOLTAGE4",
+	"VOLTAGE5",
+	"VOLTAGE6",
+	"VOLTAGE7",
+	"VOLTAGE8",
+	"VOLTAGE9",
+	"VOLTAGE10",
+	"VOLTAGE11",
+	"VOLTAGE12",
+	"VOLTAGE13",
+	"VOLTAGE14",
+	"IMU_RATEX",
+	"IMU_RATEY",
+	"IMU_RATEZ",
+	"IMU_ACCX",
+	"IMU_ACCY",
+	"IMU_ACCZ",
+	"IMU_MAGX",
+	"IMU_MAGY",
+	"IMU_MAGZ",
+	"GPS_PDOP",
+	"GPS_HDOP",
+	"GPS_VDOP",
+	"GPS_TDOP",
+	"GPS_NDOP",
+	"GPS_EDOP",
+	"GPS_ITOW",
+	"GPS_POS_UPDATE",
+	"GPS_LAT",
+	"GPS_LON",
+	"GPS_HEIGHT",
+	"GPS_HACC",
+	"GPS_VACC",
+	"GPS_VEL_UPDATE",
+	"GPS_VELN",
+	"GPS_VELE",
+	"GPS_VELD",
+	"GPS_SACC",
+	"ADC_PRESSURE1",
+	"ADC_PRESSURE2",
+	"ADC_TEMP0",
+	"ADC_TEMP1",
+	"ADC_TEMP2",
+	"ADC_VIN",
+	"ADC_MAG_SIGN",
+	"UKF_Q1",
+	"UKF_Q2",
+	"UKF_Q3",
+	"UKF_Q4",
+	"UKF_POSN",
+	"UKF_POSE",
+	"UKF_POSD",
+	"UKF_PRES_ALT",
+	"UKF_ALT (m)",
+	"UKF_VELN (m/s)",
+	"UKF_VELE (m/s)",
+	"UKF_VELD (m/s)",
+	"MOT_MOTOR0",
+	"MOT_MOTOR1",
+	"MOT_MOTOR2",
+	"MOT_MOTOR3",
+	"MOT_MOTOR4",
+	"MOT_MOTOR5",
+	"MOT_MOTOR6",
+	"MOT_MOTOR7",
+	"MOT_MOTOR8",
+	"MOT_MOTOR9",
+	"MOT_MOTOR10",
+	"MOT_MOTOR11",
+	"MOT_MOTOR12",
+	"MOT_MOTOR13",
+	"MOT_THROTTLE",
+	"MOT_PITCH",
+	"MOT_ROLL",
+	"MOT_YAW",
+	"RADIO_QUALITY",
+	"RADIO_CHANNEL0",
+	"RADIO_CHANNEL1",
+	"RADIO_CHANNEL2",
+	"RADIO_CHANNEL3",
+	"RADIO_CHANNEL4",
+	"RADIO_CHANNEL5",
+	"RADIO_CHANNEL6",
+	"RADIO_CHANNEL7",
+	"RADIO_CHANNEL8",
+	"RADIO_CHANNEL9",
+	"RADIO_CHANNEL10",
+	"RADIO_CHANNEL11",
+	"RADIO_CHANNEL12",
+	"RADIO_CHANNEL13",
+	"RADIO_CHANNEL14",
+	"RADIO_CHANNEL15",
+	"RADIO_CHANNEL16",
+	"RADIO_CHANNEL17",
+	"RADIO_ERRORS",
+	"GMBL_TRIGGER",
+	"ACC_BIAS_X",
+	"ACC_BIAS_Y",
+	"ACC_BIAS_Z",
+	"CURRENT_PDB",
+	"CURRENT_EXT",
+	"VIN_PDB",
+	"UKF_ALT_VEL",
+	0 // terminate
+};
 
 void loggerChecksumError(const char *s) {
 	fprintf(stderr, "logger: checksum error in '%s' packet\n", s);
 }
 
-void loggerDecodePacket(char *buf, loggerRecord_t *r) {
-	int i;
-	unsigned char fieldId;
-
-	for (i = 0; i < loggerNumFields; i++) {
-		fieldId = loggerFields[i].fieldId;
-		// store some fields in arrays, for convenience
-		switch (fieldId) {
-			case LOG_VOLTAGE0:
-			case LOG_VOLTAGE1:
-			case LOG_VOLTAGE2:
-			case LOG_VOLTAGE3:
-			case LOG_VOLTAGE4:
-			case LOG_VOLTAGE5:
-			case LOG_VOLTAGE6:
-			case LOG_VOLTAGE7:
-			case LOG_VOLTAGE8:
-			case LOG_VOLTAGE9:
-			case LOG_VOLTAGE10:
-			case LOG_VOLTAGE11:
-			case LOG_VOLTAGE12:
-			case LOG_VOLTAGE13:
-			case LOG_VOLTAGE14:
-				r->voltages[fieldId-LOG_VOLTAGE0] = *(float *)buf;
-				break;
-			case LOG_UKF_Q1:
-			case LOG_UKF_Q2:
-			case LOG_UKF_Q3:
-			case LOG_UKF_Q4:
-				r->quat[fieldId-LOG_UKF_Q1] = *(float *)buf;
-				break;
-			case LOG_MOT_MOTOR0:
-			case LOG_MOT_MOTOR1:
-			case LOG_MOT_MOTOR2:
-			case LOG_MOT_MOTOR3:
-			case LOG_MOT_MOTOR4:
-			case LOG_MOT_MOTOR5:
-			case LOG_MOT_MOTOR6:
-			case LOG_MOT_MOTOR7:
-			case LOG_MOT_MOTOR8:
-			case LOG_MOT_MOTOR9:
-			case LOG_MOT_MOTOR10:
-			case LOG_MOT_MOTOR11:
-			case LOG_MOT_MOTOR12:
-			case LOG_MOT_MOTOR13:
-				r->motors[fieldId-LOG_MOT_MOTOR0] = *(uint16_t *)buf;
-				break;
-			case LOG_RADIO_CHANNEL0:
-			case LOG_RADIO_CHANNEL1:
-			case LOG_RADIO_CHANNEL2:
-			case LOG_RADIO_CHANNEL3:
-			case LOG_RADIO_CHANNEL4:
-			case LOG_RADIO_CHANNEL5:
-			case LOG_RADIO_CHANNEL6:
-			case LOG_RADIO_CHANNEL7:
-			case LOG_RADIO_CHANNEL8:
-			case LOG_RADIO_CHANNEL9:
-			case LOG_RADIO_CHANNEL10:
-			case LOG_RADIO_CHANNEL11:
-			case LOG_RADIO_CHANNEL12:
-			case LOG_RADIO_CHANNEL13:
-			case LOG_RADIO_CHANNEL14:
-			case LOG_RADIO_CHANNEL15:
-			case LOG_RADIO_CHANNEL16:
-			case LOG_RADIO_CHANNEL17:
-				r->radioChannels[fieldId-LOG_RADIO_CHANNEL0] = *(int16_t *)buf;
-				break;
-		}
+void loggerStreamInit(loggerStream_t *s, FILE *fp) {
+	s->fp = fp;
+	s->pktPos = 0;
+	s->schemaPos = -1;
+	s->errors = 0;
+	s->schema.numFields = 0;
+	s->schema.packetSize = 0;
+	memset(s->schema.fieldIndex, -1, sizeof(s->schema.fieldIndex));
+}
 
-		switch (loggerFields[i].fieldType) {
-			case LOG_TYPE_DOUBLE:
-				r->data[fieldId] = *(double *)buf;
-				buf += 8;
-				break;
-			case LOG_TYPE_FLOAT:
-				r->data[fieldId] = *(float *)buf;
-				buf += 4;
-				break;
-			case LOG_TYPE_U32:
-				r->data[fieldId] = *(uint32_t *)buf;
-				buf += 4;
-				break;
-			case LOG_TYPE_S32:
-				r->data[fieldId] = *(int32_t *)buf;
-				buf += 4;
-				break;
-			case LOG_TYPE_U16:
-				r->data[fieldId] = *(uint16_t *)buf;
-				buf += 2;
-				break;
-			case LOG_TYPE_S16:
-				r->data[fieldId] = *(int16_t *)buf;
-				buf += 2;
-				break;
-			case LOG_TYPE_U8:
-				r->data[fieldId] = *(uint8_t *)buf;
-				buf += 1;
-				break;
-			case LOG_TYPE_S8:
-				r->data[fieldId] = *(int8_t *)buf;
-				buf += 1;
+// Checks for a valid packet of given type ('M' or 'L') at p, with n bytes available
+// (the rest of the file if atEof). For 'M' a valid AqH header also counts, as the packets
+// after it may not fit the schema. Returns 1 if valid, 0 if not.
+static int loggerCheckPacket(const loggerSchema_t *sc, const unsigned char *p, long n, int type, int atEof) {
+	unsigned char ckA, ckB;
+	long len, i;
+
+	if (n < 4 || p[0] != 'A' || p[1] != 'q' || (p[2] != type && (type != 'M' || p[2] != 'H')))
+		return 0;
+
+	// AqL checksum bytes are part of the record, AqH starts with its number of fields
+	if (p[2] == 'H')
+		len = 1 + p[3] * sizeof(loggerFields_t) + 2;
+	else
+		len = (type == 'M') ? sc->packetSize + 2 : sizeof(loggerRecord_t);
+	if (n < 3 + len)
+		return 0;
+
+	ckA = ckB = 0;
+	for (i = 3; i < 3 + len - 2; i++) {
+		ckA += p[i];
+		ckB += ckA;
+	}
+	if (p[i] != ckA || p[i+1] != ckB)
+		return 0;
+
+	// and it should be followed by another packet, or the end of the file
+	if (n == 3 + len)
+		return atEof;
+
+	return (n >= 3 + len + 2 && p[3+len] == 'A' && p[3+len+1] == 'q');
+}
+
+// Positions the stream at the first valid packet of the given type ('M' or 'L') starting at
+// or after offset, or at an AqH header before it (which loggerReadPacket() then reads). The
+// schema must already be known for AqM logs. Returns 0 if none found.
+// The first window read is small, as a packet is usually found near offset.
+int loggerStreamSync(loggerStream_t *s, long offset, int type) {
+	const long maxWinSize = 1<<16;
+	const long margin = sizeof(loggerRecord_t) + LOGGER_MAX_PACKET + 16;
+	long winSize = 1<<12;
+	unsigned char *win;
+	long n, i;
+	int atEof, ret = 0;
+	double t0 = TRACE_HOOK_START(loggerTrace);
+
+	if (type == 'M' && !s->schema.packetSize)
+		return 0;
+
+	win = (unsigned char *)malloc(maxWinSize + margin);
+
+	while (!ret && fseek(s->fp, offset, SEEK_SET) == 0 && (n = fread(win, 1, winSize + margin, s->fp)) > 0) {
+		atEof = (n < winSize + margin);
+		for (i = 0; i < n && i < winSize; i++) {
+			if (win[i] == 'A' && loggerCheckPacket(&s->schema, win + i, n - i, type, atEof)) {
+				fseek(s->fp, offset + i, SEEK_SET);
+				ret = 1;
 				break;
+			}
 		}
+		if (atEof)
+			break;
+		offset += winSize;
+		if (winSize < maxWinSize)
+			winSize *= 2;
+	}
+
+	free(win);
+
+	TRACE_HOOK_SPAN(loggerTrace, "sync search", TRACE_SYNC, t0);
+
+	return ret;
+}
+
+// decode the i-th field of an AqM packet
+void loggerDecodeField(const loggerSchema_t *sc, const char *buf, loggerRecord_t *r, int i) {
+	unsigned char fieldId = sc->fields[i].fieldId;
+	double v = loggerFieldValue(sc->fields[i].fieldType, buf + sc->offsets[i]);
+
+	r->data[fieldId] = v;
+
+	// store some fields in arrays, for convenience
+	switch (fieldId) {
+		case LOG_VOLTAGE0:
+		case LOG_VOLTAGE1:
+		case LOG_VOLTAGE2:
+		case LOG_VOLTAGE3:
+		case LOG_VOLTAGE4:
+		case LOG_VOLTAGE5:
+		case LOG_VOLTAGE6:
+		case LOG_VOLTAGE7:
+		case LOG_VOLTAGE8:
+		case LOG_VOLTAGE9:
+		case LOG_VOLTAGE10:
+		case LOG_VOLTAGE11:
+		case LOG_VOLTAGE12:
+		case LOG_VOLTAGE13:
+		case LOG_VOLTAGE14:
+			r->voltages[fieldId-LOG_VOLTAGE0] = v;
+			break;
+		case LOG_UKF_Q1:
+		case LOG_UKF_Q2:
+		case LOG_UKF_Q3:
+		case LOG_UKF_Q4:
+			r->quat[fieldId-LOG_UKF_Q1] = v;
+			break;
+		case LOG_MOT_MOTOR0:
+		case LOG_MOT_MOTOR1:
+		case LOG_MOT_MOTOR2:
+		case LOG_MOT_MOTOR3:
+		case LOG_MOT_MOTOR4:
+		case LOG_MOT_MOTOR5:
+		case LOG_MOT_MOTOR6:
+		case LOG_MOT_MOTOR7:
+		case LOG_MOT_MOTOR8:
+		case LOG_MOT_MOTOR9:
+		case LOG_MOT_MOTOR10:
+		case LOG_MOT_MOTOR11:
+		case LOG_MOT_MOTOR12:
+		case LOG_MOT_MOTOR13:
+			r->motors[fieldId-LOG_MOT_MOTOR0] = (uint16_t)(int32_t)v;
+			break;
+		case LOG_RADIO_CHANNEL0:
+		case LOG_RADIO_CHANNEL1:
+		case LOG_RADIO_CHANNEL2:
+		case LOG_RADIO_CHANNEL3:
+		case LOG_RADIO_CHANNEL4:
+		case LOG_RADIO_CHANNEL5:
+		case LOG_RADIO_CHANNEL6:
+		case LOG_RADIO_CHANNEL7:
+		case LOG_RADIO_CHANNEL8:
+		case LOG_RADIO_CHANNEL9:
+		case LOG_RADIO_CHANNEL10:
+		case LOG_RADIO_CHANNEL11:
+		case LOG_RADIO_CHANNEL12:
+		case LOG_RADIO_CHANNEL13:
+		case LOG_RADIO_CHANNEL14:
+		case LOG_RADIO_CHANNEL15:
+		case LOG_RADIO_CHANNEL16:
+		case LOG_RADIO_CHANNEL17:
+			r->radioChannels[fieldId-LOG_RADIO_CHANNEL0] = (int16_t)(int32_t)v;
+			break;
+	}
+}
+
+// stores v as a value of the given type at p
+void loggerEncodeValue(int type, char *p, double v) {
+	switch (type) {
+		case LOG_TYPE_DOUBLE:
+			*(double *)p = v;
+			break;
+		case LOG_TYPE_FLOAT:
+			*(float *)p = v;
+			break;
+		case LOG_TYPE_U32:
+			*(uint32_t *)p = v;
+			break;
+		case LOG_TYPE_S32:
+			*(int32_t *)p = v;
+			break;
+		case LOG_TYPE_U16:
+			*(uint16_t *)p = v;
+			break;
+		case LOG_TYPE_S16:
+			*(int16_t *)p = v;
+			break;
+		case LOG_TYPE_U8:
+			*(uint8_t *)p = v;
+			break;
+		case LOG_TYPE_S8:
+			*(int8_t *)p = v;
+			break;
+	}
+}
+
+static const int loggerTypeSizes[] = {8, 4, 4, 4, 2, 2, 1, 1};
+
+// sets the offsets, field index and packet size of a schema from its fields
+void loggerSchemaLayout(loggerSchema_t *sc) {
+	int i;
+
+	memset(sc->fieldIndex, -1, sizeof(sc->fieldIndex));
+	sc->packetSize = 0;
+	for (i = 0; i < sc->numFields; i++) {
+		sc->offsets[i] = sc->packetSize;
+		sc->fieldIndex[sc->fields[i].fieldId] = i;
+		if (sc->fields[i].fieldType <= LOG_TYPE_S8)
+			sc->packetSize += loggerTypeSizes[sc->fields[i].fieldType];
+	}
+}
+
+// decode only the given field IDs (those not present in the packet are skipped)
+void loggerDecodeFieldIds(const loggerSchema_t *sc, const char *buf, loggerRecord_t *r, const int *ids, int n) {
+	double t0 = TRACE_HOOK_START(loggerTrace);
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (ids[i] < LOGGER_MAX_FIELDS && sc->fieldIndex[ids[i]] >= 0 && sc->fieldIndex[ids[i]] < sc->numFields)
+			loggerDecodeField(sc, buf, r, sc->fieldIndex[ids[i]]);
+
+	TRACE_HOOK_ADD(loggerTrace, TRACE_DECODE, t0);
+}
+
+void loggerDecodePacket(const loggerSchema_t *sc, const char *buf, loggerRecord_t *r) {
+	double t0 = TRACE_HOOK_START(loggerTrace);
+	int i;
+
+	for (i = 0; i < sc->numFields; i++)
+		loggerDecodeField(sc, buf, r, i);
+
+	TRACE_HOOK_ADD(loggerTrace, TRACE_DECODE, t0);
+}
+
+// Makes the AqH packet of a schema in buf (of at least LOGGER_MAX_HEADER bytes). Returns its
+// length, 0 if the schema has no fields.
+int loggerEncodeHeader(const loggerSchema_t *sc, unsigned char *buf) {
+	unsigned char ckA, ckB;
+	int len, i;
+
+	if (!sc->numFields)
+		return 0;
+
+	buf[0] = 'A';
+	buf[1] = 'q';
+	buf[2] = 'H';
+	buf[3] = sc->numFields;
+	memcpy(buf + 4, sc->fields, sc->numFields * sizeof(loggerFields_t));
+	len = 4 + sc->numFields * sizeof(loggerFields_t);
+
+	// the field count is part of the checksum
+	ckA = ckB = 0;
+	for (i = 3; i < len; i++) {
+		ckA += buf[i];
+		ckB += ckA;
+	}
+	buf[len++] = ckA;
+	buf[len++] = ckB;
+
+	return len;
+}
+
+// Makes the AqM packet of record r with the layout of sc in buf (of at least
+// LOGGER_MAX_PACKET + 5 bytes). Returns its length.
+int loggerEncodePacket(const loggerSchema_t *sc, const loggerRecord_t *r, unsigned char *buf) {
+	unsigned char ckA, ckB;
+	int i;
+
+	buf[0] = 'A';
+	buf[1] = 'q';
+	buf[2] = 'M';
+	for (i = 0; i < sc->numFields; i++)
+		loggerEncodeValue(sc->fields[i].fieldType, (char *)buf + 3 + sc->offsets[i], r->data[sc->fields[i].fieldId]);
+
+	ckA = ckB = 0;
+	for (i = 3; i < 3 + sc->packetSize; i++) {
+		ckA += buf[i];
+		ckB += ckA;
 	}
+	buf[i++] = ckA;
+	buf[i++] = ckB;
+
+	return i;
 }
 
-int loggerReadEntryM(FILE *fp, loggerRecord_t *r) {
-	char buf[1024];
+int loggerReadEntryM(loggerStream_t *s) {
 	unsigned char ckA, ckB;
 	int i;
 
-	if (loggerPacketSize > 0 && fread(buf, loggerPacketSize, 1, fp) == 1) {
+	if (s->schema.packetSize > 0 && fread(s->buf, s->schema.packetSize, 1, s->fp) == 1) {
 		// calc checksum
 		ckA = ckB = 0;
-		for (i = 0; i < loggerPacketSize; i++) {
-			ckA += buf[i];
+		for (i = 0; i < s->schema.packetSize; i++) {
+			ckA += s->buf[i];
 			ckB += ckA;
 		}
 
-		if (fgetc(fp) == ckA && fgetc(fp) == ckB) {
-			loggerDecodePacket(buf, r);
-
+		if (fgetc(s->fp) == ckA && fgetc(s->fp) == ckB)
 			return 1;
-		}
 
 		loggerChecksumError("M");
+		s->errors++;
 	}
 
 	return 0;
 }
 
-int loggerReadEntryH(FILE *fp) {
-	char buf[1024];
+int loggerReadEntryH(loggerStream_t *s) {
+	loggerSchema_t *sc = &s->schema;
+	char buf[LOGGER_MAX_FIELDS * sizeof(loggerFields_t)];
 	unsigned char ckA, ckB;
 	int numFields;
 	int i;
 
-	numFields = fgetc(fp);
+	if ((numFields = fgetc(s->fp)) == EOF)
+		return 0;
 
-	if (fread(buf, numFields * sizeof(loggerFields_t), 1, fp) == 1) {
+	if (fread(buf, numFields * sizeof(loggerFields_t), 1, s->fp) == 1) {
 		// calc checksum
 		ckA = ckB = numFields;
 		for (i = 0; i < numFields * sizeof(loggerFields_t); i++) {
@@ -178,37 +460,16 @@ int loggerReadEntryH(FILE *fp) {
 			ckB += ckA;
 		}
 
-		if (fgetc(fp) == ckA && fgetc(fp) == ckB) {
-			loggerFields = (loggerFields_t *)realloc(loggerFields, numFields * sizeof(loggerFields_t));
-			memcpy(loggerFields, buf, numFields * sizeof(loggerFields_t));
-			loggerNumFields = numFields;
-
-			loggerPacketSize = 0;
-			for (i = 0; i < numFields; i++) {
-				switch (loggerFields[i].fieldType) {
-					case LOG_TYPE_DOUBLE:
-						loggerPacketSize += 8;
-						break;
-					case LOG_TYPE_FLOAT:
-					case LOG_TYPE_U32:
-					case LOG_TYPE_S32:
-						loggerPacketSize += 4;
-						break;
-					case LOG_TYPE_U16:
-					case LOG_TYPE_S16:
-						loggerPacketSize += 2;
-						break;
-					case LOG_TYPE_U8:
-					case LOG_TYPE_S8:
-						loggerPacketSize += 1;
-						break;
-				}
-			}
+		if (fgetc(s->fp) == ckA && fgetc(s->fp) == ckB) {
+			memcpy(sc->fields, buf, numFields * sizeof(loggerFields_t));
+			sc->numFields = numFields;
+			loggerSchemaLayout(sc);
 
 			return 1;
 		}
 		else {
 			loggerChecksumError("H");
+			s->errors++;
 		}
 	}
 
@@ -233,13 +494,18 @@ int loggerReadEntryL(FILE *fp, loggerRecord_t *r) {
 		}
 		else {
 			loggerChecksumError("L");
-			return 0;
+			return -1;
 		}
 	}
 	return 0;
 }
 
-int loggerReadEntry(FILE *fp, loggerRecord_t *r) {
+// Reads the next valid packet. AqL records are decoded into r and 'L' is returned;
+// AqM packets are left undecoded in s->buf and 'M' is returned. r is cleared when an AqH
+// header is read.
+int loggerReadPacket(loggerStream_t *s, loggerRecord_t *r) {
+	FILE *fp = s->fp;
+	double t0 = TRACE_HOOK_START(loggerTrace);
 	int c = 0;
 
 	loggerTop:
@@ -251,22 +517,30 @@ int loggerReadEntry(FILE *fp, loggerRecord_t *r) {
 			goto loggerTop;
 
 		c = fgetc(fp);
+		s->pktPos = ftell(fp) - 3;
 
 		if (c == 'L') {
-			if (loggerReadEntryL(fp, r) == 0)
+			if ((c = loggerReadEntryL(fp, r)) <= 0) {
+				s->errors -= c;
+				c = 0;
 				goto loggerTop;
-			else
-				return 1;
+			}
+			TRACE_HOOK_ADD(loggerTrace, TRACE_IO, t0);
+			return 'L';
 		}
 		else if (c == 'H') {
-			loggerReadEntryH(fp);
+			// fields the new schema lacks are not left with values from the old one
+			if (loggerReadEntryH(s)) {
+				s->schemaPos = s->pktPos;
+				memset(r, 0, sizeof(loggerRecord_t));
+			}
 			goto loggerTop;
 		}
 		else if (c == 'M') {
-			if (loggerReadEntryM(fp, r) == 0)
+			if (loggerReadEntryM(s) == 0)
 				goto loggerTop;
-			else
-				return 1;
+			TRACE_HOOK_ADD(loggerTrace, TRACE_IO, t0);
+			return 'M';
 		}
 		else {
 //			fprintf(stderr, "logger: Unknown record type '%d'\n", c);
@@ -275,17 +549,611 @@ int loggerReadEntry(FILE *fp, loggerRecord_t *r) {
 
 	}
 
+	TRACE_HOOK_ADD(loggerTrace, TRACE_IO, t0);
+
 	return EOF;
 }
 
-// allocates memory and reads an entire log
-int loggerReadLog(const char *fname, loggerRecord_t **l) {
-	loggerRecord_t buf;
+// Positions the stream at offset (eg. one saved from pktPos), with the schema of the AqH header
+// at schemaPos (saved from the stream's schemaPos when it was there), or the schema as it is
+// if schemaPos is -1. Returns 0 if that header cannot be read.
+int loggerStreamSeek(loggerStream_t *s, long schemaPos, long offset) {
+	char id[3];
+
+	if (schemaPos >= 0) {
+		if (fseek(s->fp, schemaPos, SEEK_SET) || fread(id, 3, 1, s->fp) != 1 || memcmp(id, "AqH", 3) || !loggerReadEntryH(s))
+			return 0;
+		s->schemaPos = schemaPos;
+	}
+
+	return (fseek(s->fp, offset, SEEK_SET) == 0);
+}
+
+int loggerReadEntry(FILE *fp, loggerRecord_t *r) {
+	int c;
+
+	loggerDefaultStream.fp = fp;
+
+	if ((c = loggerReadPacket(&loggerDefaultStream, r)) == EOF)
+		return EOF;
+
+	if (c == 'M')
+		loggerDecodePacket(&loggerDefaultStream.schema, loggerDefaultStream.buf, r);
+
+	return 1;
+}
+
+// Bits of AqZ archive blocks are kept most significant first. The reader loads 8 bytes at a
+// time, so what it reads must be followed by 8 spare bytes.
+typedef struct {
+	unsigned char *buf;
+	long len, size;
+	uint64_t acc;									// bits not yet in buf
+	int n;											// how many
+} loggerBits_t;
+
+typedef struct {
+	const unsigned char *p;
+	uint64_t pos;									// in bits
+} loggerBitReader_t;
+
+// bits of the prefixes 0, 10, 110, 1110, 11110 and 11111 of coded differences
+static const int loggerPackVarBits[] = {0, 6, 10, 16, 32, 64};
+
+static void loggerBitsGrow(loggerBits_t *b, long n) {
+	if (b->len + n > b->size) {
+		b->size = (b->len + n) * 2;
+		b->buf = (unsigned char *)realloc(b->buf, b->size);
+	}
+}
+
+static void loggerBitsPut(loggerBits_t *b, uint64_t v, int bits) {
+	if (bits > 32) {
+		loggerBitsPut(b, v >> 32, bits - 32);
+		bits = 32;
+	}
+	loggerBitsGrow(b, 8);
+	b->acc = (b->acc << bits) | (v & ((1ULL << bits) - 1));
+	b->n += bits;
+	while (b->n >= 8) {
+		b->n -= 8;
+		b->buf[b->len++] = b->acc >> b->n;
+	}
+}
+
+static void loggerBitsFlush(loggerBits_t *b) {
+	if (b->n)
+		loggerBitsPut(b, 0, 8 - b->n);
+}
+
+// appends whole bytes (after loggerBitsFlush())
+static void loggerBitsBytes(loggerBits_t *b, const void *p, long n) {
+	loggerBitsGrow(b, n);
+	memcpy(b->buf + b->len, p, n);
+	b->len += n;
+}
+
+// the next 57 or more bits, at the top
+static inline uint64_t loggerBitsPeek(const loggerBitReader_t *r) {
+	uint64_t w;
+
+	memcpy(&w, r->p + (r->pos >> 3), 8);
+	return __builtin_bswap64(w) << (r->pos & 7);
+}
+
+static inline uint64_t loggerBitsGet(loggerBitReader_t *r, int bits) {
+	uint64_t v;
+
+	if (bits > 32) {
+		v = loggerBitsGet(r, bits - 32) << 32;
+		return v | loggerBitsGet(r, 32);
+	}
+	if (!bits)
+		return 0;
+	v = loggerBitsPeek(r) >> (64 - bits);
+	r->pos += bits;
+
+	return v;
+}
+
+static void loggerPackPutDiff(loggerBits_t *b, int64_t d) {
+	uint64_t z = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);	// zigzag: small magnitudes are small
+	int k;
+
+	if (!z) {
+		loggerBitsPut(b, 0, 1);
+		return;
+	}
+	for (k = 1; k < 5 && z >> loggerPackVarBits[k]; k++)
+		;
+	loggerBitsPut(b, (k < 5) ? (1 << (k + 1)) - 2 : 31, (k < 5) ? k + 1 : 5);
+	loggerBitsPut(b, z, loggerPackVarBits[k]);
+}
+
+static inline int64_t loggerPackGetDiff(loggerBitReader_t *r) {
+	uint64_t w = ~loggerBitsPeek(r), z;
+	int k = w ? __builtin_clzll(w) : 64;
+
+	if (k >= 5) {
+		k = 5;
+		r->pos += 5;
+	}
+	else {
+		r->pos += k + 1;
+	}
+	z = loggerBitsGet(r, loggerPackVarBits[k]);
+
+	return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+// codes the values v[1..n-1] of a field after the first; width is 32 or 64 bits for XOR
+static void loggerPackCode(loggerBits_t *b, int coding, int width, const uint64_t *v, int n) {
+	int lb = (width == 64) ? 6 : 5;
+	int lead, trail, len, pl = -1, pt = 0;
+	int64_t d, last = 0;
+	uint64_t x;
+	int j;
+
+	for (j = 1; j < n; j++) {
+		switch (coding) {
+			case LOGGER_PACK_DELTA:
+				loggerPackPutDiff(b, (int64_t)(v[j] - v[j-1]));
+				break;
+			case LOGGER_PACK_DOD:
+				d = (int64_t)(v[j] - v[j-1]);
+				loggerPackPutDiff(b, d - last);
+				last = d;
+				break;
+			case LOGGER_PACK_XOR:
+				if (!(x = v[j] ^ v[j-1])) {
+					loggerBitsPut(b, 0, 1);
+					break;
+				}
+				lead = __builtin_clzll(x) - (64 - width);
+				trail = __builtin_ctzll(x);
+				// within the meaningful bits of the last value, or new ones
+				if (pl >= 0 && lead >= pl && trail >= pt) {
+					loggerBitsPut(b, 2, 2);
+					loggerBitsPut(b, x >> pt, width - pl - pt);
+				}
+				else {
+					len = width - lead - trail;
+					loggerBitsPut(b, 3, 2);
+					loggerBitsPut(b, lead, lb);
+					loggerBitsPut(b, len - 1, lb);
+					loggerBitsPut(b, x >> trail, len);
+					pl = lead;
+					pt = trail;
+				}
+				break;
+		}
+	}
+}
+
+// Decodes the values v[1..n-1] of a field after the first. Returns 0 if the bits run past
+// limit (a bad block).
+static int loggerPackDecode(loggerBitReader_t *r, uint64_t limit, int coding, int width, uint64_t *v, int n) {
+	int lb = (width == 64) ? 6 : 5;
+	int len = 0, pt = 0;
+	int64_t d = 0;
+	uint64_t w;
+	int j;
+
+	switch (coding) {
+		case LOGGER_PACK_CONST:
+			for (j = 1; j < n; j++)
+				v[j] = v[0];
+			return 1;
+
+		case LOGGER_PACK_DELTA:
+			for (j = 1; j < n && r->pos <= limit; j++)
+				v[j] = v[j-1] + loggerPackGetDiff(r);
+			break;
+
+		case LOGGER_PACK_DOD:
+			for (j = 1; j < n && r->pos <= limit; j++) {
+				d += loggerPackGetDiff(r);
+				v[j] = v[j-1] + d;
+			}
+			break;
+
+		case LOGGER_PACK_XOR:
+			for (j = 1; j < n && r->pos <= limit; j++) {
+				w = loggerBitsPeek(r);
+				if (!(w >> 63)) {
+					r->pos++;
+					v[j] = v[j-1];
+					continue;
+				}
+				r->pos += 2;
+				if (w & (1ULL << 62)) {
+					pt = loggerBitsGet(r, lb);				// leading zeros, for now
+					len = loggerBitsGet(r, lb) + 1;
+					pt = width - pt - len;
+				}
+				v[j] = v[j-1] ^ (loggerBitsGet(r, len) << pt);
+			}
+			break;
+
+		default:
+			return 0;
+	}
+
+	return (j == n && r->pos <= limit);
+}
+
+// value of a field as the 64 bits first stored by the AqZ codings: integers sign extended,
+// floats and doubles as their bits
+static uint64_t loggerPackRaw(int type, const char *p) {
+	uint32_t f;
+	uint64_t d;
+
+	switch (type) {
+		case LOG_TYPE_DOUBLE:
+			memcpy(&d, p, 8);
+			return d;
+		case LOG_TYPE_FLOAT:
+			memcpy(&f, p, 4);
+			return f;
+		default:
+			return (int64_t)loggerFieldValue(type, p);
+	}
+}
+
+static void loggerChecksum(const unsigned char *p, long n, unsigned char *ck) {
+	unsigned char ckA = 0, ckB = 0;
+	long i;
+
+	for (i = 0; i < n; i++) {
+		ckA += p[i];
+		ckB += ckA;
+	}
+	ck[0] = ckA;
+	ck[1] = ckB;
+}
+
+// Makes the header of an AqZ archive in buf (of at least LOGGER_PACK_HEADER_SIZE(numBlocks)
+// bytes), blockLens being the byte length of each block. Returns its length.
+int loggerPackEncodeHeader(const loggerSchema_t *sc, int blockRecords, int numRecords, int numBlocks, const uint32_t *blockLens, unsigned char *buf) {
+	uint32_t counts[3] = {(uint32_t)blockRecords, (uint32_t)numRecords, (uint32_t)numBlocks};
+	int len;
+
+	buf[0] = 'A';
+	buf[1] = 'q';
+	buf[2] = 'Z';
+	buf[3] = LOGGER_PACK_VERSION;
+	len = 4 + loggerEncodeHeader(sc, buf + 4);
+	memcpy(buf + len, counts, sizeof(counts));
+	len += sizeof(counts);
+	memcpy(buf + len, blockLens, numBlocks * 4);
+	len += numBlocks * 4;
+	loggerChecksum(buf + 3, len - 3, buf + len);
+
+	return len + 2;
+}
+
+// Codes records data[0..n-1] (in the layout of sc) as an AqZ block in *buf, which is
+// allocated. Each field gets the coding which takes the fewest bits. Returns its length.
+long loggerPackEncodeBlock(const loggerSchema_t *sc, const char *data, int n, unsigned char **buf) {
+	loggerBits_t out, best, cur, t;
+	uint64_t *raw, *ival;
+	uint32_t u32 = n;
+	unsigned char ck[2], coding, c;
+	int i, j, type, width, same, isInt, isFloat;
+	double v;
+	const char *p;
+
+	memset(&out, 0, sizeof(out));
+	memset(&best, 0, sizeof(best));
+	memset(&cur, 0, sizeof(cur));
+	raw = (uint64_t *)malloc(n * sizeof(uint64_t));
+	ival = (uint64_t *)malloc(n * sizeof(uint64_t));
+
+	loggerBitsBytes(&out, &u32, 4);
+
+	for (i = 0; i < sc->numFields; i++) {
+		type = sc->fields[i].fieldType;
+		width = (type == LOG_TYPE_FLOAT) ? 32 : 64;
+		same = 1;
+		isFloat = (type == LOG_TYPE_DOUBLE || type == LOG_TYPE_FLOAT);
+		isInt = !isFloat;
+
+		for (j = 0, p = data + sc->offsets[i]; j < n; j++, p += sc->packetSize) {
+			raw[j] = loggerPackRaw(type, p);
+			same &= (raw[j] == raw[0]);
+		}
+
+		// floats and doubles which are all integers can be coded as differences too
+		if (isFloat) {
+			isInt = 1;
+			for (j = 0, p = data + sc->offsets[i]; j < n && isInt; j++, p += sc->packetSize) {
+				v = loggerFieldValue(type, p);
+				isInt = (v == floor(v) && fabs(v) < 9007199254740992.0 && !(v == 0.0 && signbit(v)));
+				ival[j] = (int64_t)v;
+			}
+		}
+		else {
+			memcpy(ival, raw, n * sizeof(uint64_t));
+		}
+
+		best.len = best.n = 0;
+		coding = LOGGER_PACK_CONST;
+		loggerBitsPut(&best, raw[0], 64);
+		if (!same) {
+			for (c = LOGGER_PACK_DELTA; c <= LOGGER_PACK_XOR; c++) {
+				if ((c == LOGGER_PACK_XOR) ? !isFloat : !isInt)
+					continue;
+				cur.len = cur.n = 0;
+				loggerBitsPut(&cur, (c == LOGGER_PACK_XOR) ? raw[0] : ival[0], 64);
+				loggerPackCode(&cur, c, width, (c == LOGGER_PACK_XOR) ? raw : ival, n);
+				if (coding == LOGGER_PACK_CONST || cur.len < best.len) {
+					t = best;
+					best = cur;
+					cur = t;
+					coding = c;
+				}
+			}
+		}
+		loggerBitsFlush(&best);
+
+		u32 = best.len;
+		loggerBitsBytes(&out, &coding, 1);
+		loggerBitsBytes(&out, &u32, 4);
+		loggerBitsBytes(&out, best.buf, best.len);
+	}
+
+	loggerChecksum(out.buf, out.len, ck);
+	loggerBitsBytes(&out, ck, 2);
+
+	free(raw);
+	free(ival);
+	free(best.buf);
+	free(cur.buf);
+
+	*buf = out.buf;
+
+	return out.len;
+}
+
+// Decodes an AqZ block of len bytes at buf (followed by 8 spare bytes) in to records at
+// data, in the layout of sc, with room for maxRecords. Returns the number of records, -1 if
+// the block is bad or has more records than that.
+int loggerPackDecodeBlock(const loggerSchema_t *sc, const unsigned char *buf, long len, char *data, int maxRecords) {
+	loggerBitReader_t r;
+	uint64_t *v;
+	uint32_t n, j, flen;
+	unsigned char ck[2];
+	int i, type, coding, ok = 1;
+	long pos = 4;
+	char *p;
+
+	if (len < 6)
+		return -1;
+	loggerChecksum(buf, len - 2, ck);
+	if (ck[0] != buf[len-2] || ck[1] != buf[len-1])
+		return -1;
+	len -= 2;
+
+	memcpy(&n, buf, 4);
+	if (maxRecords < 0 || n > (uint32_t)maxRecords)
+		return -1;
+	v = (uint64_t *)malloc((n ? n : 1) * sizeof(uint64_t));
+
+	for (i = 0; ok && i < sc->numFields; i++) {
+		if (pos + 5 > len)
+			break;
+		coding = buf[pos];
+		memcpy(&flen, buf + pos + 1, 4);
+		pos += 5;
+		if (pos + flen > len || flen < 8)
+			break;
+
+		type = sc->fields[i].fieldType;
+		r.p = buf + pos;
+		r.pos = 0;
+		v[0] = loggerBitsGet(&r, 64);
+		if (!(ok = loggerPackDecode(&r, flen * 8, coding, (type == LOG_TYPE_FLOAT) ? 32 : 64, v, n)))
+			break;
+		pos += flen;
+
+		// differences of floats and doubles are of their integer values
+		p = data + sc->offsets[i];
+		if (type == LOG_TYPE_DOUBLE && (coding == LOGGER_PACK_DELTA || coding == LOGGER_PACK_DOD)) {
+			for (j = 0; j < n; j++, p += sc->packetSize)
+				*(double *)p = (int64_t)v[j];
+		}
+		else if (type == LOG_TYPE_FLOAT && (coding == LOGGER_PACK_DELTA || coding == LOGGER_PACK_DOD)) {
+			for (j = 0; j < n; j++, p += sc->packetSize)
+				*(float *)p = (int64_t)v[j];
+		}
+		else if (type == LOG_TYPE_DOUBLE) {
+			for (j = 0; j < n; j++, p += sc->packetSize)
+				memcpy(p, &v[j], 8);
+		}
+		else if (type == LOG_TYPE_FLOAT) {
+			for (j = 0; j < n; j++, p += sc->packetSize)
+				memcpy(p, &v[j], 4);
+		}
+		else if (type == LOG_TYPE_U8 || type == LOG_TYPE_S8) {
+			for (j = 0; j < n; j++, p += sc->packetSize)
+				*(uint8_t *)p = v[j];
+		}
+		else if (type == LOG_TYPE_U16 || type == LOG_TYPE_S16) {
+			for (j = 0; j < n; j++, p += sc->packetSize)
+				*(uint16_t *)p = v[j];
+		}
+		else {
+			for (j = 0; j < n; j++, p += sc->packetSize)
+				*(uint32_t *)p = v[j];
+		}
+	}
+
+	free(v);
+
+	return (i == sc->numFields && pos == len) ? (int)n : -1;
+}
+
+// Opens an AqZ archive and reads its header. Returns 1 if opened, 0 if fname cannot be
+// opened or is not an AqZ archive, -1 if it is one but cannot be read.
+int loggerPackOpen(const char *fname, loggerPack_t *z) {
+	unsigned char *buf;
+	uint32_t counts[3], blen;
+	unsigned char ck[2];
+	long len, pos;
+	int i, numFields;
+
+	memset(z, 0, sizeof(loggerPack_t));
+	if (!(z->fp = fopen(fname, "rb")))
+		return 0;
+
+	buf = (unsigned char *)malloc(LOGGER_PACK_HEADER_SIZE(0));
+	if (fread(buf, 8, 1, z->fp) != 1 || buf[0] != 'A' || buf[1] != 'q' || buf[2] != 'Z') {
+		free(buf);
+		fclose(z->fp);
+		z->fp = NULL;
+		return 0;
+	}
+
+	if (buf[3] != LOGGER_PACK_VERSION || buf[4] != 'A' || buf[5] != 'q' || buf[6] != 'H') {
+		fprintf(stderr, "logger: '%s' is an AqZ archive of unknown version %d\n", fname, buf[3]);
+		goto loggerPackBad;
+	}
+
+	// the AqH header, the counts, then the block lengths
+	numFields = buf[7];
+	len = 8 + numFields * sizeof(loggerFields_t) + 2 + sizeof(counts);
+	if (fread(buf + 8, len - 8, 1, z->fp) != 1)
+		goto loggerPackBad;
+	memcpy(counts, buf + len - sizeof(counts), sizeof(counts));
+	if (!counts[0] || counts[2] != (counts[1] + counts[0] - 1) / counts[0])
+		goto loggerPackBad;
+
+	buf = (unsigned char *)realloc(buf, len + counts[2] * 4 + 2);
+	if (fread(buf + len, counts[2] * 4 + 2, 1, z->fp) != 1)
+		goto loggerPackBad;
+	loggerChecksum(buf + 3, len - 3 + counts[2] * 4, ck);
+	if (ck[0] != buf[len + counts[2] * 4] || ck[1] != buf[len + counts[2] * 4 + 1])
+		goto loggerPackBad;
+
+	z->schema.numFields = numFields;
+	memcpy(z->schema.fields, buf + 8, numFields * sizeof(loggerFields_t));
+	loggerSchemaLayout(&z->schema);
+	z->blockRecords = counts[0];
+	z->numRecords = counts[1];
+	z->numBlocks = counts[2];
+
+	z->blockPos = (long *)malloc((z->numBlocks + 1) * sizeof(long));
+	pos = len + z->numBlocks * 4 + 2;
+	for (i = 0; i < z->numBlocks; i++) {
+		z->blockPos[i] = pos;
+		memcpy(&blen, buf + len + i * 4, 4);
+		pos += blen;
+	}
+	z->blockPos[i] = pos;
+
+	free(buf);
+
+	return 1;
+
+loggerPackBad:
+	fprintf(stderr, "logger: bad AqZ archive header in '%s'\n", fname);
+	free(buf);
+	fclose(z->fp);
+	z->fp = NULL;
+
+	return -1;
+}
+
+// Reads the bytes of block b of an open archive in to buf, which must have room for them and
+// 8 more. Returns their number, -1 on error.
+long loggerPackReadBlock(loggerPack_t *z, int b, unsigned char *buf) {
+	long len = z->blockPos[b+1] - z->blockPos[b];
+
+	if (fseek(z->fp, z->blockPos[b], SEEK_SET) || fread(buf, len, 1, z->fp) != 1)
+		return -1;
+	memset(buf + len, 0, 8);
+
+	return len;
+}
+
+void loggerPackClose(loggerPack_t *z) {
+	if (z->fp)
+		fclose(z->fp);
+	free(z->blockPos);
+	z->fp = NULL;
+	z->blockPos = NULL;
+}
+
+// reads all records of an open AqZ archive in to l
+static int loggerReadPackLog(const char *fname, loggerPack_t *z, loggerLog_t *l) {
+	unsigned char *buf = NULL;
+	long len, maxLen = 0;
+	int b, n = 0;
+
+	l->schema = z->schema;
+	for (b = 0; b < z->numBlocks; b++)
+		if (z->blockPos[b+1] - z->blockPos[b] > maxLen)
+			maxLen = z->blockPos[b+1] - z->blockPos[b];
+
+	if (z->numRecords && z->schema.packetSize)
+		l->data = (char *)calloc(z->numRecords, z->schema.packetSize);
+	if (l->data)
+		buf = (unsigned char *)malloc(maxLen + 8);
+
+	for (b = 0; buf && b < z->numBlocks; b++) {
+		if ((len = loggerPackReadBlock(z, b, buf)) < 0 || loggerPackDecodeBlock(&z->schema, buf, len,
+				l->data + (long)n * z->schema.packetSize, z->numRecords - n) != ((b < z->numBlocks - 1) ? z->blockRecords : z->numRecords - n)) {
+			fprintf(stderr, "logger: bad block %d in AqZ archive '%s'\n", b, fname);
+			break;
+		}
+		n += (b < z->numBlocks - 1) ? z->blockRecords : z->numRecords - n;
+	}
+	l->numRecords = n;
+
+	free(buf);
+	loggerPackClose(z);
+
+	return n;
+}
+
+// adds the fields of s to the layout sc of a whole log; a field logged as more than one
+// type is kept as a double
+static void loggerLogAddFields(loggerSchema_t *sc, const loggerSchema_t *s) {
+	loggerFields_t *f;
+	int i, j;
+
+	for (i = 0; i < s->numFields; i++) {
+		if ((j = sc->fieldIndex[s->fields[i].fieldId]) < 0) {
+			f = &sc->fields[sc->numFields];
+			sc->fieldIndex[s->fields[i].fieldId] = sc->numFields++;
+			*f = s->fields[i];
+		}
+		else if (sc->fields[j].fieldType != s->fields[i].fieldType) {
+			sc->fields[j].fieldType = LOG_TYPE_DOUBLE;
+		}
+	}
+}
+
+static int loggerSchemaEqual(const loggerSchema_t *a, const loggerSchema_t *b) {
+	return (a->numFields == b->numFields && !memcmp(a->fields, b->fields, a->numFields * sizeof(loggerFields_t)));
+}
+
+// Reads an entire log (or AqZ archive) in to l, see loggerLog_t. Returns the number of records.
+int loggerReadLog(const char *fname, loggerLog_t *l) {
+	loggerStream_t *s;
+	loggerPack_t z;
+	loggerSchema_t last;
+	loggerRecord_t r;
+	char *p;
+	int legacy = 0, same = 0;
+	int c, i, j, n = 0;
 	FILE *fp;
-	int n = 0;
-	int i;
 
-	*l = NULL;
+	memset(l, 0, sizeof(loggerLog_t));
+	memset(l->schema.fieldIndex, -1, sizeof(l->schema.fieldIndex));
+
+	if ((c = loggerPackOpen(fname, &z)))
+		return (c > 0) ? loggerReadPackLog(fname, &z, l) : 0;
 
 #if defined (__WIN32__)
 	fp = fopen(fname, "rb");
@@ -294,47 +1162,90 @@ int loggerReadLog(const char *fname, loggerRecord_t **l) {
 #endif
 	if (fp == NULL) {
 		fprintf(stderr, "logger: cannot open log file '%s'\n", fname);
+		return 0;
 	}
-	else {
-		loggerPacketSize = 0;
-		loggerNumFields = 0;
 
-		// force header read
-		loggerReadEntry(fp, &buf);
-		rewind(fp);
+	s = (loggerStream_t *)malloc(sizeof(loggerStream_t));
+	loggerStreamInit(s, fp);
+	last.numFields = 0;
 
-		while (loggerReadEntry(fp, &buf) != EOF)
-			n++;
+	// count the records and collect the fields of each header
+	while ((c = loggerReadPacket(s, &r)) != EOF) {
+		if (c == 'L') {
+			legacy = 1;
+		}
+		else if (!loggerSchemaEqual(&last, &s->schema)) {
+			last = s->schema;
+			loggerLogAddFields(&l->schema, &last);
+		}
+		n++;
+	}
+
+	// AqL records have every field, as doubles
+	if (legacy) {
+		for (i = 0; i < LOG_NUM_IDS; i++) {
+			last.fields[i].fieldId = i;
+			last.fields[i].fieldType = LOG_TYPE_DOUBLE;
+		}
+		last.numFields = LOG_NUM_IDS;
+		loggerLogAddFields(&l->schema, &last);
+	}
+	loggerSchemaLayout(&l->schema);
 
-		*l = (loggerRecord_t *)calloc(n, sizeof(loggerRecord_t));
+	if (n && l->schema.packetSize)
+		l->data = (char *)calloc(n, l->schema.packetSize);
+	if (!l->data)
+		n = 0;
 
-		rewind(fp);
+	rewind(fp);
+	loggerStreamInit(s, fp);
+	last.numFields = 0;
 
-		for (i = 0; i < n; i++)
-			loggerReadEntry(fp, &(*l)[i]);
+	for (i = 0; i < n && (c = loggerReadPacket(s, &r)) != EOF; i++) {
+		p = l->data + (long)i * l->schema.packetSize;
+
+		if (c == 'M') {
+			if (!loggerSchemaEqual(&last, &s->schema)) {
+				last = s->schema;
+				same = loggerSchemaEqual(&last, &l->schema);
+			}
+			// the usual case, one header for the whole log
+			if (same) {
+				memcpy(p, s->buf, l->schema.packetSize);
+				continue;
+			}
+			memset(&r, 0, sizeof(r));
+			loggerDecodePacket(&s->schema, s->buf, &r);
+		}
 
-		fclose(fp);
+		for (j = 0; j < l->schema.numFields; j++)
+			loggerEncodeValue(l->schema.fields[j].fieldType, p + l->schema.offsets[j], r.data[l->schema.fields[j].fieldId]);
 	}
+	l->numRecords = i;
 
-	return n;
+	free(s);
+	fclose(fp);
+
+	return l->numRecords;
+}
+
+// expands record rec of a loaded log in to r
+void loggerLogRecord(const loggerLog_t *l, int rec, loggerRecord_t *r) {
+	memset(r, 0, sizeof(loggerRecord_t));
+	loggerDecodePacket(&l->schema, l->data + (long)rec * l->schema.packetSize, r);
 }
 
 int loggerRecordSize(void) {
-	if (loggerPacketSize)
-		return loggerPacketSize + 2 + 3;
+	if (loggerDefaultStream.schema.packetSize)
+		return loggerDefaultStream.schema.packetSize + 2 + 3;
 	else
 		return (sizeof(loggerRecord_t));
 }
 
-void loggerFree(loggerRecord_t *l) {
-	if (l) {
-		free(l);
-		l = NULL;
-	}
+void loggerFree(loggerLog_t *l) {
+	free(l->data);
+	l->data = NULL;
+	l->numRecords = 0;
 
-	if (loggerFields) {
-		free(loggerFields);
-		loggerPacketSize = 0;
-		loggerNumFields = 0;
-	}
+	loggerStreamInit(&loggerDefaultStream, NULL);
 }
@@ -24,6 +24,7 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
 
 enum log_fields {
 	LOG_LASTUPDATE = 0,
@@ -137,117 +138,7 @@ enum log_fields {
 	LOG_NUM_IDS
 };
 
-static const char *loggerFieldLabels[] = {
-	"LASTUPDATE",
-	"VOLTAGE0",
-	"VOLTAGE1",
-	"VOLTAGE2",
-	"VOLTAGE3",
-	"VOLTAGE4",
-	"VOLTAGE5",
-	"VOLTAGE6",
-	"VOLTAGE7",
-	"VOLTAGE8",
-	"VOLTAGE9",
-	"VOLTAGE10",
-	"VOLTAGE11",
-	"VOLTAGE12",
-	"VOLTAGE13",
-	"VOLTAGE14",
-	"IMU_RATEX",
-	"IMU_RATEY",
-	"IMU_RATEZ",
-	"IMU_ACCX",
-	"IMU_ACCY",
-	"IMU_ACCZ",
-	"IMU_MAGX",
-	"IMU_MAGY",
-	"IMU_MAGZ",
-	"GPS_PDOP",
-	"GPS_HDOP",
-	"GPS_VDOP",
-	"GPS_TDOP",
-	"GPS_NDOP",
-	"GPS_EDOP",
-	"GPS_ITOW",
-	"GPS_POS_UPDATE",
-	"GPS_LAT",
-	"GPS_LON",
-	"GPS_HEIGHT",
-	"GPS_HACC",
-	"GPS_VACC",
-	"GPS_VEL_UPDATE",
-	"GPS_VELN",
-	"GPS_VELE",
-	"GPS_VELD",
-	"GPS_SACC",
-	"ADC_PRESSURE1",
-	"ADC_PRESSURE2",
-	"ADC_TEMP0",
-	"ADC_TEMP1",
-	"ADC_TEMP2",
-	"ADC_VIN",
-	"ADC_MAG_SIGN",
-	"UKF_Q1",
-	"UKF_Q2",
-	"UKF_Q3",
-	"UKF_Q4",
-	"UKF_POSN",
-	"UKF_POSE",
-	"UKF_POSD",
-	"UKF_PRES_ALT",
-	"UKF_ALT (m)",
-	"UKF_VELN (m/s)",
-	"UKF_VELE (m/s)",
-	"UKF_VELD (m/s)",
-	"MOT_MOTOR0",
-	"MOT_MOTOR1",
-	"MOT_MOTOR2",
-	"MOT_MOTOR3",
-	"MOT_MOTOR4",
-	"MOT_MOTOR5",
-	"MOT_MOTOR6",
-	"MOT_MOTOR7",
-	"MOT_MOTOR8",
-	"MOT_MOTOR9",
-	"MOT_MOTOR10",
-	"MOT_MOTOR11",
-	"MOT_MOTOR12",
-	"MOT_MOTOR13",
-	"MOT_THROTTLE",
-	"MOT_PITCH",
-	"MOT_ROLL",
-	"MOT_YAW",
-	"RADIO_QUALITY",
-	"RADIO_CHANNEL0",
-	"RADIO_CHANNEL1",
-	"RADIO_CHANNEL2",
-	"RADIO_CHANNEL3",
-	"RADIO_CHANNEL4",
-	"RADIO_CHANNEL5",
-	"RADIO_CHANNEL6",
-	"RADIO_CHANNEL7",
-	"RADIO_CHANNEL8",
-	"RADIO_CHANNEL9",
-	"RADIO_CHANNEL10",
-	"RADIO_CHANNEL11",
-	"RADIO_CHANNEL12",
-	"RADIO_CHANNEL13",
-	"RADIO_CHANNEL14",
-	"RADIO_CHANNEL15",
-	"RADIO_CHANNEL16",
-	"RADIO_CHANNEL17",
-	"RADIO_ERRORS",
-	"GMBL_TRIGGER",
-	"ACC_BIAS_X",
-	"ACC_BIAS_Y",
-	"ACC_BIAS_Z",
-	"CURRENT_PDB",
-	"CURRENT_EXT",
-	"VIN_PDB",
-	"UKF_ALT_VEL",
-	0 // terminate
-};
+extern const char *loggerFieldLabels[];			// [LOG_NUM_IDS + 1], NULL terminated
 
 enum log_field_types {
 	LOG_TYPE_DOUBLE = 0,
@@ -300,9 +191,132 @@ typedef struct {
 
 } __attribute__((packed)) loggerRecord_t;
 
+#define LOGGER_MAX_FIELDS	256
+#define LOGGER_MAX_PACKET	(LOGGER_MAX_FIELDS * 8)
+#define LOGGER_MAX_HEADER	(LOGGER_MAX_FIELDS * 2 + 6)
+
+// field layout of AqM packets, as described by the last AqH header read
+typedef struct {
+	loggerFields_t fields[LOGGER_MAX_FIELDS];
+	unsigned short offsets[LOGGER_MAX_FIELDS];		// byte offset of each field in packet
+	short fieldIndex[LOGGER_MAX_FIELDS];			// packet field index by field ID, -1 if not logged
+	int numFields;
+	int packetSize;
+} loggerSchema_t;
+
+// A whole log held in memory by loggerReadLog(). Each record is kept as packed values of
+// the types they were logged with (as an AqM packet payload), at about the size of the
+// log file rather than of a loggerRecord_t each. All records have the layout of schema:
+// that of the log's AqH header, or if the header changes during the log, one of all the
+// fields logged (as double where a field's type changes). AqL records are kept as the
+// doubles they are logged as.
+typedef struct {
+	loggerSchema_t schema;
+	char *data;										// numRecords * schema.packetSize bytes
+	int numRecords;
+} loggerLog_t;
+
+// value of the given type at p, as a double
+static inline double loggerFieldValue(int type, const char *p) {
+	switch (type) {
+		case LOG_TYPE_DOUBLE:	return *(const double *)p;
+		case LOG_TYPE_FLOAT:	return *(const float *)p;
+		case LOG_TYPE_U32:		return *(const uint32_t *)p;
+		case LOG_TYPE_S32:		return *(const int32_t *)p;
+		case LOG_TYPE_U16:		return *(const uint16_t *)p;
+		case LOG_TYPE_S16:		return *(const int16_t *)p;
+		case LOG_TYPE_U8:		return *(const uint8_t *)p;
+		case LOG_TYPE_S8:		return *(const int8_t *)p;
+	}
+	return 0.0;
+}
+
+// type of a field in a loaded log (LOG_TYPE_x), -1 if it was not logged
+static inline int loggerLogFieldType(const loggerLog_t *l, int fieldId) {
+	int i = l->schema.fieldIndex[fieldId];
+
+	return (i < 0) ? -1 : l->schema.fields[i].fieldType;
+}
+
+// pointer to the value of a field in record rec, of type loggerLogFieldType(); NULL if not logged
+static inline const void *loggerLogField(const loggerLog_t *l, int rec, int fieldId) {
+	int i = l->schema.fieldIndex[fieldId];
+
+	return (i < 0) ? NULL : l->data + (long)rec * l->schema.packetSize + l->schema.offsets[i];
+}
+
+// value of a field in record rec, 0 if not logged (as in loggerRecord_t.data[])
+static inline double loggerLogValue(const loggerLog_t *l, int rec, int fieldId) {
+	int i = l->schema.fieldIndex[fieldId];
+
+	return (i < 0) ? 0.0 : loggerFieldValue(l->schema.fields[i].fieldType, l->data + (long)rec * l->schema.packetSize + l->schema.offsets[i]);
+}
+
+// AqZ archives (written by logPack) hold the records of a loaded log in blocks, each of
+// which decodes on its own. The file is "AqZ", a version byte, the AqH header of the
+// records, the records per block, record count and block count (u32 each), the byte length
+// of each block (u32 each) and a checksum of all from the version byte on. Each block
+// has its record count (u32), then for each field of the header in turn a coding byte
+// (LOGGER_PACK_x), the byte length of its bits (u32) and the bits, and lastly a checksum.
+// The first value of a field is stored whole (64 bits: integers sign extended, floats and
+// doubles as their bits) and the rest as differences from the last value (DELTA), from
+// the last difference (DOD), or XORed with the last value (XOR, for floats and doubles).
+#define LOGGER_PACK_VERSION	1
+#define LOGGER_PACK_BLOCK	4096						// default records per block
+
+enum loggerPackCodings {
+	LOGGER_PACK_CONST = 0,								// all values are the first
+	LOGGER_PACK_DELTA,
+	LOGGER_PACK_DOD,
+	LOGGER_PACK_XOR
+};
+
+typedef struct {
+	loggerSchema_t schema;
+	int blockRecords;
+	int numRecords;
+	int numBlocks;
+	long *blockPos;										// file offset of each block, and the end of the last
+	FILE *fp;
+} loggerPack_t;
+
+// bytes needed for the header of an AqZ archive of n blocks
+#define LOGGER_PACK_HEADER_SIZE(n)	(4 + LOGGER_MAX_HEADER + 12 + (n) * 4 + 2)
+
+// reader state for one log file; lets packets be read and checked without decoding them
+typedef struct {
+	FILE *fp;
+	loggerSchema_t schema;
+	long pktPos;									// file offset of last packet read
+	long schemaPos;									// file offset of the AqH header of schema, -1 if none
+	int errors;										// packets with checksum errors so far
+	char buf[LOGGER_MAX_PACKET];					// raw payload of last AqM packet read
+} loggerStream_t;
+
+// timing hooks for --trace (see trace.h), set by logDump; NULL while not tracing
+extern const struct traceHooks_s *loggerTrace;
+
+extern void loggerStreamInit(loggerStream_t *s, FILE *fp);
+extern int loggerStreamSync(loggerStream_t *s, long offset, int type);
+extern int loggerStreamSeek(loggerStream_t *s, long schemaPos, long offset);
+extern int loggerReadPacket(loggerStream_t *s, loggerRecord_t *r);
+extern void loggerDecodeField(const loggerSchema_t *sc, const char *buf, loggerRecord_t *r, int i);
+extern void loggerDecodeFieldIds(const loggerSchema_t *sc, const char *buf, loggerRecord_t *r, const int *ids, int n);
+extern void loggerDecodePacket(const loggerSchema_t *sc, const char *buf, loggerRecord_t *r);
+extern void loggerEncodeValue(int type, char *p, double v);
+extern void loggerSchemaLayout(loggerSchema_t *sc);
+extern int loggerEncodeHeader(const loggerSchema_t *sc, unsigned char *buf);
+extern int loggerEncodePacket(const loggerSchema_t *sc, const loggerRecord_t *r, unsigned char *buf);
 extern int loggerReadEntry(FILE *fp, loggerRecord_t *r);
-extern int loggerReadLog(const char *fname, loggerRecord_t **l);
-extern void loggerFree(loggerRecord_t *l);
+extern int loggerReadLog(const char *fname, loggerLog_t *l);
+extern void loggerLogRecord(const loggerLog_t *l, int rec, loggerRecord_t *r);
+extern void loggerFree(loggerLog_t *l);
+extern int loggerPackEncodeHeader(const loggerSchema_t *sc, int blockRecords, int numRecords, int numBlocks, const uint32_t *blockLens, unsigned char *buf);
+extern long loggerPackEncodeBlock(const loggerSchema_t *sc, const char *data, int n, unsigned char **buf);
+extern int loggerPackDecodeBlock(const loggerSchema_t *sc, const unsigned char *buf, long len, char *data, int maxRecords);
+extern int loggerPackOpen(const char *fname, loggerPack_t *z);
+extern long loggerPackReadBlock(loggerPack_t *z, int b, unsigned char *buf);
+extern void loggerPackClose(loggerPack_t *z);
 
 #ifdef __cplusplus
 }
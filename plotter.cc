@@ -21,8 +21,11 @@
 */
 
 #include "plotter.h"
+#include "trace.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <algorithm>
 #if defined (__WIN32__)
 	#include "windows.h"
@@ -33,6 +36,8 @@
 
 // runtime defaults
 bool plotLegendOnTop = false;
+bool plotNoLod = false;
+const traceHooks_t *plotTrace;
 int plotMaxColors = PLOTTER_COLOR0MAP_LEN;
 int plotNumValues = 0;
 int plotNumPages = 1;
@@ -138,6 +143,14 @@ const char *plotValueLabels[100];
 			"-notrans",
 			"Do not adjust the transparency of overlapping lines."
 		},
+		{
+			"nolod",
+			NULL, NULL,
+			&plotNoLod,
+			PL_OPT_BOOL,
+			"-nolod",
+			"Draw every point of long lines (by default they are reduced to the\n                            first, last, min. and max. point in each pixel column)."
+		},
 		{
 			"cmap0",
 			NULL, NULL,
@@ -312,13 +325,85 @@ void plotterNewPage(const int nvals, double ymin, double ymax, double xmin, doub
 #endif
 }
 
+// Level of detail: reduces a line of many more points than the graph has pixel columns (ncols
+// over xmin-xmax) to the first, last, min. and max. point of each column, in their original
+// order. The same pixels get drawn, peaks and glitches included, from at most 4 points per
+// column. X values must be in ascending order. xOut/yOut need room for 4 * (ncols + 2) points.
+// Returns the number of points, or 0 if the line is not reduced.
+int plotterDecimate(const int nrec, const double xVals[], const double yVals[], double xmin, double xmax, int ncols, double xOut[], double yOut[]) {
+	int first = 0, lo = 0, hi = 0, n = 0, col, lastCol = INT_MIN, i, j;
+	int idx[4];
+	double scale;
+
+	if (ncols < 1 || nrec <= ncols * PLOTTER_LOD_MIN_PTS || !(xmax > xmin))
+		return 0;
+
+	for (i = 1; i < nrec; i++)
+		if (!(xVals[i] >= xVals[i-1]))
+			return 0;
+
+	scale = ncols / (xmax - xmin);
+
+	for (i = 0; i <= nrec; i++) {
+		if (i < nrec) {
+			// points outside the graph are kept in one column on each side
+			col = (int)std::max(-1.0, std::min((double)ncols, floor((xVals[i] - xmin) * scale)));
+			if (col == lastCol) {
+				if (yVals[i] < yVals[lo])
+					lo = i;
+				if (yVals[i] > yVals[hi])
+					hi = i;
+				continue;
+			}
+		}
+
+		// end of a column
+		if (i) {
+			idx[0] = first;
+			idx[1] = std::min(lo, hi);
+			idx[2] = std::max(lo, hi);
+			idx[3] = i - 1;
+			for (j = 0; j < 4; j++) {
+				if (j && idx[j] == idx[j-1])
+					continue;
+				xOut[n] = xVals[idx[j]];
+				yOut[n++] = yVals[idx[j]];
+			}
+		}
+
+		if (i < nrec) {
+			first = lo = hi = i;
+			lastCol = col;
+		}
+	}
+
+	return n;
+}
+
+#ifdef HAS_PLPLOT
+// width of the current graph area in pixels (or as given with -geometry for devices without pixels)
+int plotterGraphColumns(void) {
+	PLFLT xp, yp, vxmin, vxmax, vymin, vymax;
+	PLINT xleng = 0, yleng, xoff, yoff;
+
+	plgpage(&xp, &yp, &xleng, &yleng, &xoff, &yoff);
+	if (xleng <= 0)
+		xleng = atoi(plotDefaultSize);
+	plgvpd(&vxmin, &vxmax, &vymin, &vymax);
+
+	return std::max(1, (int)(xleng * (vxmax - vxmin)));
+}
+#endif
+
 void plotterLine(const int nrec, const int nval, const double xVals[], const double yVals[], const char *label) {
 #ifdef HAS_PLPLOT
 	static int nextn = plotValsPerPage;
 	static int cmap0color = plotStartColor;
 	double ymin, ymax, xmin, xmax;
-	int r, g, b;
-	double a;
+	double wxmin, wxmax, wymin, wymax;
+	double *xLod, *yLod;
+	int r, g, b, ncols, n;
+	double a, t0 = TRACE_HOOK_START(plotTrace);
 
 	if (++plotCurrValIdx >= plotValsPerPage)
 		plotCurrValIdx = 0;
@@ -348,11 +433,58 @@ void plotterLine(const int nrec, const int nval, const double xVals[], const dou
 	plotValueLabels[plotCurrValIdx] = label;
 	plotLegendOptions[plotCurrValIdx] = PL_LEGEND_NONE;
 	plcol0(cmap0color);
-	plline(nrec, (PLFLT *)xVals, (PLFLT *)yVals);
+
+	// draw long lines at the level of detail the graph can show
+	ncols = plotterGraphColumns();
+	n = 0;
+	if (!plotNoLod && nrec > ncols * PLOTTER_LOD_MIN_PTS) {
+		plgvpw(&wxmin, &wxmax, &wymin, &wymax);
+		xLod = (double *)calloc(4 * (ncols + 2), sizeof(double));
+		yLod = (double *)calloc(4 * (ncols + 2), sizeof(double));
+		if ((n = plotterDecimate(nrec, xVals, yVals, wxmin, wxmax, ncols, xLod, yLod)))
+			plline(n, (PLFLT *)xLod, (PLFLT *)yLod);
+		free(xLod);
+		free(yLod);
+	}
+	if (!n)
+		plline(nrec, (PLFLT *)xVals, (PLFLT *)yVals);
 
 	if (plotCurrValIdx == nextn - 1)
 		plotterEndPage();
 
+	TRACE_HOOK_SPAN(plotTrace, "plot line", TRACE_PLOT, t0);
+
+#else
+	fprintf(stderr, "plotter: error -- no plotting library available\n");
+#endif
+}
+
+// Draws a graph of nx by ny values (zVals[x * ny + y]) as a color map on a page of its own,
+// with the grid spread over xmin-xmax and ymin-ymax. Values from zmin to zmax use the whole
+// color range (plplot color map 1).
+void plotterImage(const int nx, const int ny, const double zVals[], double xmin, double xmax, double ymin, double ymax, double zmin, double zmax, const char *title) {
+#ifdef HAS_PLPLOT
+	PLFLT **z;
+	double t0 = TRACE_HOOK_START(plotTrace);
+	int i, j;
+
+	plAlloc2dGrid(&z, nx, ny);
+	for (i = 0; i < nx; i++)
+		for (j = 0; j < ny; j++)
+			z[i][j] = zVals[i * ny + j];
+
+	plotterNewPage(0, ymin, ymax, xmin, xmax, title);
+	plimage((const PLFLT **)z, nx, ny, xmin, xmax, ymin, ymax, zmin, zmax, xmin, xmax, ymin, ymax);
+	plcol0(1);
+	plbox("bcst", 0.0, 0, "bcst", 0.0, 0);	// frame over the image
+
+	plFree2dGrid(z, nx, ny);
+	free(plotColors);
+	free(plotLegendOptions);
+	plotColors = NULL;
+	plotLegendOptions = NULL;
+
+	TRACE_HOOK_SPAN(plotTrace, "plot image", TRACE_PLOT, t0);
 #else
 	fprintf(stderr, "plotter: error -- no plotting library available\n");
 #endif
@@ -407,7 +539,10 @@ void plotterEndPage(void) {
 
 void plotterEnd(void) {
 #ifdef HAS_PLPLOT
-	plend();
+	double t0 = TRACE_HOOK_START(plotTrace);
+
+	plend();	// (output files are finished here)
+	TRACE_HOOK_SPAN(plotTrace, "plot end", TRACE_PLOT, t0);
 #endif
 }
 
@@ -50,6 +50,9 @@ int main(int argc, char *argv[]) {
 		);
 	}
 
+	// or, for values over two dimensions (eg. a spectrogram), one color map graph per page
+	plotterImage(nx, ny, zVals[], xmin, xmax, ymin, ymax, zmin, zmax, title);
+
 	plotterEnd();  // must call to finish up
 }
 --------------
@@ -65,12 +68,14 @@ extern "C" {
 #include <math.h>
 
 #define PLOTTER_COLOR0MAP_LEN		24				// number of colors in plplot color0 map
+#define PLOTTER_LOD_MIN_PTS			4				// reduce lines with more than this many points per pixel column
 
 // option defaults
 //
 static bool plotNoLegend = false;					// if true, do not draw a legend
 static bool plotWhiteBg = false;					// if true, use a white background and change color scheme to suit
 static bool plotNoAlpha = false;					// if true, do not adjust the transparency of overlapping lines
+extern bool plotNoLod;								// if true, draw every point of a line (see plotterDecimate())
 static int plotValsPerPage = 0;						// if not zero, limit number of items shown per graph
 static int plotMaxLegendValsOnTop = 3;				// if up to this many graph items, put legend on top as title (instead of on right side)
 static int plotStartColor = 2;						// color index of first color to use for plot
@@ -90,11 +95,16 @@ static char plotDefaultDevice[] = "aqt";
 static char plotDefaultDevice[] = "xwin";
 #endif
 
+// timing hooks for --trace (see trace.h), set by logDump; NULL while not tracing
+extern const struct traceHooks_s *plotTrace;
+
 extern void plotterUsage(void);
 extern void plotterOpts(int &argc, char **argv);
 extern bool plotterInit(const int nValues, double *minYValues, double *maxYValues, double *minXValues, double *maxXValues);
 extern void plotterNewPage(const int nvals, double ymin, double ymax, double xmin, double xmax, const char *title = 0);
 extern void plotterLine(const int nrec, const int nval, const double xVals[], const double yVals[], const char *label);
+extern int plotterDecimate(const int nrec, const double xVals[], const double yVals[], double xmin, double xmax, int ncols, double xOut[], double yOut[]);
+extern void plotterImage(const int nx, const int ny, const double zVals[], double xmin, double xmax, double ymin, double ymax, double zmin, double zmax, const char *title);
 extern void plotterEndPage();
 extern void plotterEnd();
 
@@ -0,0 +1,402 @@
+/*
+ * trace.cc
+ *
+ *  Run time tracing of where the time goes, written in Chrome trace event format.
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#ifdef __linux__
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	#include <linux/perf_event.h>
+#endif
+
+typedef struct {
+	const char *name;
+	int act;
+	double ts, dur;
+} traceEvent_t;
+
+typedef struct {
+	double ts;
+	double total[TRACE_NUM_ACTIVITIES];
+} traceCounter_t;
+
+typedef struct traceThread {
+	int tid;
+	char name[TRACE_MAX_THREAD_NAME];
+	traceEvent_t *events;
+	int numEvents, eventsAlloc;
+	traceCounter_t *counters;
+	int numCounters, countersAlloc;
+	double total[TRACE_NUM_ACTIVITIES];		// micros
+	double lastCounter;
+	int perfFd;								// performance counter group, -1 if none
+	int perfIdx[TRACE_NUM_COUNTERS];		// of each counter in the group, -1 if not counted
+	uint64_t perfStart[TRACE_NUM_COUNTERS];
+	uint64_t perfTotal[TRACE_NUM_ACTIVITIES][TRACE_NUM_COUNTERS];
+	struct traceThread *next;
+} traceThread_t;
+
+static const char *traceActivityNames[TRACE_NUM_ACTIVITIES + 1] = {
+	"io", "sync", "decode", "derive", "filter", "format", "write", "plot", "phase"
+};
+
+static const char *tracePerfNames[TRACE_NUM_COUNTERS] = {
+	"cycles", "instructions", "cache misses", "branch misses"
+};
+
+bool traceEnabled;
+
+static bool tracePerf;
+static int tracePerfErr;				// errno of the first counter which failed to open
+static char *traceFileName;
+static double traceStartTime;
+static traceThread_t *traceThreads;
+static int traceNumThreads;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread traceThread_t *traceSelf;
+
+double traceNow(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static traceThread_t *traceThread(void);
+
+// Starts tracing, to the given file or (if NULL) only for the summary printed at the end.
+bool traceOpen(const char *fname) {
+	FILE *fp;
+
+	if (fname) {
+		// fail now rather than after the run
+		if (!(fp = fopen(fname, "w")))
+			return false;
+		fclose(fp);
+		traceFileName = strdup(fname);
+	}
+
+	if (!traceEnabled)
+		traceStartTime = traceNow();
+	traceEnabled = true;
+
+	return true;
+}
+
+// opens the performance counters of the calling thread; returns the number of counters
+static int tracePerfOpen(traceThread_t *t) {
+	int n = 0;
+#ifdef __linux__
+	static const uint64_t configs[TRACE_NUM_COUNTERS] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+	};
+	struct perf_event_attr attr;
+	int fd, i;
+
+	for (i = 0; i < TRACE_NUM_COUNTERS; i++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = configs[i];
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		// this thread, any CPU; the first counter which opens leads the group
+		fd = syscall(SYS_perf_event_open, &attr, 0, -1, (n ? t->perfFd : -1), 0);
+		if (fd < 0) {
+			if (!tracePerfErr)
+				tracePerfErr = errno;
+			t->perfIdx[i] = -1;
+			continue;
+		}
+		if (!n)
+			t->perfFd = fd;
+		t->perfIdx[i] = n++;
+	}
+#else
+	tracePerfErr = ENOSYS;
+#endif
+	return n;
+}
+
+// reads the counters of the calling thread in to c (zero for those not counted)
+static void tracePerfRead(traceThread_t *t, uint64_t *c) {
+	uint64_t buf[TRACE_NUM_COUNTERS + 1];		// number of counters, then their values
+	int i;
+
+	memset(c, 0, TRACE_NUM_COUNTERS * sizeof(uint64_t));
+#ifdef __linux__
+	if (t->perfFd < 0 || read(t->perfFd, buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t))
+		return;
+	for (i = 0; i < TRACE_NUM_COUNTERS; i++)
+		if (t->perfIdx[i] >= 0 && t->perfIdx[i] < (int)buf[0])
+			c[i] = buf[1 + t->perfIdx[i]];
+#endif
+}
+
+// Also reads performance counters (and starts tracing, if not already on). Returns false,
+// after saying why, if they are not available; times are still traced then.
+bool traceCountersOpen(void) {
+	traceThread_t *t;
+	int i;
+
+	traceOpen(NULL);
+	tracePerf = true;
+
+	// try them on this thread; others open theirs when first traced
+	t = traceThread();
+	if (t->perfFd < 0) {
+		tracePerf = false;
+		fprintf(stderr, "trace: performance counters are not available (%s)%s\n", strerror(tracePerfErr),
+			(tracePerfErr == EACCES || tracePerfErr == EPERM ? ", see /proc/sys/kernel/perf_event_paranoid" : ""));
+		return false;
+	}
+	for (i = 0; i < TRACE_NUM_COUNTERS; i++)
+		if (t->perfIdx[i] < 0)
+			fprintf(stderr, "trace: no %s counter (%s)\n", tracePerfNames[i], strerror(tracePerfErr));
+
+	return true;
+}
+
+// trace state of the calling thread, set up on first use
+static traceThread_t *traceThread(void) {
+	traceThread_t *t;
+
+	if ((t = traceSelf))
+		return t;
+
+	t = (traceThread_t *)calloc(1, sizeof(traceThread_t));
+	t->lastCounter = traceNow();
+	t->perfFd = -1;
+
+	pthread_mutex_lock(&traceLock);
+	t->tid = ++traceNumThreads;
+	t->next = traceThreads;
+	traceThreads = t;
+	pthread_mutex_unlock(&traceLock);
+
+	snprintf(t->name, sizeof(t->name), "thread %d", t->tid);
+	traceSelf = t;
+
+	if (tracePerf)
+		tracePerfOpen(t);
+
+	return t;
+}
+
+// start time of an activity or span; also takes a counter reading for an activity
+double traceStart(void) {
+	traceThread_t *t;
+
+	if (tracePerf) {
+		t = traceThread();
+		tracePerfRead(t, t->perfStart);
+	}
+
+	return traceNow();
+}
+
+// name of the calling thread in the trace; fmt may contain a %d for n
+void traceThreadName(const char *fmt, int n) {
+	if (traceEnabled)
+		snprintf(traceThread()->name, TRACE_MAX_THREAD_NAME, fmt, n);
+}
+
+static void traceAddTime(traceThread_t *t, int act, double now, double dur) {
+	traceCounter_t *c;
+	uint64_t perf[TRACE_NUM_COUNTERS];
+	int i;
+
+	t->total[act] += dur;
+
+	if (t->perfFd >= 0) {
+		tracePerfRead(t, perf);
+		for (i = 0; i < TRACE_NUM_COUNTERS; i++)
+			t->perfTotal[act][i] += perf[i] - t->perfStart[i];
+	}
+
+	if (now - t->lastCounter < TRACE_COUNTER_PERIOD)
+		return;
+	t->lastCounter = now;
+
+	if (t->numCounters == t->countersAlloc) {
+		t->countersAlloc = t->countersAlloc ? t->countersAlloc * 2 : 256;
+		t->counters = (traceCounter_t *)realloc(t->counters, t->countersAlloc * sizeof(traceCounter_t));
+	}
+	c = &t->counters[t->numCounters++];
+	c->ts = now;
+	memcpy(c->total, t->total, sizeof(c->total));
+}
+
+// adds the time since t0 (from traceNow()) to the total of an activity
+void traceAdd(int act, double t0) {
+	double now = traceNow();
+
+	traceAddTime(traceThread(), act, now, now - t0);
+}
+
+// records a span from t0 until now; name must stay valid until traceClose()
+void traceSpan(const char *name, int act, double t0) {
+	traceThread_t *t = traceThread();
+	traceEvent_t *e;
+	double now = traceNow();
+
+	if (act < TRACE_NUM_ACTIVITIES)
+		traceAddTime(t, act, now, now - t0);
+
+	if (!traceFileName)
+		return;
+
+	if (t->numEvents == t->eventsAlloc) {
+		t->eventsAlloc = t->eventsAlloc ? t->eventsAlloc * 2 : 256;
+		t->events = (traceEvent_t *)realloc(t->events, t->eventsAlloc * sizeof(traceEvent_t));
+	}
+	e = &t->events[t->numEvents++];
+	e->name = name;
+	e->act = act;
+	e->ts = t0;
+	e->dur = now - t0;
+}
+
+const traceHooks_t traceHooks = {traceStart, traceAdd, traceSpan};
+
+// Writes the trace file (if any) and prints a summary of the run. All traced threads must
+// have finished. Returns false if the file could not be written.
+bool traceClose(uint64_t records, double bytes) {
+	traceThread_t *t;
+	double total[TRACE_NUM_ACTIVITIES];
+	uint64_t perf[TRACE_NUM_ACTIVITIES][TRACE_NUM_COUNTERS];
+	bool counted[TRACE_NUM_COUNTERS];
+	double wall = (traceNow() - traceStartTime) / 1e6;
+	long n = 0;
+	bool first = true;
+	int i, j;
+	FILE *fp = NULL;
+
+	if (!traceEnabled)
+		return true;
+	traceEnabled = false;
+
+	if (traceFileName && !(fp = fopen(traceFileName, "w"))) {
+		fprintf(stderr, "trace: cannot write %s\n", traceFileName);
+		return false;
+	}
+
+	memset(total, 0, sizeof(total));
+	memset(perf, 0, sizeof(perf));
+	memset(counted, 0, sizeof(counted));
+
+	if (fp)
+		fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (t = traceThreads; t; t = t->next) {
+		for (j = 0; j < TRACE_NUM_ACTIVITIES; j++) {
+			total[j] += t->total[j];
+			for (i = 0; i < TRACE_NUM_COUNTERS; i++)
+				perf[j][i] += t->perfTotal[j][i];
+		}
+		if (t->perfFd >= 0) {
+			for (i = 0; i < TRACE_NUM_COUNTERS; i++)
+				if (t->perfIdx[i] >= 0)
+					counted[i] = true;
+#ifdef __linux__
+			close(t->perfFd);
+#endif
+		}
+
+		if (!fp)
+			continue;
+
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", (first ? "" : ",\n"), t->tid, t->name);
+		fprintf(fp, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}", t->tid, t->tid);
+		first = false;
+
+		for (i = 0; i < t->numEvents; i++)
+			fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				t->events[i].name, traceActivityNames[t->events[i].act], t->tid, t->events[i].ts - traceStartTime, t->events[i].dur);
+
+		// plus the final totals
+		if (t->numCounters == t->countersAlloc) {
+			t->countersAlloc++;
+			t->counters = (traceCounter_t *)realloc(t->counters, t->countersAlloc * sizeof(traceCounter_t));
+		}
+		t->counters[t->numCounters].ts = t->lastCounter + 1.0;
+		memcpy(t->counters[t->numCounters++].total, t->total, sizeof(t->total));
+
+		for (i = 0; i < t->numCounters; i++) {
+			fprintf(fp, ",\n{\"name\":\"ms spent, %s\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{", t->name, t->tid, t->counters[i].ts - traceStartTime);
+			for (j = 0; j < TRACE_NUM_ACTIVITIES; j++)
+				fprintf(fp, "%s\"%s\":%.3f", (j ? "," : ""), traceActivityNames[j], t->counters[i].total[j] / 1e3);
+			fprintf(fp, "}}");
+		}
+
+		n += t->numEvents + t->numCounters;
+	}
+
+	if (fp) {
+		fprintf(fp, "\n]}\n");
+
+		if (ferror(fp) | fclose(fp)) {
+			fprintf(stderr, "trace: error writing %s\n", traceFileName);
+			return false;
+		}
+
+		fprintf(stderr, "trace: wrote %ld events of %d threads to %s\n", n, traceNumThreads, traceFileName);
+	}
+	fprintf(stderr, "trace: %.3fs, %llu records (%.0f records/s), %.1f MB (%.1f MB/s)\n", wall, (unsigned long long)records,
+		(wall > 0.0 ? records / wall : 0.0), bytes / 1e6, (wall > 0.0 ? bytes / 1e6 / wall : 0.0));
+	fprintf(stderr, "trace: time spent, all threads:");
+	for (j = 0; j < TRACE_NUM_ACTIVITIES; j++)
+		fprintf(stderr, " %s %.3fs", traceActivityNames[j], total[j] / 1e6);
+	fprintf(stderr, "\n");
+
+	if (!tracePerf)
+		return true;
+
+	// counts per record of each activity which used any time
+	fprintf(stderr, "trace: per record %10s %10s %6s %10s %10s\n", "cycles", "instr", "IPC", "cache miss", "branch miss");
+	for (j = 0; j < TRACE_NUM_ACTIVITIES; j++) {
+		if (total[j] <= 0.0)
+			continue;
+		fprintf(stderr, "trace: %-10s", traceActivityNames[j]);
+		for (i = 0; i < TRACE_NUM_COUNTERS; i++) {
+			if (!counted[i])
+				fprintf(stderr, " %10s", "n/a");
+			else
+				fprintf(stderr, " %10.1f", records ? (double)perf[j][i] / records : 0.0);
+			// instructions per cycle after the instructions
+			if (i == 1) {
+				if (counted[0] && counted[1] && perf[j][0])
+					fprintf(stderr, " %6.2f", (double)perf[j][1] / perf[j][0]);
+				else
+					fprintf(stderr, " %6s", "n/a");
+			}
+		}
+		fprintf(stderr, "\n");
+	}
+
+	return true;
+}
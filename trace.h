@@ -0,0 +1,100 @@
+/*
+ * trace.h
+ *
+ *  Run time tracing of where the time goes, written in Chrome trace event format
+ *  (load the file in chrome://tracing or https://ui.perfetto.dev).
+
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+Tracing is always compiled in and costs one test of traceEnabled per traced call while it is
+off. Two kinds of timing are kept, per thread and without locking:
+
+ - spans, for work which takes a while (a sync search, a batch of records, a plotted line);
+   each one is written as a complete ("X") event on the timeline of its thread.
+ - time totals per activity, for things done per record or per value (reading a packet,
+   decoding it, evaluating the filter, formatting a row). These are far too many to write
+   one by one, so each thread writes its running totals as a counter ("C") event every
+   TRACE_COUNTER_PERIOD instead, which shows as a graph of where its time went.
+
+Usage:
+	traceOpen("out.json");			// or NULL for the summary only
+	t0 = TRACE_START();
+	... read a packet ...
+	TRACE_ADD(TRACE_IO, t0);			// per record activity
+	TRACE_SPAN("sync search", TRACE_SYNC, t0);	// span, also added to the activity total
+	traceClose(records, bytes);
+
+With traceCountersOpen() (and on Linux) the CPU's performance counters are read too, at the
+start and end of each activity, and the cycles, instructions, cache misses and branch
+misses of each activity per record are printed by traceClose(). Each read is a system call,
+so this slows the run down. If the kernel or CPU does not provide the counters (eg.
+perf_event_paranoid is 3, or in a virtual machine) only the times are kept. Activities
+must not be nested for the counts to be right (spans of TRACE_PHASE may contain them).
+*/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+#define TRACE_COUNTER_PERIOD	10000.0		// micros between activity total events of a thread
+#define TRACE_MAX_THREAD_NAME	32
+#define TRACE_NUM_COUNTERS		4			// cycles, instructions, cache misses, branch misses
+
+// activities time is added up for; spans of TRACE_PHASE contain other activities and are not added
+enum traceActivities {
+	TRACE_IO = 0,		// reading log files
+	TRACE_SYNC,			// searching for packets
+	TRACE_DECODE,		// decoding packets
+	TRACE_DERIVE,		// calculated fields and spectra
+	TRACE_FILTER,		// export filter
+	TRACE_FORMAT,		// formatting exported values
+	TRACE_WRITE,		// writing output
+	TRACE_PLOT,			// plot rendering
+	TRACE_NUM_ACTIVITIES,
+	TRACE_PHASE = TRACE_NUM_ACTIVITIES
+};
+
+extern bool traceEnabled;
+
+#define TRACE_START()				(traceEnabled ? traceStart() : 0.0)
+#define TRACE_ADD(act, t0)			do { if (traceEnabled) traceAdd(act, t0); } while (0)
+#define TRACE_SPAN(name, act, t0)	do { if (traceEnabled) traceSpan(name, act, t0); } while (0)
+
+extern bool traceOpen(const char *fname);
+extern bool traceCountersOpen(void);
+extern double traceNow(void);
+extern double traceStart(void);
+extern void traceThreadName(const char *fmt, int n);
+extern void traceAdd(int act, double t0);
+extern void traceSpan(const char *name, int act, double t0);
+extern bool traceClose(uint64_t records, double bytes);
+
+// Modules which other programs link too (logger.c, plotter.cc) time through hooks which the
+// program sets while tracing and are NULL otherwise, so that those programs need not link
+// trace.cc.
+typedef struct traceHooks_s {
+	double (*start)(void);
+	void (*add)(int act, double t0);
+	void (*span)(const char *name, int act, double t0);
+} traceHooks_t;
+
+extern const traceHooks_t traceHooks;		// traceStart(), traceAdd() and traceSpan()
+
+#define TRACE_HOOK_START(h)					((h) ? (h)->start() : 0.0)
+#define TRACE_HOOK_ADD(h, act, t0)			do { if (h) (h)->add(act, t0); } while (0)
+#define TRACE_HOOK_SPAN(h, name, act, t0)	do { if (h) (h)->span(name, act, t0); } while (0)
+
+#endif /* TRACE_H_ */